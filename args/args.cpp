@@ -4,6 +4,7 @@
 #include <filesystem>
 #include <getopt.h>
 #include <iostream>
+#include <stdexcept>
 
 namespace args {
 
@@ -15,6 +16,18 @@ namespace args {
             << "To run the program, use:" << std::endl
             << "\tgifgen [-p | -j] <input file 1> <input file 2> [...] -o <result file name> [-t <delay>]" 
             << std::endl
+            << "or, to read raw frames from standard input or a pipe:" << std::endl
+            << "\tgifgen --stream <- | pipe> -o <result file name> [-t <delay>]" 
+            << std::endl
+            << "or, to append the frames written to a directory to a GIF as they arrive:" << std::endl
+            << "\tgifgen [-p | -j] --watch <directory> -o <result file name> [-t <delay>]" 
+            << std::endl
+            << "or, to encode many GIFs at once:" << std::endl
+            << "\tgifgen --batch <manifest>" 
+            << std::endl
+            << "or, to serve encode requests from other processes:" << std::endl
+            << "\tgifgen --serve <socket path>" 
+            << std::endl
             << std::endl
             << "Options:"
             << std::endl
@@ -40,6 +53,130 @@ namespace args {
             << "\t\tThe default value is 0." 
             << std::endl
             << std::endl
+            << "\t-r, --reuse-palettes" << std::endl
+            << "\t\tRe-use the previous frame's color palette unless a scene change is detected." << std::endl
+            << "\t\tThis is much faster for video-like input, where consecutive frames are similar."
+            << std::endl
+            << std::endl
+            << "\t-g, --global-palette" << std::endl
+            << "\t\tBuild one color palette for all frames and store it as the global color table" << std::endl
+            << "\t\tinstead of giving each frame its own local color table."
+            << std::endl
+            << std::endl
+            << "\t--local-palette-threshold <error>" << std::endl
+            << "\t\tWith --global-palette, give a frame its own local color table if the" << std::endl
+            << "\t\troot-mean-square color error of the frame under the global palette exceeds" << std::endl
+            << "\t\tthe given value. Colors are measured as points in RGB space with channels" << std::endl
+            << "\t\tin the range [0, 255]."
+            << std::endl
+            << std::endl
+            << "\t--delta" << std::endl
+            << "\t\tOnly encode the rectangle of pixels which changed since the previous frame." << std::endl
+            << "\t\tThis greatly reduces the size of mostly-static animations like screen recordings."
+            << std::endl
+            << std::endl
+            << "\t--transparency <tolerance>" << std::endl
+            << "\t\tMake pixels which match the previous frame transparent so that they compress well." << std::endl
+            << "\t\tA pixel matches if no channel differs by more than the given tolerance, which" << std::endl
+            << "\t\tmust be between 0 and 255. A tolerance of 0 is lossless."
+            << std::endl
+            << std::endl
+            << "\t--coalesce" << std::endl
+            << "\t\tSkip frames which duplicate the previous frame and show the previous frame for" << std::endl
+            << "\t\tlonger instead. This is useful for recordings with idle periods."
+            << std::endl
+            << std::endl
+            << "\t--coalesce-tolerance <tolerance>" << std::endl
+            << "\t\tWith --coalesce, also skip frames in which no channel of any pixel differs from" << std::endl
+            << "\t\tthe previous frame by more than the given tolerance, which must be between 0 and 255."
+            << std::endl
+            << std::endl
+            << "\t--scale <factor>" << std::endl
+            << "\t\tReduce the frames by the given factor, which must be greater than 0 and at" << std::endl
+            << "\t\tmost 1. It may be given as a fraction, such as 1/4. JPEG frames are reduced by" << std::endl
+            << "\t\t1/2, 1/4 or 1/8 while they are decoded, which is much faster than decoding the" << std::endl
+            << "\t\twhole frame, and any remaining reduction is done by averaging pixels."
+            << std::endl
+            << std::endl
+            << "\t--resize <width>x<height>" << std::endl
+            << "\t\tResize every frame to fit a canvas of the given size before it is encoded. Frames" << std::endl
+            << "\t\tmay then have differing dimensions. This is applied after --scale."
+            << std::endl
+            << std::endl
+            << "\t--fit <pad | crop | stretch>" << std::endl
+            << "\t\tWith --resize, how frames with a different aspect ratio to the canvas are fitted." << std::endl
+            << "\t\tpad fits the whole frame inside the canvas and fills the edges with black, crop" << std::endl
+            << "\t\tfills the canvas and cuts off the frame's edges, and stretch changes the frame's" << std::endl
+            << "\t\taspect ratio. The default is pad."
+            << std::endl
+            << std::endl
+            << "\t--filter <area | lanczos>" << std::endl
+            << "\t\tWith --resize, the filter used to resize frames. area averages the pixels which" << std::endl
+            << "\t\tcover each output pixel and suits reductions, while lanczos keeps more detail." << std::endl
+            << "\t\tThe default is area."
+            << std::endl
+            << std::endl
+            << "\t--background <RRGGBB>" << std::endl
+            << "\t\tThe color that transparent and translucent pixels of PNG frames are blended" << std::endl
+            << "\t\tagainst, as a hexadecimal RGB value. The default is 000000, which is black."
+            << std::endl
+            << std::endl
+            << "\t--threads <count>" << std::endl
+            << "\t\tThe number of worker threads in the shared task pool. Frames are decoded," << std::endl
+            << "\t\tpalettized and compressed in parallel, and the output does not depend on the" << std::endl
+            << "\t\tnumber of threads. The default value of 0 uses one thread per core."
+            << std::endl
+            << std::endl
+            << "\t--band-rows <rows>" << std::endl
+            << "\t\tDecode and encode each frame in bands of the given number of rows, so that whole" << std::endl
+            << "\t\tframes are never held in memory. Each frame is decoded twice, once to choose its" << std::endl
+            << "\t\tcolors and once to encode it. Frames over 64 megapixels are encoded in bands of" << std::endl
+            << "\t\t256 rows automatically. Cannot be used with --stream, --global-palette, --scale," << std::endl
+            << "\t\t--resize, --reuse-palettes, --delta, --transparency or --coalesce."
+            << std::endl
+            << std::endl
+            << "\t--stream <- | path>" << std::endl
+            << "\t\tRead frames from a stream of concatenated binary PPM (P6) images or a YUV4MPEG2" << std::endl
+            << "\t\tstream instead of from image files. Use - for standard input, or give the path" << std::endl
+            << "\t\tof a pipe. Frames are encoded as they arrive, so a video decoder can write to" << std::endl
+            << "\t\tgifgen directly. No file type flag is needed, and --global-palette cannot be used."
+            << std::endl
+            << std::endl
+            << "\t--watch <directory>" << std::endl
+            << "\t\tWatch the directory and append each file that is written to it, or moved into it," << std::endl
+            << "\t\tto the GIF as soon as it is complete, until gifgen is interrupted. Files already in" << std::endl
+            << "\t\tthe directory and names starting with . are ignored. The output always holds a" << std::endl
+            << "\t\tvalid GIF ending with the latest frame, so it can be previewed while it grows, and" << std::endl
+            << "\t\tthe time taken to append each frame is printed. With --coalesce, a frame is only" << std::endl
+            << "\t\tappended once the next distinct frame arrives. --global-palette and --band-rows" << std::endl
+            << "\t\tcannot be used."
+            << std::endl
+            << std::endl
+            << "\t--batch <manifest>" << std::endl
+            << "\t\tEncode every GIF listed in the manifest, which has one JSON object per line, such as:" << std::endl
+            << "\t\t{\"inputs\": [\"a.png\", \"b.jpg\"], \"output\": \"ab.gif\", \"delay\": 100," << std::endl
+            << "\t\t \"options\": {\"reuse_palettes\": true, \"resize\": \"320x240\"}}" << std::endl
+            << "\t\tThe delay is in milliseconds. The options are named after the command-line options," << std::endl
+            << "\t\twith underscores, and flags take true or false. reuse_palettes, delta, transparency," << std::endl
+            << "\t\tcoalesce, coalesce_tolerance, scale, resize, fit, filter and background are supported." << std::endl
+            << "\t\tInputs may mix PNG and JPEG images. Several jobs run at once and share the worker" << std::endl
+            << "\t\tthreads. A line of JSON describing the result of each job is printed as it finishes." << std::endl
+            << "\t\tOnly --threads and --memory-limit may be given with --batch."
+            << std::endl
+            << std::endl
+            << "\t--serve <socket path>" << std::endl
+            << "\t\tRun as a daemon which encodes GIFs for clients of a Unix domain socket until it" << std::endl
+            << "\t\tis interrupted. Each request has the fields of a --batch manifest line, without" << std::endl
+            << "\t\tan output, and may have a priority; lower values are started first. The GIF is" << std::endl
+            << "\t\tsent back as it is encoded, and requests may be cancelled. See gifgen_client for" << std::endl
+            << "\t\ta client. Only --threads and --memory-limit may be given with --serve."
+            << std::endl
+            << std::endl
+            << "\t--memory-limit <megabytes>" << std::endl
+            << "\t\tWith --batch or --serve, the memory that the running jobs are expected to use at" << std::endl
+            << "\t\tonce. A job only starts once its estimated memory is free. The default is 1024."
+            << std::endl
+            << std::endl
             <<"\t-d, --directory" << std::endl
             << "\t\tIgnore positional input file arguments and use all files in the top level of the" << std::endl
             << "\t\tspecified directory as input frames. The full contents of the directory will be" << std::endl
@@ -79,23 +216,140 @@ namespace args {
 
     // Parsing logic for timing delay
     void set_timing_delay(program_arguments& args, const std::string& delay_string) {
+        try {
+            args.delay = parse_delay(delay_string);
+            assert (args.delay <= MAX_DELAY_VALUE);
+        }
+        catch(std::invalid_argument& e) {
+            error(std::string("Timing delay ") + e.what());
+        }
+    }
+
+    // Parsing logic for the local palette threshold
+    void set_local_palette_threshold(program_arguments& args, const std::string& threshold_string) {
+        try {
+            // std::stod may throw out_of_range or invalid_argument exceptions 
+            // on failure.
+            double threshold = std::stod(threshold_string);
+            if (threshold < 0) {
+                error("Local palette threshold must not be negative");
+            }
+            args.local_palette_threshold = threshold;
+        }
+        catch(std::exception& e) {
+            error("Unable to convert local palette threshold to a number");
+        }
+    }
+
+    // Parses a per-channel color tolerance. The name describes the 
+    // tolerance in error messages.
+    uint8_t parse_channel_tolerance(const std::string& tolerance_string, const std::string& name) {
+        try {
+            return parse_channel_tolerance(tolerance_string);
+        }
+        catch(std::invalid_argument& e) {
+            error(name + " " + e.what());
+        }
+        return 0;
+    }
+
+    // Parsing logic for the scale factor, which may be a decimal number or
+    // a fraction.
+    void set_scale(program_arguments& args, const std::string& scale_string) {
+        try {
+            args.scale = parse_scale(scale_string);
+        }
+        catch(std::invalid_argument& e) {
+            error(std::string("Scale ") + e.what());
+        }
+    }
+
+    // Parsing logic for the canvas size, in the form <width>x<height>
+    void set_canvas_size(program_arguments& args, const std::string& size_string) {
+        try {
+            parse_canvas_size(size_string, *args.canvas);
+        }
+        catch(std::invalid_argument& e) {
+            error(std::string("Canvas size ") + e.what());
+        }
+    }
+
+    // Parsing logic for the fit mode
+    void set_fit_mode(program_arguments& args, const std::string& mode) {
+        try {
+            args.canvas->fit = parse_fit_mode(mode);
+        }
+        catch(std::invalid_argument& e) {
+            error(std::string("Fit mode ") + e.what());
+        }
+    }
+
+    // Parsing logic for the resize filter
+    void set_resize_filter(program_arguments& args, const std::string& filter) {
+        try {
+            args.canvas->filter = parse_resize_filter(filter);
+        }
+        catch(std::invalid_argument& e) {
+            error(std::string("Filter ") + e.what());
+        }
+    }
+
+    // Parsing logic for the background color, given as six hexadecimal 
+    // digits
+    void set_background(program_arguments& args, const std::string& color_string) {
+        try {
+            args.background = parse_color(color_string);
+        }
+        catch(std::invalid_argument& e) {
+            error(std::string("Background color ") + e.what());
+        }
+    }
+
+    // Parsing logic for the thread count
+    void set_thread_count(program_arguments& args, const std::string& threads_string) {
         try {
             // std::stoi may throw out_of_range or invalid_argument exceptions 
             // on failure.
-            int parsed_delay = std::stoi(delay_string);
-            if (parsed_delay < 0 || static_cast<std::size_t>(parsed_delay) > MAX_DELAY_MS) {
-                error("Timing delay out of allowable range");
+            int threads = std::stoi(threads_string);
+            if (threads < 0 || threads > MAX_THREADS) {
+                error("Thread count must be between 0 and " + std::to_string(MAX_THREADS));
             }
-            else if (parsed_delay % 10 != 0) {
-                error("Timing delay must be a multiple of 10");
+            args.threads = threads;
+        }
+        catch(std::exception& e) {
+            error("Unable to convert thread count to integer value");
+        }
+    }
+
+    // Parsing logic for the band height
+    void set_band_rows(program_arguments& args, const std::string& rows_string) {
+        try {
+            // std::stoi may throw out_of_range or invalid_argument exceptions 
+            // on failure.
+            int rows = std::stoi(rows_string);
+            if (rows <= 0) {
+                error("Band rows must be positive");
             }
-            else {
-                args.delay = parsed_delay / 10;
-                assert (args.delay <= MAX_DELAY_VALUE);
+            args.band_rows = rows;
+        }
+        catch(std::exception& e) {
+            error("Unable to convert band rows to integer value");
+        }
+    }
+
+    // Parsing logic for the batch memory limit
+    void set_memory_limit(program_arguments& args, const std::string& limit_string) {
+        try {
+            // std::stoi may throw out_of_range or invalid_argument exceptions 
+            // on failure.
+            int limit = std::stoi(limit_string);
+            if (limit <= 0) {
+                error("Memory limit must be positive");
             }
+            args.memory_limit_mb = limit;
         }
         catch(std::exception& e) {
-            error("Unable to convert timing delay to integer value");
+            error("Unable to convert memory limit to integer value");
         }
     }
 
@@ -157,7 +411,41 @@ namespace args {
         program_arguments args;
         bool found_file_type = false;
         bool found_delay = false;
+        args.file_type = image::file_type::PNG;
         args.delay = 0;
+        args.reuse_palettes = false;
+        args.global_palette = false;
+        args.delta_frames = false;
+        args.coalesce_duplicates = false;
+        args.threads = 0;
+        args.background = image::rgb_pixel_t(0, 0, 0);
+
+        // The canvas options are collected as they are found, and removed
+        // again if no canvas size is given.
+        args.canvas.emplace();
+        bool found_canvas_size = false;
+        bool found_fit_option = false;
+        bool found_background = false;
+
+        // Identifiers for options which only have a long form. These are 
+        // outside the range of characters used for short options.
+        constexpr int LOCAL_PALETTE_THRESHOLD_OPT = 256;
+        constexpr int DELTA_OPT = 257;
+        constexpr int TRANSPARENCY_OPT = 258;
+        constexpr int COALESCE_OPT = 259;
+        constexpr int COALESCE_TOLERANCE_OPT = 260;
+        constexpr int THREADS_OPT = 261;
+        constexpr int SCALE_OPT = 262;
+        constexpr int RESIZE_OPT = 263;
+        constexpr int FIT_OPT = 264;
+        constexpr int FILTER_OPT = 265;
+        constexpr int BACKGROUND_OPT = 266;
+        constexpr int STREAM_OPT = 267;
+        constexpr int BAND_ROWS_OPT = 268;
+        constexpr int BATCH_OPT = 269;
+        constexpr int MEMORY_LIMIT_OPT = 270;
+        constexpr int SERVE_OPT = 271;
+        constexpr int WATCH_OPT = 272;
 
         int ind = 0; // Unused but required for getopt_long
         int cur_opt; // The option currently being processed
@@ -170,13 +458,32 @@ namespace args {
             {"output",      required_argument, 0,  'o'},
             {"timing",      required_argument, 0,  't'},
             {"directory",   required_argument, 0,  'd'},
+            {"reuse-palettes", no_argument,    0,  'r'},
+            {"global-palette", no_argument,    0,  'g'},
+            {"local-palette-threshold", required_argument, 0, LOCAL_PALETTE_THRESHOLD_OPT},
+            {"delta",       no_argument,       0,  DELTA_OPT},
+            {"transparency", required_argument, 0, TRANSPARENCY_OPT},
+            {"coalesce",    no_argument,       0,  COALESCE_OPT},
+            {"coalesce-tolerance", required_argument, 0, COALESCE_TOLERANCE_OPT},
+            {"threads",     required_argument, 0,  THREADS_OPT},
+            {"scale",       required_argument, 0,  SCALE_OPT},
+            {"resize",      required_argument, 0,  RESIZE_OPT},
+            {"fit",         required_argument, 0,  FIT_OPT},
+            {"filter",      required_argument, 0,  FILTER_OPT},
+            {"background",  required_argument, 0,  BACKGROUND_OPT},
+            {"stream",      required_argument, 0,  STREAM_OPT},
+            {"band-rows",   required_argument, 0,  BAND_ROWS_OPT},
+            {"batch",       required_argument, 0,  BATCH_OPT},
+            {"memory-limit", required_argument, 0, MEMORY_LIMIT_OPT},
+            {"serve",       required_argument, 0,  SERVE_OPT},
+            {"watch",       required_argument, 0,  WATCH_OPT},
             {"help",        no_argument,       0,  'h'},
             {0,             0,                 0,  0  }
         };
 
         // Defines the short versions of the options and whether they 
         // take any values. A colon indicates an argument.
-        const auto optstring = "pjo:t:d:h";
+        const auto optstring = "pjo:t:d:rgh";
 
         // Iterate over all specified options and add them to args.
         while ((cur_opt = getopt_long(argc, argv, optstring, opts, &ind)) != -1) {
@@ -224,6 +531,137 @@ namespace args {
 
                     break;
 
+                case 'r':
+                    args.reuse_palettes = true;
+                    break;
+
+                case 'g':
+                    args.global_palette = true;
+                    break;
+
+                case LOCAL_PALETTE_THRESHOLD_OPT:
+                    if (args.local_palette_threshold.has_value()) {
+                        error("Duplicate local palette threshold specified");
+                    }
+                    else {
+                        set_local_palette_threshold(args, optarg);
+                    }
+
+                    break;
+
+                case DELTA_OPT:
+                    args.delta_frames = true;
+                    break;
+
+                case TRANSPARENCY_OPT:
+                    if (args.transparency_tolerance.has_value()) {
+                        error("Duplicate transparency tolerance specified");
+                    }
+                    else {
+                        args.transparency_tolerance = parse_channel_tolerance(optarg, "Transparency tolerance");
+                    }
+
+                    break;
+
+                case COALESCE_OPT:
+                    args.coalesce_duplicates = true;
+                    break;
+
+                case COALESCE_TOLERANCE_OPT:
+                    if (args.coalesce_tolerance.has_value()) {
+                        error("Duplicate coalesce tolerance specified");
+                    }
+                    else {
+                        args.coalesce_tolerance = parse_channel_tolerance(optarg, "Coalesce tolerance");
+                    }
+
+                    break;
+
+                case THREADS_OPT:
+                    set_thread_count(args, optarg);
+                    break;
+
+                case SCALE_OPT:
+                    if (args.scale.has_value()) {
+                        error("Duplicate scale specified");
+                    }
+                    else {
+                        set_scale(args, optarg);
+                    }
+
+                    break;
+
+                case RESIZE_OPT:
+                    if (found_canvas_size) {
+                        error("Duplicate canvas size specified");
+                    }
+                    else {
+                        set_canvas_size(args, optarg);
+                        found_canvas_size = true;
+                    }
+
+                    break;
+
+                case FIT_OPT:
+                    set_fit_mode(args, optarg);
+                    found_fit_option = true;
+                    break;
+
+                case FILTER_OPT:
+                    set_resize_filter(args, optarg);
+                    found_fit_option = true;
+                    break;
+
+                case BACKGROUND_OPT:
+                    set_background(args, optarg);
+                    found_background = true;
+                    break;
+
+                case STREAM_OPT:
+                    if (args.stream_input.has_value()) {
+                        error("Duplicate stream specified");
+                    }
+                    args.stream_input = optarg;
+                    break;
+
+                case BAND_ROWS_OPT:
+                    if (args.band_rows.has_value()) {
+                        error("Duplicate band rows specified");
+                    }
+                    set_band_rows(args, optarg);
+                    break;
+
+                case BATCH_OPT:
+                    if (args.batch_manifest.has_value()) {
+                        error("Duplicate batch manifest specified");
+                    }
+                    args.batch_manifest = optarg;
+                    break;
+
+                case SERVE_OPT:
+                    if (args.serve_socket.has_value()) {
+                        error("Duplicate socket specified");
+                    }
+                    args.serve_socket = optarg;
+                    break;
+
+                case WATCH_OPT:
+                    if (args.watch_directory.has_value()) {
+                        error("Duplicate watched directory specified");
+                    }
+                    else if (!std::filesystem::is_directory(optarg)) {
+                        error(std::string("No such directory: ") + optarg);
+                    }
+                    args.watch_directory = optarg;
+                    break;
+
+                case MEMORY_LIMIT_OPT:
+                    if (args.memory_limit_mb.has_value()) {
+                        error("Duplicate memory limit specified");
+                    }
+                    set_memory_limit(args, optarg);
+                    break;
+
                 case 'h':
                     // If we see the help flag, stop the application immediately after printing
                     // out the help message.
@@ -244,13 +682,68 @@ namespace args {
             }
         }
 
-        // Check for missing values
-        if (!found_file_type) {
+        // Check for missing values. The jobs of a batch or of the server
+        // give their own inputs, output and options.
+        if (args.batch_manifest.has_value() || args.serve_socket.has_value()) {
+            if (args.batch_manifest.has_value() && args.serve_socket.has_value()) {
+                error("--batch and --serve cannot be used together");
+            }
+            else if (found_file_type || !args.input_files.empty() || args.stream_input.has_value() || 
+                    args.watch_directory.has_value() || args.output_file_name != "" || optind < argc) {
+                error("--batch and --serve cannot be used with input files, a file type flag, --stream, --watch or --output");
+            }
+            else if (found_delay || args.reuse_palettes || args.global_palette || 
+                     args.local_palette_threshold.has_value() || args.delta_frames || 
+                     args.transparency_tolerance.has_value() || args.coalesce_duplicates || 
+                     args.coalesce_tolerance.has_value() || args.scale.has_value() || 
+                     found_canvas_size || found_fit_option || found_background || args.band_rows.has_value()) {
+                error("The timing and options of each job are given in the manifest or request");
+            }
+            args.canvas.reset();
+            return args;
+        }
+        else if (args.memory_limit_mb.has_value()) {
+            error("--memory-limit requires --batch or --serve");
+        }
+        else if (!found_file_type && !args.stream_input.has_value()) {
             error("No file type flag was specified");
         }
+        else if (args.stream_input.has_value() && (found_file_type || !args.input_files.empty())) {
+            error("--stream cannot be used with input files or a file type flag");
+        }
+        else if (args.stream_input.has_value() && args.global_palette) {
+            error("--global-palette cannot be used with --stream");
+        }
+        else if (args.watch_directory.has_value() && 
+                 (args.stream_input.has_value() || !args.input_files.empty() || optind < argc)) {
+            error("--watch cannot be used with input files or --stream");
+        }
+        else if (args.watch_directory.has_value() && (args.global_palette || args.band_rows.has_value())) {
+            error("--global-palette and --band-rows cannot be used with --watch");
+        }
         else if (args.output_file_name == "") {
             error("No output file was specified");
         }
+        else if (args.local_palette_threshold.has_value() && !args.global_palette) {
+            error("A local palette threshold requires --global-palette");
+        }
+        else if (args.coalesce_tolerance.has_value() && !args.coalesce_duplicates) {
+            error("A coalesce tolerance requires --coalesce");
+        }
+        else if (found_fit_option && !found_canvas_size) {
+            error("--fit and --filter require --resize");
+        }
+        else if (args.band_rows.has_value() && 
+                 (args.stream_input.has_value() || args.global_palette || args.scale.has_value() || 
+                  found_canvas_size || args.reuse_palettes || args.delta_frames || 
+                  args.transparency_tolerance.has_value() || args.coalesce_duplicates)) {
+            error("--band-rows cannot be used with --stream, --global-palette, --scale, --resize, "
+                  "--reuse-palettes, --delta, --transparency or --coalesce");
+        }
+
+        if (!found_canvas_size) {
+            args.canvas.reset();
+        }
 
         // Check that we have at least one usable input file.
         // If an input directory wasn't specified, add all the
@@ -259,7 +752,10 @@ namespace args {
         while (optind < argc) {
             std::string arg = argv[optind];
 
-            if (dir_specified) {
+            if (args.stream_input.has_value()) {
+                error("--stream cannot be used with input files or a file type flag");
+            }
+            else if (dir_specified) {
                 std::cout << "Warning: Unused argument " << arg 
                           << ". The specified directory is used for input data instead." 
                           << std::endl;
@@ -271,7 +767,7 @@ namespace args {
             ++optind;
         }
 
-        if (args.input_files.empty()) {
+        if (args.input_files.empty() && !args.stream_input.has_value() && !args.watch_directory.has_value()) {
             error("No input files were specified");
         }
 
@@ -1,30 +1,61 @@
 #ifndef ARGS_HPP
 #define ARGS_HPP
 
+#include <optional>
 #include <string>
 #include <vector>
 #include "image_utils.hpp"
+#include "option_values.hpp"
+#include "preprocess.hpp"
 
 // Enables the parsing of command-line arguments into
 // simple structures.
 namespace args {
 
-    // The maximal delay allowed in a GIF Graphics
-    // Control Extension block, measured in hundredths
-    // of a second.
-    constexpr std::size_t MAX_DELAY_VALUE = 0xFFFF; 
-
-    // The maximal delay allowed in a GIF Graphics
-    // Control Extension block, measured in milliseconds.
-    constexpr std::size_t MAX_DELAY_MS = MAX_DELAY_VALUE * 10;
+    // The largest number of worker threads that may be requested.
+    constexpr int MAX_THREADS = 256;
 
     // Represents the parsed command-line arguments required
     // to run the program
     struct program_arguments {
         image::file_type file_type;
         std::vector<std::string> input_files;
+
+        // The stream that frames are read from instead of input files, if
+        // any. "-" is standard input.
+        std::optional<std::string> stream_input;
+
+        // The directory whose new files are appended to the GIF as they
+        // are written, if any, instead of input files.
+        std::optional<std::string> watch_directory;
         std::string output_file_name;
         std::size_t delay;
+        bool reuse_palettes;
+        bool global_palette;
+        std::optional<double> local_palette_threshold;
+        bool delta_frames;
+        std::optional<uint8_t> transparency_tolerance;
+        bool coalesce_duplicates;
+        std::optional<uint8_t> coalesce_tolerance;
+        std::size_t threads;
+        std::optional<double> scale;
+
+        // The color that pixels with an alpha channel are blended against.
+        image::rgb_pixel_t background;
+
+        // The canvas that frames are fitted to, if they are resized.
+        std::optional<preprocess::fit_options> canvas;
+
+        // The height of the bands that frames are encoded in, if each frame
+        // is encoded a band at a time to bound memory use.
+        std::optional<std::size_t> band_rows;
+
+        // The manifest of the jobs to run instead of encoding one GIF, if 
+        // any, or the socket to serve encode requests on, and the memory 
+        // that the running jobs may use, in megabytes.
+        std::optional<std::string> batch_manifest;
+        std::optional<std::string> serve_socket;
+        std::optional<std::size_t> memory_limit_mb;
     };
 
     // Parses the command-line arguments into a program_arguments
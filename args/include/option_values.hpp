@@ -0,0 +1,52 @@
+#ifndef OPTION_VALUES_HPP
+#define OPTION_VALUES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "image_utils.hpp"
+#include "preprocess.hpp"
+
+// Parses the values of the encoding options, which are given both on the
+// command line and in the jobs of a batch manifest or server request, so
+// that each is checked in the same way wherever it comes from.
+//
+// Each parser throws std::invalid_argument if the value is not valid. The
+// message completes a sentence which begins with the option's name, such
+// as "must be between 0 and 255".
+namespace args {
+
+    // The maximal delay allowed in a GIF Graphics
+    // Control Extension block, measured in hundredths
+    // of a second.
+    constexpr std::size_t MAX_DELAY_VALUE = 0xFFFF;
+
+    // The maximal delay allowed in a GIF Graphics
+    // Control Extension block, measured in milliseconds.
+    constexpr std::size_t MAX_DELAY_MS = MAX_DELAY_VALUE * 10;
+
+    // Parses a delay in milliseconds, which must be a multiple of 10, and
+    // returns it in hundredths of a second.
+    std::size_t parse_delay(const std::string& text);
+
+    // Parses a per-channel color tolerance in the range [0, 255].
+    uint8_t parse_channel_tolerance(const std::string& text);
+
+    // Parses a scale factor, which may be a decimal number or a fraction
+    // such as 1/4, and must be greater than 0 and at most 1.
+    double parse_scale(const std::string& text);
+
+    // Parses a canvas size in the form <width>x<height> into the canvas.
+    void parse_canvas_size(const std::string& text, preprocess::fit_options& canvas);
+
+    // Parses pad, crop or stretch.
+    preprocess::fit_mode parse_fit_mode(const std::string& text);
+
+    // Parses area or lanczos.
+    preprocess::resize_filter parse_resize_filter(const std::string& text);
+
+    // Parses a color given as six hexadecimal digits, such as FF8000.
+    image::rgb_pixel_t parse_color(const std::string& text);
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include "option_values.hpp"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+namespace args {
+
+    // Parses a whole string as an integer. std::stoll alone would accept
+    // trailing text, such as "3.5" or "10ms".
+    long long parse_integer(const std::string& text) {
+        std::size_t length = 0;
+        long long value = 0;
+        try {
+            value = std::stoll(text, &length);
+        }
+        catch (const std::exception&) {
+            length = 0;
+        }
+        if (length == 0 || length != text.size()) {
+            throw std::invalid_argument("must be an integer");
+        }
+        return value;
+    }
+
+    double parse_number(const std::string& text) {
+        std::size_t length = 0;
+        double value = 0;
+        try {
+            value = std::stod(text, &length);
+        }
+        catch (const std::exception&) {
+            length = 0;
+        }
+        if (length == 0 || length != text.size()) {
+            throw std::invalid_argument("must be a number");
+        }
+        return value;
+    }
+
+    std::size_t parse_delay(const std::string& text) {
+        auto delay = parse_integer(text);
+        if (delay < 0 || static_cast<std::size_t>(delay) > MAX_DELAY_MS) {
+            throw std::invalid_argument("must be between 0 and " + std::to_string(MAX_DELAY_MS));
+        }
+        if (delay % 10 != 0) {
+            throw std::invalid_argument("must be a multiple of 10");
+        }
+        return static_cast<std::size_t>(delay) / 10;
+    }
+
+    uint8_t parse_channel_tolerance(const std::string& text) {
+        auto tolerance = parse_integer(text);
+        if (tolerance < 0 || tolerance > UINT8_MAX) {
+            throw std::invalid_argument("must be between 0 and 255");
+        }
+        return static_cast<uint8_t>(tolerance);
+    }
+
+    double parse_scale(const std::string& text) {
+        auto slash = text.find('/');
+        double scale = slash == std::string::npos
+            ? parse_number(text)
+            : parse_number(text.substr(0, slash)) / parse_number(text.substr(slash + 1));
+        if (!(scale > 0 && scale <= 1)) {
+            throw std::invalid_argument("must be greater than 0 and at most 1");
+        }
+        return scale;
+    }
+
+    void parse_canvas_size(const std::string& text, preprocess::fit_options& canvas) {
+        auto separator = text.find('x');
+        if (separator == std::string::npos) {
+            throw std::invalid_argument("must be given as <width>x<height>");
+        }
+
+        long long width = 0, height = 0;
+        try {
+            width = parse_integer(text.substr(0, separator));
+            height = parse_integer(text.substr(separator + 1));
+        }
+        catch (const std::invalid_argument&) {
+            throw std::invalid_argument("must be given as <width>x<height>");
+        }
+        if (width <= 0 || height <= 0 || width > UINT16_MAX || height > UINT16_MAX) {
+            throw std::invalid_argument("must have dimensions between 1 and " + std::to_string(UINT16_MAX));
+        }
+        canvas.width = width;
+        canvas.height = height;
+    }
+
+    preprocess::fit_mode parse_fit_mode(const std::string& text) {
+        if (text == "pad") {
+            return preprocess::fit_mode::pad;
+        }
+        else if (text == "crop") {
+            return preprocess::fit_mode::crop;
+        }
+        else if (text == "stretch") {
+            return preprocess::fit_mode::stretch;
+        }
+        throw std::invalid_argument("must be one of pad, crop or stretch");
+    }
+
+    preprocess::resize_filter parse_resize_filter(const std::string& text) {
+        if (text == "area") {
+            return preprocess::resize_filter::area;
+        }
+        else if (text == "lanczos") {
+            return preprocess::resize_filter::lanczos;
+        }
+        throw std::invalid_argument("must be one of area or lanczos");
+    }
+
+    image::rgb_pixel_t parse_color(const std::string& text) {
+        auto is_hex_digit = [](char c) { return std::isxdigit(static_cast<unsigned char>(c)) != 0; };
+        if (text.size() != 6 || !std::all_of(text.begin(), text.end(), is_hex_digit)) {
+            throw std::invalid_argument("must be given as six hexadecimal digits, such as FFFFFF");
+        }
+        auto color = std::stoul(text, nullptr, 16);
+        return image::rgb_pixel_t((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
+    }
+}
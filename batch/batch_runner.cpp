@@ -0,0 +1,302 @@
+#include "batch_runner.hpp"
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "file_reader.hpp"
+#include "image_io.hpp"
+#include "output_file.hpp"
+
+namespace batch {
+
+    memory_budget::memory_budget(std::size_t limit) : 
+            limit_bytes(limit),
+            mutex(),
+            released(),
+            reserved(0),
+            next_ticket(0),
+            serving_ticket(0) {
+        if (limit_bytes == 0) {
+            throw std::invalid_argument("A memory budget must allow at least one byte");
+        }
+    }
+
+    std::size_t memory_budget::acquire(std::size_t bytes) {
+        auto amount = std::min(bytes, limit_bytes);
+        std::unique_lock<std::mutex> lock(mutex);
+        auto ticket = next_ticket++;
+        released.wait(lock, [&]() { 
+            return ticket == serving_ticket && reserved + amount <= limit_bytes; 
+        });
+        reserved += amount;
+        ++serving_ticket;
+
+        // The next request may fit as well.
+        released.notify_all();
+        return amount;
+    }
+
+    void memory_budget::release(std::size_t reserved_bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        reserved -= reserved_bytes;
+        released.notify_all();
+    }
+
+    std::size_t memory_budget::limit() const {
+        return limit_bytes;
+    }
+
+    // Each frame the pipeline holds is an RGB image of 3 bytes a pixel, 
+    // with a transparency mask of a byte a pixel if the job uses 
+    // transparency, and its compressed data. Codes of at most 12 bits a 
+    // pixel keep the compressed data under 2 bytes a pixel.
+    constexpr std::size_t FRAME_BYTES_PER_PIXEL = 6;
+
+    std::size_t estimate_job_memory(const batch_job& job, const runtime::task_pool& pool) {
+        std::size_t input_bytes = 0;
+        for (const auto& filename : job.input_files) {
+            std::error_code error;
+            auto size = std::filesystem::file_size(filename, error);
+            if (!error) {
+                input_bytes += size;
+            }
+        }
+
+        const auto& first_file = job.input_files.front();
+        auto info = image::read_image_info(first_file, image::file_type::PNG);
+        if (!info.has_value()) {
+            info = image::read_image_info(first_file, image::file_type::JPEG);
+        }
+        std::size_t frame_pixels = info.has_value() ? info->width * info->height : 0;
+        if (job.options.canvas.has_value()) {
+            frame_pixels += job.options.canvas->width * job.options.canvas->height;
+        }
+
+        // As many frames as the pipeline has buffers are held at once. The
+        // GIF takes at most a byte for each pixel of every frame.
+        auto frame_count = job.input_files.size();
+        auto frames_held = std::min(frame_count, 2 * pool.worker_count() + 2);
+        return input_bytes + frames_held * frame_pixels * FRAME_BYTES_PER_PIXEL + frame_count * frame_pixels;
+    }
+
+    void write_json_string(std::ostream& out, const std::string& value) {
+        out << '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+            }
+            else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    void write_result(std::ostream& out, const job_result& result) {
+        std::ostringstream line;
+        line << "{\"line\": " << result.line << ", \"output\": ";
+        write_json_string(line, result.output_file);
+        line << ", \"status\": \"" << (result.succeeded ? "ok" : "failed") << "\"";
+        if (!result.succeeded) {
+            line << ", \"error\": ";
+            write_json_string(line, result.error);
+        }
+        line << ", \"frames\": " << result.frames
+             << ", \"bytes\": " << result.output_bytes
+             << std::fixed << std::setprecision(3)
+             << ", \"queued_ms\": " << 1000 * result.queued_time.count()
+             << ", \"run_ms\": " << 1000 * result.run_time.count()
+             << "}\n";
+        out << line.str() << std::flush;
+    }
+
+    // A job which has been given its memory and waits for a runner.
+    struct queued_job {
+        batch_job job;
+        std::size_t reserved_bytes;
+        std::chrono::steady_clock::time_point listed;
+    };
+
+    const std::vector<image::byte_view>& job_inputs::read(const std::vector<std::string>& filenames) {
+        reads.resize(filenames.size());
+        for (std::size_t i = 0; i < reads.size(); ++i) {
+            reads[i].filename = filenames[i];
+        }
+        reader.read_files(reads);
+
+        views.clear();
+        for (const auto& file : reads) {
+            if (file.error) {
+                throw std::runtime_error("Unable to read " + file.filename + ": " + file.error.message());
+            }
+            views.emplace_back(file.contents);
+        }
+        return views;
+    }
+
+    void job_inputs::trim() {
+        for (auto& file : reads) {
+            if (file.contents.capacity() > MAX_KEPT_BUFFER_BYTES) {
+                image::file_buffer().swap(file.contents);
+            }
+        }
+    }
+
+    // The buffers of a runner thread, which are re-used from job to job.
+    // The output is freed after each job if it is large, as the inputs 
+    // are.
+    struct job_runner {
+        job_inputs inputs;
+        std::vector<uint8_t> output;
+
+        job_result run(const queued_job& queued, runtime::task_pool& pool);
+    };
+
+    job_result job_runner::run(const queued_job& queued, runtime::task_pool& pool) {
+        const auto& job = queued.job;
+        job_result result;
+        result.line = job.line;
+        result.output_file = job.output_file;
+        auto started = std::chrono::steady_clock::now();
+        result.queued_time = started - queued.listed;
+
+        try {
+            const auto& images = inputs.read(job.input_files);
+            auto stats = encoder::encode_images(images, output, job.options, pool);
+            image::replace_file(job.output_file, [this](const std::filesystem::path& temp_path) {
+                auto out = image::open_output_file(temp_path);
+                out.write(reinterpret_cast<const char*>(output.data()), output.size());
+                out.close();
+            });
+            result.succeeded = true;
+            result.frames = stats.frames;
+            result.output_bytes = output.size();
+        }
+        catch (const std::exception& e) {
+            result.error = e.what();
+        }
+
+        result.run_time = std::chrono::steady_clock::now() - started;
+        inputs.trim();
+        if (output.capacity() > job_inputs::MAX_KEPT_BUFFER_BYTES) {
+            std::vector<uint8_t>().swap(output);
+        }
+        return result;
+    }
+
+    batch_summary run_batch(std::istream& manifest,
+                            const std::function<void(const job_result&)>& on_result,
+                            const batch_options& options,
+                            runtime::task_pool& pool) {
+        memory_budget budget(options.memory_limit);
+        auto max_jobs = options.max_jobs > 0 ? options.max_jobs : 2 * pool.worker_count();
+
+        std::mutex queue_mutex;
+        std::condition_variable queue_changed;
+        std::deque<queued_job> queue;
+        bool manifest_done = false;
+
+        std::mutex result_mutex;
+        batch_summary summary;
+        auto report = [&](const job_result& result) {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            ++summary.jobs;
+            if (!result.succeeded) {
+                ++summary.failed;
+            }
+            on_result(result);
+        };
+
+        auto run_jobs = [&]() {
+            job_runner runner;
+            while (true) {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_changed.wait(lock, [&]() { return !queue.empty() || manifest_done; });
+                if (queue.empty()) {
+                    return;
+                }
+                auto queued = std::move(queue.front());
+                queue.pop_front();
+                lock.unlock();
+                queue_changed.notify_all();
+
+                auto result = runner.run(queued, pool);
+                budget.release(queued.reserved_bytes);
+                report(result);
+            }
+        };
+
+        std::vector<std::thread> runners;
+        for (std::size_t i = 0; i < max_jobs; ++i) {
+            runners.emplace_back(run_jobs);
+        }
+
+        // The runners are stopped and joined even if reading the manifest
+        // fails.
+        auto stop_runners = [&]() {
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                manifest_done = true;
+            }
+            queue_changed.notify_all();
+            for (auto& runner : runners) {
+                runner.join();
+            }
+        };
+
+        try {
+            std::string line;
+            std::size_t line_number = 0;
+            while (std::getline(manifest, line)) {
+                ++line_number;
+                if (std::all_of(line.begin(), line.end(), [](char c) { return std::isspace(static_cast<unsigned char>(c)); })) {
+                    continue;
+                }
+
+                queued_job queued;
+                queued.listed = std::chrono::steady_clock::now();
+                try {
+                    queued.job = parse_job(line, line_number);
+                }
+                catch (const std::invalid_argument& e) {
+                    job_result result;
+                    result.line = line_number;
+                    result.error = e.what();
+                    report(result);
+                    continue;
+                }
+
+                // A job is only given its memory once a runner is about to 
+                // be free, so that queued jobs do not hold memory that 
+                // running jobs could use.
+                {
+                    std::unique_lock<std::mutex> lock(queue_mutex);
+                    queue_changed.wait(lock, [&]() { return queue.empty(); });
+                }
+                queued.reserved_bytes = budget.acquire(estimate_job_memory(queued.job, pool));
+                {
+                    std::lock_guard<std::mutex> lock(queue_mutex);
+                    queue.push_back(std::move(queued));
+                }
+                queue_changed.notify_all();
+            }
+        }
+        catch (...) {
+            stop_runners();
+            throw;
+        }
+
+        stop_runners();
+        return summary;
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef BATCH_RUNNER_HPP
+#define BATCH_RUNNER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "file_reader.hpp"
+#include "image_io.hpp"
+#include "manifest.hpp"
+#include "task_pool.hpp"
+
+// Encodes the many GIFs of a batch at once, so that a large number of
+// small jobs keeps every core busy without paying for a new process each.
+namespace batch {
+
+    // Limits the memory which the jobs running at once are expected to
+    // use. Reservations are granted in the order they are requested.
+    class memory_budget {
+    public:
+        explicit memory_budget(std::size_t limit_bytes);
+
+        // Waits until the bytes can be reserved, and returns the amount
+        // reserved. A request for more than the whole budget reserves the
+        // whole budget, so that a large job runs on its own rather than 
+        // never.
+        std::size_t acquire(std::size_t bytes);
+
+        void release(std::size_t reserved_bytes);
+
+        std::size_t limit() const;
+
+    private:
+        const std::size_t limit_bytes;
+        std::mutex mutex;
+        std::condition_variable released;
+        std::size_t reserved;
+
+        // The tickets of the requests which have been made and granted, so
+        // that requests are granted in order.
+        std::size_t next_ticket;
+        std::size_t serving_ticket;
+    };
+
+    // Estimates the memory used to encode a job from the sizes of its input
+    // files and the header of its first input: the files themselves, the
+    // frames which the pipeline holds at once, and the GIF. Inputs which 
+    // cannot be read are left out of the estimate; they fail the job 
+    // later.
+    std::size_t estimate_job_memory(const batch_job& job, const runtime::task_pool& pool);
+
+    // Reads the input files of jobs into memory. The buffers are re-used
+    // from job to job, except for any which are larger than is worth 
+    // keeping between jobs, whose memory is not covered by a budget.
+    class job_inputs {
+    public:
+        // The largest buffer which is kept from one job to the next.
+        static constexpr std::size_t MAX_KEPT_BUFFER_BYTES = std::size_t(8) << 20;
+
+        // Reads the files, and returns views of their contents which are
+        // valid until the next call. Throws std::runtime_error naming the
+        // first file which cannot be read.
+        const std::vector<image::byte_view>& read(const std::vector<std::string>& filenames);
+
+        // Frees the large buffers.
+        void trim();
+
+    private:
+        image::batch_file_reader reader;
+        std::vector<image::file_read> reads;
+        std::vector<image::byte_view> views;
+    };
+
+    // The outcome of a job, or of a manifest line which could not be
+    // parsed as a job.
+    struct job_result {
+        std::size_t line = 0;
+        std::string output_file;
+        bool succeeded = false;
+
+        // Why the job failed, if it did.
+        std::string error;
+
+        std::size_t frames = 0;
+        std::size_t output_bytes = 0;
+
+        // The time spent waiting for memory and a free runner, and the 
+        // time spent reading, encoding and writing.
+        std::chrono::duration<double> queued_time {0};
+        std::chrono::duration<double> run_time {0};
+    };
+
+    // Writes the result as a single line of JSON.
+    void write_result(std::ostream& out, const job_result& result);
+
+    // Writes a value as a JSON string, with quotes.
+    void write_json_string(std::ostream& out, const std::string& value);
+
+    struct batch_options {
+        // The bytes that the running jobs are expected to use at once.
+        std::size_t memory_limit = std::size_t(1) << 30;
+
+        // The largest number of jobs which run at once, or 0 for twice the
+        // number of workers in the pool. Each running job has its own
+        // thread, which reads the inputs and writes the GIF while the 
+        // frames of every job are encoded by the pool.
+        std::size_t max_jobs = 0;
+    };
+
+    struct batch_summary {
+        std::size_t jobs = 0;
+        std::size_t failed = 0;
+    };
+
+    // Runs every job in the manifest, one line at a time. Blank lines are 
+    // skipped. Jobs start in the order they are listed, as memory becomes
+    // available, and their frames share the task pool. Each GIF is written
+    // to a temporary file which replaces the output only once it is 
+    // complete, so a failed job never leaves a partial GIF behind.
+    //
+    // on_result is called once for each job, or line which could not be 
+    // parsed, as it finishes. Calls are made from several threads, but 
+    // never at the same time.
+    batch_summary run_batch(std::istream& manifest,
+                            const std::function<void(const job_result&)>& on_result,
+                            const batch_options& options = {},
+                            runtime::task_pool& pool = runtime::task_pool::shared());
+}
+
+#endif
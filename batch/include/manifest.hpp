@@ -0,0 +1,55 @@
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "memory_encoder.hpp"
+
+// Describes the jobs of a batch, which are listed in a manifest file with
+// one JSON object per line.
+namespace batch {
+
+    // A GIF to encode from a list of PNG or JPEG files.
+    struct batch_job {
+        // The line of the manifest which described the job, from 1.
+        std::size_t line = 0;
+
+        std::vector<std::string> input_files;
+        std::string output_file;
+        encoder::encode_options options;
+
+        // Jobs sent to the server are started in order of priority, 
+        // lowest value first.
+        int priority = 0;
+    };
+
+    enum class job_format {
+        // A line of a manifest, whose GIF is written to its output file.
+        manifest,
+
+        // A request to the server, whose GIF is sent back rather than 
+        // written to a file. Requests have no output, and may have a 
+        // priority.
+        request
+    };
+
+    // Parses a line of a manifest, such as:
+    //
+    //   {"inputs": ["a.png", "b.jpg"], "output": "ab.gif", "delay": 100,
+    //    "options": {"reuse_palettes": true, "resize": "320x240"}}
+    //
+    // The inputs and output are required. The delay is in milliseconds, 
+    // as with --timing. The options are named after the command-line 
+    // options and take the same values, except that flags take true or 
+    // false: reuse_palettes, delta, transparency, coalesce, 
+    // coalesce_tolerance, scale, resize, fit, filter and background. The
+    // input files may mix PNG and JPEG images.
+    //
+    // Throws std::invalid_argument if the line is not a JSON object, a
+    // required field is missing, or a field is unknown or has an invalid
+    // value.
+    batch_job parse_job(const std::string& json, std::size_t line, job_format format = job_format::manifest);
+}
+
+#endif
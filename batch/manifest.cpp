@@ -0,0 +1,167 @@
+#include "manifest.hpp"
+#include <sstream>
+#include <stdexcept>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include "option_values.hpp"
+
+namespace batch {
+
+    using boost::property_tree::ptree;
+
+    [[noreturn]] void invalid(const std::string& field, const std::string& problem) {
+        throw std::invalid_argument("\"" + field + "\" " + problem);
+    }
+
+    // Reads a value which must be a single JSON value, not an object or a
+    // list.
+    template <class T>
+    T get_value(const ptree& node, const std::string& field, const std::string& expected) {
+        auto value = node.get_value_optional<T>();
+        if (!node.empty() || !value) {
+            invalid(field, "must be " + expected);
+        }
+        return *value;
+    }
+
+    // Reads a value which must be a single JSON value with the parser for
+    // the matching command-line option, which describes any problem with it.
+    template <class Parser>
+    auto parse_field(const ptree& node, const std::string& field, Parser parse) {
+        if (!node.empty()) {
+            invalid(field, "must be a single value");
+        }
+        try {
+            return parse(node.data());
+        }
+        catch (const std::invalid_argument& e) {
+            invalid(field, e.what());
+        }
+    }
+
+    std::vector<std::string> get_string_list(const ptree& node, const std::string& field) {
+        std::vector<std::string> values;
+        for (const auto& [key, child] : node) {
+            if (!key.empty() || !child.empty()) {
+                invalid(field, "must be a list of strings");
+            }
+            values.push_back(child.data());
+        }
+        if (values.empty()) {
+            invalid(field, "must be a non-empty list of strings");
+        }
+        return values;
+    }
+
+    // Applies the options object of a job. The canvas options are collected
+    // as they are found, and discarded again if no canvas size is given.
+    void set_options(encoder::encode_options& options, const ptree& node) {
+        preprocess::fit_options canvas;
+        bool found_canvas_size = false;
+        bool found_fit_option = false;
+        std::optional<uint8_t> coalesce_tolerance;
+
+        if (!node.data().empty()) {
+            invalid("options", "must be an object");
+        }
+        for (const auto& [key, child] : node) {
+            if (key == "reuse_palettes") {
+                options.builder.reuse_palettes = get_value<bool>(child, key, "true or false");
+            }
+            else if (key == "delta") {
+                options.builder.delta_frames = get_value<bool>(child, key, "true or false");
+            }
+            else if (key == "transparency") {
+                options.builder.transparency_tolerance = parse_field(child, key, args::parse_channel_tolerance);
+            }
+            else if (key == "coalesce") {
+                options.builder.coalesce_duplicates = get_value<bool>(child, key, "true or false");
+            }
+            else if (key == "coalesce_tolerance") {
+                coalesce_tolerance = parse_field(child, key, args::parse_channel_tolerance);
+            }
+            else if (key == "scale") {
+                options.decoding.scale = parse_field(child, key, args::parse_scale);
+            }
+            else if (key == "resize") {
+                parse_field(child, key, [&canvas](const std::string& size) {
+                    args::parse_canvas_size(size, canvas);
+                });
+                found_canvas_size = true;
+            }
+            else if (key == "fit") {
+                canvas.fit = parse_field(child, key, args::parse_fit_mode);
+                found_fit_option = true;
+            }
+            else if (key == "filter") {
+                canvas.filter = parse_field(child, key, args::parse_resize_filter);
+                found_fit_option = true;
+            }
+            else if (key == "background") {
+                options.decoding.background = parse_field(child, key, args::parse_color);
+            }
+            else {
+                invalid(key, "is not a known option");
+            }
+        }
+
+        if (coalesce_tolerance.has_value()) {
+            if (!options.builder.coalesce_duplicates) {
+                invalid("coalesce_tolerance", "requires \"coalesce\"");
+            }
+            options.builder.duplicate_tolerance = *coalesce_tolerance;
+        }
+        if (found_fit_option && !found_canvas_size) {
+            invalid("fit", "and \"filter\" require \"resize\"");
+        }
+        if (found_canvas_size) {
+            options.canvas = canvas;
+        }
+    }
+
+    batch_job parse_job(const std::string& json, std::size_t line, job_format format) {
+        ptree root;
+        try {
+            std::istringstream in(json);
+            boost::property_tree::read_json(in, root);
+        }
+        catch (const boost::property_tree::json_parser_error& e) {
+            throw std::invalid_argument("Invalid JSON: " + e.message());
+        }
+
+        batch_job job;
+        job.line = line;
+        bool found_inputs = false;
+        bool found_output = false;
+        for (const auto& [key, child] : root) {
+            if (key == "inputs") {
+                job.input_files = get_string_list(child, key);
+                found_inputs = true;
+            }
+            else if (key == "output" && format == job_format::manifest) {
+                job.output_file = get_value<std::string>(child, key, "a string");
+                found_output = !job.output_file.empty();
+            }
+            else if (key == "delay") {
+                job.options.delay = parse_field(child, key, args::parse_delay);
+            }
+            else if (key == "options") {
+                set_options(job.options, child);
+            }
+            else if (key == "priority" && format == job_format::request) {
+                job.priority = get_value<int>(child, key, "an integer");
+            }
+            else {
+                invalid(key, "is not a known field");
+            }
+        }
+
+        if (!found_inputs) {
+            throw std::invalid_argument("No \"inputs\" were given");
+        }
+        if (!found_output && format == job_format::manifest) {
+            throw std::invalid_argument("No \"output\" was given");
+        }
+        return job;
+    }
+}
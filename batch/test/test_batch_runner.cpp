@@ -0,0 +1,132 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <sstream>
+#include <thread>
+#include "batch_runner.hpp"
+#include "test_support.hpp"
+
+using namespace batch;
+using namespace test_support;
+
+constexpr std::size_t WIDTH = 40;
+constexpr std::size_t HEIGHT = 30;
+
+TEST_CASE("Test running a batch", "[batch_runner]") {
+    temp_directory dir("test_batch_runner");
+    std::vector<std::string> frames;
+    for (std::size_t i = 0; i < 6; ++i) {
+        frames.push_back(write_frame(dir, i, WIDTH, HEIGHT, i % 2 == 0 ? image::file_type::PNG : image::file_type::JPEG));
+    }
+
+    // Many small jobs, with a few which fail and a blank line.
+    constexpr std::size_t JOB_COUNT = 24;
+    std::ostringstream manifest;
+    for (std::size_t i = 0; i < JOB_COUNT; ++i) {
+        std::vector<std::string> inputs(frames.begin(), frames.begin() + 1 + i % frames.size());
+        manifest << "{\"inputs\": " << json_list(inputs) << ", \"output\": \"" << dir.file("out" + std::to_string(i) + ".gif")
+                 << "\", \"delay\": " << 10 * i << ", \"options\": {\"delta\": " << (i % 3 == 0 ? "true" : "false") << "}}\n";
+    }
+    manifest << "\n";
+    manifest << "{\"inputs\": [\"" << dir.file("missing.png") << "\"], \"output\": \"" << dir.file("missing.gif") << "\"}\n";
+    manifest << "{\"inputs\": [\"" << frames[0] << "\"], \"output\": \"" << dir.file("bad.gif") << "\", \"options\": {\"speed\": 2}}\n";
+
+    std::istringstream manifest_in(manifest.str());
+    std::map<std::size_t, job_result> results;
+    batch_options options;
+    options.max_jobs = 4;
+    auto summary = run_batch(manifest_in, [&results](const job_result& result) {
+        results[result.line] = result;
+    }, options);
+
+    REQUIRE(summary.jobs == JOB_COUNT + 2);
+    REQUIRE(summary.failed == 2);
+    REQUIRE(results.size() == JOB_COUNT + 2);
+
+    for (std::size_t i = 0; i < JOB_COUNT; ++i) {
+        const auto& result = results.at(i + 1);
+        INFO(result.error);
+        REQUIRE(result.succeeded);
+        REQUIRE(result.frames == 1 + i % frames.size());
+
+        encoder::encode_options expected_options;
+        expected_options.delay = i;
+        expected_options.builder.delta_frames = i % 3 == 0;
+        std::vector<std::string> inputs(frames.begin(), frames.begin() + 1 + i % frames.size());
+        auto gif = read_file(result.output_file);
+        REQUIRE(result.output_bytes == gif.size());
+        REQUIRE(gif == encode_files(inputs, expected_options));
+    }
+
+    // The blank line is skipped, and the failed jobs leave no output.
+    const auto& missing = results.at(JOB_COUNT + 2);
+    REQUIRE_FALSE(missing.succeeded);
+    REQUIRE_FALSE(missing.error.empty());
+    REQUIRE_FALSE(std::filesystem::exists(dir.file("missing.gif")));
+    REQUIRE_FALSE(std::filesystem::exists(dir.file("missing.gif.tmp")));
+    const auto& invalid = results.at(JOB_COUNT + 3);
+    REQUIRE_FALSE(invalid.succeeded);
+    REQUIRE(invalid.error.find("speed") != std::string::npos);
+    REQUIRE_FALSE(std::filesystem::exists(dir.file("bad.gif")));
+}
+
+TEST_CASE("Test a memory budget", "[batch_runner]") {
+    memory_budget budget(100);
+    REQUIRE(budget.acquire(60) == 60);
+
+    // The request is granted once enough memory is released.
+    std::atomic<bool> granted = false;
+    std::size_t reserved = 0;
+    std::thread waiter([&]() {
+        reserved = budget.acquire(50);
+        granted = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    REQUIRE_FALSE(granted);
+    budget.release(60);
+    waiter.join();
+    REQUIRE(granted);
+    REQUIRE(reserved == 50);
+
+    // A request larger than the budget takes all of it.
+    budget.release(50);
+    REQUIRE(budget.acquire(1000) == 100);
+    budget.release(100);
+}
+
+TEST_CASE("Test estimating the memory of a job", "[batch_runner]") {
+    temp_directory dir("test_batch_runner");
+    batch_job job;
+    job.input_files = {write_frame(dir, 0, WIDTH, HEIGHT), write_frame(dir, 1, WIDTH, HEIGHT)};
+    auto file_bytes = std::filesystem::file_size(job.input_files[0]) + std::filesystem::file_size(job.input_files[1]);
+
+    runtime::task_pool pool(2);
+    auto estimate = estimate_job_memory(job, pool);
+    REQUIRE(estimate > file_bytes + 2 * WIDTH * HEIGHT * 3);
+
+    // A larger canvas takes more memory.
+    job.options.canvas.emplace();
+    job.options.canvas->width = 4 * WIDTH;
+    job.options.canvas->height = 4 * HEIGHT;
+    REQUIRE(estimate_job_memory(job, pool) > estimate);
+
+    // Files which cannot be read are left out.
+    job.options.canvas.reset();
+    job.input_files = {dir.file("missing.png")};
+    REQUIRE(estimate_job_memory(job, pool) < estimate);
+}
+
+TEST_CASE("Test writing results", "[batch_runner]") {
+    job_result result;
+    result.line = 4;
+    result.output_file = "a \"quoted\" name.gif";
+    result.error = "Line\nbreak";
+    std::ostringstream out;
+    write_result(out, result);
+    REQUIRE(out.str() == "{\"line\": 4, \"output\": \"a \\\"quoted\\\" name.gif\", \"status\": \"failed\", "
+                         "\"error\": \"Line\\u000abreak\", \"frames\": 0, \"bytes\": 0, "
+                         "\"queued_ms\": 0.000, \"run_ms\": 0.000}\n");
+}
@@ -0,0 +1,91 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <stdexcept>
+#include "manifest.hpp"
+
+using namespace batch;
+
+TEST_CASE("Test parsing a job with only the required fields", "[manifest]") {
+    auto job = parse_job(R"({"inputs": ["a.png", "b.jpg"], "output": "out.gif"})", 3);
+    REQUIRE(job.line == 3);
+    REQUIRE(job.input_files == std::vector<std::string> {"a.png", "b.jpg"});
+    REQUIRE(job.output_file == "out.gif");
+    REQUIRE(job.options.delay == 0);
+    REQUIRE_FALSE(job.options.builder.reuse_palettes);
+    REQUIRE_FALSE(job.options.builder.delta_frames);
+    REQUIRE_FALSE(job.options.builder.transparency_tolerance.has_value());
+    REQUIRE_FALSE(job.options.builder.coalesce_duplicates);
+    REQUIRE(job.options.decoding.scale == 1.0);
+    REQUIRE_FALSE(job.options.canvas.has_value());
+}
+
+TEST_CASE("Test parsing a job with every option", "[manifest]") {
+    auto job = parse_job(R"({
+        "inputs": ["a.png"], "output": "out.gif", "delay": 120,
+        "options": {
+            "reuse_palettes": true, "delta": true, "transparency": 4,
+            "coalesce": true, "coalesce_tolerance": 2, "scale": 0.5,
+            "resize": "320x240", "fit": "crop", "filter": "lanczos",
+            "background": "FF8000"
+        }
+    })", 1);
+
+    REQUIRE(job.options.delay == 12);
+    const auto& builder = job.options.builder;
+    REQUIRE(builder.reuse_palettes);
+    REQUIRE(builder.delta_frames);
+    REQUIRE(builder.transparency_tolerance == 4);
+    REQUIRE(builder.coalesce_duplicates);
+    REQUIRE(builder.duplicate_tolerance == 2);
+    REQUIRE(job.options.decoding.scale == 0.5);
+    REQUIRE(job.options.decoding.background == image::rgb_pixel_t(255, 128, 0));
+    REQUIRE(job.options.canvas.has_value());
+    REQUIRE(job.options.canvas->width == 320);
+    REQUIRE(job.options.canvas->height == 240);
+    REQUIRE(job.options.canvas->fit == preprocess::fit_mode::crop);
+    REQUIRE(job.options.canvas->filter == preprocess::resize_filter::lanczos);
+}
+
+TEST_CASE("Test parsing invalid jobs", "[manifest]") {
+    auto invalid_jobs = {
+        R"(not json)",
+        R"({"inputs": ["a.png"]})",
+        R"({"output": "out.gif"})",
+        R"({"inputs": [], "output": "out.gif"})",
+        R"({"inputs": "a.png", "output": "out.gif"})",
+        R"({"inputs": [["a.png"]], "output": "out.gif"})",
+        R"({"inputs": ["a.png"], "output": ""})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "delay": 15})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "delay": -10})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "delay": "fast"})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "colour": true})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": "delta"})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": {"deltas": true}})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": {"delta": "yes"}})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": {"transparency": 256}})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": {"coalesce_tolerance": 2}})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": {"scale": 1.5}})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": {"resize": "320"}})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": {"resize": "0x240"}})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": {"fit": "crop"}})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": {"resize": "32x24", "fit": "zoom"}})",
+        R"({"inputs": ["a.png"], "output": "out.gif", "options": {"background": "red"}})",
+    };
+    for (auto json : invalid_jobs) {
+        INFO(json);
+        REQUIRE_THROWS_AS(parse_job(json, 1), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Test parsing a request to the server", "[manifest]") {
+    auto job = parse_job(R"({"inputs": ["a.png"], "priority": -2, "options": {"delta": true}})", 5, job_format::request);
+    REQUIRE(job.input_files == std::vector<std::string> {"a.png"});
+    REQUIRE(job.output_file.empty());
+    REQUIRE(job.priority == -2);
+    REQUIRE(job.options.builder.delta_frames);
+
+    // A request's GIF is sent back, and a manifest has no priorities.
+    REQUIRE_THROWS_AS(parse_job(R"({"inputs": ["a.png"], "output": "out.gif"})", 1, job_format::request), std::invalid_argument);
+    REQUIRE_THROWS_AS(parse_job(R"({"inputs": ["a.png"], "output": "out.gif", "priority": 1})", 1), std::invalid_argument);
+}
@@ -0,0 +1,270 @@
+#include "gifgen.h"
+#include "gif_builder.hpp"
+#include "gif_sink.hpp"
+#include "image_utils.hpp"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Exceptions must not cross the C interface, so every function catches
+// them and records the reason in the encoder.
+
+// Thrown from the sink when the caller's callback asks to stop.
+struct callback_failure : std::runtime_error {
+    callback_failure() : std::runtime_error("The output callback stopped encoding") {}
+};
+
+// Forwards the stream to the caller's callback. Once the sink is closed,
+// the rest of the stream is dropped, so that an encoder which is destroyed
+// before it is finished does not call back into the caller.
+class callback_sink : public gif::gif_sink {
+public:
+    callback_sink(gifgen_output_fn fn, void* data) : output(fn), user_data(data), closed(false) {}
+
+    void on_bytes(std::span<const char> bytes) override {
+        if (closed) {
+            return;
+        }
+        if (output(user_data, reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size()) != 0) {
+            throw callback_failure();
+        }
+    }
+
+    void close() {
+        closed = true;
+    }
+
+private:
+    gifgen_output_fn output;
+    void* user_data;
+    bool closed;
+};
+
+struct gifgen_encoder {
+    enum class encoder_state {
+        configuring,
+        encoding,
+        finished,
+        failed
+    };
+
+    std::size_t width;
+    std::size_t height;
+    encoder_state state = encoder_state::configuring;
+    gifgen_options options;
+    std::string last_error;
+
+    // The sink is created with the builder, when the first frame is added.
+    gifgen_output_fn output = nullptr;
+    void* user_data = nullptr;
+    std::vector<uint8_t> collected;
+    std::unique_ptr<gif::gif_sink> sink;
+    std::unique_ptr<gif::gif_builder> builder;
+
+    // An unfinished stream is completed here rather than by the builder's
+    // destructor, where a failure would terminate the caller's process.
+    ~gifgen_encoder() {
+        if (auto callback = dynamic_cast<callback_sink*>(sink.get())) {
+            callback->close();
+        }
+        if (builder && state != encoder_state::finished) {
+            try {
+                builder->complete_stream();
+            }
+            catch (...) {
+            }
+        }
+    }
+};
+
+namespace {
+
+    gifgen_status fail(gifgen_encoder* encoder, gifgen_status status, const std::string& message) {
+        encoder->last_error = message;
+        return status;
+    }
+
+    // Runs an action which may throw, and converts any exception into a
+    // status. A builder which threw part way through a frame cannot be
+    // used again.
+    template<class Action>
+    gifgen_status run(gifgen_encoder* encoder, Action&& action) {
+        try {
+            action();
+            encoder->last_error.clear();
+            return GIFGEN_OK;
+        }
+        catch (const callback_failure& e) {
+            encoder->state = gifgen_encoder::encoder_state::failed;
+            return fail(encoder, GIFGEN_CALLBACK_FAILED, e.what());
+        }
+        catch (const std::bad_alloc&) {
+            encoder->state = gifgen_encoder::encoder_state::failed;
+            return fail(encoder, GIFGEN_OUT_OF_MEMORY, "Out of memory");
+        }
+        catch (const std::exception& e) {
+            encoder->state = gifgen_encoder::encoder_state::failed;
+            return fail(encoder, GIFGEN_INTERNAL_ERROR, e.what());
+        }
+        catch (...) {
+            encoder->state = gifgen_encoder::encoder_state::failed;
+            return fail(encoder, GIFGEN_INTERNAL_ERROR, "Unknown error");
+        }
+    }
+
+    gif::builder_options get_builder_options(const gifgen_options& options) {
+        gif::builder_options builder_options;
+        builder_options.reuse_palettes = options.reuse_palettes != 0;
+        builder_options.palette_reuse_threshold = options.palette_reuse_threshold;
+        builder_options.delta_frames = options.delta_frames != 0;
+        if (options.transparency) {
+            builder_options.transparency_tolerance = options.transparency_tolerance;
+        }
+        builder_options.coalesce_duplicates = options.coalesce_duplicates != 0;
+        builder_options.duplicate_tolerance = options.duplicate_tolerance;
+        return builder_options;
+    }
+
+    // The header is written when the builder is constructed, so this
+    // waits until the options and output are final.
+    void start_encoding(gifgen_encoder* encoder) {
+        if (encoder->output) {
+            encoder->sink = std::make_unique<callback_sink>(encoder->output, encoder->user_data);
+        }
+        else {
+            encoder->sink = std::make_unique<gif::vector_sink>(encoder->collected);
+        }
+        encoder->state = gifgen_encoder::encoder_state::encoding;
+        encoder->builder = std::make_unique<gif::gif_builder>(
+            *encoder->sink, encoder->width, encoder->height,
+            encoder->options.delay, get_builder_options(encoder->options));
+    }
+}
+
+extern "C" {
+
+    void gifgen_default_options(gifgen_options* options) {
+        if (!options) {
+            return;
+        }
+        std::memset(options, 0, sizeof(gifgen_options));
+        options->struct_size = sizeof(gifgen_options);
+        options->palette_reuse_threshold = gif::builder_options().palette_reuse_threshold;
+    }
+
+    gifgen_status gifgen_encoder_create(uint32_t width, uint32_t height, gifgen_encoder** encoder) {
+        constexpr uint32_t MAX_DIMENSION = std::numeric_limits<uint16_t>::max();
+        if (!encoder || width == 0 || height == 0 || width > MAX_DIMENSION || height > MAX_DIMENSION) {
+            return GIFGEN_INVALID_ARGUMENT;
+        }
+
+        auto created = new (std::nothrow) gifgen_encoder();
+        if (!created) {
+            return GIFGEN_OUT_OF_MEMORY;
+        }
+        created->width = width;
+        created->height = height;
+        gifgen_default_options(&created->options);
+        *encoder = created;
+        return GIFGEN_OK;
+    }
+
+    void gifgen_encoder_destroy(gifgen_encoder* encoder) {
+        delete encoder;
+    }
+
+    // Only the part of the options that the caller knows about is copied,
+    // so that callers built against an older header keep working.
+    gifgen_status gifgen_encoder_set_options(gifgen_encoder* encoder, const gifgen_options* options) {
+        if (!encoder) {
+            return GIFGEN_INVALID_ARGUMENT;
+        }
+        if (!options || options->struct_size < offsetof(gifgen_options, delay) + sizeof(options->delay)) {
+            return fail(encoder, GIFGEN_INVALID_ARGUMENT, "The options must be initialized with gifgen_default_options");
+        }
+        if (encoder->state != gifgen_encoder::encoder_state::configuring) {
+            return fail(encoder, GIFGEN_INVALID_STATE, "Options cannot be changed after a frame has been added");
+        }
+
+        gifgen_options copied;
+        gifgen_default_options(&copied);
+        std::memcpy(&copied, options, std::min(options->struct_size, sizeof(gifgen_options)));
+        copied.struct_size = sizeof(gifgen_options);
+        if (!(copied.palette_reuse_threshold >= 0 && copied.palette_reuse_threshold <= 1)) {
+            return fail(encoder, GIFGEN_INVALID_ARGUMENT, "The palette re-use threshold must be between 0 and 1");
+        }
+        encoder->options = copied;
+        encoder->last_error.clear();
+        return GIFGEN_OK;
+    }
+
+    gifgen_status gifgen_encoder_set_output(gifgen_encoder* encoder, gifgen_output_fn output, void* user_data) {
+        if (!encoder) {
+            return GIFGEN_INVALID_ARGUMENT;
+        }
+        if (encoder->state != gifgen_encoder::encoder_state::configuring) {
+            return fail(encoder, GIFGEN_INVALID_STATE, "The output cannot be changed after a frame has been added");
+        }
+        encoder->output = output;
+        encoder->user_data = user_data;
+        encoder->last_error.clear();
+        return GIFGEN_OK;
+    }
+
+    gifgen_status gifgen_encoder_add_frame(gifgen_encoder* encoder, const uint8_t* pixels, size_t row_stride) {
+        if (!encoder) {
+            return GIFGEN_INVALID_ARGUMENT;
+        }
+        if (!pixels || row_stride < 3 * encoder->width) {
+            return fail(encoder, GIFGEN_INVALID_ARGUMENT, "A frame needs pixels, with rows at least three bytes per pixel apart");
+        }
+        if (encoder->state == gifgen_encoder::encoder_state::finished ||
+                encoder->state == gifgen_encoder::encoder_state::failed) {
+            return fail(encoder, GIFGEN_INVALID_STATE, "Frames cannot be added to a finished or failed encoder");
+        }
+
+        return run(encoder, [&]() {
+            if (encoder->state == gifgen_encoder::encoder_state::configuring) {
+                start_encoding(encoder);
+            }
+            encoder->builder->add_frame(image::view_rgb_pixels(encoder->width, encoder->height, pixels, row_stride));
+        });
+    }
+
+    gifgen_status gifgen_encoder_finish(gifgen_encoder* encoder) {
+        if (!encoder) {
+            return GIFGEN_INVALID_ARGUMENT;
+        }
+        if (encoder->state != gifgen_encoder::encoder_state::encoding) {
+            return fail(encoder, GIFGEN_INVALID_STATE, "Only an encoder with at least one frame can be finished, once");
+        }
+
+        return run(encoder, [&]() {
+            encoder->builder->complete_stream();
+            encoder->state = gifgen_encoder::encoder_state::finished;
+        });
+    }
+
+    gifgen_status gifgen_encoder_output(const gifgen_encoder* encoder, const uint8_t** data, size_t* size) {
+        if (!encoder || !data || !size) {
+            return GIFGEN_INVALID_ARGUMENT;
+        }
+        if (encoder->state != gifgen_encoder::encoder_state::finished || encoder->output) {
+            return GIFGEN_INVALID_STATE;
+        }
+        *data = encoder->collected.data();
+        *size = encoder->collected.size();
+        return GIFGEN_OK;
+    }
+
+    const char* gifgen_last_error(const gifgen_encoder* encoder) {
+        return encoder ? encoder->last_error.c_str() : "";
+    }
+}
@@ -0,0 +1,138 @@
+#ifndef GIFGEN_H
+#define GIFGEN_H
+
+/*
+ * The C interface of libgifgen, for encoding GIFs inside another process.
+ *
+ * An encoder is created for each GIF, given frames of 8-bit RGB pixels
+ * one at a time, and finished. The encoded stream is either passed to a
+ * callback as it is produced or collected in a buffer owned by the
+ * encoder.
+ *
+ * Encoders share no state, so any number of them may be used at once on
+ * different threads. A single encoder must not be used by two threads at
+ * the same time. Large frames are split into parts which are processed on
+ * a pool of worker threads that is shared by every encoder.
+ *
+ * No function throws or aborts on bad input. Each returns a status, and
+ * the reason for a failure can be read with gifgen_last_error.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Only the functions below are exported from the library. */
+#define GIFGEN_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The version of the interface. Functions and option fields are only
+ * added within a major version. */
+#define GIFGEN_VERSION_MAJOR 1
+#define GIFGEN_VERSION_MINOR 0
+
+typedef enum gifgen_status {
+    GIFGEN_OK = 0,
+
+    /* An argument was null, out of range, or inconsistent. */
+    GIFGEN_INVALID_ARGUMENT = 1,
+
+    /* The function cannot be called in the encoder's current state, such
+     * as adding a frame after the encoder was finished. */
+    GIFGEN_INVALID_STATE = 2,
+
+    /* The output callback asked for encoding to stop. */
+    GIFGEN_CALLBACK_FAILED = 3,
+
+    GIFGEN_OUT_OF_MEMORY = 4,
+
+    /* Any other failure. The encoder cannot be used any more. */
+    GIFGEN_INTERNAL_ERROR = 5
+} gifgen_status;
+
+/* An encoder for one GIF. */
+typedef struct gifgen_encoder gifgen_encoder;
+
+/* How the GIF is encoded. Call gifgen_default_options to fill in the
+ * defaults before changing any fields. Boolean fields are non-zero to
+ * enable them. The fields match the options of the gifgen program. */
+typedef struct gifgen_options {
+    /* The size of this struct, as set by gifgen_default_options. Fields
+     * added in later versions are appended, and an older caller's struct
+     * is read only up to its size. */
+    size_t struct_size;
+
+    /* The time between frames in hundredths of a second. */
+    uint16_t delay;
+
+    /* Re-use the color table of an earlier frame unless the colors have
+     * changed by more than the threshold, from 0 to 1. */
+    int reuse_palettes;
+    double palette_reuse_threshold;
+
+    /* Only encode the rectangle of each frame which changed. */
+    int delta_frames;
+
+    /* Leave pixels which differ from the previous frame by no more than
+     * the tolerance in every channel transparent. */
+    int transparency;
+    uint8_t transparency_tolerance;
+
+    /* Show a frame which duplicates the previous frame, within the
+     * tolerance, by displaying the previous frame for longer. */
+    int coalesce_duplicates;
+    uint8_t duplicate_tolerance;
+} gifgen_options;
+
+/* Receives the next bytes of the encoded stream, which are only valid
+ * until it returns. Returns zero to continue, or non-zero to stop
+ * encoding, which makes the call that produced the bytes fail with
+ * GIFGEN_CALLBACK_FAILED. */
+typedef int (*gifgen_output_fn)(void* user_data, const uint8_t* bytes, size_t size);
+
+GIFGEN_API void gifgen_default_options(gifgen_options* options);
+
+/* Creates an encoder for a GIF whose frames have the given dimensions,
+ * each from 1 to 65535 pixels. On success, *encoder is set to the new
+ * encoder, which must be freed with gifgen_encoder_destroy. */
+GIFGEN_API gifgen_status gifgen_encoder_create(uint32_t width, uint32_t height, gifgen_encoder** encoder);
+
+/* Frees the encoder and its output. A null encoder is ignored. */
+GIFGEN_API void gifgen_encoder_destroy(gifgen_encoder* encoder);
+
+/* Sets how the GIF is encoded. This may only be called before the first
+ * frame is added. */
+GIFGEN_API gifgen_status gifgen_encoder_set_options(gifgen_encoder* encoder, const gifgen_options* options);
+
+/* Passes the encoded stream to the callback as it is produced, instead
+ * of collecting it in the encoder. The header is passed on with the
+ * first frame, and each frame as soon as it is final. This may only be
+ * called before the first frame is added. */
+GIFGEN_API gifgen_status gifgen_encoder_set_output(gifgen_encoder* encoder, gifgen_output_fn output, void* user_data);
+
+/* Adds a frame of 8-bit RGB pixels, three bytes per pixel, with rows
+ * starting row_stride bytes apart. The pixels are not used after the
+ * call returns. */
+GIFGEN_API gifgen_status gifgen_encoder_add_frame(gifgen_encoder* encoder, const uint8_t* pixels, size_t row_stride);
+
+/* Completes the GIF. At least one frame must have been added. No more
+ * frames may be added afterwards. */
+GIFGEN_API gifgen_status gifgen_encoder_finish(gifgen_encoder* encoder);
+
+/* Gives the complete GIF collected by a finished encoder without an
+ * output callback. The data belongs to the encoder, and is valid until
+ * it is destroyed. */
+GIFGEN_API gifgen_status gifgen_encoder_output(const gifgen_encoder* encoder, const uint8_t** data, size_t* size);
+
+/* Describes the last failure of a call with the encoder, or returns an
+ * empty string if there has been none. The string is valid until the
+ * next call with the encoder. */
+GIFGEN_API const char* gifgen_last_error(const gifgen_encoder* encoder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
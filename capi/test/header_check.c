@@ -0,0 +1,9 @@
+/* Compiled as C to check that the public header is valid C. */
+#include "gifgen.h"
+
+/* Called from the C++ tests so that the check is linked in. */
+int gifgen_header_check_default_delay(void) {
+    gifgen_options options;
+    gifgen_default_options(&options);
+    return options.delay;
+}
@@ -0,0 +1,265 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "gifgen.h"
+#include "gif_builder.hpp"
+#include "image_utils.hpp"
+#include "test_support.hpp"
+
+extern "C" int gifgen_header_check_default_delay(void);
+
+constexpr std::size_t WIDTH = 40;
+constexpr std::size_t HEIGHT = 30;
+
+// Rows are padded to check that the stride is respected.
+constexpr std::size_t STRIDE = 3 * WIDTH + 5;
+
+// Draws the shared test frames into padded rows.
+std::vector<std::vector<uint8_t>> draw_frames(std::size_t count) {
+    std::vector<std::vector<uint8_t>> frames;
+    for (std::size_t i = 0; i < count; ++i) {
+        auto& pixels = frames.emplace_back(STRIDE * HEIGHT, 0xAB);
+        test_support::draw_frame(i, image::view_rgb_pixels(WIDTH, HEIGHT, pixels.data(), STRIDE));
+    }
+    return frames;
+}
+
+// Encodes the frames with a builder directly.
+std::vector<uint8_t> encode_with_builder(const std::vector<std::vector<uint8_t>>& frames, std::size_t delay,
+                                         const gif::builder_options& options) {
+    std::ostringstream out;
+    gif::gif_builder builder(out, WIDTH, HEIGHT, delay, options);
+    for (const auto& frame : frames) {
+        builder.add_frame(image::view_rgb_pixels(WIDTH, HEIGHT, frame.data(), STRIDE));
+    }
+    builder.complete_stream();
+    auto bytes = out.str();
+    return std::vector<uint8_t>(bytes.begin(), bytes.end());
+}
+
+// Encodes the frames through the C interface into the encoder's buffer.
+gifgen_status encode_with_c_api(const std::vector<std::vector<uint8_t>>& frames, const gifgen_options& options,
+                                std::vector<uint8_t>& output) {
+    gifgen_encoder* encoder = nullptr;
+    auto status = gifgen_encoder_create(WIDTH, HEIGHT, &encoder);
+    if (status != GIFGEN_OK) {
+        return status;
+    }
+    status = gifgen_encoder_set_options(encoder, &options);
+    for (std::size_t i = 0; i < frames.size() && status == GIFGEN_OK; ++i) {
+        status = gifgen_encoder_add_frame(encoder, frames[i].data(), STRIDE);
+    }
+    if (status == GIFGEN_OK) {
+        status = gifgen_encoder_finish(encoder);
+    }
+    if (status == GIFGEN_OK) {
+        const uint8_t* data;
+        std::size_t size;
+        status = gifgen_encoder_output(encoder, &data, &size);
+        output.assign(data, data + size);
+    }
+    gifgen_encoder_destroy(encoder);
+    return status;
+}
+
+struct callback_state {
+    std::vector<uint8_t> bytes;
+    std::size_t calls = 0;
+    std::size_t fail_on_call = 0;
+};
+
+int collect_output(void* user_data, const uint8_t* bytes, size_t size) {
+    auto state = static_cast<callback_state*>(user_data);
+    if (++state->calls == state->fail_on_call) {
+        return 1;
+    }
+    state->bytes.insert(state->bytes.end(), bytes, bytes + size);
+    return 0;
+}
+
+TEST_CASE("Test the header compiles as C", "[gifgen_c]") {
+    REQUIRE(gifgen_header_check_default_delay() == 0);
+}
+
+TEST_CASE("Test encoding into the encoder's buffer", "[gifgen_c]") {
+    auto frames = draw_frames(6);
+
+    SECTION("Default options") {
+        gifgen_options options;
+        gifgen_default_options(&options);
+        std::vector<uint8_t> output;
+        REQUIRE(encode_with_c_api(frames, options, output) == GIFGEN_OK);
+        REQUIRE(output == encode_with_builder(frames, 0, {}));
+    }
+
+    SECTION("Optimizations enabled") {
+        gifgen_options options;
+        gifgen_default_options(&options);
+        options.delay = 12;
+        options.reuse_palettes = 1;
+        options.delta_frames = 1;
+        options.transparency = 1;
+        options.transparency_tolerance = 2;
+        options.coalesce_duplicates = 1;
+
+        gif::builder_options builder_options;
+        builder_options.reuse_palettes = true;
+        builder_options.delta_frames = true;
+        builder_options.transparency_tolerance = 2;
+        builder_options.coalesce_duplicates = true;
+
+        std::vector<uint8_t> output;
+        REQUIRE(encode_with_c_api(frames, options, output) == GIFGEN_OK);
+        REQUIRE(output == encode_with_builder(frames, 12, builder_options));
+    }
+
+    SECTION("Options from an older caller") {
+        // A caller built against a header with only the delay sees the
+        // defaults for every later field.
+        gifgen_options options;
+        std::memset(&options, 0xFF, sizeof(options));
+        options.struct_size = offsetof(gifgen_options, delay) + sizeof(options.delay);
+        options.delay = 7;
+        std::vector<uint8_t> output;
+        REQUIRE(encode_with_c_api(frames, options, output) == GIFGEN_OK);
+        REQUIRE(output == encode_with_builder(frames, 7, {}));
+    }
+}
+
+TEST_CASE("Test encoding through a callback", "[gifgen_c]") {
+    auto frames = draw_frames(4);
+    gifgen_encoder* encoder = nullptr;
+    REQUIRE(gifgen_encoder_create(WIDTH, HEIGHT, &encoder) == GIFGEN_OK);
+    callback_state state;
+
+    SECTION("Complete stream") {
+        REQUIRE(gifgen_encoder_set_output(encoder, collect_output, &state) == GIFGEN_OK);
+        for (const auto& frame : frames) {
+            REQUIRE(gifgen_encoder_add_frame(encoder, frame.data(), STRIDE) == GIFGEN_OK);
+        }
+        REQUIRE(gifgen_encoder_finish(encoder) == GIFGEN_OK);
+        REQUIRE(state.bytes == encode_with_builder(frames, 0, {}));
+
+        // The stream was not collected.
+        const uint8_t* data;
+        std::size_t size;
+        REQUIRE(gifgen_encoder_output(encoder, &data, &size) == GIFGEN_INVALID_STATE);
+    }
+
+    SECTION("Callback stops encoding") {
+        state.fail_on_call = 3;
+        REQUIRE(gifgen_encoder_set_output(encoder, collect_output, &state) == GIFGEN_OK);
+        gifgen_status status = GIFGEN_OK;
+        for (std::size_t i = 0; i < frames.size() && status == GIFGEN_OK; ++i) {
+            status = gifgen_encoder_add_frame(encoder, frames[i].data(), STRIDE);
+        }
+        REQUIRE(status == GIFGEN_CALLBACK_FAILED);
+        REQUIRE(std::strlen(gifgen_last_error(encoder)) > 0);
+
+        // The encoder cannot be used after failing, and the callback is
+        // not called again, even when the encoder is destroyed.
+        auto calls = state.calls;
+        REQUIRE(gifgen_encoder_add_frame(encoder, frames[0].data(), STRIDE) == GIFGEN_INVALID_STATE);
+        REQUIRE(gifgen_encoder_finish(encoder) == GIFGEN_INVALID_STATE);
+        gifgen_encoder_destroy(encoder);
+        encoder = nullptr;
+        REQUIRE(state.calls == calls);
+    }
+
+    SECTION("Unfinished encoder is destroyed") {
+        REQUIRE(gifgen_encoder_set_output(encoder, collect_output, &state) == GIFGEN_OK);
+        REQUIRE(gifgen_encoder_add_frame(encoder, frames[0].data(), STRIDE) == GIFGEN_OK);
+        auto calls = state.calls;
+        gifgen_encoder_destroy(encoder);
+        encoder = nullptr;
+        REQUIRE(state.calls == calls);
+    }
+
+    gifgen_encoder_destroy(encoder);
+}
+
+TEST_CASE("Test invalid arguments and states", "[gifgen_c]") {
+    gifgen_encoder* encoder = nullptr;
+    REQUIRE(gifgen_encoder_create(0, HEIGHT, &encoder) == GIFGEN_INVALID_ARGUMENT);
+    REQUIRE(gifgen_encoder_create(WIDTH, 70000, &encoder) == GIFGEN_INVALID_ARGUMENT);
+    REQUIRE(gifgen_encoder_create(WIDTH, HEIGHT, nullptr) == GIFGEN_INVALID_ARGUMENT);
+    REQUIRE(encoder == nullptr);
+
+    REQUIRE(gifgen_encoder_add_frame(nullptr, nullptr, 0) == GIFGEN_INVALID_ARGUMENT);
+    REQUIRE(gifgen_encoder_finish(nullptr) == GIFGEN_INVALID_ARGUMENT);
+    REQUIRE(std::strlen(gifgen_last_error(nullptr)) == 0);
+    gifgen_encoder_destroy(nullptr);
+
+    REQUIRE(gifgen_encoder_create(WIDTH, HEIGHT, &encoder) == GIFGEN_OK);
+    auto frame = draw_frames(1).front();
+    const uint8_t* data;
+    std::size_t size;
+
+    // Nothing to finish or output yet.
+    REQUIRE(gifgen_encoder_finish(encoder) == GIFGEN_INVALID_STATE);
+    REQUIRE(gifgen_encoder_output(encoder, &data, &size) == GIFGEN_INVALID_STATE);
+
+    // Bad frames and options.
+    REQUIRE(gifgen_encoder_add_frame(encoder, nullptr, STRIDE) == GIFGEN_INVALID_ARGUMENT);
+    REQUIRE(gifgen_encoder_add_frame(encoder, frame.data(), 3 * WIDTH - 1) == GIFGEN_INVALID_ARGUMENT);
+    REQUIRE(std::strlen(gifgen_last_error(encoder)) > 0);
+
+    gifgen_options options;
+    gifgen_default_options(&options);
+    options.palette_reuse_threshold = 1.5;
+    REQUIRE(gifgen_encoder_set_options(encoder, &options) == GIFGEN_INVALID_ARGUMENT);
+    options.struct_size = 0;
+    REQUIRE(gifgen_encoder_set_options(encoder, &options) == GIFGEN_INVALID_ARGUMENT);
+
+    // The encoder is still usable, and a success clears the error.
+    REQUIRE(gifgen_encoder_add_frame(encoder, frame.data(), STRIDE) == GIFGEN_OK);
+    REQUIRE(std::strlen(gifgen_last_error(encoder)) == 0);
+
+    // The configuration is fixed once a frame is added.
+    gifgen_default_options(&options);
+    REQUIRE(gifgen_encoder_set_options(encoder, &options) == GIFGEN_INVALID_STATE);
+    REQUIRE(gifgen_encoder_set_output(encoder, collect_output, nullptr) == GIFGEN_INVALID_STATE);
+
+    REQUIRE(gifgen_encoder_finish(encoder) == GIFGEN_OK);
+    REQUIRE(gifgen_encoder_finish(encoder) == GIFGEN_INVALID_STATE);
+    REQUIRE(gifgen_encoder_add_frame(encoder, frame.data(), STRIDE) == GIFGEN_INVALID_STATE);
+    REQUIRE(gifgen_encoder_output(encoder, &data, &size) == GIFGEN_OK);
+    REQUIRE(size > 0);
+    gifgen_encoder_destroy(encoder);
+}
+
+TEST_CASE("Test encoders on separate threads", "[gifgen_c]") {
+    auto frames = draw_frames(8);
+    gifgen_options options;
+    gifgen_default_options(&options);
+    options.reuse_palettes = 1;
+    options.delta_frames = 1;
+    auto expected = encode_with_builder(frames, 0, [] {
+        gif::builder_options builder_options;
+        builder_options.reuse_palettes = true;
+        builder_options.delta_frames = true;
+        return builder_options;
+    }());
+
+    constexpr std::size_t THREAD_COUNT = 8;
+    std::vector<std::vector<uint8_t>> outputs(THREAD_COUNT);
+    std::vector<gifgen_status> statuses(THREAD_COUNT);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < THREAD_COUNT; ++i) {
+        threads.emplace_back([&, i]() {
+            statuses[i] = encode_with_c_api(frames, options, outputs[i]);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (std::size_t i = 0; i < THREAD_COUNT; ++i) {
+        REQUIRE(statuses[i] == GIFGEN_OK);
+        REQUIRE(outputs[i] == expected);
+    }
+}
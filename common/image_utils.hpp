@@ -2,6 +2,9 @@
 #define COMMON_IMAGE_UTILS
 
 #include <boost/gil.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 
 // This file contains type definitions and utilities to improve
 // the readability of image processing code that relies on 
@@ -11,6 +14,22 @@ namespace image {
     using rgb_image_t = boost::gil::rgb8_image_t;
     using rgb_image_view_t = boost::gil::rgb8_view_t;
 
+    // Views rows of 8-bit RGB pixels which are held elsewhere, such as a
+    // frame from a video decoder, without copying them. Rows start 
+    // row_stride bytes apart, which may be more than three bytes per 
+    // pixel. The view is mutable so that it can be passed wherever an 
+    // rgb_image_view_t is taken, but the pixels may only be read through
+    // it.
+    inline rgb_image_view_t view_rgb_pixels(std::size_t width, std::size_t height, 
+                                            const uint8_t* pixels, std::size_t row_stride) {
+        auto first = reinterpret_cast<rgb_pixel_t*>(const_cast<uint8_t*>(pixels));
+        return boost::gil::interleaved_view(width, height, first, row_stride);
+    }
+
+    // Flags a subset of an image's pixels. Holds one entry per pixel,
+    // in row-major order, which is non-zero for flagged pixels.
+    using pixel_mask = std::vector<uint8_t>;
+
     // Enumerates the possible image types that could be used
     // to construct a GIF.
     enum class file_type {
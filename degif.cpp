@@ -76,6 +76,7 @@ private:
     std::vector<uint8_t> binary_content;
     std::size_t current_byte_offset;
     std::size_t local_color_table_size;
+    bool has_global_color_table;
     std::size_t total_image_data_size; 
 
     // Validates the GIF file signature and the version.
@@ -112,12 +113,9 @@ private:
         uint8_t global_color_flag = packed_fields & 0x80;
         uint8_t color_resolution = (packed_fields & 0x70) >> 4;
         uint8_t sort_flag = packed_fields & 0x08;
-        // uint8_t global_color_table_size = packed_fields & 0x07; // We don't use this.
+        uint8_t encoded_global_color_table_size = packed_fields & 0x07;
 
-        if (global_color_flag != 0) {
-            error() << "Global color table flag is set" << std::endl;
-            return false;
-        }
+        has_global_color_table = global_color_flag != 0;
         if (color_resolution != 7) {
             error() << "Incorrect color resolution. Expected 0b111, but got (int value) " << color_resolution << std::endl;
             return false;
@@ -141,6 +139,13 @@ private:
 
         current_byte_offset += SCREEN_DESCRIPTOR_SIZE;
 
+        // The global color table, if any, immediately follows the descriptor.
+        if (has_global_color_table) {
+            std::size_t global_color_table_size = 1 << (encoded_global_color_table_size + 1);
+            std::cout << "\tGlobal color table size: " << global_color_table_size << std::endl;
+            current_byte_offset += 3 * global_color_table_size;
+        }
+
         return true;
     }
 
@@ -257,8 +262,8 @@ private:
         uint8_t sort_flag = bit_fields & 0x20;
         uint8_t encoded_color_table_size = bit_fields & 0x07;
 
-        if (local_color_table_flag == 0) {
-            error() << "Local color table flag is unset" << std::endl;
+        if (local_color_table_flag == 0 && !has_global_color_table) {
+            error() << "Local color table flag is unset and there is no global color table" << std::endl;
             return false;
         }
         if (interlace_flag != 0) {
@@ -270,8 +275,14 @@ private:
             return false;
         }
 
-        local_color_table_size = 1 << (encoded_color_table_size + 1);
-        std::cout << "\tLocal color table size: " << local_color_table_size << std::endl;
+        if (local_color_table_flag == 0) {
+            local_color_table_size = 0;
+            std::cout << "\tUses the global color table" << std::endl;
+        }
+        else {
+            local_color_table_size = 1 << (encoded_color_table_size + 1);
+            std::cout << "\tLocal color table size: " << local_color_table_size << std::endl;
+        }
 
         current_byte_offset += IMAGE_DESCRIPTOR_SIZE;
 
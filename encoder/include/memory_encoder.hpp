@@ -0,0 +1,89 @@
+#ifndef MEMORY_ENCODER_HPP
+#define MEMORY_ENCODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "gif_builder.hpp"
+#include "gif_sink.hpp"
+#include "image_io.hpp"
+#include "image_utils.hpp"
+#include "preprocess.hpp"
+#include "task_pool.hpp"
+
+// Encodes GIFs from frames held in memory into a byte vector, so that a
+// service which receives images over the network can encode them without
+// touching the filesystem.
+namespace encoder {
+
+    struct encode_options {
+        // The time between frames in hundredths of a second.
+        std::size_t delay = 0;
+
+        // How the stream is encoded. A global palette is used as given.
+        gif::builder_options builder;
+
+        // How PNG and JPEG images are decoded.
+        image::decode_options decoding;
+
+        // When set, every frame is fitted to a canvas of this size, and
+        // frames may have differing dimensions.
+        std::optional<preprocess::fit_options> canvas;
+    };
+
+    // A frame of 8-bit RGB pixels held by the caller. Rows start row_stride
+    // bytes apart, which may be more than three bytes per pixel.
+    struct raw_frame {
+        const uint8_t* pixels;
+        std::size_t row_stride;
+    };
+
+    // Encodes PNG and JPEG images held in memory as the frames of a GIF.
+    // The type of each image is identified from its magic bytes, so both
+    // may be mixed. The images are decoded and encoded on the task pool as
+    // by pipeline::add_frames, and the output is the same as that of 
+    // adding the decoded frames to a gif::gif_builder one by one.
+    //
+    // The output is replaced by the GIF. Its memory is re-used, so passing
+    // the same vector for each request avoids allocating it every time.
+    // Returns the builder's statistics.
+    //
+    // Throws std::invalid_argument if there are no images, and
+    // std::runtime_error if an image is not a PNG or JPEG image which can
+    // be read as 8-bit RGB, is corrupt, or has different dimensions from
+    // the first without a canvas.
+    gif::builder_stats encode_images(const std::vector<image::byte_view>& images,
+                                     std::vector<uint8_t>& output,
+                                     const encode_options& options = {},
+                                     runtime::task_pool& pool = runtime::task_pool::shared());
+
+    // Encodes the images in the same way, but passes the GIF to the sink
+    // as it is encoded. If the sink throws, no more frames are encoded and
+    // the exception is rethrown.
+    gif::builder_stats encode_images(const std::vector<image::byte_view>& images,
+                                     gif::gif_sink& sink,
+                                     const encode_options& options = {},
+                                     runtime::task_pool& pool = runtime::task_pool::shared());
+
+    // Encodes raw frames of the given dimensions as a GIF in the same way.
+    // Each frame is copied once, into a buffer which is re-used for later
+    // frames. The decoding options do not apply.
+    //
+    // Throws std::invalid_argument if there are no frames, a dimension is
+    // 0 or too large for a GIF, or a stride is shorter than a row.
+    gif::builder_stats encode_frames(std::size_t width, std::size_t height,
+                                     const std::vector<raw_frame>& frames,
+                                     std::vector<uint8_t>& output,
+                                     const encode_options& options = {},
+                                     runtime::task_pool& pool = runtime::task_pool::shared());
+
+    // Encodes raw frames into a sink, as encode_images does.
+    gif::builder_stats encode_frames(std::size_t width, std::size_t height,
+                                     const std::vector<raw_frame>& frames,
+                                     gif::gif_sink& sink,
+                                     const encode_options& options = {},
+                                     runtime::task_pool& pool = runtime::task_pool::shared());
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "memory_encoder.hpp"
+#include "frame_pipeline.hpp"
+#include "gif_sink.hpp"
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace encoder {
+
+    // Checks that the dimensions fit in a GIF's 16-bit fields.
+    void check_dimensions(std::size_t width, std::size_t height) {
+        constexpr std::size_t MAX_DIMENSION = std::numeric_limits<uint16_t>::max();
+        if (width == 0 || height == 0 || width > MAX_DIMENSION || height > MAX_DIMENSION) {
+            throw std::invalid_argument("Frames of " + std::to_string(width) + "x" + std::to_string(height) +
+                                        " pixels cannot be encoded as a GIF");
+        }
+    }
+
+    // Adds the frames to a new builder which writes to the sink, and
+    // completes the stream.
+    gif::builder_stats encode_to_sink(std::size_t width, std::size_t height, std::size_t frame_count,
+                                      const pipeline::frame_decoder& decode,
+                                      gif::gif_sink& sink,
+                                      const encode_options& options,
+                                      runtime::task_pool& pool) {
+        gif::gif_builder builder(sink, width, height, options.delay, options.builder);
+        pipeline::add_frames(builder, frame_count, decode, {}, pool);
+        builder.complete_stream();
+        return builder.stats();
+    }
+
+    // Every header is checked before any image is decoded, so that a bad
+    // image is reported without wasting work on the others.
+    gif::builder_stats encode_images(const std::vector<image::byte_view>& images,
+                                     gif::gif_sink& sink,
+                                     const encode_options& options,
+                                     runtime::task_pool& pool) {
+        if (images.empty()) {
+            throw std::invalid_argument("At least one image is needed to encode a GIF");
+        }
+
+        std::vector<image::file_type> types;
+        types.reserve(images.size());
+        std::size_t width = 0, height = 0;
+        for (std::size_t i = 0; i < images.size(); ++i) {
+            auto info = image::read_image_info(images[i]);
+            if (!info.has_value() || !image::is_rgb8_compatible(*info)) {
+                throw std::runtime_error("Image " + std::to_string(i) + " is not a PNG or JPEG image "
+                                         "which can be read with 8-bit RGB color channels");
+            }
+            if (i == 0) {
+                width = info->width;
+                height = info->height;
+            }
+            else if (!options.canvas.has_value() && (info->width != width || info->height != height)) {
+                throw std::runtime_error("Image " + std::to_string(i) + " does not have the dimensions of the first image");
+            }
+            types.push_back(info->type);
+        }
+
+        if (options.canvas.has_value()) {
+            width = options.canvas->width;
+            height = options.canvas->height;
+        }
+        else {
+            width = image::scaled_dimension(width, options.decoding.scale);
+            height = image::scaled_dimension(height, options.decoding.scale);
+        }
+        check_dimensions(width, height);
+
+        auto decode = [&](std::size_t i, image::rgb_image_t& img) {
+            image::decode_to_canvas(images[i], img, types[i], options.decoding, options.canvas);
+            if (static_cast<std::size_t>(img.width()) != width || static_cast<std::size_t>(img.height()) != height) {
+                throw std::runtime_error("Image " + std::to_string(i) + " does not match the dimensions of its header");
+            }
+        };
+        return encode_to_sink(width, height, images.size(), decode, sink, options, pool);
+    }
+
+    gif::builder_stats encode_images(const std::vector<image::byte_view>& images,
+                                     std::vector<uint8_t>& output,
+                                     const encode_options& options,
+                                     runtime::task_pool& pool) {
+        output.clear();
+        gif::vector_sink sink(output);
+        return encode_images(images, sink, options, pool);
+    }
+
+    gif::builder_stats encode_frames(std::size_t width, std::size_t height,
+                                     const std::vector<raw_frame>& frames,
+                                     gif::gif_sink& sink,
+                                     const encode_options& options,
+                                     runtime::task_pool& pool) {
+        if (frames.empty()) {
+            throw std::invalid_argument("At least one frame is needed to encode a GIF");
+        }
+        if (width == 0 || height == 0) {
+            throw std::invalid_argument("Frames must have at least one pixel");
+        }
+        for (const auto& frame : frames) {
+            if (frame.row_stride < 3 * width) {
+                throw std::invalid_argument("The row stride of a frame is shorter than its rows");
+            }
+        }
+
+        std::size_t gif_width = options.canvas.has_value() ? options.canvas->width : width;
+        std::size_t gif_height = options.canvas.has_value() ? options.canvas->height : height;
+        check_dimensions(gif_width, gif_height);
+
+        auto decode = [&](std::size_t i, image::rgb_image_t& img) {
+            auto frame_view = image::view_rgb_pixels(width, height, frames[i].pixels, frames[i].row_stride);
+            if (options.canvas.has_value()) {
+                preprocess::fit_frame(frame_view, img, *options.canvas);
+            }
+            else {
+                img.recreate(width, height);
+                boost::gil::copy_pixels(frame_view, boost::gil::view(img));
+            }
+        };
+        return encode_to_sink(gif_width, gif_height, frames.size(), decode, sink, options, pool);
+    }
+
+    gif::builder_stats encode_frames(std::size_t width, std::size_t height,
+                                     const std::vector<raw_frame>& frames,
+                                     std::vector<uint8_t>& output,
+                                     const encode_options& options,
+                                     runtime::task_pool& pool) {
+        output.clear();
+        gif::vector_sink sink(output);
+        return encode_frames(width, height, frames, sink, options, pool);
+    }
+}
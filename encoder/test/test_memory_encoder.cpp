@@ -0,0 +1,186 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include "memory_encoder.hpp"
+#include "test_support.hpp"
+
+using namespace encoder;
+using namespace test_support;
+
+constexpr std::size_t WIDTH = 40;
+constexpr std::size_t HEIGHT = 30;
+
+// Encodes the images as a GIF with a builder, one by one.
+std::vector<uint8_t> encode_serially(const std::vector<image::rgb_image_t>& images, std::size_t delay, 
+                                     const gif::builder_options& options) {
+    std::ostringstream out;
+    gif::gif_builder builder(out, images.front().width(), images.front().height(), delay, options);
+    for (const auto& img : images) {
+        builder.add_frame(boost::gil::view(const_cast<image::rgb_image_t&>(img)));
+    }
+    builder.complete_stream();
+    auto bytes = out.str();
+    return std::vector<uint8_t>(bytes.begin(), bytes.end());
+}
+
+// Encodes an image as it would be stored in a file.
+image::file_buffer encode_image(const image::rgb_image_t& img, image::file_type type) {
+    auto filename = (std::filesystem::temp_directory_path() / "test_memory_encoder_image").string();
+    image::write_image(filename, img, type);
+    std::vector<image::file_read> reads(1);
+    reads[0].filename = filename;
+    image::batch_file_reader(false).read_files(reads);
+    std::filesystem::remove(filename);
+    return reads[0].contents;
+}
+
+TEST_CASE("Test encoding images from memory", "[memory_encoder]") {
+    std::vector<image::file_buffer> files;
+    std::vector<image::rgb_image_t> decoded;
+    for (std::size_t i = 0; i < 6; ++i) {
+        image::rgb_image_t img(WIDTH, HEIGHT);
+        draw_frame(i, boost::gil::view(img));
+        auto type = i % 2 == 0 ? image::file_type::PNG : image::file_type::JPEG;
+        files.push_back(encode_image(img, type));
+        image::read_image(files.back(), decoded.emplace_back(), type);
+    }
+    std::vector<image::byte_view> images(files.begin(), files.end());
+
+    encode_options options;
+    options.delay = 7;
+    options.builder.delta_frames = true;
+
+    // The output is replaced, and its memory is re-used.
+    std::vector<uint8_t> output(3, 0xAB);
+    auto stats = encode_images(images, output, options);
+    REQUIRE(stats.frames == 6);
+    REQUIRE(output == encode_serially(decoded, 7, options.builder));
+
+    auto capacity = output.capacity();
+    auto first_output = output;
+    encode_images(images, output, options);
+    REQUIRE(output == first_output);
+    REQUIRE(output.capacity() == capacity);
+}
+
+TEST_CASE("Test encoding images from memory onto a canvas", "[memory_encoder]") {
+    image::rgb_image_t small(20, 10), large(WIDTH, HEIGHT);
+    draw_frame(0, boost::gil::view(small));
+    draw_frame(1, boost::gil::view(large));
+    auto small_file = encode_image(small, image::file_type::PNG);
+    auto large_file = encode_image(large, image::file_type::PNG);
+    std::vector<image::byte_view> images {small_file, large_file};
+
+    std::vector<uint8_t> output;
+    REQUIRE_THROWS_AS(encode_images(images, output), std::runtime_error);
+
+    encode_options options;
+    options.canvas = preprocess::fit_options {};
+    options.canvas->width = 16;
+    options.canvas->height = 12;
+    std::vector<image::rgb_image_t> fitted(2);
+    preprocess::fit_frame(boost::gil::view(small), fitted[0], *options.canvas);
+    preprocess::fit_frame(boost::gil::view(large), fitted[1], *options.canvas);
+
+    encode_images(images, output, options);
+    REQUIRE(output == encode_serially(fitted, 0, options.builder));
+}
+
+TEST_CASE("Test encoding invalid images from memory", "[memory_encoder]") {
+    std::vector<uint8_t> output;
+    REQUIRE_THROWS_AS(encode_images({}, output), std::invalid_argument);
+
+    image::file_buffer garbage {'G', 'I', 'F', '8', '9', 'a', 0, 0};
+    REQUIRE_THROWS_AS(encode_images({garbage}, output), std::runtime_error);
+
+    // A file which is cut off after its header fails when it is decoded.
+    image::rgb_image_t img(WIDTH, HEIGHT);
+    draw_frame(0, boost::gil::view(img));
+    auto file = encode_image(img, image::file_type::PNG);
+    file.resize(file.size() / 2);
+    REQUIRE_THROWS_AS(encode_images({file}, output), std::runtime_error);
+}
+
+TEST_CASE("Test encoding raw frames with a stride", "[memory_encoder]") {
+    // Each row is padded, and the padding is never read.
+    constexpr std::size_t STRIDE = 3 * WIDTH + 13;
+    std::vector<std::vector<uint8_t>> buffers;
+    std::vector<raw_frame> frames;
+    std::vector<image::rgb_image_t> images;
+    for (std::size_t i = 0; i < 5; ++i) {
+        auto& img = images.emplace_back(WIDTH, HEIGHT);
+        draw_frame(i, boost::gil::view(img));
+        auto& buffer = buffers.emplace_back(STRIDE * HEIGHT, 0xEE);
+        auto img_view = boost::gil::view(img);
+        for (std::size_t y = 0; y < HEIGHT; ++y) {
+            for (std::size_t x = 0; x < WIDTH; ++x) {
+                for (std::size_t c = 0; c < 3; ++c) {
+                    buffer[y * STRIDE + 3 * x + c] = img_view(x, y)[c];
+                }
+            }
+        }
+        frames.push_back({buffer.data(), STRIDE});
+    }
+
+    encode_options options;
+    options.builder.coalesce_duplicates = true;
+    std::vector<uint8_t> output;
+    auto stats = encode_frames(WIDTH, HEIGHT, frames, output, options);
+    REQUIRE(stats.frames == 5);
+    REQUIRE(output == encode_serially(images, 0, options.builder));
+
+    REQUIRE_THROWS_AS(encode_frames(WIDTH, HEIGHT, {}, output), std::invalid_argument);
+    REQUIRE_THROWS_AS(encode_frames(0, HEIGHT, frames, output), std::invalid_argument);
+    REQUIRE_THROWS_AS(encode_frames(WIDTH, HEIGHT, {{buffers[0].data(), 3 * WIDTH - 1}}, output), std::invalid_argument);
+    REQUIRE_THROWS_AS(encode_frames(70000, 1, {{buffers[0].data(), 3 * 70000}}, output), std::invalid_argument);
+}
+
+// Collects the stream, and throws once the given number of frames have 
+// been emitted.
+class stopping_sink : public gif::gif_sink {
+public:
+    explicit stopping_sink(std::size_t stop) : stop_frame(stop) {}
+
+    std::vector<uint8_t> bytes;
+    std::size_t frames_begun = 0;
+
+    void on_bytes(std::span<const char> data) override {
+        bytes.insert(bytes.end(), data.begin(), data.end());
+    }
+
+    void on_frame_begin(std::size_t index) override {
+        frames_begun = index + 1;
+        if (index == stop_frame) {
+            throw std::runtime_error("stopped");
+        }
+    }
+
+private:
+    std::size_t stop_frame;
+};
+
+TEST_CASE("Test encoding raw frames into a sink", "[memory_encoder]") {
+    // The frames point into the images, which must not be moved.
+    std::vector<image::rgb_image_t> images;
+    images.reserve(8);
+    std::vector<raw_frame> frames;
+    for (std::size_t i = 0; i < 8; ++i) {
+        auto& img = images.emplace_back(WIDTH, HEIGHT);
+        draw_frame(i, boost::gil::view(img));
+        frames.push_back({boost::gil::interleaved_view_get_raw_data(boost::gil::view(img)), 3 * WIDTH});
+    }
+
+    // The sink receives the same stream as the output vector.
+    stopping_sink whole_stream(frames.size());
+    auto stats = encode_frames(WIDTH, HEIGHT, frames, whole_stream);
+    REQUIRE(stats.frames == frames.size());
+    REQUIRE(whole_stream.bytes == encode_serially(images, 0, {}));
+
+    // A sink which throws stops the encoding.
+    stopping_sink stopped(2);
+    REQUIRE_THROWS_WITH(encode_frames(WIDTH, HEIGHT, frames, stopped), "stopped");
+    REQUIRE(stopped.frames_begun == 3);
+}
@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include "frame_diff.hpp"
+
+namespace gif {
+
+    image::rgb_image_view_t 
+    get_rect_view(const image::rgb_image_view_t& image_view, const frame_rect& rect) {
+        assert (rect.left + rect.width <= static_cast<std::size_t>(image_view.width()));
+        assert (rect.top + rect.height <= static_cast<std::size_t>(image_view.height()));
+        return boost::gil::subimage_view(image_view, rect.left, rect.top, rect.width, rect.height);
+    }
+
+    // Each pixel holds one byte per channel.
+    constexpr std::size_t BYTES_PER_PIXEL = 3;
+    static_assert(sizeof(image::rgb_pixel_t) == BYTES_PER_PIXEL);
+
+    // Returns a pointer to the first channel of row y of the image.
+    const uint8_t* row_bytes(const image::rgb_image_view_t& image_view, std::size_t y) {
+        return &image_view.row_begin(y)[0][0];
+    }
+
+    // Loads 8 bytes from an arbitrarily aligned address.
+    uint64_t load_word(const uint8_t* p) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        return word;
+    }
+
+    // Returns the index of the first byte in [0, size) at which the two
+    // byte arrays differ, or size if they do not differ.
+    std::size_t first_difference(const uint8_t* a, const uint8_t* b, std::size_t size) {
+        std::size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            auto difference = load_word(a + i) ^ load_word(b + i);
+            if (difference != 0) {
+                // On a little-endian machine the first byte in memory is the 
+                // least significant.
+                if constexpr (std::endian::native == std::endian::little) {
+                    return i + std::countr_zero(difference) / 8;
+                }
+                else {
+                    return i + std::countl_zero(difference) / 8;
+                }
+            }
+        }
+        for (; i < size; ++i) {
+            if (a[i] != b[i]) {
+                return i;
+            }
+        }
+        return size;
+    }
+
+    // Returns one more than the index of the last byte in [0, size) at 
+    // which the two byte arrays differ, or 0 if they do not differ.
+    std::size_t last_difference_end(const uint8_t* a, const uint8_t* b, std::size_t size) {
+        std::size_t end = size;
+        for (; end >= sizeof(uint64_t); end -= sizeof(uint64_t)) {
+            auto start = end - sizeof(uint64_t);
+            auto difference = load_word(a + start) ^ load_word(b + start);
+            if (difference != 0) {
+                if constexpr (std::endian::native == std::endian::little) {
+                    return end - std::countl_zero(difference) / 8;
+                }
+                else {
+                    return end - std::countr_zero(difference) / 8;
+                }
+            }
+        }
+        for (; end > 0; --end) {
+            if (a[end - 1] != b[end - 1]) {
+                return end;
+            }
+        }
+        return 0;
+    }
+
+    std::optional<frame_rect> find_changed_rect(const image::rgb_image_view_t& before,
+                                                const image::rgb_image_view_t& after) {
+        assert (before.dimensions() == after.dimensions());
+
+        std::size_t width = before.width();
+        std::size_t height = before.height();
+        std::size_t row_size = width * BYTES_PER_PIXEL;
+
+        // The rectangle is tracked as the half-open ranges [left, right) 
+        // and [top, bottom). It starts out empty, with left > right.
+        std::size_t left = width;
+        std::size_t right = 0;
+        std::optional<std::size_t> top;
+        std::size_t bottom = 0;
+
+        for (std::size_t y = 0; y < height; ++y) {
+            auto before_row = row_bytes(before, y);
+            auto after_row = row_bytes(after, y);
+            if (std::memcmp(before_row, after_row, row_size) == 0) {
+                continue;
+            }
+
+            if (!top.has_value()) {
+                top = y;
+            }
+            bottom = y + 1;
+
+            // Only the columns outside [left, right) can grow the rectangle.
+            if (left > 0) {
+                auto scan_bytes = left * BYTES_PER_PIXEL;
+                auto index = first_difference(before_row, after_row, scan_bytes);
+                if (index < scan_bytes) {
+                    left = index / BYTES_PER_PIXEL;
+                }
+            }
+            if (right < width) {
+                auto scan_start = std::max(right, left) * BYTES_PER_PIXEL;
+                auto end = last_difference_end(
+                    before_row + scan_start, after_row + scan_start, row_size - scan_start
+                );
+                if (end > 0) {
+                    right = (scan_start + end + BYTES_PER_PIXEL - 1) / BYTES_PER_PIXEL;
+                }
+            }
+        }
+
+        if (!top.has_value()) {
+            return std::nullopt;
+        }
+
+        assert (left < right);
+        assert (*top < bottom);
+        return frame_rect { left, *top, right - left, bottom - *top };
+    }
+
+    std::size_t find_unchanged_pixels(const image::rgb_image_view_t& before,
+                                      const image::rgb_image_view_t& after,
+                                      uint8_t tolerance,
+                                      image::pixel_mask& unchanged) {
+        assert (before.dimensions() == after.dimensions());
+
+        std::size_t width = before.width();
+        std::size_t height = before.height();
+        unchanged.resize(width * height);
+
+        // The loops are written over plain bytes so that the compiler can 
+        // vectorize them.
+        std::size_t unchanged_count = 0;
+        auto mask_it = unchanged.begin();
+        for (std::size_t y = 0; y < height; ++y) {
+            auto before_row = row_bytes(before, y);
+            auto after_row = row_bytes(after, y);
+            for (std::size_t x = 0; x < width; ++x) {
+                uint8_t max_difference = 0;
+                for (std::size_t c = 0; c < BYTES_PER_PIXEL; ++c) {
+                    auto b = before_row[BYTES_PER_PIXEL * x + c];
+                    auto a = after_row[BYTES_PER_PIXEL * x + c];
+                    uint8_t difference = std::max(a, b) - std::min(a, b);
+                    max_difference = std::max(max_difference, difference);
+                }
+
+                bool is_unchanged = max_difference <= tolerance;
+                *mask_it++ = is_unchanged;
+                unchanged_count += is_unchanged;
+            }
+        }
+
+        return unchanged_count;
+    }
+
+    // Answers whether no channel of the two rows differs by more than 
+    // tolerance.
+    bool rows_match(const uint8_t* a, const uint8_t* b, std::size_t size, uint8_t tolerance) {
+        if (tolerance == 0) {
+            return std::memcmp(a, b, size) == 0;
+        }
+
+        // Collect the differences instead of returning early so that the
+        // loop can be vectorized.
+        uint8_t max_difference = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            uint8_t difference = std::max(a[i], b[i]) - std::min(a[i], b[i]);
+            max_difference = std::max(max_difference, difference);
+        }
+        return max_difference <= tolerance;
+    }
+
+    bool frames_match(const image::rgb_image_view_t& before,
+                      const image::rgb_image_view_t& after,
+                      uint8_t tolerance) {
+        assert (before.dimensions() == after.dimensions());
+
+        std::size_t row_size = BYTES_PER_PIXEL * before.width();
+        for (std::size_t y = 0; y < static_cast<std::size_t>(before.height()); ++y) {
+            if (!rows_match(row_bytes(before, y), row_bytes(after, y), row_size, tolerance)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Mixes the bits of a word so that every input bit affects every 
+    // output bit. This is the finalizer of MurmurHash3.
+    uint64_t mix_word(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    uint64_t hash_frame(const image::rgb_image_view_t& image_view) {
+        constexpr uint64_t MULTIPLIER = 0x9e3779b97f4a7c15ull;
+        constexpr std::size_t WORD_SIZE = sizeof(uint64_t);
+
+        std::size_t width = image_view.width();
+        std::size_t height = image_view.height();
+        std::size_t row_size = BYTES_PER_PIXEL * width;
+
+        // Each word is folded into the hash with a multiply and a rotate,
+        // which is cheap compared to reading the word from memory.
+        uint64_t h = mix_word((uint64_t(width) << 32) | height);
+        for (std::size_t y = 0; y < height; ++y) {
+            auto row = row_bytes(image_view, y);
+
+            std::size_t i = 0;
+            for (; i + WORD_SIZE <= row_size; i += WORD_SIZE) {
+                h = std::rotl((h ^ load_word(row + i)) * MULTIPLIER, 29);
+            }
+
+            uint64_t tail = 0;
+            std::memcpy(&tail, row + i, row_size - i);
+            h = std::rotl((h ^ tail) * MULTIPLIER, 29);
+        }
+
+        return mix_word(h);
+    }
+}
@@ -4,12 +4,20 @@
 namespace gif {
 
     gif_block_buffer::gif_block_buffer(std::ostream& out) : 
-            out_file(out), 
+            out_file(&out), 
+            out_string(nullptr),
             buffer() {
         // Ensure the size is zero to start with
         buffer.at(0) = 0;
     }
 
+    gif_block_buffer::gif_block_buffer(std::pmr::string& out) : 
+            out_file(nullptr), 
+            out_string(&out),
+            buffer() {
+        buffer.at(0) = 0;
+    }
+
     gif_block_buffer::~gif_block_buffer() {
         if (current_block_size() > 0) {
             write_current_block();
@@ -40,7 +48,12 @@ namespace gif {
         // The size is stored in the buffer already so we don't
         // need to update it before writing.
         auto bytes = current_block_size() + 1;
-        out_file.write(buffer.begin(), bytes);
+        if (out_string) {
+            out_string->append(buffer.data(), bytes);
+        }
+        else {
+            out_file->write(buffer.data(), bytes);
+        }
 
         // Reset the size to 0
         buffer.at(0) = 0;
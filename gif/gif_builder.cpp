@@ -1,8 +1,13 @@
 #include "gif_builder.hpp"
+#include "gif_block_buffer.hpp"
 #include "gif_data_format.hpp"
 #include "lzw.hpp"
+#include "task_pool.hpp"
+#include <algorithm>
+#include <array>
 #include <cassert>
-#include <iostream>
+#include <cmath>
+#include <streambuf>
 
 namespace gif {
 
@@ -15,47 +20,87 @@ namespace gif {
         return std::make_pair(lsb, msb);
     }
 
-    void gif_builder::write(const std::vector<char>& v) {
-        assert (v.size() > 0);
-        out_file.write(v.data(), v.size());
+    // Helper to write the contents of a fixed-size block downstream.
+    template<std::size_t N>
+    void write(std::ostream& out, const std::array<char, N>& block) {
+        static_assert (N > 0);
+        out.write(block.data(), block.size());
     }
 
+    // A stream buffer which appends everything written to it to a string,
+    // so that blocks can be assembled in memory and written out at once.
+    class string_append_buffer : public std::streambuf {
+    public:
+        explicit string_append_buffer(std::pmr::string& s) : target(s) {}
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                target.push_back(traits_type::to_char_type(c));
+            }
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize xsputn(const char* s, std::streamsize count) override {
+            target.append(s, static_cast<std::size_t>(count));
+            return count;
+        }
 
-    void gif_builder::write_gif_header() {
-        out_file << "GIF89a";
+    private:
+        std::pmr::string& target;
+    };
+
+    // Returns the color table as it should be written to the stream. When
+    // transparency is enabled, a placeholder entry is added for the 
+    // transparent color. Its value is never displayed.
+    palettize::color_table gif_builder::with_transparent_entry(const palettize::color_table& palette) const {
+        auto color_table = palette;
+        if (options.transparency_tolerance.has_value()) {
+            color_table.add_color(image::rgb_pixel_t(0, 0, 0));
+        }
+        return color_table;
     }
 
-    void gif_builder::write_screen_descriptor() {
+    void gif_builder::write_gif_header(std::ostream& out) const {
+        out << "GIF89a";
+    }
+
+    void gif_builder::write_screen_descriptor(std::ostream& out) const {
         // Break dimension values into bytes
         auto [width_lsb, width_msb] = split_numeric_field(width);
         auto [height_lsb, height_msb] = split_numeric_field(height);
 
+        // The packed byte describes the global color table, if there is one.
+        char packed_byte = options.global_palette.has_value()
+            ? get_screen_descriptor_packed_byte(with_transparent_entry(*options.global_palette).min_bit_depth())
+            : SCREEN_DESCRIPTOR_PACKED_BYTE;
+
         // Construct the block and write it to the file
-        std::vector<char> screen_descriptor_block {
+        std::array<char, SCREEN_DESCRIPTOR_SIZE> screen_descriptor_block {
             width_lsb, width_msb,
             height_lsb, height_msb,
-            SCREEN_DESCRIPTOR_PACKED_BYTE,
+            packed_byte,
             0x00, // Background color. Not used. 
             0x00  // Pixel aspect ratio. Not used.
         };
 
-        assert (screen_descriptor_block.size() == SCREEN_DESCRIPTOR_SIZE);
-        write(screen_descriptor_block);
+        write(out, screen_descriptor_block);
     }
 
     // The NETSCAPE2.0 extension is used to control looping
     // behaviour and appears once in the stream.
-    void gif_builder::write_netscape_extension() {
+    void gif_builder::write_netscape_extension(std::ostream& out) const {
     
-        std::vector<char> netscape_block_header {
+        std::array<char, 2> netscape_block_header {
             static_cast<char>(EXTENSION_INTRO_BYTE),
             static_cast<char>(NETSCAPE_EXT_LABEL_BYTE)
         };
-        write(netscape_block_header);
+        write(out, netscape_block_header);
 
-        // The netscape block uses data sub-blocks, so we use the 
+        // The netscape block uses data sub-blocks, so we use a 
         // block buffer to handle the minutiae. The first block 
         // holds the signature.
+        gif_block_buffer block_buffer(out);
         for (const char c : NETSCAPE_EXT_SIGNATURE) {
             block_buffer << c;
         }
@@ -74,66 +119,76 @@ namespace gif {
 
 
     // Writes the extension block used for graphics enhancements.
-    // Our sole use case for this block is to enable delays between
-    // frames.
-    void gif_builder::write_graphics_control_ext() {
+    // We use this block to enable delays between frames, to keep 
+    // each frame on the canvas beneath its successor in delta and
+    // transparency modes, and to mark the transparent color.
+    void gif_builder::write_graphics_control_ext(
+            std::ostream& out,
+            std::optional<palettize::color_table::index_type> transparent_index) const {
         auto [delay_lsb, delay_msb] = split_numeric_field(delay);
 
-        std::vector<char> graphics_block {
+        auto disposal = options.delta_frames || options.transparency_tolerance.has_value()
+                      ? disposal_method::do_not_dispose 
+                      : disposal_method::unspecified;
+        auto packed_byte = get_graphic_control_packed_byte(disposal, transparent_index.has_value());
+
+        std::array<char, GRAPHIC_CONTROL_BLOCK_SIZE> graphics_block {
             static_cast<char>(EXTENSION_INTRO_BYTE),
             static_cast<char>(GRAPHIC_CONTROL_LABEL_BYTE),
             static_cast<char>(GRAPHIC_CONTROL_SUB_BLOCK_SIZE),
-            static_cast<char>(GRAPHIC_CONTROL_BLOCK_PACKED_BYTE),
+            static_cast<char>(packed_byte),
             delay_lsb, delay_msb,
-            0x00, // Transparent color index. Not used.
+            static_cast<char>(transparent_index.value_or(0)),
             0x00, // End-of-block marker
         };
-
-        assert (graphics_block.size() == GRAPHIC_CONTROL_BLOCK_SIZE);
-        write(graphics_block);
+        write(out, graphics_block);
     }
 
-    void gif_builder::write_image_descriptor(const image::rgb_image_view_t& image_view,
-                                             const palettize::color_table& local_color_table) {
-        // Break dimension values into bytes
-        auto image_width = image_view.width();
-        auto image_height = image_view.height();
-        
-        assert (image_width == width);
-        assert (image_height == height);
+    // The local color table is null for frames which use the global color table.
+    void gif_builder::write_image_descriptor(std::ostream& out, 
+                                             const frame_rect& rect,
+                                             const palettize::color_table* local_color_table) const {
+        assert (rect.left + rect.width <= width);
+        assert (rect.top + rect.height <= height);
 
-        auto [width_lsb, width_msb] = split_numeric_field(image_width);
-        auto [height_lsb, height_msb] = split_numeric_field(image_height);
+        // Break position and dimension values into bytes
+        auto [left_lsb, left_msb] = split_numeric_field(rect.left);
+        auto [top_lsb, top_msb] = split_numeric_field(rect.top);
+        auto [width_lsb, width_msb] = split_numeric_field(rect.width);
+        auto [height_lsb, height_msb] = split_numeric_field(rect.height);
 
         // Pack the color bit fields into a byte. See the GIF spec
         // for more information.
-        auto bit_depth = local_color_table.min_bit_depth();
-        char color_bit_fields = get_image_descriptor_packed_byte(bit_depth);
+        char color_bit_fields = local_color_table 
+            ? get_image_descriptor_packed_byte(local_color_table->min_bit_depth())
+            : IMAGE_DESCRIPTOR_PACKED_BYTE_NO_LOCAL_TABLE;
 
         // Construct the block and write it to the file
-        std::vector<char> image_descriptor_block {
+        std::array<char, IMAGE_DESCRIPTOR_SIZE> image_descriptor_block {
             IMAGE_SEPARATOR_BYTE,
-            0x00, 0x00, // Left offset
-            0x00, 0x00, // Top offset
+            left_lsb, left_msb,
+            top_lsb, top_msb,
             width_lsb, width_msb,
             height_lsb, height_msb,
             color_bit_fields
         };
-
-        assert (image_descriptor_block.size() == IMAGE_DESCRIPTOR_SIZE);
-        write(image_descriptor_block);
+        write(out, image_descriptor_block);
     }
 
-    void gif_builder::write_local_color_table(const palettize::color_table& local_color_table) {
+    // Writes a global or local color table. The two are formatted identically.
+    void gif_builder::write_color_table(std::ostream& out, const palettize::color_table& color_table) const {
+        assert (color_table.size() > 0);
+
         // We might have any number of colors in the palette up to 256, but the
         // size of the block is encoded as a power of 2, so we must round up to
-        // the next power of 2.
-        auto encoded_block_size = 1u << local_color_table.min_bit_depth();
+        // the next power of 2. The unused entries are left black.
+        auto encoded_block_size = 1u << color_table.min_bit_depth();
         auto block_size = encoded_block_size * 3; // 3 bytes per color
-        std::vector<char> color_table_block(block_size);
+        std::array<char, 256 * 3> color_table_block {};
+        assert (block_size <= color_table_block.size());
 
-        for (std::size_t i = 0; i < local_color_table.size(); ++i) {
-            auto pixel = local_color_table.at(i);
+        for (std::size_t i = 0; i < color_table.size(); ++i) {
+            auto pixel = color_table.at(i);
             char r = static_cast<char>(pixel[0]);
             char g = static_cast<char>(pixel[1]);
             char b = static_cast<char>(pixel[2]);
@@ -144,30 +199,90 @@ namespace gif {
             color_table_block.at(block_index + 2) = b;
         }
 
-        assert (color_table_block.size() == block_size);
-        write(color_table_block);
+        out.write(color_table_block.data(), block_size);
     }
 
-    // Encodes the image as LZW-compressed color table indices, packages up the
-    // resulting codes into sub-blocks, and writes those blocks to the output file.
-    void gif_builder::write_image_data(const image::rgb_image_view_t& image_view,
-                                       const palettize::color_table& local_color_table) {
-        std::cout << "\tLZW-encoding image data" << std::endl;
+    // The number of color table indices which are mapped at once before
+    // they are compressed. The buffer stays in the cache while the LZW 
+    // encoder reads it back.
+    constexpr std::size_t INDEX_CHUNK_SIZE = 1 << 14;
+
+    // The number of chunks which are mapped together, one per task, in 
+    // images which are larger than a chunk.
+    constexpr std::size_t CHUNKS_PER_BATCH = 8;
+
+    // Maps the pixels of the image to color table indices a few rows at a
+    // time, and feeds each chunk of indices to the LZW encoder as soon as
+    // it is mapped. Excluded pixels are given the index just past the end 
+    // of the palette.
+    //
+    // LZW compression is serial, but mapping is not. In an image which is
+    // larger than a chunk, the chunks are mapped in batches on the pool, 
+    // and the next batch is mapped while the encoder consumes the current
+    // one, so that a large still image is not mapped on a single thread.
+    template<class Encoder>
+    void encode_pixels(Encoder& encoder, 
+                       const image::rgb_image_view_t& image_view, 
+                       const palettize::color_table& color_table, 
+                       const image::pixel_mask* excluded,
+                       std::pmr::vector<uint8_t>& chunk) {
+        std::size_t w = image_view.width();
+        std::size_t h = image_view.height();
+        std::size_t chunk_rows = std::max<std::size_t>(1, INDEX_CHUNK_SIZE / std::max<std::size_t>(1, w));
+        if (h <= chunk_rows) {
+            chunk.resize(h * w);
+            palettize::palettize_rows(image_view, color_table, 0, h, chunk.data(), excluded, color_table.size());
+            encoder.encode(chunk.begin(), chunk.end());
+            return;
+        }
+
+        // The batches alternate between the two halves of the buffer.
+        std::size_t batch_rows = chunk_rows * CHUNKS_PER_BATCH;
+        chunk.resize(2 * batch_rows * w);
+        auto batch_indices = [&](std::size_t first_row) {
+            return chunk.data() + (first_row / batch_rows % 2) * batch_rows * w;
+        };
+        auto map_batch = [&](std::size_t first_row) {
+            auto indices = batch_indices(first_row);
+            runtime::parallel_for(first_row, std::min(h, first_row + batch_rows), chunk_rows, 
+                                  [&](std::size_t first, std::size_t end) {
+                palettize::palettize_rows(image_view, color_table, first, end, 
+                                          indices + (first - first_row) * w, excluded, color_table.size());
+            });
+        };
+
+        map_batch(0);
+        for (std::size_t first_row = 0; first_row < h; first_row += batch_rows) {
+            runtime::task_group next_batch;
+            auto next_row = first_row + batch_rows;
+            if (next_row < h) {
+                next_batch.run([&map_batch, next_row]() { map_batch(next_row); });
+            }
+            auto indices = batch_indices(first_row);
+            encoder.encode(indices, indices + (std::min(h, next_row) - first_row) * w);
+            next_batch.wait();
+        }
+    }
 
+    // LZW-compresses the color table indices of an image, packages up the
+    // resulting codes into sub-blocks, and appends those blocks to the 
+    // output. The indices are never held for the whole image.
+    void gif_builder::write_image_data(std::pmr::string& out, 
+                                       const image::rgb_image_view_t& image_view,
+                                       const palettize::color_table& color_table,
+                                       const image::pixel_mask* excluded,
+                                       std::pmr::memory_resource* memory) const {
         // The first byte of the image block tells the decoder how many bits
         // to use for its LZW dictionary.
-        out_file << LZW_CODE_SIZE;
+        out.push_back(static_cast<char>(LZW_CODE_SIZE));
 
         // The remainder of the image block is made up of data sub-blocks full
-        // of LZW-compressed image data. The image data must first be encoded
-        // as color table indices. Then, we can set the LZW encoder to forward
-        // directly to a buffer that packs the sub-blocks appropriately.
-        auto index_list = palettize::palettize_image(image_view, local_color_table);
-
-        // The block buffer should never have anything left overfrom  previous frames.
-        assert (block_buffer.current_block_size() == 0);
+        // of LZW-compressed image data. The LZW encoder forwards directly to 
+        // a buffer that packs the sub-blocks appropriately.
+        gif_block_buffer block_buffer(out);
         lzw::lzw_encoder encoder(LZW_CODE_SIZE, block_buffer); 
-        encoder.encode(index_list.begin(), index_list.end());
+        std::pmr::vector<uint8_t> chunk(memory);
+        encode_pixels(encoder, image_view, color_table, excluded, chunk);
         encoder.flush();
 
         // Write out any remaining data from the buffer in a smaller
@@ -181,57 +296,538 @@ namespace gif {
         block_buffer.write_current_block();
     }
 
-    void gif_builder::write_gif_trailer() {
-        out_file << GIF_TRAILER_BYTE;
+    void gif_builder::write_gif_trailer(std::ostream& out) const {
+        out << GIF_TRAILER_BYTE;
+    }
+
+    // When transparency is enabled, one entry of every color table is 
+    // reserved for the transparent color.
+    palettize::color_table gif_builder::create_color_table(const image::rgb_image_view_t& image_view,
+                                                          const image::pixel_mask* excluded,
+                                                          std::pmr::memory_resource* memory) const {
+        auto max_colors = palettize::color_table::max_size();
+        if (options.transparency_tolerance.has_value()) {
+            --max_colors;
+        }
+
+        if (excluded) {
+            return palettize::create_color_table(image_view, *excluded, max_colors, memory);
+        }
+        else if (max_colors < palettize::color_table::max_size()) {
+            image::pixel_mask none_excluded(image_view.size(), 0);
+            return palettize::create_color_table(image_view, none_excluded, max_colors, memory);
+        }
+        else {
+            return palettize::create_color_table(image_view, memory);
+        }
+    }
+
+    // Re-using a palette is only worthwhile if the frame's colors are close
+    // to those of the frame that the palette was made for. Comparing against
+    // that frame rather than the previous one prevents a slow drift in colors
+    // from going unnoticed.
+    //
+    // New palettes are only created when the frame is mapped, so that this
+    // expensive step can run on several frames at once.
+    void gif_builder::choose_color_table(frame_job& frame) {
+        auto create_palette = [this, &frame]() {
+            frame.palette_to_create.emplace(std::allocator_arg, 
+                                            std::pmr::polymorphic_allocator<char>(&palette_memory));
+            frame.local_palette = frame.palette_to_create->get_future().share();
+        };
+
+        if (!options.reuse_palettes) {
+            create_palette();
+            return;
+        }
+
+        auto histogram = palettize::compute_coarse_histogram(frame.rect_view);
+        if (reference_palette.has_value() && 
+            palettize::histogram_distance(histogram, reference_histogram) <= options.palette_reuse_threshold) {
+            ++frame_stats.palettes_reused;
+            frame.local_palette = *reference_palette;
+            return;
+        }
+
+        // A frame whose pixels are all transparent has an empty palette,
+        // which cannot be re-used by other frames.
+        create_palette();
+        const auto& transparent_pixels = frame.transparent_pixels;
+        bool all_transparent = transparent_pixels.has_value() && 
+            std::find(transparent_pixels->begin(), transparent_pixels->end(), 0) == transparent_pixels->end();
+        if (!all_transparent) {
+            reference_palette = frame.local_palette;
+            reference_histogram = histogram;
+        }
+    }
+
+    // Frames which are poorly represented by the global palette may be 
+    // given a local color table instead, if the options allow it.
+    bool gif_builder::use_global_palette(const image::rgb_image_view_t& image_view) const {
+        if (!options.global_palette.has_value()) {
+            return false;
+        }
+        else if (!options.local_palette_threshold.has_value()) {
+            return true;
+        }
+
+        // Sampling roughly 64K pixels is plenty to estimate the error.
+        constexpr std::size_t ERROR_SAMPLES = 1 << 16;
+        auto sample_step = std::max<std::size_t>(1, image_view.size() / ERROR_SAMPLES);
+        auto error = palettize::quantization_error(image_view, *options.global_palette, sample_step);
+        return error <= *options.local_palette_threshold;
+    }
+
+    const palettize::color_table& gif_builder::get_color_table(const frame_job& frame) const {
+        return frame.local_palette.has_value() 
+            ? frame.local_palette->get() 
+            : *options.global_palette;
+    }
+
+    // In delta mode, the first frame covers the whole canvas and every 
+    // later frame only covers the pixels that differ from the canvas.
+    frame_rect gif_builder::find_frame_rect(const image::rgb_image_view_t& image_view) {
+        assert (image_view.width() == width);
+        assert (image_view.height() == height);
+
+        frame_rect full_frame {0, 0, width, height};
+        if (!options.delta_frames || !has_canvas) {
+            return full_frame;
+        }
+
+        // Even an unchanged frame must hold some image data, so a single 
+        // pixel is re-encoded in that case.
+        auto canvas_view = boost::gil::view(canvas);
+        return find_changed_rect(canvas_view, image_view).value_or(frame_rect{0, 0, 1, 1});
+    }
+
+    void gif_builder::find_transparent_pixels(frame_job& frame) {
+        if (!options.transparency_tolerance.has_value() || !has_canvas) {
+            return;
+        }
+
+        auto canvas_rect_view = get_rect_view(boost::gil::view(canvas), frame.rect);
+        frame_stats.transparent_pixels += find_unchanged_pixels(
+            canvas_rect_view, frame.rect_view, *options.transparency_tolerance, 
+            frame.transparent_pixels.emplace(std::move(spare_mask))
+        );
+    }
+
+    // With a non-zero tolerance, transparent pixels may differ slightly from
+    // the canvas. The canvas keeps the displayed color so that small changes
+    // cannot accumulate unnoticed over many frames.
+    void gif_builder::update_canvas(const frame_job& frame) {
+        if (!options.delta_frames && !options.transparency_tolerance.has_value()) {
+            return;
+        }
+        else if (!has_canvas) {
+            assert (frame.rect == (frame_rect{0, 0, width, height}));
+            canvas.recreate(width, height);
+            has_canvas = true;
+        }
+
+        auto canvas_rect_view = get_rect_view(boost::gil::view(canvas), frame.rect);
+        if (!frame.transparent_pixels.has_value()) {
+            boost::gil::copy_pixels(frame.rect_view, canvas_rect_view);
+            return;
+        }
+
+        auto transparent_it = frame.transparent_pixels->begin();
+        auto canvas_it = canvas_rect_view.begin();
+        for (const auto& pixel : frame.rect_view) {
+            if (!*transparent_it++) {
+                *canvas_it = pixel;
+            }
+            ++canvas_it;
+        }
+    }
+
+    bool gif_builder::coalesce_frame(const image::rgb_image_view_t& image_view) {
+        if (!options.coalesce_duplicates) {
+            return false;
+        }
+
+        bool exact = options.duplicate_tolerance == 0;
+        auto hash = exact ? hash_frame(image_view) : 0;
+
+        // The delay of a single frame cannot be extended past the largest 
+        // value its field can hold.
+        if (has_coalesce_reference && coalesce_delay + delay <= std::numeric_limits<uint16_t>::max()) {
+            // Frames whose hashes differ are rejected without comparing 
+            // them. Equal hashes are confirmed against the copy of the 
+            // frame, so that a collision never drops a frame.
+            bool duplicate = (!exact || hash == coalesce_hash) 
+                && frames_match(boost::gil::view(coalesce_image), image_view, options.duplicate_tolerance);
+
+            if (duplicate) {
+                coalesce_delay += delay;
+                return true;
+            }
+        }
+
+        coalesce_hash = hash;
+        coalesce_image.recreate(image_view.dimensions());
+        boost::gil::copy_pixels(image_view, boost::gil::view(coalesce_image));
+        has_coalesce_reference = true;
+        coalesce_delay = delay;
+        return false;
     }
 
-    gif_builder::gif_builder(std::ostream& out, std::size_t w, std::size_t h, std::size_t d) :
-            out_file(out), 
-            block_buffer(out_file),
+    void gif_builder::flush_pending_frame() {
+        if (!has_pending_frame) {
+            return;
+        }
+
+        // The frame starts with its graphic control extension.
+        if (pending_delay != delay) {
+            auto [delay_lsb, delay_msb] = split_numeric_field(static_cast<uint16_t>(pending_delay));
+            pending_frame.at(GRAPHIC_CONTROL_DELAY_OFFSET) = delay_lsb;
+            pending_frame.at(GRAPHIC_CONTROL_DELAY_OFFSET + 1) = delay_msb;
+        }
+
+        emit_frame(pending_frame, pending_added);
+        has_pending_frame = false;
+    }
+
+    void gif_builder::emit_frame(std::span<const char> data, std::chrono::steady_clock::time_point added) {
+        sink.on_frame_begin(frames_emitted);
+        sink.on_bytes(data);
+        sink.on_frame_end(frames_emitted, std::chrono::steady_clock::now() - added);
+        ++frames_emitted;
+    }
+
+    gif_builder::gif_builder(std::ostream& out, std::size_t w, std::size_t h, std::size_t d,
+                             const builder_options& opts) :
+            gif_builder(std::make_unique<ostream_sink>(out), nullptr, w, h, d, opts) {
+    }
+
+    gif_builder::gif_builder(gif_sink& s, std::size_t w, std::size_t h, std::size_t d,
+                             const builder_options& opts) :
+            gif_builder(nullptr, &s, w, h, d, opts) {
+    }
+
+    gif_builder::gif_builder(std::unique_ptr<gif_sink> owned, gif_sink* s, 
+                             std::size_t w, std::size_t h, std::size_t d,
+                             const builder_options& opts) :
+            owned_sink(std::move(owned)),
+            sink(s ? *s : *owned_sink),
             width(static_cast<uint16_t>(w)), 
             height(static_cast<uint16_t>(h)), 
             delay(static_cast<uint16_t>(d)),
-            stream_complete(false) {
+            stream_complete(false),
+            options(opts),
+            frame_stats(),
+            reference_palette(),
+            reference_histogram(),
+            canvas(),
+            has_canvas(false),
+            has_coalesce_reference(false),
+            coalesce_delay(0),
+            coalesce_hash(0),
+            coalesce_image(),
+            pending_frame(),
+            has_pending_frame(false),
+            pending_delay(0),
+            pending_added(),
+            frames_emitted(0) {
         // Verify pre-conditions
         assert (w > 0);
         assert (h > 0);
         assert (w <= std::numeric_limits<uint16_t>::max());
         assert (h <= std::numeric_limits<uint16_t>::max());
         assert (d <= std::numeric_limits<uint16_t>::max());
+        assert (options.palette_reuse_threshold >= 0);
+        assert (!options.global_palette.has_value() || 
+                !options.transparency_tolerance.has_value() ||
+                options.global_palette->size() < palettize::color_table::max_size());
 
         // Write the header and the one-time blocks that come before
-        // any frames.
-        write_gif_header();
-        write_screen_descriptor();
-        write_netscape_extension();
+        // any frames in one go.
+        std::pmr::string header;
+        string_append_buffer buffer(header);
+        std::ostream header_stream(&buffer);
+        write_gif_header(header_stream);
+        write_screen_descriptor(header_stream);
+        if (options.global_palette.has_value()) {
+            assert (options.global_palette->size() > 0);
+            write_color_table(header_stream, with_transparent_entry(*options.global_palette));
+        }
+        write_netscape_extension(header_stream);
+        sink.on_bytes(header);
+        sink.on_header_end();
+
+        // The first frame has no canvas to be transparent against, so the
+        // mask is sized here rather than when the second frame needs it.
+        if (options.transparency_tolerance.has_value()) {
+            spare_mask.reserve(std::size_t(width) * height);
+        }
     }
 
     gif_builder::~gif_builder() {
         if (!stream_complete)  {
-            complete_stream();
+            try {
+                complete_stream();
+            }
+            catch (...) {
+            }
         }
     }
 
+    // The arena is reset once the frame is finished as well as before it,
+    // so that it grows to fit the frame straight away rather than at the
+    // start of the next frame.
     gif_builder& gif_builder::add_frame(const image::rgb_image_view_t& image_view) {
-        // For each frame, we need to encode:
-        // 0. Graphics Control Extension
-        // 1. Image Descriptor
-        // 2. Local Color Table
-        // 3. Index-encoded, LZW-compressed image data
-        
-        write_graphics_control_ext();
-
-        auto color_palette = palettize::create_color_table(image_view);
-        write_image_descriptor(image_view, color_palette);
-        write_local_color_table(color_palette);
-        write_image_data(image_view, color_palette);
-        
+        arena.reset();
+        {
+            auto frame = prepare_frame(image_view, &arena);
+            map_frame(frame);
+            compress_frame(frame);
+            write_frame(frame);
+            if (frame.transparent_pixels.has_value()) {
+                spare_mask = std::move(*frame.transparent_pixels);
+            }
+        }
+        arena.reset();
+        return *this;
+    }
+
+    // Makes every decision about the frame which depends on earlier frames.
+    // Only the pixels inside the frame's rectangle are encoded, and of 
+    // those, pixels which match the canvas may be left transparent.
+    frame_job gif_builder::prepare_frame(const image::rgb_image_view_t& image_view, 
+                                         std::pmr::memory_resource* memory) {
+        assert (!stream_complete);
+
+        frame_job frame(memory);
+        frame.added = std::chrono::steady_clock::now();
+        ++frame_stats.frames;
+        if (coalesce_frame(image_view)) {
+            ++frame_stats.frames_coalesced;
+            frame.coalesced = true;
+            return frame;
+        }
+
+        frame.rect = find_frame_rect(image_view);
+        frame.rect_view = get_rect_view(image_view, frame.rect);
+        find_transparent_pixels(frame);
+        update_canvas(frame);
+
+        if (!use_global_palette(frame.rect_view)) {
+            choose_color_table(frame);
+            if (options.global_palette.has_value()) {
+                ++frame_stats.local_palettes;
+            }
+        }
+
+        frame_stats.pixels_encoded += frame.rect.width * frame.rect.height;
+        return frame;
+    }
+
+    // Creates the frame's palette if needed. The frame's pixels are mapped
+    // to indices into that palette as they are compressed.
+    void gif_builder::map_frame(frame_job& frame) const {
+        if (frame.coalesced) {
+            return;
+        }
+
+        const image::pixel_mask* transparent_pixels = frame.transparent_pixels.has_value() 
+            ? &*frame.transparent_pixels 
+            : nullptr;
+
+        // Frames waiting to re-use this palette must be told if it could 
+        // not be created.
+        if (frame.palette_to_create.has_value()) {
+            try {
+                frame.palette_to_create->set_value(create_color_table(frame.rect_view, transparent_pixels, frame.memory));
+            }
+            catch(...) {
+                frame.palette_to_create->set_exception(std::current_exception());
+                throw;
+            }
+        }
+    }
+
+    // For each frame, we need to encode:
+    // 0. Graphics Control Extension
+    // 1. Image Descriptor
+    // 2. Local Color Table, unless the global color table is used
+    // 3. Index-encoded, LZW-compressed image data
+    void gif_builder::compress_frame(frame_job& frame) const {
+        if (frame.coalesced) {
+            return;
+        }
+
+        // The transparent color is placed just past the end of the palette.
+        const auto& color_table = get_color_table(frame);
+        std::optional<palettize::color_table::index_type> transparent_index;
+        if (frame.transparent_pixels.has_value()) {
+            transparent_index = color_table.size();
+        }
+
+        string_append_buffer buffer(frame.encoded_data);
+        std::ostream out(&buffer);
+        write_graphics_control_ext(out, transparent_index);
+        if (frame.local_palette.has_value()) {
+            auto local_color_table = with_transparent_entry(color_table);
+            write_image_descriptor(out, frame.rect, &local_color_table);
+            write_color_table(out, local_color_table);
+        }
+        else {
+            write_image_descriptor(out, frame.rect, nullptr);
+        }
+        // Transparent pixels are given the index just past the end of the 
+        // palette.
+        const image::pixel_mask* transparent_pixels = frame.transparent_pixels.has_value() 
+            ? &*frame.transparent_pixels 
+            : nullptr;
+        write_image_data(frame.encoded_data, frame.rect_view, color_table, transparent_pixels, frame.memory);
+    }
+
+    // Without coalescing, the frame's delay is final and it can be written
+    // immediately.
+    void gif_builder::write_frame(frame_job& frame) {
+        assert (!stream_complete);
+
+        if (frame.coalesced) {
+            assert (has_pending_frame);
+            pending_delay += delay;
+            return;
+        }
+
+        flush_pending_frame();
+        if (options.coalesce_duplicates) {
+            // Compressed frames rarely take more than a byte per pixel, so
+            // with room for that, later frames seldom need more memory.
+            if (pending_frame.capacity() < frame.encoded_data.size()) {
+                pending_frame.reserve(std::max(frame.encoded_data.size(), std::size_t(width) * height));
+            }
+            pending_frame.assign(frame.encoded_data.data(), frame.encoded_data.size());
+            pending_delay = delay;
+            pending_added = frame.added;
+            has_pending_frame = true;
+        }
+        else {
+            emit_frame(frame.encoded_data, frame.added);
+        }
+    }
+
+    gif_builder& gif_builder::add_banded_frame(const band_source& source, std::size_t band_rows) {
+        assert (!stream_complete);
+        assert (band_rows > 0);
+        assert (!options.delta_frames);
+        assert (!options.transparency_tolerance.has_value());
+        assert (!options.reuse_palettes);
+        assert (!options.coalesce_duplicates);
+
+        auto added = std::chrono::steady_clock::now();
+        band_rows = std::min<std::size_t>(band_rows, height);
+        image::rgb_image_t band_image(width, band_rows);
+        auto band_view = boost::gil::view(band_image);
+        auto for_each_band = [&](const std::function<void(const image::rgb_image_view_t&)>& step) {
+            for (std::size_t top = 0; top < height; top += band_rows) {
+                auto rows = std::min<std::size_t>(band_rows, height - top);
+                auto band = boost::gil::subimage_view(band_view, 0, 0, width, rows);
+                source(top, band);
+                step(band);
+            }
+        };
+
+        // The first pass counts the colors of the frame and, if a local 
+        // palette threshold is set, the squared error of each band under
+        // the global palette. Both are sampled in the same way as for 
+        // whole frames.
+        std::size_t frame_pixels = std::size_t(width) * height;
+        bool use_global = options.global_palette.has_value() && !options.local_palette_threshold.has_value();
+        std::optional<palettize::color_table> local_palette;
+        if (!use_global) {
+            constexpr std::size_t ERROR_SAMPLES = 1 << 16;
+            auto histogram_step = std::max<std::size_t>(1, frame_pixels / MAX_BANDED_HISTOGRAM_PIXELS);
+            auto error_step = std::max<std::size_t>(1, frame_pixels / ERROR_SAMPLES);
+            bool check_error = options.global_palette.has_value();
+
+            palettize::multi_frame_histogram histogram;
+            double squared_error = 0;
+            std::size_t error_samples = 0;
+            for_each_band([&](const image::rgb_image_view_t& band) {
+                histogram.add_frame(band, histogram_step);
+                if (check_error) {
+                    auto band_error = palettize::quantization_error(band, *options.global_palette, error_step);
+                    auto band_samples = (band.size() + error_step - 1) / error_step;
+                    squared_error += band_error * band_error * band_samples;
+                    error_samples += band_samples;
+                }
+            });
+
+            use_global = check_error && 
+                std::sqrt(squared_error / error_samples) <= *options.local_palette_threshold;
+            if (!use_global) {
+                local_palette = histogram.create_color_table();
+                if (options.global_palette.has_value()) {
+                    ++frame_stats.local_palettes;
+                }
+            }
+        }
+
+        ++frame_stats.frames;
+        frame_stats.pixels_encoded += frame_pixels;
+        flush_pending_frame();
+
+        // The second pass encodes the frame as write_image_data does, but
+        // one band at a time. The output of each band is assembled in 
+        // memory and written at once, so that only a band's worth of the
+        // frame is held.
+        const auto& color_table = local_palette.has_value() ? *local_palette : *options.global_palette;
+        frame_rect full_frame {0, 0, width, height};
+        std::pmr::string output;
+        string_append_buffer buffer(output);
+        std::ostream out(&buffer);
+        write_graphics_control_ext(out, std::nullopt);
+        write_image_descriptor(out, full_frame, local_palette.has_value() ? &*local_palette : nullptr);
+        if (local_palette.has_value()) {
+            write_color_table(out, *local_palette);
+        }
+        output.push_back(static_cast<char>(LZW_CODE_SIZE));
+
+        auto write_output = [this, &output]() {
+            sink.on_bytes(output);
+            output.clear();
+        };
+
+        sink.on_frame_begin(frames_emitted);
+        gif_block_buffer block_buffer(output);
+        lzw::lzw_encoder encoder(LZW_CODE_SIZE, block_buffer);
+        std::pmr::vector<uint8_t> chunk;
+        for_each_band([&](const image::rgb_image_view_t& band) {
+            encode_pixels(encoder, band, color_table, nullptr, chunk);
+            write_output();
+        });
+        encoder.flush();
+
+        if (block_buffer.current_block_size() > 0) {
+            block_buffer.write_current_block();
+        }
+        assert (block_buffer.current_block_size() == 0);
+        block_buffer.write_current_block();
+        write_output();
+        sink.on_frame_end(frames_emitted, std::chrono::steady_clock::now() - added);
+        ++frames_emitted;
         return *this;
     }
 
     void gif_builder::complete_stream() {
         assert (!stream_complete);
         stream_complete = true;
-        write_gif_trailer();
+        flush_pending_frame();
+
+        std::pmr::string trailer;
+        string_append_buffer buffer(trailer);
+        std::ostream trailer_stream(&buffer);
+        write_gif_trailer(trailer_stream);
+        sink.on_bytes(trailer);
+        sink.on_stream_end();
+    }
+
+    const builder_stats& gif_builder::stats() const {
+        return frame_stats;
     }
 }
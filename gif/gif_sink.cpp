@@ -0,0 +1,66 @@
+#include "gif_sink.hpp"
+#include "gif_data_format.hpp"
+
+namespace gif {
+
+    void gif_sink::on_header_end() {
+    }
+
+    void gif_sink::on_frame_begin(std::size_t) {
+    }
+
+    void gif_sink::on_frame_end(std::size_t, std::chrono::nanoseconds) {
+    }
+
+    void gif_sink::on_stream_end() {
+    }
+
+    ostream_sink::ostream_sink(std::ostream& out) :
+            out_file(out) {
+    }
+
+    void ostream_sink::on_bytes(std::span<const char> bytes) {
+        out_file.write(bytes.data(), bytes.size());
+    }
+
+    provisional_trailer_sink::provisional_trailer_sink(std::ostream& out) :
+            out_file(out),
+            has_trailer(false) {
+    }
+
+    void provisional_trailer_sink::on_bytes(std::span<const char> bytes) {
+        if (has_trailer) {
+            out_file.seekp(-1, std::ios::cur);
+            has_trailer = false;
+        }
+        out_file.write(bytes.data(), bytes.size());
+    }
+
+    void provisional_trailer_sink::write_trailer() {
+        out_file.put(static_cast<char>(GIF_TRAILER_BYTE));
+        out_file.flush();
+        has_trailer = true;
+    }
+
+    void provisional_trailer_sink::on_header_end() {
+        write_trailer();
+    }
+
+    void provisional_trailer_sink::on_frame_end(std::size_t, std::chrono::nanoseconds) {
+        write_trailer();
+    }
+
+    // The builder has written the real trailer over the provisional one.
+    void provisional_trailer_sink::on_stream_end() {
+        out_file.flush();
+    }
+
+    vector_sink::vector_sink(std::vector<uint8_t>& out) :
+            out_bytes(out) {
+    }
+
+    void vector_sink::on_bytes(std::span<const char> bytes) {
+        auto first = reinterpret_cast<const uint8_t*>(bytes.data());
+        out_bytes.insert(out_bytes.end(), first, first + bytes.size());
+    }
+}
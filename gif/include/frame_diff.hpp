@@ -0,0 +1,56 @@
+#ifndef FRAME_DIFF_HPP
+#define FRAME_DIFF_HPP
+
+#include <cstdint>
+#include <optional>
+#include "image_utils.hpp"
+
+namespace gif {
+
+    // A rectangular region of the GIF canvas, measured in pixels.
+    struct frame_rect {
+        std::size_t left;
+        std::size_t top;
+        std::size_t width;
+        std::size_t height;
+
+        bool operator==(const frame_rect&) const = default;
+    };
+
+    // Returns a view of the part of the image covered by rect.
+    image::rgb_image_view_t 
+    get_rect_view(const image::rgb_image_view_t& image_view, const frame_rect& rect);
+
+    // Finds the smallest rectangle which contains every pixel that differs
+    // between two images of the same size. Returns an empty optional if the
+    // images are identical.
+    //
+    // Unchanged rows are skipped using memcmp, which the C library 
+    // vectorizes. Within changed rows, only the columns outside the 
+    // rectangle found so far are scanned, one 64-bit word at a time.
+    std::optional<frame_rect> find_changed_rect(const image::rgb_image_view_t& before,
+                                                const image::rgb_image_view_t& after);
+
+    // Flags the pixels of two images of the same size which are unchanged,
+    // meaning that no channel differs by more than tolerance. The mask is
+    // resized to hold one entry per pixel. Returns the number of unchanged
+    // pixels.
+    std::size_t find_unchanged_pixels(const image::rgb_image_view_t& before,
+                                      const image::rgb_image_view_t& after,
+                                      uint8_t tolerance,
+                                      image::pixel_mask& unchanged);
+
+    // Answers whether every pixel of two images of the same size is 
+    // unchanged, meaning that no channel differs by more than tolerance.
+    // Returns as soon as a changed row is found.
+    bool frames_match(const image::rgb_image_view_t& before,
+                      const image::rgb_image_view_t& after,
+                      uint8_t tolerance);
+
+    // Computes a 64-bit hash of the image's pixels, reading them one word
+    // at a time. Identical images have equal hashes, and the chance of two
+    // different images colliding is negligible for our purposes.
+    uint64_t hash_frame(const image::rgb_image_view_t& image_view);
+}
+
+#endif
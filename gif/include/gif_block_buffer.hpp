@@ -2,7 +2,9 @@
 #define GIF_BLOCK_BUFFER_HPP
 
 #include <array>
+#include <memory_resource>
 #include <ostream>
+#include <string>
 #include <cstdlib>
 #include "gif_data_format.hpp"
 
@@ -21,6 +23,11 @@ namespace gif {
         // written to the provided output stream. 
         gif_block_buffer(std::ostream& out);
 
+        // Construct a new gif_block_buffer whose output will be 
+        // appended to the provided string. This avoids a stream write
+        // for every sub-block when a whole frame is assembled in memory.
+        gif_block_buffer(std::pmr::string& out);
+
         // Buffers are neither copyable nor moveable.
         gif_block_buffer(const gif_block_buffer&) = delete;
         gif_block_buffer& operator=(const gif_block_buffer&) = delete;
@@ -52,7 +59,9 @@ namespace gif {
         static constexpr std::size_t SUB_BLOCK_BUFFER_SIZE 
                                         = MAX_IMAGE_SUB_BLOCK_SIZE + 1;
 
-        std::ostream& out_file;
+        // Exactly one of these is set.
+        std::ostream* out_file;
+        std::pmr::string* out_string;
         std::array<char, SUB_BLOCK_BUFFER_SIZE> buffer;
     };
 
@@ -1,17 +1,152 @@
 #ifndef GIF_BUILDER_HPP
 #define GIF_BUILDER_HPP
 
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <ostream>
+#include <span>
+#include <string>
+#include <vector>
 #include "image_utils.hpp"
-#include "gif_block_buffer.hpp"
+#include "frame_diff.hpp"
+#include "gif_sink.hpp"
 #include "palettize.hpp"
+#include "frame_arena.hpp"
 
 namespace gif {
 
+    // Optional encoding behaviours for a gif_builder. The defaults 
+    // encode every frame independently of the others.
+    struct builder_options {
+        // When set, a frame is encoded with the color table of an earlier
+        // frame unless a scene change is detected. The table is rebuilt when
+        // the frame's colors differ from those of the frame that the table
+        // was created for by more than palette_reuse_threshold, as measured
+        // by palettize::histogram_distance.
+        bool reuse_palettes = false;
+        double palette_reuse_threshold = 0.05;
+
+        // When set, this color table is written once as the global color
+        // table and frames are encoded with it instead of local tables.
+        std::optional<palettize::color_table> global_palette;
+
+        // In global palette mode, a frame is given its own local color 
+        // table if its quantization error under the global palette exceeds
+        // this value (see palettize::quantization_error). If unset, every 
+        // frame uses the global palette.
+        std::optional<double> local_palette_threshold;
+
+        // When set, only the smallest rectangle containing every pixel that
+        // changed since the previous frame is encoded. Frames are displayed
+        // over their predecessors rather than replacing them.
+        bool delta_frames = false;
+
+        // When set, pixels which match the previously displayed frame, with
+        // no channel differing by more than the given tolerance, are encoded
+        // with a transparent color so that the previous frame shows through.
+        // One entry of every color table is reserved for the transparent 
+        // color, so palettes hold at most 255 colors. A global palette must
+        // leave room for this entry.
+        std::optional<uint8_t> transparency_tolerance;
+
+        // When set, a frame which duplicates the previously encoded frame is
+        // not encoded. Instead, the previous frame is displayed for longer.
+        // A copy of the previous frame is kept to compare frames with. 
+        // Exact duplicates are found by hashing, and confirmed against the
+        // copy. With a non-zero duplicate_tolerance, frames also count as 
+        // duplicates if no channel of any pixel differs by more than the 
+        // tolerance.
+        bool coalesce_duplicates = false;
+        uint8_t duplicate_tolerance = 0;
+    };
+
+    // Counters describing the work done by a gif_builder so far.
+    struct builder_stats {
+        // The number of frames added to the stream.
+        std::size_t frames = 0;
+
+        // The number of frames which re-used an earlier frame's palette.
+        std::size_t palettes_reused = 0;
+
+        // In global palette mode, the number of frames which were 
+        // given a local color table.
+        std::size_t local_palettes = 0;
+
+        // The number of pixels which were encoded across all frames. This
+        // is less than the area of all frames in delta mode.
+        std::size_t pixels_encoded = 0;
+
+        // The number of encoded pixels which were left transparent.
+        std::size_t transparent_pixels = 0;
+
+        // The number of frames which were merged into the previous frame
+        // as duplicates rather than being encoded.
+        std::size_t frames_coalesced = 0;
+    };
+
+    // A frame on its way through a gif_builder. Frames are first prepared
+    // by gif_builder::prepare_frame, in frame order. Prepared frames then
+    // have their color table created by map_frame, and are mapped to color
+    // table indices and compressed by compress_frame. These two steps may
+    // run concurrently on different threads and out of order. Finally, 
+    // frames are passed to write_frame, again in frame order.
+    //
+    // A frame refers to the pixels of the image it was prepared from, which
+    // must remain unchanged until the frame has been compressed. Its 
+    // temporary data is allocated from the memory resource it was prepared
+    // with. Frames must not outlive the builder which prepared them.
+    struct frame_job {
+        explicit frame_job(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+                memory(resource), encoded_data(resource) {}
+
+        // Where the frame's color histogram, index buffer and encoded data
+        // are allocated.
+        std::pmr::memory_resource* memory;
+
+        // When the frame's image was added to the builder.
+        std::chrono::steady_clock::time_point added;
+
+        // Set for a frame which duplicates its predecessor. There is 
+        // nothing to encode for such a frame.
+        bool coalesced = false;
+
+        // The part of the frame to encode, and a mask of the pixels in it
+        // which are left transparent, if any.
+        frame_rect rect {0, 0, 0, 0};
+        image::rgb_image_view_t rect_view;
+        std::optional<image::pixel_mask> transparent_pixels;
+
+        // The frame's local color table, if it does not use the global one.
+        // Frames which re-use a palette share it with the frame that it was
+        // created for, and wait for that frame to be mapped.
+        std::optional<std::shared_future<palettize::color_table>> local_palette;
+        std::optional<std::promise<palettize::color_table>> palette_to_create;
+
+        // The result of the compress step. Every block of the frame is 
+        // assembled here, so that it is written with a single call.
+        std::pmr::string encoded_data;
+    };
+
+    // Fills the band with the rows of a frame starting at first_row. The 
+    // band spans the whole width of the frame.
+    using band_source = std::function<void(std::size_t first_row, const image::rgb_image_view_t& band)>;
+
     // Constructs a GIF data stream from one or more still images.
     class gif_builder {
     public:
 
+        // The default height of the bands read by add_banded_frame.
+        static constexpr std::size_t DEFAULT_BAND_ROWS = 256;
+
+        // The most pixels of a banded frame whose colors are all counted
+        // to create its color table. Larger frames are sampled evenly so 
+        // that the histogram stays small.
+        static constexpr std::size_t MAX_BANDED_HISTOGRAM_PIXELS = std::size_t(1) << 24;
+
         // Creates a new GIF builder which will write its data to
         // the provided ostream, out. The dimensions width and height
         // must be the same for all images that are added to the data
@@ -19,7 +154,18 @@ namespace gif {
         // frames in hundreths of a second.
         // All the numeric parameters must be in the range [0, 0xFFFF].
         gif_builder(std::ostream& out, std::size_t width, 
-                    std::size_t height, std::size_t delay = 0);
+                    std::size_t height, std::size_t delay = 0,
+                    const builder_options& options = {});
+
+        // Creates a new GIF builder which passes its data to the sink as
+        // each part of the stream is finished. The header blocks are 
+        // passed on before the constructor returns, and each frame as soon
+        // as it is written, except that a frame is held back while 
+        // coalescing until the next distinct frame arrives. The sink must
+        // outlive the builder.
+        gif_builder(gif_sink& sink, std::size_t width, 
+                    std::size_t height, std::size_t delay = 0,
+                    const builder_options& options = {});
         
         // The builder is not copyable or moveable.
         gif_builder(const gif_builder&) = delete;
@@ -29,50 +175,183 @@ namespace gif {
 
 
         // Calls complete_stream() if the stream has not already been 
-        // terminated.
+        // terminated. If the sink throws, such as when a builder is 
+        // destroyed because its sink stopped the stream, the exception is
+        // discarded and the stream is left incomplete.
         ~gif_builder();
         
         // Adds a still frame to the data stream, represented as a 
         // boost::gil Image View. This image must have the same 
         // dimensions as those given to the builder at construction. 
         //
+        // This runs each of the steps below in turn. The frame's temporary
+        // data is allocated from the builder's frame arena, which is reset
+        // for each frame, and other buffers are re-used from frame to 
+        // frame. Once the arena has grown to fit a frame, later frames of
+        // the same size make no calls to the global allocator.
+        //
         // Returns a reference to the builder for convenience.
         gif_builder& add_frame(const image::rgb_image_view_t& image_view);
 
+        // The steps of add_frame, for clients which encode several frames 
+        // at once. See frame_job for the order in which they must be 
+        // called. map_frame and compress_frame are thread-safe. 
+        // prepare_frame and write_frame use separate state, so each may 
+        // run on its own thread, but calls to either must not overlap.
+        frame_job prepare_frame(const image::rgb_image_view_t& image_view, 
+                                std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+        void map_frame(frame_job& frame) const;
+        void compress_frame(frame_job& frame) const;
+        void write_frame(frame_job& frame);
+
+        // Adds a frame which is read from the source in bands of band_rows
+        // rows, from top to bottom, so that the whole frame is never held
+        // in memory. The frame is read twice. The first pass counts its 
+        // colors to create a local color table, and is skipped for frames
+        // which use the global palette without a local palette threshold.
+        // The second pass maps each band to color table indices and feeds
+        // them to the LZW encoder, which writes straight to the output. 
+        // Memory use is proportional to the size of a band rather than the
+        // frame.
+        //
+        // The result is identical to add_frame for frames of at most 
+        // MAX_BANDED_HISTOGRAM_PIXELS pixels. 
+        //
+        // Pre-conditions: 
+        //      Delta frames, transparency, palette re-use and duplicate 
+        //      coalescing are disabled, and no frames from prepare_frame
+        //      are waiting to be written.
+        gif_builder& add_banded_frame(const band_source& source, std::size_t band_rows = DEFAULT_BAND_ROWS);
+
         // Writes any buffered content to the output stream and 
         // terminates it as specified in the GIF standard. After
         // calling this function, all other non-const member functions
         // must not be called.
         void complete_stream();
 
+        // Returns statistics about the frames added so far.
+        const builder_stats& stats() const;
+
     private:
-        std::ostream& out_file;
-        gif_block_buffer block_buffer;
+        gif_builder(std::unique_ptr<gif_sink> owned_sink, gif_sink* sink, 
+                    std::size_t width, std::size_t height, std::size_t delay,
+                    const builder_options& options);
+
+        // The sink which was created for an output stream, if any.
+        std::unique_ptr<gif_sink> owned_sink;
+        gif_sink& sink;
         uint16_t width;
         uint16_t height;
         uint16_t delay;
         bool stream_complete;
+        builder_options options;
+        builder_stats frame_stats;
+
+        // The temporary data of frames added by add_frame.
+        runtime::frame_arena arena;
+
+        // The shared state of the promise for each new color table, which 
+        // may be held by later frames that re-use the table. Freed states 
+        // are re-used for later tables.
+        std::pmr::synchronized_pool_resource palette_memory;
+
+        // The most recently created color table, and a coarse histogram of
+        // the frame it was created for. Only used when re-using palettes.
+        std::optional<std::shared_future<palettize::color_table>> reference_palette;
+        palettize::coarse_histogram reference_histogram;
+
+        // Chooses the frame's local color table. It is either created for 
+        // the frame, or re-used from an earlier frame if the options allow.
+        void choose_color_table(frame_job&);
+
+        // Creates a color table with room for a transparent color if needed.
+        // Excluded pixels are not used to create the table.
+        palettize::color_table create_color_table(
+            const image::rgb_image_view_t&, 
+            const image::pixel_mask* excluded,
+            std::pmr::memory_resource* memory
+        ) const;
+
+        // Answers whether the frame should be encoded with the global palette.
+        bool use_global_palette(const image::rgb_image_view_t&) const;
+
+        // Returns the color table that the frame is encoded with.
+        const palettize::color_table& get_color_table(const frame_job&) const;
+
+        // The pixels currently displayed on the canvas, in their original 
+        // colors. Only kept in delta and transparency modes, which encode
+        // frames relative to the canvas.
+        image::rgb_image_t canvas;
+        bool has_canvas;
+
+        // Chooses the part of the frame to encode.
+        frame_rect find_frame_rect(const image::rgb_image_view_t&);
+
+        // Flags the pixels of the frame which match the canvas and can be
+        // left transparent, if the options allow it. The mask of the last 
+        // frame added by add_frame is kept to be re-used.
+        void find_transparent_pixels(frame_job&);
+        image::pixel_mask spare_mask;
+
+        // Copies the visible pixels of the frame onto the canvas.
+        void update_canvas(const frame_job&);
+
+        // The most recent distinct frame, which later frames are compared 
+        // with to find duplicates, and the delay it has accumulated. The 
+        // hash rejects most frames which are not exact duplicates before 
+        // they are compared with the copy of the frame.
+        bool has_coalesce_reference;
+        std::size_t coalesce_delay;
+        uint64_t coalesce_hash;
+        image::rgb_image_t coalesce_image;
+
+        // Answers whether the frame duplicates the most recent distinct 
+        // frame, in which case that frame's delay is extended. Otherwise,
+        // the frame becomes the one which later frames are compared with.
+        bool coalesce_frame(const image::rgb_image_view_t&);
+
+        // When coalescing, the most recently written frame is held back 
+        // until the next distinct frame arrives so that its delay can be 
+        // extended.
+        std::string pending_frame;
+        bool has_pending_frame;
+        std::size_t pending_delay;
+        std::chrono::steady_clock::time_point pending_added;
+
+        // Writes the pending frame, with its final delay, to the sink.
+        void flush_pending_frame();
+
+        // Passes an encoded frame to the sink between its frame boundary
+        // notifications. The frame was added at the given time.
+        std::size_t frames_emitted;
+        void emit_frame(std::span<const char> data, std::chrono::steady_clock::time_point added);
 
         // Each member function is responsible for writing a 
         // well-defined block, sub-block, or collection thereof
-        // to the output stream.
-        void write_gif_header();
-        void write_screen_descriptor();
-        void write_netscape_extension();
-        void write_graphics_control_ext();
+        // to the given output stream. Image data is appended straight to
+        // the buffer that a frame is assembled in.
+        void write_gif_header(std::ostream&) const;
+        void write_screen_descriptor(std::ostream&) const;
+        void write_netscape_extension(std::ostream&) const;
+        void write_graphics_control_ext(
+            std::ostream&,
+            std::optional<palettize::color_table::index_type> transparent_index
+        ) const;
         void write_image_descriptor(
-            const image::rgb_image_view_t&, 
-            const palettize::color_table&
-        );
-        void write_local_color_table(const palettize::color_table&);
-        void write_image_data(
-            const image::rgb_image_view_t&, 
-            const palettize::color_table&
-        );
-        void write_gif_trailer();
+            std::ostream&,
+            const frame_rect&, 
+            const palettize::color_table* local_color_table
+        ) const;
+        void write_color_table(std::ostream&, const palettize::color_table&) const;
+        void write_image_data(std::pmr::string&, 
+                              const image::rgb_image_view_t&, 
+                              const palettize::color_table&, 
+                              const image::pixel_mask* excluded,
+                              std::pmr::memory_resource* memory) const;
+        void write_gif_trailer(std::ostream&) const;
 
-        // Helper to write the contents of a vector downstream.
-        void write(const std::vector<char>&);
+        // Adds an entry for the transparent color to a palette if needed.
+        palettize::color_table with_transparent_entry(const palettize::color_table&) const;
     };
 
 }
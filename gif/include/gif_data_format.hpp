@@ -12,6 +12,10 @@ namespace gif {
     constexpr std::size_t IMAGE_DESCRIPTOR_SIZE = 10;
     constexpr std::size_t GRAPHIC_CONTROL_BLOCK_SIZE = 8;
 
+    // The offset of the two-byte delay field within the graphic control
+    // extension block.
+    constexpr std::size_t GRAPHIC_CONTROL_DELAY_OFFSET = 4;
+
     constexpr uint8_t IMAGE_SEPARATOR_BYTE = 0x2C;
     constexpr uint8_t GIF_TRAILER_BYTE = 0x3B;
     constexpr uint8_t EXTENSION_INTRO_BYTE = 0x21;
@@ -26,12 +30,48 @@ namespace gif {
     // flag, and transparaency flag to 0.
     constexpr uint8_t GRAPHIC_CONTROL_BLOCK_PACKED_BYTE = 0x00;
 
+    // The ways in which a decoder may treat a frame's area of the canvas
+    // once the frame has been displayed. See the GIF specification for 
+    // details.
+    enum class disposal_method : uint8_t {
+        unspecified = 0,
+        do_not_dispose = 1,
+        restore_to_background = 2,
+        restore_to_previous = 3
+    };
+
+    // The graphic control extension's packed byte for a given disposal 
+    // method and transparency flag. The user input flag is unset, as in 
+    // GRAPHIC_CONTROL_BLOCK_PACKED_BYTE.
+    inline constexpr uint8_t
+    get_graphic_control_packed_byte(disposal_method disposal, bool transparency) {
+        return GRAPHIC_CONTROL_BLOCK_PACKED_BYTE 
+             | (static_cast<uint8_t>(disposal) << 2) 
+             | (transparency ? 0x01 : 0x00);
+    }
+
     // See the GIF specification for details on the composition
     // of this packed byte. We set the global color table flag
     // to 0, the color resolution to 8 (encoded as 7), the sort
     // flag to 0, and the global color table size to all zeros.
     constexpr std::size_t SCREEN_DESCRIPTOR_PACKED_BYTE = 0x70;
 
+    // The screen descriptor's packed byte for streams which have a 
+    // global color table. The global color table flag is set and its 
+    // size is encoded in the lower 3 bits in the same way as for local
+    // color tables. The other fields match SCREEN_DESCRIPTOR_PACKED_BYTE.
+    inline constexpr uint8_t
+    get_screen_descriptor_packed_byte(std::size_t global_color_table_bit_depth) {
+        assert (global_color_table_bit_depth >= 1);
+        assert (global_color_table_bit_depth <= 8);
+        uint8_t encoded_table_size = static_cast<uint8_t>(global_color_table_bit_depth - 1);
+        return 0x80 | SCREEN_DESCRIPTOR_PACKED_BYTE | encoded_table_size;
+    }
+
+    // The image descriptor's packed byte for frames which use the 
+    // global color table. All flags and the table size are unset.
+    constexpr uint8_t IMAGE_DESCRIPTOR_PACKED_BYTE_NO_LOCAL_TABLE = 0x00;
+
     // See the GIF specification for details on the composition
     // of this packed byte. We set the local color table flag,
     // and unset the interlace and sort flags in the upper 4 bits.
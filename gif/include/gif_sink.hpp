@@ -0,0 +1,95 @@
+#ifndef GIF_SINK_HPP
+#define GIF_SINK_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <vector>
+
+namespace gif {
+
+    // Receives a GIF data stream from a gif_builder as it is encoded. The
+    // builder passes on each piece of the stream as soon as it is final,
+    // so a sink can forward the stream to a client, for example over
+    // chunked HTTP, while later frames are still being decoded.
+    //
+    // The header blocks are passed on when the builder is constructed,
+    // followed by on_header_end. The bytes of each encoded frame are then
+    // surrounded by on_frame_begin and on_frame_end calls, and the trailer
+    // is followed by on_stream_end. The callbacks are made on the thread
+    // that writes frames to the builder.
+    class gif_sink {
+    public:
+        virtual ~gif_sink() = default;
+
+        // Receives the next bytes of the stream. The bytes are only valid
+        // until the call returns.
+        virtual void on_bytes(std::span<const char> bytes) = 0;
+
+        virtual void on_header_end();
+
+        // Frames are numbered from 0 in the order they are emitted. A run
+        // of duplicate frames which were coalesced is emitted as one frame.
+        //
+        // time_to_emit is the time from when the first image of the frame
+        // was added to the builder until its last byte was passed to
+        // on_bytes. It includes the time spent waiting in the builder, such
+        // as while later images are compared against a coalesced frame.
+        virtual void on_frame_begin(std::size_t index);
+        virtual void on_frame_end(std::size_t index, std::chrono::nanoseconds time_to_emit);
+
+        virtual void on_stream_end();
+    };
+
+    // A sink which writes the stream to an ostream.
+    class ostream_sink : public gif_sink {
+    public:
+        explicit ostream_sink(std::ostream& out);
+
+        void on_bytes(std::span<const char> bytes) override;
+
+    private:
+        std::ostream& out_file;
+    };
+
+    // A sink which writes the stream to a seekable ostream, such as a file,
+    // and keeps a complete GIF in it while the stream is being encoded. A
+    // trailer is written after the header and after each frame, and the
+    // ostream is flushed, so that a viewer which reads the file between
+    // frames finds a valid GIF which ends with the latest frame. Each
+    // trailer is overwritten by the frame which follows it.
+    class provisional_trailer_sink : public gif_sink {
+    public:
+        explicit provisional_trailer_sink(std::ostream& out);
+
+        void on_bytes(std::span<const char> bytes) override;
+        void on_header_end() override;
+        void on_frame_end(std::size_t index, std::chrono::nanoseconds time_to_emit) override;
+        void on_stream_end() override;
+
+    private:
+        std::ostream& out_file;
+
+        // Whether the last byte written was a provisional trailer.
+        bool has_trailer;
+
+        void write_trailer();
+    };
+
+    // A sink which appends the stream to a byte vector, so that a GIF can
+    // be encoded without any file. The vector's memory is re-used if it is
+    // cleared between streams.
+    class vector_sink : public gif_sink {
+    public:
+        explicit vector_sink(std::vector<uint8_t>& out);
+
+        void on_bytes(std::span<const char> bytes) override;
+
+    private:
+        std::vector<uint8_t>& out_bytes;
+    };
+}
+
+#endif
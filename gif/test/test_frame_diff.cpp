@@ -0,0 +1,162 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include "frame_diff.hpp"
+
+using namespace gif;
+
+// Fills the image with a pattern that makes neighbouring pixels distinct.
+void fill_pattern(image::rgb_image_view_t& img_view) {
+    for (int y = 0; y < img_view.height(); ++y) {
+        for (int x = 0; x < img_view.width(); ++x) {
+            img_view(x, y) = image::rgb_pixel_t(x, y, x ^ y);
+        }
+    }
+}
+
+TEST_CASE("Test identical frames have no changed rect", "[frame_diff]") {
+    image::rgb_image_t img_1(37, 21);
+    image::rgb_image_view_t view_1 = view(img_1);
+    fill_pattern(view_1);
+    image::rgb_image_t img_2(img_1);
+
+    REQUIRE_FALSE(find_changed_rect(view_1, view(img_2)).has_value());
+}
+
+TEST_CASE("Test changed rect for single pixel changes", "[frame_diff]") {
+    // Use a width which is not a multiple of the word size to exercise the
+    // tail handling of the row scans.
+    std::size_t w = 37, h = 21;
+    image::rgb_image_t img_1(w, h);
+    image::rgb_image_view_t view_1 = view(img_1);
+    fill_pattern(view_1);
+
+    for (std::size_t y : {0ul, 10ul, h - 1}) {
+        for (std::size_t x = 0; x < w; ++x) {
+            for (int channel = 0; channel < 3; ++channel) {
+                image::rgb_image_t img_2(img_1);
+                image::rgb_image_view_t view_2 = view(img_2);
+                view_2(x, y)[channel] ^= 0x80;
+
+                auto rect = find_changed_rect(view_1, view_2);
+                REQUIRE(rect.has_value());
+                REQUIRE(*rect == frame_rect{x, y, 1, 1});
+            }
+        }
+    }
+}
+
+TEST_CASE("Test changed rect spans all changed pixels", "[frame_diff]") {
+    image::rgb_image_t img_1(64, 48);
+    image::rgb_image_view_t view_1 = view(img_1);
+    fill_pattern(view_1);
+
+    image::rgb_image_t img_2(img_1);
+    image::rgb_image_view_t view_2 = view(img_2);
+
+    // The extremes of the rectangle are set by different rows.
+    view_2(30, 5) = image::rgb_pixel_t(0, 0, 0);
+    view_2(12, 20) = image::rgb_pixel_t(0, 0, 0);
+    view_2(50, 21) = image::rgb_pixel_t(0, 0, 0);
+    view_2(31, 40) = image::rgb_pixel_t(0, 0, 0);
+
+    auto rect = find_changed_rect(view_1, view_2);
+    REQUIRE(rect.has_value());
+    REQUIRE(*rect == frame_rect{12, 5, 39, 36});
+
+    auto rect_view = get_rect_view(view_2, *rect);
+    REQUIRE(rect_view.width() == 39);
+    REQUIRE(rect_view.height() == 36);
+    REQUIRE(rect_view(0, 15) == view_2(12, 20));
+}
+
+TEST_CASE("Test changed rect of completely different frames", "[frame_diff]") {
+    image::rgb_image_t img_1(10, 10);
+    image::rgb_image_view_t view_1 = view(img_1);
+    fill_pattern(view_1);
+
+    image::rgb_image_t img_2(10, 10);
+    image::rgb_image_view_t view_2 = view(img_2);
+    for (auto& pixel : view_2) {
+        pixel = image::rgb_pixel_t(0xFF, 0xFF, 0xFF);
+    }
+
+    auto rect = find_changed_rect(view_1, view_2);
+    REQUIRE(rect.has_value());
+    REQUIRE(*rect == frame_rect{0, 0, 10, 10});
+}
+
+TEST_CASE("Test find unchanged pixels", "[frame_diff][unchanged]") {
+    image::rgb_image_t img_1(5, 2);
+    image::rgb_image_view_t view_1 = view(img_1);
+    fill_pattern(view_1);
+
+    image::rgb_image_t img_2(img_1);
+    image::rgb_image_view_t view_2 = view(img_2);
+    view_2(1, 0)[0] += 2;
+    view_2(2, 0)[1] += 5;
+    view_2(4, 1)[2] -= 3;
+
+    image::pixel_mask unchanged;
+    SECTION("Exact matches only") {
+        REQUIRE(find_unchanged_pixels(view_1, view_2, 0, unchanged) == 7);
+        REQUIRE(unchanged == image::pixel_mask{1, 0, 0, 1, 1, 
+                                               1, 1, 1, 1, 0});
+    }
+    SECTION("Small differences tolerated") {
+        REQUIRE(find_unchanged_pixels(view_1, view_2, 3, unchanged) == 9);
+        REQUIRE(unchanged == image::pixel_mask{1, 1, 0, 1, 1, 
+                                               1, 1, 1, 1, 1});
+    }
+}
+
+TEST_CASE("Test frames match", "[frame_diff][match]") {
+    std::size_t w = 37, h = 21;
+    image::rgb_image_t img_1(w, h);
+    image::rgb_image_view_t view_1 = view(img_1);
+    fill_pattern(view_1);
+
+    image::rgb_image_t img_2(img_1);
+    image::rgb_image_view_t view_2 = view(img_2);
+    REQUIRE(frames_match(view_1, view_2, 0));
+
+    view_2(w - 1, h - 1)[2] += 3;
+    REQUIRE_FALSE(frames_match(view_1, view_2, 0));
+    REQUIRE_FALSE(frames_match(view_1, view_2, 2));
+    REQUIRE(frames_match(view_1, view_2, 3));
+}
+
+TEST_CASE("Test frame hashes", "[frame_diff][hash]") {
+    std::size_t w = 37, h = 21;
+    image::rgb_image_t img_1(w, h);
+    image::rgb_image_view_t view_1 = view(img_1);
+    fill_pattern(view_1);
+
+    SECTION("Identical frames have equal hashes") {
+        image::rgb_image_t img_2(img_1);
+        REQUIRE(hash_frame(view_1) == hash_frame(view(img_2)));
+    }
+
+    SECTION("Any single changed channel changes the hash") {
+        auto original_hash = hash_frame(view_1);
+        for (std::size_t y : {0ul, h - 1}) {
+            for (std::size_t x = 0; x < w; ++x) {
+                for (int channel = 0; channel < 3; ++channel) {
+                    image::rgb_image_t img_2(img_1);
+                    image::rgb_image_view_t view_2 = view(img_2);
+                    view_2(x, y)[channel] ^= 0x01;
+                    REQUIRE(hash_frame(view_2) != original_hash);
+                }
+            }
+        }
+    }
+
+    SECTION("Hashes of sub-images only cover their pixels") {
+        image::rgb_image_t img_2(img_1);
+        image::rgb_image_view_t view_2 = view(img_2);
+        view_2(w - 1, h - 1) = image::rgb_pixel_t(1, 2, 3);
+
+        frame_rect rect {0, 0, w - 1, h - 1};
+        REQUIRE(hash_frame(get_rect_view(view_1, rect)) == hash_frame(get_rect_view(view_2, rect)));
+    }
+}
@@ -56,3 +56,25 @@ TEST_CASE("Test buffer writes when filled") {
         REQUIRE(block_data.at(i) == char(i));
     }
 }
+
+TEST_CASE("Test buffer appends blocks to a string") {
+    std::pmr::string out("prefix");
+    {
+        gif_block_buffer buffer(out);
+        for (std::size_t i = 0; i < 300; ++i) {
+            buffer << static_cast<char>(i);
+        }
+        REQUIRE(out.size() == 6 + MAX_IMAGE_SUB_BLOCK_SIZE + 1);
+        REQUIRE(buffer.current_block_size() == 300 - MAX_IMAGE_SUB_BLOCK_SIZE);
+    }
+
+    // The partial block is written when the buffer is destroyed.
+    REQUIRE(out.size() == 6 + 300 + 2);
+    REQUIRE(out.substr(0, 6) == "prefix");
+    REQUIRE(out.at(6) == char(0xFF));
+    REQUIRE(out.at(6 + MAX_IMAGE_SUB_BLOCK_SIZE + 1) == char(300 - MAX_IMAGE_SUB_BLOCK_SIZE));
+    for (std::size_t i = 0; i < 300; ++i) {
+        auto header_bytes = i < MAX_IMAGE_SUB_BLOCK_SIZE ? 1 : 2;
+        REQUIRE(out.at(6 + header_bytes + i) == char(i));
+    }
+}
@@ -0,0 +1,335 @@
+#define CATCH_CONFIG_RUNNER
+
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "gif_builder.hpp"
+#include "task_pool.hpp"
+
+// Every call into the global allocator is counted, so that the test can
+// check that the builder stops allocating once it has warmed up.
+std::atomic<std::size_t> allocation_count(0);
+
+void* counted_allocation(std::size_t size, std::size_t alignment) {
+    ++allocation_count;
+    alignment = std::max(alignment, sizeof(void*));
+    void* memory = nullptr;
+    if (posix_memalign(&memory, alignment, size > 0 ? size : 1) != 0) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(std::size_t size) {
+    return counted_allocation(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new[](std::size_t size) {
+    return counted_allocation(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return counted_allocation(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return counted_allocation(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+using namespace gif;
+
+// Discards the encoded stream, keeping only its length.
+class counting_buffer : public std::streambuf {
+public:
+    std::size_t bytes = 0;
+
+protected:
+    int_type overflow(int_type c) override {
+        ++bytes;
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        bytes += count;
+        return count;
+    }
+};
+
+// The default frames are small enough for every parallel step to run as 
+// one task. A moving square changes part of each frame, and the background
+// colors change from frame to frame so that each frame needs a new palette.
+std::vector<image::rgb_image_t> make_frames(std::size_t count, std::size_t width = 64, std::size_t height = 48) {
+    constexpr std::size_t SQUARE = 12;
+    std::vector<image::rgb_image_t> frames;
+    for (std::size_t i = 0; i < count; ++i) {
+        auto& img = frames.emplace_back(width, height);
+        auto img_view = view(img);
+        for (std::size_t y = 0; y < height; ++y) {
+            for (std::size_t x = 0; x < width; ++x) {
+                bool in_square = x >= 4 * i && x < 4 * i + SQUARE && y >= 2 * i && y < 2 * i + SQUARE;
+                img_view(x, y) = in_square
+                    ? image::rgb_pixel_t(255, 255, 255)
+                    : image::rgb_pixel_t(x * 4, y * 5, (x ^ y) + 16 * (i % 3));
+            }
+        }
+    }
+    return frames;
+}
+
+// Adds the frames with the given options, and returns the number of
+// allocations made while adding every frame after the first.
+std::size_t count_steady_allocations(const builder_options& options, 
+                                     std::size_t width = 64, std::size_t height = 48,
+                                     std::size_t frame_count = 8) {
+    constexpr std::size_t WARM_UP_FRAMES = 1;
+    auto frames = make_frames(frame_count, width, height);
+    counting_buffer buffer;
+    std::ostream out(&buffer);
+    gif_builder builder(out, width, height, 10, options);
+
+    std::size_t before = 0;
+    for (std::size_t i = 0; i < frame_count; ++i) {
+        if (i == WARM_UP_FRAMES) {
+            before = allocation_count.load();
+        }
+        builder.add_frame(view(frames[i]));
+    }
+    auto allocations = allocation_count.load() - before;
+
+    builder.complete_stream();
+    REQUIRE(builder.stats().frames == frame_count);
+    REQUIRE(buffer.bytes > 0);
+    return allocations;
+}
+
+TEST_CASE("Test adding frames stops allocating after the first frame", "[gif_builder]") {
+    SECTION("Default options") {
+        REQUIRE(count_steady_allocations({}) == 0);
+    }
+
+    SECTION("Delta frames with transparency") {
+        builder_options options;
+        options.delta_frames = true;
+        options.transparency_tolerance = 3;
+        REQUIRE(count_steady_allocations(options) == 0);
+    }
+
+    SECTION("Palette re-use and coalescing") {
+        builder_options options;
+        options.reuse_palettes = true;
+        options.coalesce_duplicates = true;
+        REQUIRE(count_steady_allocations(options) == 0);
+    }
+
+    SECTION("Global palette with a local palette threshold") {
+        builder_options options;
+        palettize::color_table palette;
+        for (int i = 0; i < 16; ++i) {
+            palette.add_color(image::rgb_pixel_t(i * 16, i * 16, i * 16));
+        }
+        options.global_palette = palette;
+        options.local_palette_threshold = 20;
+        REQUIRE(count_steady_allocations(options) == 0);
+    }
+
+    // Large frames are split into many tasks, whose loop and group state
+    // must be recycled rather than allocated for every frame.
+    SECTION("Frames split into parallel tasks") {
+        REQUIRE(runtime::task_pool::shared().worker_count() >= 2);
+        REQUIRE(count_steady_allocations({}, 640, 480, 3) == 0);
+    }
+}
+
+// Records the stream and the order of the notifications about it.
+class recording_sink : public gif_sink {
+public:
+    std::string bytes;
+    std::vector<std::string> events;
+    std::vector<std::size_t> frame_sizes;
+
+    void on_bytes(std::span<const char> data) override {
+        bytes.append(data.begin(), data.end());
+    }
+
+    void on_header_end() override {
+        events.push_back("header " + std::to_string(bytes.size()));
+    }
+
+    void on_frame_begin(std::size_t index) override {
+        events.push_back("begin " + std::to_string(index));
+        frame_start = bytes.size();
+    }
+
+    void on_frame_end(std::size_t index, std::chrono::nanoseconds time_to_emit) override {
+        events.push_back("end " + std::to_string(index));
+        frame_sizes.push_back(bytes.size() - frame_start);
+        REQUIRE(time_to_emit.count() >= 0);
+    }
+
+    void on_stream_end() override {
+        events.push_back("trailer " + std::to_string(bytes.size()));
+    }
+
+private:
+    std::size_t frame_start = 0;
+};
+
+TEST_CASE("Test sink receives the stream with frame boundaries", "[gif_builder]") {
+    auto frames = make_frames(4);
+    builder_options options;
+    options.coalesce_duplicates = true;
+
+    // The second frame is repeated, so it is emitted once, after the next
+    // distinct frame has been added.
+    std::vector<std::size_t> order {0, 1, 1, 2, 3};
+    std::stringstream ss;
+    recording_sink sink;
+    {
+        gif_builder stream_builder(ss, 64, 48, 10, options);
+        gif_builder sink_builder(sink, 64, 48, 10, options);
+        REQUIRE(sink.events == std::vector<std::string> {"header " + std::to_string(sink.bytes.size())});
+
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            stream_builder.add_frame(view(frames[order[i]]));
+            sink_builder.add_frame(view(frames[order[i]]));
+
+            // Each frame is emitted once it can no longer change.
+            std::size_t emitted = i == 0 ? 0 : i <= 2 ? 1 : i - 1;
+            REQUIRE(sink.frame_sizes.size() == emitted);
+        }
+    }
+
+    REQUIRE(sink.bytes == ss.str());
+    REQUIRE(sink.events.size() == 1 + 2 * 4 + 1);
+    for (std::size_t i = 0; i < 4; ++i) {
+        REQUIRE(sink.events[1 + 2 * i] == "begin " + std::to_string(i));
+        REQUIRE(sink.events[2 + 2 * i] == "end " + std::to_string(i));
+    }
+    REQUIRE(sink.events.back() == "trailer " + std::to_string(sink.bytes.size()));
+    REQUIRE(sink.bytes.back() == char(0x3B));
+}
+
+TEST_CASE("Test sink receives banded frames", "[gif_builder]") {
+    auto frames = make_frames(1);
+    auto source = [&frames](std::size_t first_row, const image::rgb_image_view_t& band) {
+        auto frame_view = view(frames[0]);
+        boost::gil::copy_pixels(boost::gil::subimage_view(frame_view, 0, first_row, band.width(), band.height()), band);
+    };
+
+    std::stringstream ss;
+    recording_sink sink;
+    {
+        gif_builder stream_builder(ss, 64, 48);
+        gif_builder sink_builder(sink, 64, 48);
+        stream_builder.add_frame(view(frames[0]));
+        sink_builder.add_banded_frame(source, 10);
+    }
+
+    REQUIRE(sink.bytes == ss.str());
+    REQUIRE(sink.frame_sizes.size() == 1);
+    REQUIRE(sink.events.size() == 4);
+    REQUIRE(sink.events[1] == "begin 0");
+    REQUIRE(sink.events[2] == "end 0");
+}
+
+TEST_CASE("Test tall frames are mapped in batches", "[gif_builder]") {
+    // The frame is taller than a batch of index chunks, so its indices 
+    // are mapped in several batches while they are compressed. Bands 
+    // narrower than a chunk are mapped one at a time, so both must give 
+    // the same stream.
+    constexpr std::size_t WIDTH = 16, HEIGHT = 9000;
+    image::rgb_image_t frame(WIDTH, HEIGHT);
+    auto frame_view = view(frame);
+    for (std::size_t y = 0; y < HEIGHT; ++y) {
+        for (std::size_t x = 0; x < WIDTH; ++x) {
+            frame_view(x, y) = image::rgb_pixel_t(x * 16, (y / 1000) * 16, 0);
+        }
+    }
+    auto source = [&frame_view](std::size_t first_row, const image::rgb_image_view_t& band) {
+        boost::gil::copy_pixels(boost::gil::subimage_view(frame_view, 0, first_row, band.width(), band.height()), band);
+    };
+
+    std::stringstream whole, banded;
+    {
+        gif_builder whole_builder(whole, WIDTH, HEIGHT);
+        gif_builder banded_builder(banded, WIDTH, HEIGHT);
+        whole_builder.add_frame(frame_view);
+        banded_builder.add_banded_frame(source, 100);
+    }
+    REQUIRE(whole.str() == banded.str());
+}
+
+TEST_CASE("Test provisional trailers keep the output a complete GIF", "[gif_builder]") {
+    auto frames = make_frames(3);
+    std::stringstream expected;
+    std::stringstream live;
+    provisional_trailer_sink sink(live);
+    {
+        gif_builder stream_builder(expected, 64, 48, 10);
+        gif_builder sink_builder(sink, 64, 48, 10);
+        REQUIRE(live.str().back() == char(0x3B));
+
+        // After each frame, the output is the stream so far followed by
+        // a trailer.
+        for (std::size_t i = 0; i < frames.size(); ++i) {
+            auto size_before = live.str().size();
+            stream_builder.add_frame(view(frames[i]));
+            sink_builder.add_frame(view(frames[i]));
+            auto output = live.str();
+            REQUIRE(output.size() > size_before);
+            REQUIRE(output.back() == char(0x3B));
+            REQUIRE(expected.str() == output.substr(0, output.size() - 1));
+        }
+    }
+
+    // The last trailer is the builder's own.
+    REQUIRE(live.str() == expected.str());
+}
+
+// A sink which stops the stream by throwing once it has been closed.
+class closing_sink : public gif_sink {
+public:
+    bool closed = false;
+
+    void on_bytes(std::span<const char>) override {
+        if (closed) {
+            throw std::runtime_error("closed");
+        }
+    }
+};
+
+TEST_CASE("Test destroying a builder whose sink throws", "[gif_builder]") {
+    auto frames = make_frames(1);
+    closing_sink sink;
+    {
+        gif_builder builder(sink, 64, 48);
+        builder.add_frame(view(frames[0]));
+        sink.closed = true;
+    }
+
+    // The rest of the stream could not be written, but the exception did
+    // not escape the destructor.
+    REQUIRE(sink.closed);
+}
+
+// The shared pool has several workers even on a single core, so that the
+// parallel steps really hand their tasks to other threads.
+int main(int argc, char* argv[]) {
+    runtime::task_pool::set_shared_worker_count(3);
+    return Catch::Session().run(argc, argv);
+}
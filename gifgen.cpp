@@ -5,14 +5,38 @@
 // See README.txt for details about the project and how 
 // to run this code.
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <deque>
+#include <exception>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
 #include "args.hpp"
+#include "batch_runner.hpp"
+#include "directory_watcher.hpp"
+#include "encode_server.hpp"
 #include "image_io.hpp"
+#include "file_reader.hpp"
+#include "frame_prefetcher.hpp"
+#include "frame_stream.hpp"
 #include "image_utils.hpp"
+#include "output_file.hpp"
 #include "gif_builder.hpp"
+#include "gif_sink.hpp"
+#include "frame_pipeline.hpp"
+#include "preprocess.hpp"
+#include "task_pool.hpp"
 
 struct image_dims {
     std::size_t width;
@@ -21,108 +45,625 @@ struct image_dims {
 
 // Returns true iff:
 //  1. All filenames in the list correspond to files of the given type, and
-//  2. All files are of the same dimensions, and
+//  2. All files are of the same dimensions, unless same_dimensions is 
+//     false, and
 //  3. The specific encoding can be read using a 24-bit
 //     color space (8 bits per channel)
 //
+// Only the header of each file is read, and the files are checked in
+// parallel. A file which is corrupted after its header will only fail
+// once it is decoded for encoding.
+//
 // On success, the dims parameter is updated to hold the dimensions of the
-// input frames.
+// first input frame.
 //
-// Error information will be printed before returning false.
+// Error information will be printed for the first invalid file before 
+// returning false.
 bool check_images_are_compatible(const std::vector<std::string>& filenames, 
                                  image::file_type type, 
+                                 bool same_dimensions,
                                  image_dims& dims) {
     assert (!filenames.empty());
     
     dims.width = 0;
     dims.height = 0;
 
-    try {
-        const std::string& first_file_name = filenames.front();
-        image::rgb_image_t img;
-        for (const auto& filename : filenames) {
-            if (!std::filesystem::exists(filename) || !std::filesystem::is_regular_file(filename)) {
-                std::cout << "Error: Unable to find input file " << filename << std::endl;
-                return false;
+    // The header of each file, or the error found while reading it.
+    struct file_check {
+        std::optional<image::image_info> info;
+        std::string error;
+    };
+    std::vector<file_check> checks(filenames.size());
+
+    // Headers are small, so each task checks a batch of files.
+    constexpr std::size_t FILES_PER_TASK = 16;
+    runtime::parallel_for(0, filenames.size(), FILES_PER_TASK, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            const auto& filename = filenames[i];
+            auto& check = checks[i];
+            try {
+                if (!std::filesystem::exists(filename) || !std::filesystem::is_regular_file(filename)) {
+                    check.error = "Unable to find input file " + filename;
+                }
+                else if (!(check.info = image::read_image_info(filename, type))) {
+                    check.error = "Input file " + filename + " does not match specified input file type.";
+                }
+                else if (!image::is_rgb8_compatible(*check.info)) {
+                    check.error = "Input file " + filename + " cannot be read with 8-bit RGB color channels.";
+                }
+            }
+            catch(std::exception& e) {
+                // There may be many possible file handling issues (permissions, symlinks,
+                // etc., so we report failure if anything goes wrong and leave it to the 
+                // user to diagnose these sort of issues.
+                check.error = std::string("failed to read input files. Operation failed with message: ") + e.what();
+            }
+        }
+    });
+
+    const std::string& first_file_name = filenames.front();
+    for (std::size_t i = 0; i < filenames.size(); ++i) {
+        const auto& check = checks[i];
+        if (!check.error.empty()) {
+            std::cout << "Error: " << check.error << std::endl;
+            return false;
+        }
+
+        if (dims.width == 0 && dims.height == 0) {
+            // First image, record its dimensions.
+            dims.width = check.info->width;
+            dims.height = check.info->height;
+        }
+        else if (same_dimensions && 
+                 (dims.width != check.info->width || dims.height != check.info->height)) {
+            std::cout << "Error: frames " << first_file_name << " and " << filenames[i] << " have differing dimensions." << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Builds a single color palette for all of the input frames from a joint
+// histogram of their colors. Each frame contributes a bounded sample of 
+// its pixels. Frames are decoded ahead on the shared task pool while 
+// earlier frames are sampled.
+palettize::color_table create_global_palette(const std::vector<std::string>& filenames,
+                                             image::file_type type,
+                                             const image::decode_options& decoding,
+                                             const std::optional<preprocess::fit_options>& canvas,
+                                             std::size_t max_colors) {
+    assert (!filenames.empty());
+
+    // Enough samples to find all the significant colors in a frame
+    // without reading every pixel of very large frames.
+    constexpr std::size_t SAMPLES_PER_FRAME = 1 << 18;
+
+    image::frame_prefetcher frames(filenames, type, decoding);
+    image::rgb_image_t fitted;
+    palettize::multi_frame_histogram histogram;
+    while (frames.has_next_frame()) {
+        auto img_view = boost::gil::view(frames.next_frame());
+        if (canvas.has_value()) {
+            preprocess::fit_frame(img_view, fitted, *canvas);
+            img_view = boost::gil::view(fitted);
+        }
+        auto sample_step = std::max<std::size_t>(1, img_view.size() / SAMPLES_PER_FRAME);
+        histogram.add_frame(img_view, sample_step);
+    }
+
+    return histogram.create_color_table(max_colors);
+}
+
+// Returns the dimensions of the GIF. Frames are reduced as they are 
+// decoded, and may then be fitted to a canvas.
+image_dims get_output_dims(const args::program_arguments& args, const image_dims& input_dims) {
+    if (args.canvas.has_value()) {
+        return {args.canvas->width, args.canvas->height};
+    }
+    else if (args.scale.has_value()) {
+        return {image::scaled_dimension(input_dims.width, *args.scale), 
+                image::scaled_dimension(input_dims.height, *args.scale)};
+    }
+    return input_dims;
+}
+
+gif::builder_options get_builder_options(const args::program_arguments& args) {
+    gif::builder_options options;
+    options.reuse_palettes = args.reuse_palettes;
+    options.local_palette_threshold = args.local_palette_threshold;
+    options.delta_frames = args.delta_frames;
+    options.transparency_tolerance = args.transparency_tolerance;
+    options.coalesce_duplicates = args.coalesce_duplicates;
+    options.duplicate_tolerance = args.coalesce_tolerance.value_or(0);
+    return options;
+}
+
+// Encodes the input frames as a GIF in the file at output_path, and 
+// returns the builder's statistics. Throws if a frame cannot be decoded 
+// or the file cannot be written.
+gif::builder_stats encode_gif(const args::program_arguments& args, 
+                              const image_dims& dims,
+                              const std::filesystem::path& output_path) {
+    auto output_file = image::open_output_file(output_path);
+
+    image::decode_options decoding;
+    decoding.scale = args.scale.value_or(1.0);
+    decoding.background = args.background;
+
+    auto options = get_builder_options(args);
+    if (args.global_palette) {
+        std::cout << "Creating global color palette from " << args.input_files.size() << " frame(s)" << std::endl;
+        // One entry of the global color table is reserved for the transparent color.
+        auto max_colors = palettize::color_table::max_size() - (args.transparency_tolerance.has_value() ? 1 : 0);
+        options.global_palette = create_global_palette(args.input_files, args.file_type, decoding, args.canvas, max_colors);
+        std::cout << std::endl;
+    }
+    gif::gif_builder gif_stream(output_file, dims.width, dims.height, args.delay, options);
+
+    // Add each frame to the GIF. Frames are decoded, palettized and 
+    // compressed on several threads at once, and written in order. The
+    // files are read ahead in batches, and decoded from memory.
+    // Only the headers were checked up front, so each decoded frame
+    // is checked again.
+    image::file_prefetcher files(args.input_files);
+    auto decode_frame = [&args, &dims, &files, &decoding](std::size_t i, image::rgb_image_t& img) {
+        auto contents = files.take(i);
+        image::decode_to_canvas(contents, img, args.file_type, decoding, args.canvas);
+        files.recycle(std::move(contents));
+        if (static_cast<std::size_t>(img.width()) != dims.width || 
+                static_cast<std::size_t>(img.height()) != dims.height) {
+            throw std::runtime_error("Frame " + args.input_files[i] + " does not match the dimensions of its header");
+        }
+    };
+    auto report_frame = [&args](std::size_t i) {
+        std::cout << "Added frame '" << args.input_files[i] << "' to " << args.output_file_name << std::endl;
+    };
+    pipeline::add_frames(gif_stream, args.input_files.size(), decode_frame, report_frame);
+    std::cout << std::endl;
+    
+    gif_stream.complete_stream();
+    output_file.close();
+    return gif_stream.stats();
+}
+
+// Frames with more pixels than this are encoded in bands when the options
+// allow it, as holding several of them at once could exhaust memory.
+constexpr std::size_t BANDING_THRESHOLD_PIXELS = std::size_t(64) << 20;
+
+// Answers whether the frames should be encoded a band at a time. Banded
+// frames are read straight from the input files at full size, each with 
+// its own color table.
+bool use_banded_encoding(const args::program_arguments& args, const image_dims& dims) {
+    if (args.band_rows.has_value()) {
+        return true;
+    }
+    bool compatible = !args.global_palette && !args.scale.has_value() && !args.canvas.has_value() && 
+                      !args.reuse_palettes && !args.delta_frames && 
+                      !args.transparency_tolerance.has_value() && !args.coalesce_duplicates;
+    return compatible && dims.width * dims.height > BANDING_THRESHOLD_PIXELS;
+}
+
+// Encodes the input frames as a GIF in the file at output_path as 
+// encode_gif does, but one frame at a time and one band of rows at a time,
+// so that memory use is bounded by the size of a band and of the files 
+// which are read ahead. Each band is decoded twice.
+gif::builder_stats encode_banded(const args::program_arguments& args, 
+                                 const image_dims& dims,
+                                 const std::filesystem::path& output_path) {
+    auto output_file = image::open_output_file(output_path);
+    gif::gif_builder gif_stream(output_file, dims.width, dims.height, args.delay, get_builder_options(args));
+
+    image::decode_options decoding;
+    decoding.background = args.background;
+
+    auto band_rows = args.band_rows.value_or(gif::gif_builder::DEFAULT_BAND_ROWS);
+    image::file_prefetcher files(args.input_files);
+    for (std::size_t i = 0; i < args.input_files.size(); ++i) {
+        auto contents = files.take(i);
+        {
+            image::band_reader reader(contents, args.file_type, decoding);
+            if (reader.width() != dims.width || reader.height() != dims.height) {
+                throw std::runtime_error("Frame " + args.input_files[i] + " does not match the dimensions of its header");
             }
-            else if (!image::is_file_type(filename, type)) {
-                std::cout << "Error: Input file " << filename << " does not match specified input file type." << std::endl;
+            gif_stream.add_banded_frame([&reader](std::size_t first_row, const image::rgb_image_view_t& band) {
+                reader.read_rows(first_row, band);
+            }, band_rows);
+        }
+        files.recycle(std::move(contents));
+        std::cout << "Added frame '" << args.input_files[i] << "' to " << args.output_file_name << std::endl;
+    }
+    std::cout << std::endl;
+
+    gif_stream.complete_stream();
+    output_file.close();
+    return gif_stream.stats();
+}
+
+// Encodes the frames of a stream as a GIF in the file at output_path, as
+// encode_gif does for input files. Frames are read on the calling thread 
+// and encoded as they arrive. Streamed frames are not reduced as they are
+// decoded, so with --scale they are resized to the scaled dimensions 
+// instead.
+gif::builder_stats encode_stream(const args::program_arguments& args,
+                                 image::frame_stream& stream,
+                                 const image_dims& dims,
+                                 const std::filesystem::path& output_path) {
+    auto output_file = image::open_output_file(output_path);
+    gif::gif_builder gif_stream(output_file, dims.width, dims.height, args.delay, get_builder_options(args));
+
+    std::optional<preprocess::fit_options> fit = args.canvas;
+    if (!fit.has_value() && args.scale.has_value()) {
+        fit.emplace();
+        fit->width = dims.width;
+        fit->height = dims.height;
+        fit->fit = preprocess::fit_mode::stretch;
+    }
+
+    image::rgb_image_t decoded;
+    auto read_frame = [&stream, &dims, &fit, &decoded](image::rgb_image_t& img) {
+        if (fit.has_value()) {
+            if (!stream.read_frame(decoded)) {
                 return false;
             }
-            else {
-                // Unfortunately, to verify that the image can be represented using 
-                // 8-bit color channels, we need to read in entire images here. This
-                // causes duplication with the main processing loop, but this can't be 
-                // avoided without deferring failure on later frames until after we"ve
-                // encoded their predecessors.
-                image::read_image(filename, img, type);
-                auto img_view = boost::gil::view(img);
-
-                assert (img_view.width() > 0);
-                assert (img_view.height() > 0);
-                auto img_width = static_cast<std::size_t>(img_view.width());
-                auto img_height = static_cast<std::size_t>(img_view.height());
-
-                if (dims.width == 0 && dims.height == 0) {
-                    // First image, record its dimensions.
-                    dims.width = img_width;
-                    dims.height = img_height;
-                }
-                else if (dims.width != img_width || 
-                         dims.height != img_height) {
-                    std::cout << "Error: frames " << first_file_name << " and " << filename << " have differing dimensions." << std::endl;
-                    return false;
-                }
+            preprocess::fit_frame(boost::gil::view(decoded), img, *fit);
+        }
+        else if (!stream.read_frame(img)) {
+            return false;
+        }
+
+        if (static_cast<std::size_t>(img.width()) != dims.width || 
+                static_cast<std::size_t>(img.height()) != dims.height) {
+            throw std::runtime_error("Frame " + std::to_string(stream.frames_read()) + 
+                                     " of the stream does not match the dimensions of the first frame");
+        }
+        return true;
+    };
+    auto report_frame = [&args](std::size_t i) {
+        std::cout << "Added frame " << i + 1 << " of the stream to " << args.output_file_name << std::endl;
+    };
+    pipeline::add_streamed_frames(gif_stream, read_frame, report_frame);
+    std::cout << std::endl;
+
+    gif_stream.complete_stream();
+    output_file.close();
+    return gif_stream.stats();
+}
+
+// Runs the jobs of a batch manifest, and prints the result of each job as
+// a line of JSON. Returns the program's exit status, which is 1 if any 
+// job failed.
+int run_batch(const args::program_arguments& args) {
+    std::ifstream manifest(*args.batch_manifest);
+    if (!manifest) {
+        std::cout << "Error: Unable to open manifest " << *args.batch_manifest << std::endl;
+        return 1;
+    }
+
+    batch::batch_options options;
+    if (args.memory_limit_mb.has_value()) {
+        options.memory_limit = *args.memory_limit_mb << 20;
+    }
+    auto summary = batch::run_batch(manifest, [](const batch::job_result& result) {
+        batch::write_result(std::cout, result);
+    }, options);
+    return summary.failed == 0 ? 0 : 1;
+}
+
+// Blocks SIGINT and SIGTERM in the calling thread, and so in every thread
+// it starts afterwards, so that they can be waited for by a thread which 
+// shuts the program down cleanly. Returns the blocked signals.
+sigset_t block_stop_signals() {
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+    return stop_signals;
+}
+
+// Serves encode requests on the socket until the process is interrupted
+// or terminated. Returns the program's exit status.
+int run_server(const args::program_arguments& args) {
+    auto stop_signals = block_stop_signals();
+
+    server::server_options options;
+    if (args.memory_limit_mb.has_value()) {
+        options.memory_limit = *args.memory_limit_mb << 20;
+    }
+    std::optional<server::encode_server> request_server;
+    try {
+        request_server.emplace(*args.serve_socket, options);
+    }
+    catch(std::exception& e) {
+        std::cout << "Error: Unable to serve on " << *args.serve_socket 
+                  << ". Operation failed with message: " << e.what() 
+                  << std::endl;
+        return 1;
+    }
+
+    std::thread signal_waiter([&stop_signals, &request_server]() {
+        int signal = 0;
+        sigwait(&stop_signals, &signal);
+        request_server->stop();
+    });
+    std::cout << "Serving encode requests on " << *args.serve_socket << std::endl;
+    request_server->run();
+    signal_waiter.join();
+    return 0;
+}
+
+// Reads and decodes the next file which is completed in the watched 
+// directory into img, and returns it. Files which are not images of the
+// given type, cannot be decoded, or do not have the expected dimensions are
+// skipped with a warning, as a capture tool may write other files to the
+// directory. Returns nothing once the watch has ended.
+std::optional<image::watched_file> read_watched_frame(const args::program_arguments& args,
+                                                      image::directory_watcher& watcher,
+                                                      image::batch_file_reader& reader,
+                                                      std::vector<image::file_read>& reads,
+                                                      const std::optional<image_dims>& expected_dims,
+                                                      image::rgb_image_t& img) {
+    image::decode_options decoding;
+    decoding.scale = args.scale.value_or(1.0);
+    decoding.background = args.background;
+
+    // The file's buffer is re-used for every frame.
+    assert (reads.size() == 1);
+    auto& read = reads.front();
+    while (auto file = watcher.next_file()) {
+        read.filename = file->path;
+        read.error.clear();
+        reader.read_files(reads);
+
+        try {
+            if (read.error) {
+                throw std::system_error(read.error);
+            }
+            auto info = image::read_image_info(read.contents);
+            if (!info.has_value() || info->type != args.file_type || !image::is_rgb8_compatible(*info)) {
+                throw std::runtime_error("The file does not match the specified input file type "
+                                         "or cannot be read with 8-bit RGB color channels");
             }
+            image::decode_to_canvas(read.contents, img, args.file_type, decoding, args.canvas);
+            if (expected_dims.has_value() && 
+                    (static_cast<std::size_t>(img.width()) != expected_dims->width || 
+                     static_cast<std::size_t>(img.height()) != expected_dims->height)) {
+                throw std::runtime_error("The frame does not have the dimensions of the first frame");
+            }
+            return file;
+        }
+        catch(std::exception& e) {
+            std::cout << "Warning: Skipped " << file->path 
+                      << ". Operation failed with message: " << e.what() 
+                      << std::endl;
         }
     }
+    return std::nullopt;
+}
+
+// Appends each frame which is written to the watched directory to the GIF
+// as soon as it is complete, until the process is interrupted or 
+// terminated, or the directory is removed. The GIF's dimensions are taken
+// from the first frame. The output is written in place rather than through
+// a temporary file, and is kept a valid GIF after every frame by a
+// provisional trailer. Returns the program's exit status.
+int run_watch(const args::program_arguments& args) {
+    auto stop_signals = block_stop_signals();
+    std::optional<image::directory_watcher> watcher;
+    try {
+        watcher.emplace(*args.watch_directory);
+    }
     catch(std::exception& e) {
-        // There may be many possible file handling issues (permissions, symlinks,
-        // etc., so we return false if anything goes wrong and leave it to the user
-        // to diagnose these sort of issues.
-        std::cout << "Error: failed to read input files. Operation failed with message: " 
-                  <<  e.what() 
+        std::cout << "Error: Unable to watch " << *args.watch_directory 
+                  << ". Operation failed with message: " << e.what() 
                   << std::endl;
-        return false;
+        return 1;
     }
 
-    return true;
+    std::thread signal_waiter([&stop_signals, &watcher]() {
+        int signal = 0;
+        sigwait(&stop_signals, &signal);
+        watcher->stop();
+    });
+
+    // The waiter is woken with a signal of its own if the watch ends for
+    // another reason.
+    auto join_signal_waiter = [&signal_waiter]() {
+        pthread_kill(signal_waiter.native_handle(), SIGTERM);
+        signal_waiter.join();
+    };
+
+    std::cout << "Watching " << *args.watch_directory << " for frames" << std::endl;
+
+    // The files of the frames which have been read but not yet reported,
+    // and when they were completed, so that the time taken to append each
+    // frame can be reported. Frames are read and reported on different 
+    // threads, in the same order.
+    std::mutex files_mutex;
+    std::deque<image::watched_file> files;
+    std::size_t frames_reported = 0;
+
+    image::batch_file_reader reader;
+    std::vector<image::file_read> reads(1);
+    image::rgb_image_t first_frame;
+    auto first_file = read_watched_frame(args, *watcher, reader, reads, std::nullopt, first_frame);
+    if (!first_file.has_value()) {
+        join_signal_waiter();
+        std::cout << "Error: No frames were written to " << *args.watch_directory << std::endl;
+        return 1;
+    }
+    files.push_back(*first_file);
+    image_dims dims {static_cast<std::size_t>(first_frame.width()), static_cast<std::size_t>(first_frame.height())};
+
+    std::chrono::duration<double, std::milli> total_latency {0}, max_latency {0};
+    gif::builder_stats stats;
+    try {
+        auto output_file = image::open_output_file(args.output_file_name);
+        gif::provisional_trailer_sink sink(output_file);
+        gif::gif_builder gif_stream(sink, dims.width, dims.height, args.delay, get_builder_options(args));
+
+        bool has_first_frame = true;
+        auto read_frame = [&](image::rgb_image_t& img) {
+            if (has_first_frame) {
+                img.swap(first_frame);
+                has_first_frame = false;
+                return true;
+            }
+            auto file = read_watched_frame(args, *watcher, reader, reads, dims, img);
+            if (!file.has_value()) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(files_mutex);
+            files.push_back(std::move(*file));
+            return true;
+        };
+
+        // The output has been flushed by the time a frame is reported, 
+        // unless the frame is held back for coalescing.
+        auto report_frame = [&](std::size_t i) {
+            std::lock_guard<std::mutex> lock(files_mutex);
+            if (i != frames_reported || files.empty()) {
+                throw std::logic_error("Frame " + std::to_string(i) + " was reported out of order");
+            }
+            auto file = std::move(files.front());
+            files.pop_front();
+            ++frames_reported;
+
+            std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - file.completed;
+            total_latency += latency;
+            max_latency = std::max(max_latency, latency);
+            std::cout << "Added frame '" << file.path << "' to " << args.output_file_name 
+                      << " " << latency.count() << " ms after it was written" << std::endl;
+        };
+        pipeline::add_streamed_frames(gif_stream, read_frame, report_frame);
+        std::cout << std::endl;
+
+        gif_stream.complete_stream();
+        output_file.close();
+        stats = gif_stream.stats();
+    }
+    catch(std::exception& e) {
+        join_signal_waiter();
+        std::cout << "Error: failed to create " << args.output_file_name 
+                  << ". Operation failed with message: " << e.what() 
+                  << std::endl;
+        return 1;
+    }
+    join_signal_waiter();
+
+    std::cout << "GIF file " << args.output_file_name 
+              << " created with " << stats.frames << " frame(s)" 
+              << std::endl;
+    std::cout << "Frames were added a mean of " << total_latency.count() / std::max<std::size_t>(frames_reported, 1) 
+              << " ms and at most " << max_latency.count() << " ms after they were written" 
+              << std::endl;
+    return 0;
 }
 
 int main(int argc, char **argv) {
     auto args = args::parse_arguments(argc, argv);
 
-    // In the interest of detecting user errors as quickly as possible, 
-    // we check that we are able to read in each input frame and that 
-    // they all match in size before doing any real processing. 
-    // We also determine the dimensions at the same time. 
-    assert (!args.input_files.empty());
-    image_dims dims {0, 0};
-    if (!check_images_are_compatible(args.input_files, args.file_type, dims)) {
-        return 1;
+    // All of the parallel work, including the checks of the input files,
+    // runs on the shared task pool, which has one worker per core unless a
+    // thread count was given. The count must be set before the pool is 
+    // first used.
+    if (args.threads > 0) {
+        runtime::task_pool::set_shared_worker_count(args.threads);
     }
 
-    // Create the GIF data stream
-    std::ofstream output_file(args.output_file_name, std::ios::out | std::ios::binary);
-    gif::gif_builder gif_stream(output_file, dims.width, dims.height, args.delay);
+    if (args.batch_manifest.has_value() || args.serve_socket.has_value()) {
+        return args.batch_manifest.has_value() ? run_batch(args) : run_server(args);
+    }
+    if (args.watch_directory.has_value()) {
+        return run_watch(args);
+    }
 
-    // Add each frame to the GIF
-    image::rgb_image_t img;
-    for (const auto& filename : args.input_files) {
-        std::cout << "Adding frame '" << filename << "' to " << args.output_file_name << std::endl;
-        
-        image::read_image(filename, img, args.file_type);
-        auto image_view = boost::gil::view(img);
-        gif_stream.add_frame(image_view);
+    image_dims dims {0, 0};
+    std::optional<image::frame_stream> stream;
+    if (args.stream_input.has_value()) {
+        // The stream's dimensions are taken from its first frame, which 
+        // may not have been written yet.
+        int stream_fd = *args.stream_input == "-" ? STDIN_FILENO : open(args.stream_input->c_str(), O_RDONLY);
+        if (stream_fd < 0) {
+            std::cout << "Error: Unable to open stream " << *args.stream_input << std::endl;
+            return 1;
+        }
+        try {
+            stream.emplace(stream_fd);
+        }
+        catch(std::exception& e) {
+            std::cout << "Error: failed to read stream " << *args.stream_input 
+                      << ". Operation failed with message: " << e.what() 
+                      << std::endl;
+            return 1;
+        }
+        dims.width = stream->width();
+        dims.height = stream->height();
+    }
+    else {
+        // In the interest of detecting user errors as quickly as possible, 
+        // we check that we are able to read in each input frame and that 
+        // they all match in size, unless they are fitted to a canvas, before 
+        // doing any real processing.
+        // We also determine the dimensions at the same time. 
+        assert (!args.input_files.empty());
+        if (!check_images_are_compatible(args.input_files, args.file_type, !args.canvas.has_value(), dims)) {
+            return 1;
+        }
+    }
 
-        std::cout << std::endl;
+    dims = get_output_dims(args, dims);
+
+    // The GIF is written to a temporary file which replaces the output file
+    // once it is complete, so that a frame which fails to decode does not 
+    // leave a partial GIF behind.
+    gif::builder_stats stats;
+    try {
+        image::replace_file(args.output_file_name, [&](const std::filesystem::path& temp_path) {
+            if (stream.has_value()) {
+                stats = encode_stream(args, *stream, dims, temp_path);
+            }
+            else if (use_banded_encoding(args, dims)) {
+                stats = encode_banded(args, dims, temp_path);
+            }
+            else {
+                stats = encode_gif(args, dims, temp_path);
+            }
+        });
     }
-    
-    gif_stream.complete_stream();
-    
+    catch(std::exception& e) {
+        std::cout << "Error: failed to create " << args.output_file_name 
+                  << ". Operation failed with message: " << e.what() 
+                  << std::endl;
+        return 1;
+    }
+
     std::cout << "GIF file " << args.output_file_name 
-              << " created with " << args.input_files.size() << " frame(s)" 
+              << " created with " << stats.frames << " frame(s)" 
               << std::endl;
 
+    if (args.reuse_palettes) {
+        std::cout << "Color palettes were re-used for " << stats.palettes_reused 
+                  << " of " << stats.frames << " frame(s)" << std::endl;
+    }
+    if (args.local_palette_threshold.has_value()) {
+        std::cout << "Local color palettes were needed for " << stats.local_palettes 
+                  << " of " << stats.frames << " frame(s)" << std::endl;
+    }
+    if (args.delta_frames) {
+        double total_pixels = double(dims.width) * dims.height * stats.frames;
+        std::cout << "Delta encoding covered " << 100 * stats.pixels_encoded / total_pixels
+                  << "% of the frames' pixels" << std::endl;
+    }
+    if (args.coalesce_duplicates) {
+        std::cout << "Duplicate frames were coalesced for " << stats.frames_coalesced
+                  << " of " << stats.frames << " frame(s)" << std::endl;
+    }
+    if (args.transparency_tolerance.has_value() && stats.pixels_encoded > 0) {
+        std::cout << "Transparency covered " << 100.0 * stats.transparent_pixels / stats.pixels_encoded
+                  << "% of the encoded pixels" << std::endl;
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+// A client for gifgen --serve, which sends one encode request to the 
+// server and writes the GIF that it sends back to a file. For use testing
+// the server, and as an example of its protocol.
+
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "encode_client.hpp"
+
+// Print out instructions on how to run the program.
+void print_usage() {
+    std::cout << "USAGE:\tgifgen_client <socket path> <output.gif> <request JSON>" << std::endl
+              << "\te.g. gifgen_client /tmp/gifgen.sock out.gif '{\"inputs\": [\"a.png\", \"b.png\"], \"delay\": 100}'" 
+              << std::endl; 
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        print_usage();
+        return 1;
+    }
+    std::string socket_path = argv[1];
+    std::filesystem::path output_path(argv[2]);
+    std::filesystem::path temp_path(output_path);
+    temp_path += ".tmp";
+
+    // The GIF is written as it arrives, and only replaces the output file
+    // if the request succeeds.
+    constexpr uint32_t REQUEST_ID = 1;
+    std::string result;
+    try {
+        server::encode_client client(socket_path);
+        client.encode(REQUEST_ID, argv[3]);
+
+        std::ofstream output(temp_path, std::ios::out | std::ios::binary);
+        output.exceptions(std::ios::badbit | std::ios::failbit);
+        server::message m;
+        while (result.empty() && client.receive(m)) {
+            if (m.type == server::message_type::data) {
+                output.write(m.payload.data(), m.payload.size());
+            }
+            else if (m.type == server::message_type::result) {
+                result = m.payload;
+            }
+        }
+        output.close();
+    }
+    catch(std::exception& e) {
+        std::error_code ignored;
+        std::filesystem::remove(temp_path, ignored);
+        std::cout << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (result.find("\"status\": \"ok\"") == std::string::npos) {
+        std::error_code ignored;
+        std::filesystem::remove(temp_path, ignored);
+        std::cout << (result.empty() ? "ERROR: The server closed the connection" : result) << std::endl;
+        return 1;
+    }
+    std::filesystem::rename(temp_path, output_path);
+    std::cout << result << std::endl;
+    return 0;
+}
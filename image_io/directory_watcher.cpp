@@ -0,0 +1,121 @@
+#include "directory_watcher.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace image {
+
+    // Enough for many events, each of which may have a name of up to
+    // NAME_MAX bytes.
+    constexpr std::size_t EVENT_BUFFER_SIZE = 64 * (sizeof(inotify_event) + NAME_MAX + 1);
+
+    directory_watcher::directory_watcher(const std::string& dir) :
+            directory(dir),
+            inotify_fd(-1),
+            wake_fds{-1, -1},
+            stopped(false),
+            removed(false),
+            events(EVENT_BUFFER_SIZE),
+            ready(),
+            reported() {
+        inotify_fd = inotify_init1(IN_CLOEXEC);
+        if (inotify_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Unable to create an inotify instance");
+        }
+        if (inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+            int error = errno;
+            close(inotify_fd);
+            throw std::system_error(error, std::generic_category(), "Unable to watch directory " + directory);
+        }
+        if (pipe2(wake_fds, O_CLOEXEC) < 0) {
+            int error = errno;
+            close(inotify_fd);
+            throw std::system_error(error, std::generic_category(), "Unable to create pipe");
+        }
+    }
+
+    directory_watcher::~directory_watcher() {
+        close(inotify_fd);
+        close(wake_fds[0]);
+        close(wake_fds[1]);
+    }
+
+    void directory_watcher::stop() {
+        char wake = 0;
+        while (write(wake_fds[1], &wake, 1) < 0 && errno == EINTR) {
+        }
+    }
+
+    std::optional<watched_file> directory_watcher::next_file() {
+        while (ready.empty()) {
+            if (stopped || removed || !read_events()) {
+                stopped = true;
+                return std::nullopt;
+            }
+        }
+
+        auto file = std::move(ready.front());
+        ready.pop_front();
+        return file;
+    }
+
+    bool directory_watcher::read_events() {
+        pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {wake_fds[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                return true;
+            }
+            throw std::system_error(errno, std::generic_category(), "Unable to wait for files in " + directory);
+        }
+        if (fds[1].revents != 0) {
+            return false;
+        }
+        if ((fds[0].revents & POLLIN) == 0) {
+            return true;
+        }
+
+        auto read_count = read(inotify_fd, events.data(), events.size());
+        if (read_count < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                return true;
+            }
+            throw std::system_error(errno, std::generic_category(), "Unable to read events for " + directory);
+        }
+
+        // Every file in one read completed at about the same time.
+        auto now = std::chrono::steady_clock::now();
+        std::size_t offset = 0;
+        while (offset + sizeof(inotify_event) <= static_cast<std::size_t>(read_count)) {
+            // The events are not aligned in the buffer, so each header is
+            // copied out.
+            inotify_event event;
+            std::memcpy(&event, events.data() + offset, sizeof(inotify_event));
+            const char* name = events.data() + offset + sizeof(inotify_event);
+            offset += sizeof(inotify_event) + event.len;
+
+            if (event.mask & IN_Q_OVERFLOW) {
+                throw std::runtime_error("Too many files were written to " + directory + " at once to follow them");
+            }
+            if (event.mask & IN_IGNORED) {
+                // The watch was removed, along with the directory.
+                removed = true;
+                continue;
+            }
+            if ((event.mask & IN_ISDIR) || event.len == 0 || name[0] == '.' || name[0] == '\0') {
+                continue;
+            }
+
+            std::string file_name(name);
+            if (reported.insert(file_name).second) {
+                ready.push_back({directory + "/" + file_name, now});
+            }
+        }
+        return true;
+    }
+}
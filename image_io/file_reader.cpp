@@ -0,0 +1,530 @@
+#include "file_reader.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <initializer_list>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define IMAGE_IO_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#else
+#define IMAGE_IO_HAS_IO_URING 0
+#endif
+
+namespace image {
+
+    std::error_code last_error() {
+        return std::error_code(errno, std::system_category());
+    }
+
+    // Sets the size of the buffer to the size of the open file.
+    std::error_code size_buffer(int fd, file_buffer& contents) {
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            return last_error();
+        }
+        contents.resize(file_stat.st_size);
+        return {};
+    }
+
+#if IMAGE_IO_HAS_IO_URING
+
+    // A minimal io_uring instance, set up through the raw system calls so
+    // that liburing is not required. Only the operations needed to open 
+    // and read files are used.
+    class batch_file_reader::uring {
+    public:
+        // Returns null if io_uring is not available, or does not support 
+        // opening and reading files (Linux 5.6).
+        static std::unique_ptr<uring> create(unsigned entries);
+        ~uring();
+
+        unsigned capacity() const { return entries; }
+
+        // Returns the next free submission entry, cleared.
+        io_uring_sqe& next_entry();
+
+        // Submits the new entries and waits for at least wait_count 
+        // completions. Returns false on failure.
+        bool submit(unsigned wait_count);
+
+        // Removes a completion from the queue, if there is one.
+        bool pop_completion(io_uring_cqe& completion);
+
+    private:
+        int ring_fd = -1;
+        unsigned entries = 0;
+        unsigned unsubmitted = 0;
+
+        void* sq_ring = MAP_FAILED;
+        std::size_t sq_ring_size = 0;
+        void* cq_ring = MAP_FAILED;
+        std::size_t cq_ring_size = 0;
+        io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        std::size_t sqes_size = 0;
+
+        unsigned* sq_tail = nullptr;
+        unsigned* sq_mask = nullptr;
+        unsigned* sq_array = nullptr;
+        unsigned* cq_head = nullptr;
+        unsigned* cq_tail = nullptr;
+        unsigned* cq_mask = nullptr;
+        io_uring_cqe* cqes = nullptr;
+
+        template <typename T>
+        static T* at_offset(void* base, std::size_t offset) {
+            return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+        }
+
+        static unsigned load_acquire(const unsigned* p) {
+            return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+        }
+
+        static void store_release(unsigned* p, unsigned value) {
+            __atomic_store_n(p, value, __ATOMIC_RELEASE);
+        }
+
+        bool supports(std::initializer_list<uint8_t> ops);
+    };
+
+    std::unique_ptr<batch_file_reader::uring> batch_file_reader::uring::create(unsigned entries) {
+        io_uring_params params {};
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        std::unique_ptr<uring> ring(new uring());
+        ring->ring_fd = fd;
+        ring->entries = params.sq_entries;
+
+        ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            ring->sq_ring_size = ring->cq_ring_size = std::max(ring->sq_ring_size, ring->cq_ring_size);
+        }
+
+        ring->sq_ring = mmap(nullptr, ring->sq_ring_size, PROT_READ | PROT_WRITE, 
+                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (ring->sq_ring == MAP_FAILED) {
+            return nullptr;
+        }
+        if (!single_mmap) {
+            ring->cq_ring = mmap(nullptr, ring->cq_ring_size, PROT_READ | PROT_WRITE, 
+                                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (ring->cq_ring == MAP_FAILED) {
+                return nullptr;
+            }
+        }
+        void* cq_base = single_mmap ? ring->sq_ring : ring->cq_ring;
+
+        ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        ring->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, 
+                                                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (ring->sqes == MAP_FAILED) {
+            return nullptr;
+        }
+
+        ring->sq_tail = at_offset<unsigned>(ring->sq_ring, params.sq_off.tail);
+        ring->sq_mask = at_offset<unsigned>(ring->sq_ring, params.sq_off.ring_mask);
+        ring->sq_array = at_offset<unsigned>(ring->sq_ring, params.sq_off.array);
+        ring->cq_head = at_offset<unsigned>(cq_base, params.cq_off.head);
+        ring->cq_tail = at_offset<unsigned>(cq_base, params.cq_off.tail);
+        ring->cq_mask = at_offset<unsigned>(cq_base, params.cq_off.ring_mask);
+        ring->cqes = at_offset<io_uring_cqe>(cq_base, params.cq_off.cqes);
+
+        if (!ring->supports({IORING_OP_OPENAT, IORING_OP_READ})) {
+            return nullptr;
+        }
+        return ring;
+    }
+
+    bool batch_file_reader::uring::supports(std::initializer_list<uint8_t> ops) {
+        constexpr unsigned PROBE_OPS = 256;
+        std::vector<unsigned char> probe_memory(sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op), 0);
+        auto probe = reinterpret_cast<io_uring_probe*>(probe_memory.data());
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0) {
+            return false;
+        }
+        return std::all_of(ops.begin(), ops.end(), [probe](uint8_t op) {
+            return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+        });
+    }
+
+    batch_file_reader::uring::~uring() {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqes_size);
+        }
+        if (cq_ring != MAP_FAILED) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sq_ring != MAP_FAILED) {
+            munmap(sq_ring, sq_ring_size);
+        }
+        if (ring_fd >= 0) {
+            close(ring_fd);
+        }
+    }
+
+    // Only this thread writes the tail, so it can be read directly.
+    io_uring_sqe& batch_file_reader::uring::next_entry() {
+        assert (unsubmitted < entries);
+        unsigned tail = *sq_tail + unsubmitted;
+        unsigned index = tail & *sq_mask;
+        sq_array[index] = index;
+        sqes[index] = io_uring_sqe {};
+        ++unsubmitted;
+        return sqes[index];
+    }
+
+    bool batch_file_reader::uring::submit(unsigned wait_count) {
+        store_release(sq_tail, *sq_tail + unsubmitted);
+        auto submit_count = unsubmitted;
+        unsubmitted = 0;
+
+        while (submit_count > 0 || wait_count > 0) {
+            auto result = syscall(__NR_io_uring_enter, ring_fd, submit_count, wait_count, 
+                                  IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            submit_count -= std::min<unsigned>(submit_count, result);
+            wait_count = 0;
+        }
+        return true;
+    }
+
+    bool batch_file_reader::uring::pop_completion(io_uring_cqe& completion) {
+        unsigned head = *cq_head;
+        if (head == load_acquire(cq_tail)) {
+            return false;
+        }
+        completion = cqes[head & *cq_mask];
+        store_release(cq_head, head + 1);
+        return true;
+    }
+
+#else
+
+    // A placeholder for platforms without io_uring.
+    class batch_file_reader::uring {
+    public:
+        static std::unique_ptr<uring> create(unsigned) {
+            return nullptr;
+        }
+    };
+
+#endif
+
+    batch_file_reader::batch_file_reader(bool allow_io_uring) : ring() {
+        if (allow_io_uring) {
+            ring = uring::create(MAX_BATCH_FILES);
+        }
+    }
+
+    batch_file_reader::~batch_file_reader() = default;
+
+    batch_file_reader::backend batch_file_reader::active_backend() const {
+        return ring ? backend::io_uring : backend::pread;
+    }
+
+    void batch_file_reader::read_with_pread(file_read& read) {
+        read.error.clear();
+        int fd = open(read.filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            read.error = last_error();
+            read.contents.clear();
+            return;
+        }
+
+        read.error = size_buffer(fd, read.contents);
+        std::size_t offset = 0;
+        while (!read.error && offset < read.contents.size()) {
+            auto result = pread(fd, read.contents.data() + offset, read.contents.size() - offset, offset);
+            if (result < 0 && errno != EINTR) {
+                read.error = last_error();
+            }
+            else if (result == 0) {
+                // The file was truncated after its size was read.
+                read.contents.resize(offset);
+            }
+            else if (result > 0) {
+                offset += result;
+            }
+        }
+
+        if (read.error) {
+            read.contents.clear();
+        }
+        close(fd);
+    }
+
+#if IMAGE_IO_HAS_IO_URING
+
+    // The files are read in three steps. All of the files are opened with 
+    // one submission, then their buffers are sized and all of the reads are 
+    // submitted together. Reads which return short are re-submitted for the
+    // rest of the file. Finally, the files are closed.
+    void batch_file_reader::read_files(std::vector<file_read>& reads) {
+        if (!ring) {
+            for (auto& read : reads) {
+                read_with_pread(read);
+            }
+            return;
+        }
+
+        for (std::size_t first = 0; first < reads.size(); first += ring->capacity()) {
+            std::size_t last = std::min<std::size_t>(reads.size(), first + ring->capacity());
+            std::size_t batch_size = last - first;
+            std::vector<int> fds(batch_size, -1);
+            std::vector<std::size_t> offsets(batch_size, 0);
+
+            for (std::size_t i = 0; i < batch_size; ++i) {
+                auto& read = reads[first + i];
+                read.error.clear();
+                auto& entry = ring->next_entry();
+                entry.opcode = IORING_OP_OPENAT;
+                entry.fd = AT_FDCWD;
+                entry.addr = reinterpret_cast<uintptr_t>(read.filename.c_str());
+                entry.open_flags = O_RDONLY | O_CLOEXEC;
+                entry.user_data = i;
+            }
+
+            // Waits for all the submitted entries, calling handle_completion
+            // for each one. If the ring fails, the affected files are read 
+            // with pread instead.
+            auto complete = [&](std::size_t count, auto handle_completion) {
+                if (!ring->submit(count)) {
+                    return false;
+                }
+                io_uring_cqe completion;
+                for (std::size_t done = 0; done < count; ) {
+                    if (!ring->pop_completion(completion)) {
+                        if (!ring->submit(1)) {
+                            return false;
+                        }
+                        continue;
+                    }
+                    handle_completion(completion);
+                    ++done;
+                }
+                return true;
+            };
+
+            bool ring_ok = complete(batch_size, [&](const io_uring_cqe& completion) {
+                auto i = completion.user_data;
+                if (completion.res < 0) {
+                    reads[first + i].error = std::error_code(-completion.res, std::system_category());
+                }
+                else {
+                    fds[i] = completion.res;
+                }
+            });
+
+            // Submit the reads of the whole files, then re-submit the rest 
+            // of any short reads until every file is complete.
+            std::vector<std::size_t> pending;
+            for (std::size_t i = 0; ring_ok && i < batch_size; ++i) {
+                auto& read = reads[first + i];
+                if (fds[i] >= 0 && !read.error) {
+                    read.error = size_buffer(fds[i], read.contents);
+                    if (!read.error && !read.contents.empty()) {
+                        pending.push_back(i);
+                    }
+                }
+            }
+
+            while (ring_ok && !pending.empty()) {
+                for (auto i : pending) {
+                    auto& read = reads[first + i];
+                    auto& entry = ring->next_entry();
+                    entry.opcode = IORING_OP_READ;
+                    entry.fd = fds[i];
+                    entry.addr = reinterpret_cast<uintptr_t>(read.contents.data() + offsets[i]);
+                    entry.len = static_cast<uint32_t>(std::min<std::size_t>(read.contents.size() - offsets[i], UINT32_MAX));
+                    entry.off = offsets[i];
+                    entry.user_data = i;
+                }
+
+                std::vector<std::size_t> unfinished;
+                ring_ok = complete(pending.size(), [&](const io_uring_cqe& completion) {
+                    auto i = completion.user_data;
+                    auto& read = reads[first + i];
+                    if (completion.res < 0) {
+                        read.error = std::error_code(-completion.res, std::system_category());
+                    }
+                    else if (completion.res == 0) {
+                        // The file was truncated after its size was read.
+                        read.contents.resize(offsets[i]);
+                    }
+                    else {
+                        offsets[i] += completion.res;
+                        if (offsets[i] < read.contents.size()) {
+                            unfinished.push_back(i);
+                        }
+                    }
+                });
+                pending = std::move(unfinished);
+            }
+
+            for (std::size_t i = 0; i < batch_size; ++i) {
+                auto& read = reads[first + i];
+                if (fds[i] >= 0) {
+                    close(fds[i]);
+                }
+                if (!ring_ok) {
+                    read_with_pread(read);
+                }
+                else if (read.error) {
+                    read.contents.clear();
+                }
+            }
+
+            if (!ring_ok) {
+                // Stop using a ring which has failed.
+                ring.reset();
+                for (std::size_t i = last; i < reads.size(); ++i) {
+                    read_with_pread(reads[i]);
+                }
+                return;
+            }
+        }
+    }
+
+#else
+
+    void batch_file_reader::read_files(std::vector<file_read>& reads) {
+        for (auto& read : reads) {
+            read_with_pread(read);
+        }
+    }
+
+#endif
+
+    file_prefetcher::file_prefetcher(std::vector<std::string> names,
+                                     std::size_t max_files,
+                                     std::size_t max_bytes,
+                                     bool allow_io_uring) :
+            filenames(std::move(names)),
+            max_files_ahead(std::max<std::size_t>(1, max_files)),
+            max_bytes_ahead(max_bytes),
+            reader(allow_io_uring),
+            mutex(),
+            files_read(),
+            files_taken(),
+            files(filenames.size()),
+            spare_buffers(),
+            read_end(0),
+            wanted_end(0),
+            files_ahead(0),
+            bytes_ahead(0),
+            stopping(false),
+            io_thread() {
+        io_thread = std::thread([this]() { run_io_thread(); });
+    }
+
+    file_prefetcher::~file_prefetcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        files_taken.notify_all();
+        io_thread.join();
+    }
+
+    std::size_t file_prefetcher::file_count() const {
+        return filenames.size();
+    }
+
+    batch_file_reader::backend file_prefetcher::active_backend() const {
+        return reader.active_backend();
+    }
+
+    void file_prefetcher::run_io_thread() {
+        std::vector<file_read> batch;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (read_end < files.size()) {
+            files_taken.wait(lock, [this]() {
+                return stopping 
+                    || wanted_end > read_end
+                    || (files_ahead < max_files_ahead && bytes_ahead < max_bytes_ahead);
+            });
+            if (stopping) {
+                return;
+            }
+
+            // Read as many files as the limit allows, or up to the file 
+            // which is being waited for.
+            std::size_t batch_size = std::max(max_files_ahead - std::min(files_ahead, max_files_ahead), 
+                                              wanted_end > read_end ? wanted_end - read_end : 0);
+            batch_size = std::min({batch_size, batch_file_reader::MAX_BATCH_FILES, files.size() - read_end});
+            batch_size = std::max<std::size_t>(batch_size, 1);
+
+            batch.resize(batch_size);
+            for (std::size_t i = 0; i < batch_size; ++i) {
+                batch[i].filename = filenames[read_end + i];
+                if (!spare_buffers.empty()) {
+                    batch[i].contents = std::move(spare_buffers.back());
+                    spare_buffers.pop_back();
+                }
+            }
+
+            lock.unlock();
+            reader.read_files(batch);
+            lock.lock();
+
+            for (std::size_t i = 0; i < batch_size; ++i) {
+                auto& file = files[read_end + i];
+                file.contents = std::move(batch[i].contents);
+                file.error = batch[i].error;
+                file.state = file_state::ready;
+                ++files_ahead;
+                bytes_ahead += file.contents.size();
+            }
+            read_end += batch_size;
+            files_read.notify_all();
+        }
+    }
+
+    file_buffer file_prefetcher::take(std::size_t index) {
+        assert (index < files.size());
+        std::unique_lock<std::mutex> lock(mutex);
+        if (index >= read_end) {
+            wanted_end = std::max(wanted_end, index + 1);
+            files_taken.notify_all();
+            files_read.wait(lock, [this, index]() { return index < read_end; });
+        }
+
+        auto& file = files[index];
+        assert (file.state == file_state::ready);
+        file.state = file_state::taken;
+        --files_ahead;
+        bytes_ahead -= file.contents.size();
+        files_taken.notify_all();
+
+        if (file.error) {
+            throw std::system_error(file.error, "Unable to read " + filenames[index]);
+        }
+        return std::move(file.contents);
+    }
+
+    void file_prefetcher::recycle(file_buffer buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Enough buffers for a whole batch are kept.
+        if (spare_buffers.size() < batch_file_reader::MAX_BATCH_FILES) {
+            buffer.clear();
+            spare_buffers.push_back(std::move(buffer));
+        }
+    }
+}
@@ -0,0 +1,140 @@
+#include "frame_prefetcher.hpp"
+#include "image_io.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace image {
+
+    frame_prefetcher::frame_prefetcher(std::vector<std::string> names, 
+                                       file_type t,
+                                       const decode_options& o,
+                                       std::size_t max_buffered_bytes,
+                                       runtime::task_pool& p) :
+            filenames(std::move(names)),
+            type(t),
+            options(o),
+            files(filenames),
+            pool(p),
+            buffers(),
+            next_frame_index(0),
+            state(std::make_shared<task_state>()) {
+        // Frames further ahead than one per worker could not be decoded 
+        // any sooner, so there is no use in buffering them.
+        std::size_t count = pool.worker_count() + 1;
+        if (!filenames.empty()) {
+            auto info = read_image_info(filenames.front(), type);
+            if (info.has_value()) {
+                auto frame_pixels = scaled_dimension(info->width, options.scale) * scaled_dimension(info->height, options.scale);
+                auto frame_bytes = frame_pixels * sizeof(rgb_pixel_t);
+                count = std::min(count, max_buffered_bytes / frame_bytes);
+            }
+        }
+        count = std::min(std::max<std::size_t>(count, 2), std::max<std::size_t>(filenames.size(), 1));
+        buffers.resize(count);
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        for (std::size_t i = 0; i < std::min(buffers.size(), filenames.size()); ++i) {
+            start_decoding(i);
+        }
+    }
+
+    frame_prefetcher::~frame_prefetcher() {
+        // Only tasks which are decoding are waited for. They run on other
+        // threads, so this does not wait for a task which is queued behind
+        // the calling thread's own.
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->destroyed = true;
+        state->buffer_changed.wait(lock, [this]() { return state->decoding_tasks == 0; });
+    }
+
+    std::size_t frame_prefetcher::frame_count() const {
+        return filenames.size();
+    }
+
+    std::size_t frame_prefetcher::buffer_count() const {
+        return buffers.size();
+    }
+
+    bool frame_prefetcher::has_next_frame() const {
+        return next_frame_index < filenames.size();
+    }
+
+    void frame_prefetcher::start_decoding(std::size_t frame) {
+        auto& buffer = buffers[frame % buffers.size()];
+        buffer.frame = frame;
+        buffer.state = buffer_state::queued;
+        buffer.error = nullptr;
+
+        try {
+            // Earlier frames are needed sooner.
+            pool.submit([this, frame, state = state]() {
+                std::unique_lock<std::mutex> lock(state->mutex);
+                if (!state->destroyed) {
+                    run_decoding_task(frame, lock);
+                }
+            }, frame);
+        }
+        catch(...) {
+            // The frame will be decoded by next_frame instead.
+        }
+    }
+
+    void frame_prefetcher::decode(frame_buffer& buffer) {
+        try {
+            auto contents = files.take(buffer.frame);
+            read_image(contents, buffer.image, type, options);
+            files.recycle(std::move(contents));
+        }
+        catch(...) {
+            buffer.error = std::current_exception();
+        }
+    }
+
+    void frame_prefetcher::run_decoding_task(std::size_t frame, std::unique_lock<std::mutex>& lock) {
+        auto& buffer = buffers[frame % buffers.size()];
+        if (buffer.frame == frame && buffer.state == buffer_state::queued) {
+            buffer.state = buffer_state::decoding;
+            ++state->decoding_tasks;
+            lock.unlock();
+            decode(buffer);
+            lock.lock();
+            buffer.state = buffer_state::ready;
+            --state->decoding_tasks;
+            state->buffer_changed.notify_all();
+        }
+    }
+
+    rgb_image_t& frame_prefetcher::next_frame() {
+        assert (has_next_frame());
+        std::unique_lock<std::mutex> lock(state->mutex);
+
+        // The buffer of the previous frame is no longer in use, so the
+        // frame which follows the buffered ones can be started.
+        if (next_frame_index > 0) {
+            auto following_frame = next_frame_index - 1 + buffers.size();
+            if (following_frame < filenames.size()) {
+                start_decoding(following_frame);
+            }
+        }
+
+        auto frame = next_frame_index++;
+        auto& buffer = buffers[frame % buffers.size()];
+        assert (buffer.frame == frame);
+        if (buffer.state == buffer_state::queued) {
+            // Decode the frame here rather than wait for a busy pool.
+            buffer.state = buffer_state::decoding;
+            lock.unlock();
+            decode(buffer);
+            lock.lock();
+            buffer.state = buffer_state::ready;
+        }
+        else {
+            state->buffer_changed.wait(lock, [&buffer]() { return buffer.state == buffer_state::ready; });
+        }
+
+        if (buffer.error) {
+            std::rethrow_exception(buffer.error);
+        }
+        return buffer.image;
+    }
+}
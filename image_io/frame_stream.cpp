@@ -0,0 +1,403 @@
+#include "frame_stream.hpp"
+#include "pixel_convert.hpp"
+#include "task_pool.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+
+namespace image {
+
+    // Enough to hold any header, and small enough that copying frame data
+    // which arrives with a header costs little.
+    constexpr std::size_t STREAM_BUFFER_SIZE = std::size_t(64) << 10;
+
+    // The longest header line which is accepted.
+    constexpr std::size_t MAX_LINE_LENGTH = 4096;
+
+    // The largest frame dimension which is accepted, which is also the 
+    // largest that a GIF can hold.
+    constexpr std::size_t MAX_DIMENSION = 0xFFFF;
+
+    frame_stream::frame_stream(int file_descriptor) :
+            fd(file_descriptor),
+            stream_type(stream_format::PPM),
+            buffer(STREAM_BUFFER_SIZE),
+            buffer_begin(0),
+            buffer_end(0),
+            has_next_header(false),
+            frame_width(0),
+            frame_height(0),
+            first_width(0),
+            first_height(0),
+            frame_count(0),
+            max_value(255),
+            monochrome(false),
+            chroma_shift_x(1),
+            chroma_shift_y(1),
+            full_range(false),
+            planes(),
+            wide_samples() {
+        auto first = peek_byte();
+        if (first == 'P') {
+            stream_type = stream_format::PPM;
+            has_next_header = read_ppm_header();
+        }
+        else if (first == 'Y') {
+            stream_type = stream_format::Y4M;
+            read_y4m_stream_header();
+            has_next_header = read_y4m_frame_header();
+        }
+        else if (first == -1) {
+            throw std::runtime_error("The frame stream is empty");
+        }
+        else {
+            throw std::runtime_error("The frame stream is not a PPM or YUV4MPEG2 stream");
+        }
+
+        if (!has_next_header) {
+            throw std::runtime_error("The frame stream has no frames");
+        }
+        first_width = frame_width;
+        first_height = frame_height;
+    }
+
+    stream_format frame_stream::format() const {
+        return stream_type;
+    }
+
+    std::size_t frame_stream::width() const {
+        return first_width;
+    }
+
+    std::size_t frame_stream::height() const {
+        return first_height;
+    }
+
+    std::size_t frame_stream::frames_read() const {
+        return frame_count;
+    }
+
+    bool frame_stream::read_frame(rgb_image_t& img) {
+        if (!has_next_header) {
+            has_next_header = stream_type == stream_format::PPM 
+                ? read_ppm_header() 
+                : read_y4m_frame_header();
+            if (!has_next_header) {
+                return false;
+            }
+        }
+
+        if (static_cast<std::size_t>(img.width()) != frame_width || 
+                static_cast<std::size_t>(img.height()) != frame_height) {
+            img.recreate(frame_width, frame_height);
+        }
+        if (stream_type == stream_format::PPM) {
+            read_ppm_pixels(img);
+        }
+        else {
+            read_y4m_pixels(img);
+        }
+
+        has_next_header = false;
+        ++frame_count;
+        return true;
+    }
+
+    bool frame_stream::fill_buffer() {
+        buffer_begin = 0;
+        buffer_end = 0;
+        while (true) {
+            auto count = ::read(fd, buffer.data(), buffer.size());
+            if (count >= 0) {
+                buffer_end = count;
+                return count > 0;
+            }
+            if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "Unable to read the frame stream");
+            }
+        }
+    }
+
+    int frame_stream::peek_byte() {
+        if (buffer_begin == buffer_end && !fill_buffer()) {
+            return -1;
+        }
+        return buffer[buffer_begin];
+    }
+
+    int frame_stream::get_byte() {
+        auto byte = peek_byte();
+        if (byte != -1) {
+            ++buffer_begin;
+        }
+        return byte;
+    }
+
+    void frame_stream::read_exact(unsigned char* destination, std::size_t count) {
+        while (count > 0) {
+            if (buffer_begin < buffer_end) {
+                auto buffered = std::min(count, buffer_end - buffer_begin);
+                std::memcpy(destination, buffer.data() + buffer_begin, buffered);
+                buffer_begin += buffered;
+                destination += buffered;
+                count -= buffered;
+            }
+            else if (count >= buffer.size()) {
+                auto read_count = ::read(fd, destination, count);
+                if (read_count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (read_count < 0) {
+                    throw std::system_error(errno, std::generic_category(), "Unable to read the frame stream");
+                }
+                if (read_count == 0) {
+                    throw std::runtime_error("The frame stream ended part way through a frame");
+                }
+                destination += read_count;
+                count -= read_count;
+            }
+            else if (!fill_buffer()) {
+                throw std::runtime_error("The frame stream ended part way through a frame");
+            }
+        }
+    }
+
+    std::string frame_stream::read_line() {
+        std::string line;
+        while (true) {
+            auto byte = get_byte();
+            if (byte == -1) {
+                throw std::runtime_error("The frame stream ended part way through a header");
+            }
+            if (byte == '\n') {
+                return line;
+            }
+            if (line.size() == MAX_LINE_LENGTH) {
+                throw std::runtime_error("The frame stream has a header line which is too long");
+            }
+            line.push_back(static_cast<char>(byte));
+        }
+    }
+
+    // A PPM header is the magic number P6 followed by the width, height and
+    // maximum sample value as decimal numbers. These are separated by 
+    // whitespace, which may include comments running from # to the end of 
+    // the line. A single whitespace character separates the header from 
+    // the samples.
+    bool frame_stream::read_ppm_header() {
+        // Tolerate whitespace between concatenated frames.
+        while (std::isspace(peek_byte())) {
+            get_byte();
+        }
+        if (peek_byte() == -1) {
+            return false;
+        }
+        if (get_byte() != 'P' || get_byte() != '6') {
+            throw std::runtime_error("The frame stream has a frame which is not a binary PPM image");
+        }
+
+        auto read_number = [this](std::size_t max) {
+            int byte = get_byte();
+            while (std::isspace(byte) || byte == '#') {
+                if (byte == '#') {
+                    while (byte != '\n' && byte != -1) {
+                        byte = get_byte();
+                    }
+                }
+                byte = get_byte();
+            }
+
+            std::size_t value = 0;
+            if (!std::isdigit(byte)) {
+                throw std::runtime_error("The frame stream has a malformed PPM header");
+            }
+            while (std::isdigit(byte)) {
+                value = 10 * value + (byte - '0');
+                if (value > max) {
+                    throw std::runtime_error("The frame stream has a PPM header value which is out of range");
+                }
+                byte = get_byte();
+            }
+            if (!std::isspace(byte)) {
+                throw std::runtime_error("The frame stream has a malformed PPM header");
+            }
+            return value;
+        };
+
+        frame_width = read_number(MAX_DIMENSION);
+        frame_height = read_number(MAX_DIMENSION);
+        max_value = read_number(0xFFFF);
+        if (frame_width == 0 || frame_height == 0 || max_value == 0) {
+            throw std::runtime_error("The frame stream has a PPM header value which is out of range");
+        }
+        return true;
+    }
+
+    // The stream header is the magic string YUV4MPEG2 followed by a list of
+    // parameters on one line. Each parameter is a letter and a value. The
+    // dimensions, color space and extension parameters are used here, and
+    // the frame rate, interlacing and aspect ratio are ignored.
+    void frame_stream::read_y4m_stream_header() {
+        auto line = read_line();
+        constexpr const char* MAGIC = "YUV4MPEG2";
+        if (line.compare(0, std::strlen(MAGIC), MAGIC) != 0) {
+            throw std::runtime_error("The frame stream is not a PPM or YUV4MPEG2 stream");
+        }
+
+        std::string color_space = "420jpeg";
+        std::size_t position = std::strlen(MAGIC);
+        while (position < line.size()) {
+            auto end = line.find(' ', position);
+            if (end == std::string::npos) {
+                end = line.size();
+            }
+            auto parameter = line.substr(position, end - position);
+            position = end + 1;
+            if (parameter.empty()) {
+                continue;
+            }
+
+            auto value = parameter.substr(1);
+            try {
+                switch (parameter[0]) {
+                    case 'W': frame_width = std::stoul(value); break;
+                    case 'H': frame_height = std::stoul(value); break;
+                    case 'C': color_space = value; break;
+                    case 'X': 
+                        if (value == "COLORRANGE=FULL") {
+                            full_range = true;
+                        }
+                        break;
+                }
+            }
+            catch(std::exception&) {
+                throw std::runtime_error("The frame stream has a malformed YUV4MPEG2 header");
+            }
+        }
+
+        if (frame_width == 0 || frame_height == 0 || 
+                frame_width > MAX_DIMENSION || frame_height > MAX_DIMENSION) {
+            throw std::runtime_error("The frame stream has YUV4MPEG2 dimensions which are out of range");
+        }
+
+        if (color_space == "420jpeg" || color_space == "420paldv" || 
+                color_space == "420mpeg2" || color_space == "420") {
+            chroma_shift_x = 1;
+            chroma_shift_y = 1;
+        }
+        else if (color_space == "422") {
+            chroma_shift_x = 1;
+            chroma_shift_y = 0;
+        }
+        else if (color_space == "444") {
+            chroma_shift_x = 0;
+            chroma_shift_y = 0;
+        }
+        else if (color_space == "mono") {
+            monochrome = true;
+            chroma_shift_x = 0;
+            chroma_shift_y = 0;
+        }
+        else {
+            throw std::runtime_error("The frame stream uses the unsupported YUV4MPEG2 color space " + color_space);
+        }
+    }
+
+    // Each frame starts with the word FRAME and any frame parameters on
+    // one line.
+    bool frame_stream::read_y4m_frame_header() {
+        if (peek_byte() == -1) {
+            return false;
+        }
+        if (read_line().compare(0, 5, "FRAME") != 0) {
+            throw std::runtime_error("The frame stream has a malformed YUV4MPEG2 frame header");
+        }
+        return true;
+    }
+
+    void frame_stream::read_ppm_pixels(rgb_image_t& img) {
+        auto img_view = boost::gil::view(img);
+        std::size_t row_samples = 3 * frame_width;
+
+        // 8-bit samples are read into the image, and 16-bit samples are 
+        // narrowed into it.
+        if (max_value <= 0xFF) {
+            if (img_view.is_1d_traversable()) {
+                read_exact(reinterpret_cast<unsigned char*>(&img_view(0, 0)), row_samples * frame_height);
+            }
+            else {
+                for (std::size_t y = 0; y < frame_height; ++y) {
+                    read_exact(reinterpret_cast<unsigned char*>(&img_view(0, y)), row_samples);
+                }
+            }
+
+            if (max_value != 0xFF) {
+                for (std::size_t y = 0; y < frame_height; ++y) {
+                    auto row = reinterpret_cast<uint8_t*>(&img_view(0, y));
+                    for (std::size_t i = 0; i < row_samples; ++i) {
+                        row[i] = static_cast<uint8_t>(std::min<std::size_t>(0xFF, (row[i] * 0xFF + max_value / 2) / max_value));
+                    }
+                }
+            }
+            return;
+        }
+
+        // 16-bit samples are big-endian, and are stretched to the full 
+        // 16-bit range before they are narrowed.
+        wide_samples.resize(row_samples * frame_height);
+        auto bytes = reinterpret_cast<unsigned char*>(wide_samples.data());
+        read_exact(bytes, 2 * wide_samples.size());
+        for (std::size_t i = 0; i < wide_samples.size(); ++i) {
+            std::size_t value = (std::size_t(bytes[2 * i]) << 8) | bytes[2 * i + 1];
+            if (max_value != 0xFFFF) {
+                value = std::min<std::size_t>(0xFFFF, (value * 0xFFFF + max_value / 2) / max_value);
+            }
+            wide_samples[i] = static_cast<uint16_t>(value);
+        }
+        for (std::size_t y = 0; y < frame_height; ++y) {
+            narrow_channels(wide_samples.data() + y * row_samples, 
+                            reinterpret_cast<uint8_t*>(&img_view(0, y)), 
+                            row_samples);
+        }
+    }
+
+    // The planes are read together, and then converted in bands of rows on
+    // the shared task pool.
+    void frame_stream::read_y4m_pixels(rgb_image_t& img) {
+        std::size_t luma_size = frame_width * frame_height;
+        std::size_t chroma_width = (frame_width + (std::size_t(1) << chroma_shift_x) - 1) >> chroma_shift_x;
+        std::size_t chroma_height = (frame_height + (std::size_t(1) << chroma_shift_y) - 1) >> chroma_shift_y;
+        std::size_t chroma_size = monochrome ? 0 : chroma_width * chroma_height;
+
+        // Monochrome frames are converted with a neutral chroma row after 
+        // the luma plane, which is not read from the stream.
+        if (monochrome) {
+            planes.resize(luma_size + frame_width);
+            std::fill(planes.begin() + luma_size, planes.end(), 128);
+        }
+        else {
+            planes.resize(luma_size + 2 * chroma_size);
+        }
+        read_exact(planes.data(), luma_size + 2 * chroma_size);
+
+        auto img_view = boost::gil::view(img);
+        constexpr std::size_t ROWS_PER_TASK = 32;
+        runtime::parallel_for(0, frame_height, ROWS_PER_TASK, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t y = begin; y < end; ++y) {
+                const uint8_t* luma = planes.data() + y * frame_width;
+                const uint8_t* cb = planes.data() + luma_size;
+                const uint8_t* cr = cb;
+                if (!monochrome) {
+                    cb += (y >> chroma_shift_y) * chroma_width;
+                    cr = cb + chroma_size;
+                }
+                ycbcr_to_rgb(luma, cb, cr, chroma_shift_x, full_range, 
+                             reinterpret_cast<uint8_t*>(&img_view(0, y)), frame_width);
+            }
+        });
+    }
+}
@@ -1,9 +1,205 @@
 #include "image_io.hpp"
+#include "pixel_convert.hpp"
+#include "preprocess.hpp"
 #include <boost/gil/extension/io/png.hpp>
 #include <boost/gil/extension/io/jpeg.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <csetjmp>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <streambuf>
+#include <system_error>
+#include <vector>
 
 namespace image {
 
+    // GIL's read_image_info sets up a full decoder for the file, and reports
+    // errors by throwing. Headers are instead parsed directly here, which 
+    // only requires the first few bytes of a PNG file, and the segments of 
+    // a JPEG file up to its frame header.
+
+    // Reads a big-endian integer of the given number of bytes. 
+    std::size_t read_big_endian(const unsigned char* bytes, std::size_t length) {
+        std::size_t value = 0;
+        for (std::size_t i = 0; i < length; ++i) {
+            value = (value << 8) | bytes[i];
+        }
+        return value;
+    }
+
+    // A PNG file begins with an 8 byte signature, which is followed by the
+    // IHDR chunk: a 4 byte length, the chunk type, the width and height as
+    // 4 byte integers, and then one byte each for the bit depth and color 
+    // type.
+    std::optional<image_info> read_png_info(std::istream& file) {
+        constexpr unsigned char SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        constexpr std::size_t HEADER_SIZE = sizeof(SIGNATURE) + 8 + 10;
+
+        unsigned char header[HEADER_SIZE];
+        if (!file.read(reinterpret_cast<char*>(header), HEADER_SIZE) 
+                || !std::equal(std::begin(SIGNATURE), std::end(SIGNATURE), header)
+                || std::string(header + 12, header + 16) != "IHDR") {
+            return std::nullopt;
+        }
+
+        const unsigned char* ihdr = header + 16;
+        image_info info;
+        info.type = file_type::PNG;
+        info.width = read_big_endian(ihdr, 4);
+        info.height = read_big_endian(ihdr + 4, 4);
+        info.bit_depth = ihdr[8];
+
+        // The channels in each color type, as reported by libpng.
+        switch (ihdr[9]) {
+            case 0: info.channels = 1; break; // Grayscale
+            case 2: info.channels = 3; break; // RGB
+            case 3: info.channels = 1; break; // Indexed
+            case 4: info.channels = 2; break; // Grayscale with alpha
+            case 6: info.channels = 4; break; // RGBA
+            default: return std::nullopt;
+        }
+
+        if (info.width == 0 || info.height == 0) {
+            return std::nullopt;
+        }
+        return info;
+    }
+
+    // A JPEG file is a sequence of segments, each starting with a 0xFF
+    // byte and a marker code. The frame dimensions are held in the first 
+    // start of frame (SOF) segment, which follows any tables and metadata.
+    // Every segment before it has a two byte length after its marker.
+    std::optional<image_info> read_jpeg_info(std::istream& file) {
+        unsigned char marker[2];
+        if (!file.read(reinterpret_cast<char*>(marker), 2) 
+                || marker[0] != 0xFF 
+                || marker[1] != 0xD8) {
+            return std::nullopt;
+        }
+
+        while (true) {
+            // Markers may be preceded by any number of 0xFF fill bytes.
+            int byte = file.get();
+            if (byte != 0xFF) {
+                return std::nullopt;
+            }
+            while (byte == 0xFF) {
+                byte = file.get();
+            }
+            if (byte == std::char_traits<char>::eof()) {
+                return std::nullopt;
+            }
+
+            // Restart markers and TEM have no length.
+            if ((byte >= 0xD0 && byte <= 0xD7) || byte == 0x01) {
+                continue;
+            }
+            // The image data starts before any frame header was found.
+            if (byte == 0xD9 || byte == 0xDA) {
+                return std::nullopt;
+            }
+
+            unsigned char length_bytes[2];
+            if (!file.read(reinterpret_cast<char*>(length_bytes), 2)) {
+                return std::nullopt;
+            }
+            auto length = read_big_endian(length_bytes, 2);
+            if (length < 2) {
+                return std::nullopt;
+            }
+
+            // SOF0 to SOF15, except for DHT (C4), JPG (C8) and DAC (CC).
+            bool is_frame_header = byte >= 0xC0 && byte <= 0xCF 
+                                && byte != 0xC4 && byte != 0xC8 && byte != 0xCC;
+            if (!is_frame_header) {
+                file.seekg(length - 2, std::ios::cur);
+                continue;
+            }
+
+            // The SOF segment holds the precision, height, width and 
+            // number of components.
+            unsigned char frame_header[6];
+            if (length < 8 || !file.read(reinterpret_cast<char*>(frame_header), 6)) {
+                return std::nullopt;
+            }
+
+            image_info info;
+            info.type = file_type::JPEG;
+            info.bit_depth = frame_header[0];
+            info.height = read_big_endian(frame_header + 1, 2);
+            info.width = read_big_endian(frame_header + 3, 2);
+            info.channels = frame_header[5];
+
+            // A height of 0 is deferred to a later DNL segment, which 
+            // libjpeg does not support.
+            if (info.width == 0 || info.height == 0 || info.channels == 0) {
+                return std::nullopt;
+            }
+            return info;
+        }
+    }
+
+    std::optional<image_info> read_image_info(const std::string& filename, file_type type) {
+        assert (type == file_type::JPEG || type == file_type::PNG);
+        std::ifstream file(filename, std::ios::in | std::ios::binary);
+        if (!file) {
+            return std::nullopt;
+        }
+        return type == file_type::JPEG
+            ? read_jpeg_info(file)
+            : read_png_info(file);
+    }
+
+    // Reads from an image in memory without copying it, for the header 
+    // parsers above.
+    class memory_streambuf : public std::streambuf {
+    public:
+        explicit memory_streambuf(byte_view contents) {
+            auto begin = const_cast<char*>(reinterpret_cast<const char*>(contents.data()));
+            setg(begin, begin, begin + contents.size());
+        }
+
+    protected:
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode) override {
+            char* base = direction == std::ios_base::beg ? eback()
+                       : direction == std::ios_base::cur ? gptr()
+                       : egptr();
+            if (offset < eback() - base || offset > egptr() - base) {
+                return pos_type(off_type(-1));
+            }
+            setg(eback(), base + offset, egptr());
+            return pos_type(gptr() - eback());
+        }
+    };
+
+    std::optional<image_info> read_image_info(byte_view contents) {
+        if (contents.size() == 0) {
+            return std::nullopt;
+        }
+        memory_streambuf buffer(contents);
+        std::istream stream(&buffer);
+        return contents.data()[0] == 0xFF
+            ? read_jpeg_info(stream)
+            : read_png_info(stream);
+    }
+
+    // libjpeg converts 8-bit grayscale and YCbCr or RGB JPEG images to
+    // RGB, but not CMYK images. Every PNG layout can be converted.
+    bool is_rgb8_compatible(const image_info& info) {
+        if (info.type == file_type::JPEG) {
+            return info.bit_depth == 8 && (info.channels == 1 || info.channels == 3);
+        }
+        return info.bit_depth <= 16 && info.channels <= 4;
+    }
+
+    bool is_file_type(const std::string& filename, file_type type) {
+        return read_image_info(filename, type).has_value();
+    }
+
     // Due to how boost::gil handles different file types, image layouts,
     // etc., there isn't a clean generic way to work specifically with JPEG
     // and PNG files as we want to without a little duplication. The jpeg and 
@@ -11,44 +207,482 @@ namespace image {
     // a common type, which restricts how they may be used. This is the reason
     // for the delegation approach taken here, which does unfortunately introduce
     // some duplication, but allows the code to remain dead-simple. 
+    //
+    // GIL only reads images whose layout matches the image exactly, so 
+    // images are instead read with libpng and libjpeg directly, in the 
+    // layout they are stored in, and converted to 8-bit RGB.
+
+    void read_image(const std::string& filename, boost::gil::rgb8_image_t& img, file_type type) {
+        assert (type == file_type::JPEG || type == file_type::PNG);
+        return type == file_type::JPEG 
+            ? read_jpeg_image(filename, img) 
+            : read_png_image(filename, img); 
+    }
 
-    template<class BoostFileTag>
-    bool boost_is_file_type(const std::string& filename) {
-        // Unfortunately, GIL doesn't give us a nice way to query an image file's
-        // encoding, so we try to read the image header as the given file type, 
-        // and return false if this fails.
-        try {
-            boost::gil::read_image_info(filename, BoostFileTag{});
-            return true;
+    file_buffer read_file_contents(const std::string& filename) {
+        std::vector<file_read> reads(1);
+        reads[0].filename = filename;
+        batch_file_reader(false).read_files(reads);
+        if (reads[0].error) {
+            throw std::system_error(reads[0].error, "Unable to read " + filename);
         }
-        catch(...) {
-            return false;
+        return std::move(reads[0].contents);
+    }
+
+    void read_png_image(const std::string& filename, boost::gil::rgb8_image_t& img) {
+        read_image(read_file_contents(filename), img, file_type::PNG);
+    }
+
+    void read_jpeg_image(const std::string& filename, boost::gil::rgb8_image_t& img) {
+        read_image(read_file_contents(filename), img, file_type::JPEG);
+    }
+
+    std::size_t scaled_dimension(std::size_t dimension, double scale) {
+        assert (scale > 0 && scale <= 1);
+        // Allow for rounding error in scales such as 0.3.
+        constexpr double TOLERANCE = 1e-6;
+        auto scaled = static_cast<std::size_t>(std::ceil(dimension * scale - TOLERANCE));
+        return std::max<std::size_t>(1, scaled);
+    }
+
+    // Reduces the image in place to its scaled dimensions, if they differ.
+    void resample_to_scale(rgb_image_t& img, std::size_t width, std::size_t height) {
+        if (static_cast<std::size_t>(img.width()) != width || static_cast<std::size_t>(img.height()) != height) {
+            rgb_image_t resampled(width, height);
+            preprocess::resize(boost::gil::view(img), boost::gil::view(resampled), preprocess::resize_filter::area);
+            img = std::move(resampled);
         }
     }
 
-    bool is_file_type(const std::string& filename, file_type type) {
+    // libpng reports fatal errors through a callback which must not return.
+    // The callback jumps back to the function which set the jump buffer, 
+    // which then throws. No objects with destructors may be created in 
+    // those functions between the setjmp call and the end of decoding.
+    struct png_decoder {
+        png_structp png = nullptr;
+        png_infop info = nullptr;
+        std::string error_message;
+
+        // The file contents, and how far they have been read.
+        byte_view contents;
+        std::size_t offset = 0;
+
+        // The layout of decoded rows, in libpng's terms.
+        std::size_t width = 0;
+        std::size_t height = 0;
+        std::size_t channels = 0;
+        std::size_t bit_depth = 0;
+        std::size_t row_bytes = 0;
+        std::size_t passes = 1;
+
+        ~png_decoder() {
+            png_destroy_read_struct(&png, &info, nullptr);
+        }
+    };
+
+    void on_png_error(png_structp png, png_const_charp message) {
+        auto decoder = static_cast<png_decoder*>(png_get_error_ptr(png));
+        decoder->error_message = message;
+        png_longjmp(png, 1);
+    }
+
+    void ignore_png_warning(png_structp, png_const_charp) {
+    }
+
+    void read_png_data(png_structp png, png_bytep data, png_size_t length) {
+        auto decoder = static_cast<png_decoder*>(png_get_io_ptr(png));
+        if (decoder->contents.size() - decoder->offset < length) {
+            png_error(png, "unexpected end of file");
+        }
+        std::memcpy(data, decoder->contents.data() + decoder->offset, length);
+        decoder->offset += length;
+    }
+
+    // Reads the PNG header and sets up the transformations which expand 
+    // palettes, packed gray pixels and tRNS chunks. Rows are then decoded
+    // as gray, gray and alpha, RGB or RGBA pixels, with 8 or 16 bits per
+    // channel. 16-bit channels are decoded in the machine's byte order.
+    void start_png_decoding(png_decoder& decoder) {
+        decoder.png = png_create_read_struct(PNG_LIBPNG_VER_STRING, &decoder, on_png_error, ignore_png_warning);
+        if (!decoder.png) {
+            throw std::bad_alloc();
+        }
+        if (setjmp(png_jmpbuf(decoder.png))) {
+            throw std::runtime_error("png is invalid: " + decoder.error_message);
+        }
+
+        decoder.info = png_create_info_struct(decoder.png);
+        if (!decoder.info) {
+            throw std::bad_alloc();
+        }
+        png_set_read_fn(decoder.png, &decoder, read_png_data);
+        png_read_info(decoder.png, decoder.info);
+
+        auto color_type = png_get_color_type(decoder.png, decoder.info);
+        auto bit_depth = png_get_bit_depth(decoder.png, decoder.info);
+        if (color_type == PNG_COLOR_TYPE_PALETTE) {
+            png_set_palette_to_rgb(decoder.png);
+        }
+        if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
+            png_set_expand_gray_1_2_4_to_8(decoder.png);
+        }
+        if (png_get_valid(decoder.png, decoder.info, PNG_INFO_tRNS)) {
+            png_set_tRNS_to_alpha(decoder.png);
+        }
+        if (bit_depth == 16 && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {
+            png_set_swap(decoder.png);
+        }
+        decoder.passes = png_set_interlace_handling(decoder.png);
+        png_read_update_info(decoder.png, decoder.info);
+
+        decoder.width = png_get_image_width(decoder.png, decoder.info);
+        decoder.height = png_get_image_height(decoder.png, decoder.info);
+        decoder.channels = png_get_channels(decoder.png, decoder.info);
+        decoder.bit_depth = png_get_bit_depth(decoder.png, decoder.info);
+        decoder.row_bytes = png_get_rowbytes(decoder.png, decoder.info);
+    }
+
+    // Decodes the next row, or the next row of the current pass of an 
+    // interlaced image, into the given row, which holds the rows of any 
+    // earlier passes.
+    void read_png_row(png_decoder& decoder, png_bytep row) {
+        if (setjmp(png_jmpbuf(decoder.png))) {
+            throw std::runtime_error("png is invalid: " + decoder.error_message);
+        }
+        png_read_row(decoder.png, row, nullptr);
+    }
+
+    // Converts a decoded row to 8-bit RGB, blending any alpha channel with
+    // the background. 16-bit rows are first narrowed into the scratch row, 
+    // which holds a row of 8-bit channels.
+    void convert_png_row(const png_decoder& decoder, const unsigned char* row, 
+                         const decode_options& options, uint8_t* rgb, 
+                         uint8_t* scratch) {
+        const uint8_t* channels = row;
+        if (decoder.bit_depth == 16) {
+            narrow_channels(reinterpret_cast<const uint16_t*>(row), scratch, decoder.width * decoder.channels);
+            channels = scratch;
+        }
+
+        switch (decoder.channels) {
+            case 1: expand_gray(channels, rgb, decoder.width); break;
+            case 2: flatten_gray_alpha(channels, options.background, rgb, decoder.width); break;
+            case 3: 
+                if (channels != rgb) {
+                    std::copy_n(channels, 3 * decoder.width, rgb);
+                }
+                break;
+            case 4: flatten_alpha(channels, options.background, rgb, decoder.width); break;
+        }
+    }
+
+    // Decodes a PNG image in the layout that it is stored in, converting 
+    // each row to 8-bit RGB as it is decoded. 8-bit RGB rows are decoded 
+    // straight into the image. Interlaced images are only complete after 
+    // the last pass, so all of their rows are decoded before any of them 
+    // are converted.
+    void decode_png(byte_view contents, rgb_image_t& img, const decode_options& options) {
+        png_decoder decoder;
+        decoder.contents = contents;
+        start_png_decoding(decoder);
+
+        img.recreate(decoder.width, decoder.height);
+
+        auto img_view = boost::gil::view(img);
+        auto image_row = [&](std::size_t y) {
+            return reinterpret_cast<uint8_t*>(&img_view(0, y));
+        };
+
+        bool is_rgb8 = decoder.channels == 3 && decoder.bit_depth == 8;
+        if (is_rgb8 && decoder.passes == 1) {
+            for (std::size_t y = 0; y < decoder.height; ++y) {
+                read_png_row(decoder, image_row(y));
+                convert_png_row(decoder, image_row(y), options, image_row(y), nullptr);
+            }
+            return;
+        }
+
+        // Rows are held as 16-bit values so that 16-bit channels are aligned.
+        std::size_t row_values = (decoder.row_bytes + 1) / 2;
+        std::size_t buffered_rows = decoder.passes == 1 ? 1 : decoder.height;
+        std::vector<uint16_t> rows(row_values * buffered_rows);
+        std::vector<uint8_t> scratch(decoder.bit_depth == 16 ? decoder.width * decoder.channels : 0);
+        auto buffered_row = [&](std::size_t y) {
+            return reinterpret_cast<unsigned char*>(rows.data() + (decoder.passes == 1 ? 0 : y * row_values));
+        };
+
+        for (std::size_t pass = 0; pass < decoder.passes; ++pass) {
+            for (std::size_t y = 0; y < decoder.height; ++y) {
+                read_png_row(decoder, buffered_row(y));
+                if (pass + 1 == decoder.passes) {
+                    convert_png_row(decoder, buffered_row(y), options, image_row(y), scratch.data());
+                }
+            }
+        }
+    }
+
+    struct image_dimensions {
+        std::size_t width;
+        std::size_t height;
+    };
+
+    // libjpeg reports fatal errors through a callback which must not 
+    // return. The callback jumps back to decode_scaled_jpeg, which then
+    // throws.
+    struct jpeg_error_handler {
+        jpeg_error_mgr manager;
+        std::jmp_buf jump;
+        char message[JMSG_LENGTH_MAX];
+    };
+
+    void on_jpeg_error(j_common_ptr info) {
+        auto handler = reinterpret_cast<jpeg_error_handler*>(info->err);
+        (*info->err->format_message)(info, handler->message);
+        std::longjmp(handler->jump, 1);
+    }
+
+    void ignore_jpeg_message(j_common_ptr) {
+    }
+
+    // Decodes a JPEG image from memory, reduced by 1/denominator during the
+    // inverse DCT, and returns the full dimensions of the image from its 
+    // header. libjpeg converts grayscale and YCbCr images to RGB. No objects
+    // with destructors may be created between the setjmp call and the end 
+    // of decoding.
+    image_dimensions decode_scaled_jpeg(byte_view contents, rgb_image_t& img, unsigned denominator) {
+        jpeg_decompress_struct info;
+        jpeg_error_handler errors;
+        info.err = jpeg_std_error(&errors.manager);
+        errors.manager.error_exit = on_jpeg_error;
+        errors.manager.output_message = ignore_jpeg_message;
+
+        if (setjmp(errors.jump)) {
+            jpeg_destroy_decompress(&info);
+            throw std::runtime_error(std::string("jpeg is invalid: ") + errors.message);
+        }
+
+        jpeg_create_decompress(&info);
+        jpeg_mem_src(&info, contents.data(), contents.size());
+        jpeg_read_header(&info, TRUE);
+        info.scale_num = 1;
+        info.scale_denom = denominator;
+        info.out_color_space = JCS_RGB;
+        jpeg_start_decompress(&info);
+
+        img.recreate(info.output_width, info.output_height);
+        auto img_view = boost::gil::view(img);
+        while (info.output_scanline < info.output_height) {
+            auto row = reinterpret_cast<JSAMPROW>(&img_view(0, info.output_scanline));
+            jpeg_read_scanlines(&info, &row, 1);
+        }
+
+        image_dimensions full_dimensions {info.image_width, info.image_height};
+        jpeg_finish_decompress(&info);
+        jpeg_destroy_decompress(&info);
+        return full_dimensions;
+    }
+
+    void read_image(byte_view contents, boost::gil::rgb8_image_t& img, file_type type, double scale) {
+        decode_options options;
+        options.scale = scale;
+        read_image(contents, img, type, options);
+    }
+
+    void read_image(byte_view contents, boost::gil::rgb8_image_t& img, file_type type, 
+                    const decode_options& options) {
         assert (type == file_type::JPEG || type == file_type::PNG);
-        return type == file_type::JPEG 
-            ? boost_is_file_type<boost::gil::jpeg_tag>(filename) 
-            : boost_is_file_type<boost::gil::png_tag>(filename);
+        assert (options.scale > 0 && options.scale <= 1);
+        if (type == file_type::JPEG) {
+            read_jpeg_image(contents, img, options.scale);
+            return;
+        }
+
+        decode_png(contents, img, options);
+        resample_to_scale(img, 
+                          scaled_dimension(img.width(), options.scale), 
+                          scaled_dimension(img.height(), options.scale));
     }
 
-    void read_image(const std::string& filename, boost::gil::rgb8_image_t& img, file_type type) {
+    void decode_to_canvas(byte_view contents, boost::gil::rgb8_image_t& img, file_type type, 
+                          const decode_options& options,
+                          const std::optional<preprocess::fit_options>& canvas) {
+        if (!canvas.has_value()) {
+            read_image(contents, img, type, options);
+            return;
+        }
+        thread_local boost::gil::rgb8_image_t decoded;
+        read_image(contents, decoded, type, options);
+        preprocess::fit_frame(boost::gil::view(decoded), img, *canvas);
+    }
+
+    void read_jpeg_image(byte_view contents, boost::gil::rgb8_image_t& img, double scale) {
+        assert (scale > 0 && scale <= 1);
+
+        // The largest power-of-two reduction which libjpeg supports that 
+        // does not reduce the image past the scale.
+        unsigned denominator = 1;
+        while (denominator < 8 && 1.0 / (2 * denominator) >= scale) {
+            denominator *= 2;
+        }
+
+        auto full_dimensions = decode_scaled_jpeg(contents, img, denominator);
+        resample_to_scale(img, 
+                          scaled_dimension(full_dimensions.width, scale), 
+                          scaled_dimension(full_dimensions.height, scale));
+    }
+
+    // The state of an incremental JPEG decoder. As for decode_scaled_jpeg,
+    // each function which calls into libjpeg sets the jump buffer first.
+    struct jpeg_decoder {
+        jpeg_decompress_struct info;
+        jpeg_error_handler errors;
+        bool created = false;
+
+        ~jpeg_decoder() {
+            if (created) {
+                jpeg_destroy_decompress(&info);
+            }
+        }
+    };
+
+    void start_jpeg_decoding(jpeg_decoder& decoder, byte_view contents) {
+        decoder.info.err = jpeg_std_error(&decoder.errors.manager);
+        decoder.errors.manager.error_exit = on_jpeg_error;
+        decoder.errors.manager.output_message = ignore_jpeg_message;
+        if (setjmp(decoder.errors.jump)) {
+            throw std::runtime_error(std::string("jpeg is invalid: ") + decoder.errors.message);
+        }
+
+        jpeg_create_decompress(&decoder.info);
+        decoder.created = true;
+        jpeg_mem_src(&decoder.info, contents.data(), contents.size());
+        jpeg_read_header(&decoder.info, TRUE);
+        decoder.info.out_color_space = JCS_RGB;
+        jpeg_start_decompress(&decoder.info);
+    }
+
+    void read_jpeg_row(jpeg_decoder& decoder, JSAMPROW row) {
+        if (setjmp(decoder.errors.jump)) {
+            throw std::runtime_error(std::string("jpeg is invalid: ") + decoder.errors.message);
+        }
+        jpeg_read_scanlines(&decoder.info, &row, 1);
+    }
+
+    struct band_reader::decoder {
+        byte_view contents;
+        file_type type;
+        decode_options options;
+        std::size_t width = 0;
+        std::size_t height = 0;
+
+        // The row that the decoder will produce next.
+        std::size_t next_row = 0;
+
+        std::unique_ptr<png_decoder> png;
+        std::unique_ptr<jpeg_decoder> jpeg;
+
+        // A decoded row of a PNG image, held as 16-bit values so that 16-bit
+        // channels are aligned, and its 8-bit channels after narrowing.
+        std::vector<uint16_t> png_row;
+        std::vector<uint8_t> scratch;
+
+        // Rows which are decoded only to be skipped.
+        std::vector<uint8_t> skipped_row;
+
+        // The whole of an interlaced PNG image.
+        rgb_image_t interlaced;
+        bool is_interlaced = false;
+
+        decoder(byte_view file_contents, file_type file, const decode_options& decoding) :
+                contents(file_contents), type(file), options(decoding) {
+            restart();
+            skipped_row.resize(3 * width);
+        }
+
+        void restart() {
+            next_row = 0;
+            if (type == file_type::JPEG) {
+                jpeg.reset();
+                jpeg = std::make_unique<jpeg_decoder>();
+                start_jpeg_decoding(*jpeg, contents);
+                width = jpeg->info.output_width;
+                height = jpeg->info.output_height;
+                return;
+            }
+
+            png.reset();
+            png = std::make_unique<png_decoder>();
+            png->contents = contents;
+            start_png_decoding(*png);
+            width = png->width;
+            height = png->height;
+            is_interlaced = png->passes > 1;
+            png_row.resize((png->row_bytes + 1) / 2);
+            scratch.resize(png->bit_depth == 16 ? png->width * png->channels : 0);
+        }
+
+        void read_row(uint8_t* rgb) {
+            if (type == file_type::JPEG) {
+                read_jpeg_row(*jpeg, rgb);
+            }
+            else if (png->channels == 3 && png->bit_depth == 8) {
+                read_png_row(*png, rgb);
+            }
+            else {
+                auto row = reinterpret_cast<unsigned char*>(png_row.data());
+                read_png_row(*png, row);
+                convert_png_row(*png, row, options, rgb, scratch.data());
+            }
+            ++next_row;
+        }
+    };
+
+    band_reader::band_reader(byte_view contents, file_type type, const decode_options& options) :
+            state(std::make_unique<decoder>(contents, type, options)) {
         assert (type == file_type::JPEG || type == file_type::PNG);
-        return type == file_type::JPEG 
-            ? read_jpeg_image(filename, img) 
-            : read_png_image(filename, img); 
+        assert (options.scale == 1);
     }
 
-    void read_png_image(const std::string& filename, boost::gil::rgb8_image_t& img) {
-        boost::gil::read_image(filename, img, boost::gil::png_tag{});
+    band_reader::~band_reader() = default;
+
+    std::size_t band_reader::width() const {
+        return state->width;
     }
 
-    void read_jpeg_image(const std::string& filename, boost::gil::rgb8_image_t& img) {
-        boost::gil::read_image(filename, img, boost::gil::jpeg_tag{});
+    std::size_t band_reader::height() const {
+        return state->height;
+    }
+
+    void band_reader::read_rows(std::size_t first_row, const rgb_image_view_t& band) {
+        assert (std::size_t(band.width()) == state->width);
+        assert (first_row + band.height() <= state->height);
+
+        if (state->is_interlaced) {
+            if (state->interlaced.width() == 0) {
+                decode_png(state->contents, state->interlaced, state->options);
+            }
+            auto rows = boost::gil::subimage_view(boost::gil::const_view(state->interlaced), 
+                                                  0, first_row, band.width(), band.height());
+            boost::gil::copy_pixels(rows, band);
+            return;
+        }
+
+        if (first_row < state->next_row) {
+            state->restart();
+        }
+        while (state->next_row < first_row) {
+            state->read_row(state->skipped_row.data());
+        }
+        for (std::ptrdiff_t y = 0; y < band.height(); ++y) {
+            state->read_row(reinterpret_cast<uint8_t*>(&band(0, y)));
+        }
+    }
+
+    void read_jpeg_image(const std::string& filename, boost::gil::rgb8_image_t& img, double scale) {
+        read_jpeg_image(read_file_contents(filename), img, scale);
     }
 
-    void write_image(const std::string& filename, boost::gil::rgb8_image_t& img, file_type type) {
+    void write_image(const std::string& filename, const boost::gil::rgb8_image_t& img, file_type type) {
         assert (type == file_type::JPEG || type == file_type::PNG);
         return type == file_type::JPEG 
             ? write_jpeg_image(filename, img) 
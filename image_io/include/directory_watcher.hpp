@@ -0,0 +1,80 @@
+#ifndef DIRECTORY_WATCHER_HPP
+#define DIRECTORY_WATCHER_HPP
+
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace image {
+
+    // A file which was completed in a watched directory, and when its
+    // completion was noticed.
+    struct watched_file {
+        std::string path;
+        std::chrono::steady_clock::time_point completed;
+    };
+
+    // Reports the files which are written into a directory, such as the
+    // frames of a screen capture, in the order that they are completed.
+    // The directory is watched with inotify, so a file is reported as soon
+    // as the kernel reports that it is complete rather than when the
+    // directory is next scanned.
+    //
+    // A file is complete once it is closed after being written to, or once
+    // it is moved into the directory. Each name is only reported once, and
+    // sub-directories and names starting with '.' are ignored, so that a
+    // producer which writes a frame in several steps can write it to a
+    // hidden file and then rename it.
+    class directory_watcher {
+    public:
+        // Starts watching the directory. Files which are already in the
+        // directory are not reported. Throws std::system_error if the
+        // directory cannot be watched.
+        explicit directory_watcher(const std::string& directory);
+        ~directory_watcher();
+
+        directory_watcher(const directory_watcher&) = delete;
+        directory_watcher& operator=(const directory_watcher&) = delete;
+
+        // Waits for the next file to be completed, and returns it. Returns
+        // nothing once stop has been called, or if the directory was
+        // removed. Throws std::runtime_error if so many files were written
+        // at once that the kernel dropped some of their events, and
+        // std::system_error if the events cannot be read.
+        std::optional<watched_file> next_file();
+
+        // Makes next_file return nothing, from now on. This may be called
+        // from any thread, including while another thread waits for a file.
+        void stop();
+
+    private:
+        std::string directory;
+        int inotify_fd;
+
+        // Written to by stop to wake next_file.
+        int wake_fds[2];
+        bool stopped;
+        bool removed;
+
+        // Events which have been read, and the files which were found in
+        // them but not yet returned.
+        std::vector<char> events;
+        std::deque<watched_file> ready;
+
+        // The name of every file which has been reported, so that a file 
+        // which is written again is not reported twice. This grows by a 
+        // name for each file for as long as the directory is watched, 
+        // which is a few megabytes for a capture of a hundred thousand 
+        // frames.
+        std::unordered_set<std::string> reported;
+
+        // Waits for events and adds the files they complete to ready.
+        // Returns false if the watcher was stopped.
+        bool read_events();
+    };
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef FILE_READER_HPP
+#define FILE_READER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Reads the whole contents of input files into memory, so that images can
+// be decoded from memory rather than through many small reads by the 
+// codecs.
+namespace image {
+
+    // The contents of a file.
+    using file_buffer = std::vector<unsigned char>;
+
+    // A request to read a file, and its outcome.
+    struct file_read {
+        std::string filename;
+        file_buffer contents;
+        std::error_code error;
+    };
+
+    // Reads batches of whole files. On Linux, the files of a batch are 
+    // opened and read through an io_uring submission queue, so that the 
+    // kernel works on all of them at once rather than waiting for each 
+    // open and read in turn. Where io_uring is unavailable, such as on 
+    // older kernels or where it has been disabled, each file is read with
+    // pread instead.
+    class batch_file_reader {
+    public:
+        enum class backend {
+            io_uring,
+            pread
+        };
+
+        // The largest number of files which are read at once.
+        static constexpr std::size_t MAX_BATCH_FILES = 64;
+
+        // Uses io_uring if it is available and allowed.
+        explicit batch_file_reader(bool allow_io_uring = true);
+        ~batch_file_reader();
+
+        batch_file_reader(const batch_file_reader&) = delete;
+        batch_file_reader& operator=(const batch_file_reader&) = delete;
+
+        backend active_backend() const;
+
+        // Reads each file into its contents, which are resized to fit. The
+        // memory the contents already hold is re-used. The error of a file 
+        // which cannot be read is set, and its contents are cleared.
+        void read_files(std::vector<file_read>& reads);
+
+    private:
+        class uring;
+        std::unique_ptr<uring> ring;
+
+        void read_with_pread(file_read& read);
+    };
+
+    // Reads a list of files ahead of their use on a dedicated I/O thread, 
+    // in batches with a batch_file_reader. Reading stops while the files 
+    // which have been read but not yet taken reach either limit. Buffers 
+    // which are recycled are re-used for later files, so that memory is 
+    // not allocated for every file.
+    class file_prefetcher {
+    public:
+        static constexpr std::size_t DEFAULT_MAX_FILES_AHEAD = 256;
+        static constexpr std::size_t DEFAULT_MAX_BYTES_AHEAD = std::size_t(64) << 20;
+
+        file_prefetcher(std::vector<std::string> filenames,
+                        std::size_t max_files_ahead = DEFAULT_MAX_FILES_AHEAD,
+                        std::size_t max_bytes_ahead = DEFAULT_MAX_BYTES_AHEAD,
+                        bool allow_io_uring = true);
+
+        // Stops the I/O thread.
+        ~file_prefetcher();
+
+        file_prefetcher(const file_prefetcher&) = delete;
+        file_prefetcher& operator=(const file_prefetcher&) = delete;
+
+        std::size_t file_count() const;
+        batch_file_reader::backend active_backend() const;
+
+        // Waits for the file with the given index to be read, and returns
+        // its contents. Each file may be taken once, from any thread. Files 
+        // are read in order, but the limits do not delay a file which is 
+        // being waited for.
+        //
+        // Throws std::system_error if the file could not be read.
+        file_buffer take(std::size_t index);
+
+        // Returns a buffer which is no longer needed, to be re-used.
+        void recycle(file_buffer buffer);
+
+    private:
+        enum class file_state {
+            pending,
+            ready,
+            taken
+        };
+
+        struct file_entry {
+            file_state state = file_state::pending;
+            file_buffer contents;
+            std::error_code error;
+        };
+
+        const std::vector<std::string> filenames;
+        const std::size_t max_files_ahead;
+        const std::size_t max_bytes_ahead;
+        batch_file_reader reader;
+
+        std::mutex mutex;
+        std::condition_variable files_read;
+        std::condition_variable files_taken;
+        std::vector<file_entry> files;
+        std::vector<file_buffer> spare_buffers;
+
+        // Files before read_end have been read.
+        std::size_t read_end;
+
+        // One past the largest index which has been waited for.
+        std::size_t wanted_end;
+
+        // The files which have been read but not taken, and their size.
+        std::size_t files_ahead;
+        std::size_t bytes_ahead;
+
+        bool stopping;
+        std::thread io_thread;
+
+        void run_io_thread();
+    };
+}
+
+#endif
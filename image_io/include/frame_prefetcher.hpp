@@ -0,0 +1,121 @@
+#ifndef FRAME_PREFETCHER_HPP
+#define FRAME_PREFETCHER_HPP
+
+#include "file_reader.hpp"
+#include "image_io.hpp"
+#include "image_utils.hpp"
+#include "task_pool.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace image {
+
+    // Reads a sequence of image files in order, decoding the frames ahead 
+    // of the code which uses them as tasks on a task pool. The files 
+    // themselves are read further ahead by a file_prefetcher. Decoded frames 
+    // are held in a fixed ring of image buffers which are re-used, so the 
+    // frames only take as much memory as the ring.
+    class frame_prefetcher {
+    public:
+        // The default limit on the memory used by the buffers.
+        static constexpr std::size_t DEFAULT_MAX_BUFFERED_BYTES = std::size_t(256) << 20;
+
+        // Starts decoding the first frames, which are reduced and converted
+        // to 8-bit RGB with the given options as by read_image. The number of buffers is chosen so that they hold
+        // at most max_buffered_bytes of pixels, based on the dimensions in 
+        // the first file's header, but there are always at least two so 
+        // that a frame can be decoded while the previous one is used.
+        frame_prefetcher(std::vector<std::string> filenames, 
+                         file_type type,
+                         const decode_options& options = {},
+                         std::size_t max_buffered_bytes = DEFAULT_MAX_BUFFERED_BYTES,
+                         runtime::task_pool& pool = runtime::task_pool::shared());
+
+        // Waits for any frames which are being decoded. Decoding tasks 
+        // which have not started yet do nothing when they run, so the 
+        // prefetcher may be destroyed on a worker of its pool, even a pool
+        // with a single worker.
+        ~frame_prefetcher();
+
+        frame_prefetcher(const frame_prefetcher&) = delete;
+        frame_prefetcher& operator=(const frame_prefetcher&) = delete;
+
+        std::size_t frame_count() const;
+        std::size_t buffer_count() const;
+
+        // Answers whether next_frame may be called again.
+        bool has_next_frame() const;
+
+        // Returns the next frame, waiting for it to be decoded if necessary.
+        // If its decoding has not started yet, it is decoded on the calling
+        // thread. The image may be modified, and remains valid until the 
+        // next call, when its buffer is re-used for a later frame. 
+        //
+        // Rethrows any exception thrown while decoding the frame. The 
+        // following frames can still be read.
+        rgb_image_t& next_frame();
+
+    private:
+        enum class buffer_state {
+            queued,
+            decoding,
+            ready
+        };
+
+        struct frame_buffer {
+            rgb_image_t image;
+            std::size_t frame = 0;
+            buffer_state state = buffer_state::ready;
+            std::exception_ptr error;
+        };
+
+        const std::vector<std::string> filenames;
+        const file_type type;
+        const decode_options options;
+        file_prefetcher files;
+        runtime::task_pool& pool;
+        std::vector<frame_buffer> buffers;
+
+        // The index of the frame which next_frame returns next.
+        std::size_t next_frame_index;
+
+        // The state which is shared with the decoding tasks, which may 
+        // run after the prefetcher has been destroyed.
+        struct task_state {
+            // Guards the buffers' states, and is used to wait for them to
+            // change.
+            std::mutex mutex;
+            std::condition_variable buffer_changed;
+
+            // Set once the prefetcher is destroyed, after which the tasks
+            // must not use it.
+            bool destroyed = false;
+
+            // The number of tasks which are decoding a frame, which must
+            // finish before the prefetcher is destroyed.
+            std::size_t decoding_tasks = 0;
+        };
+
+        std::shared_ptr<task_state> state;
+
+        // Marks a frame's buffer as queued and submits a task to decode 
+        // it. Must be called with the mutex locked.
+        void start_decoding(std::size_t frame);
+
+        // Decodes a frame into its buffer, which must have been claimed by
+        // moving it to the decoding state.
+        void decode(frame_buffer& buffer);
+
+        // The body of a decoding task, which is called with the mutex 
+        // locked. Does nothing if the frame has already been claimed by 
+        // next_frame.
+        void run_decoding_task(std::size_t frame, std::unique_lock<std::mutex>& lock);
+    };
+}
+
+#endif
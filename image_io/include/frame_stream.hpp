@@ -0,0 +1,123 @@
+#ifndef FRAME_STREAM_HPP
+#define FRAME_STREAM_HPP
+
+#include "image_utils.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace image {
+
+    // The formats of raw frame streams.
+    enum class stream_format {
+        // Concatenated binary PPM (P6) images, each with its own header.
+        PPM,
+
+        // A YUV4MPEG2 stream, which has one header for the whole stream
+        // and a short header before each frame's planes.
+        Y4M
+    };
+
+    // Reads raw frames one after another from a file descriptor, such as
+    // standard input or a pipe from a video decoder. Frames are parsed as
+    // they arrive, so the first frame can be used before the rest of the
+    // stream has been produced.
+    //
+    // Headers are parsed from a small buffer, but pixel data is read from
+    // the descriptor straight into the destination image or into planes
+    // which are re-used for every frame. 8-bit PPM frames are not copied
+    // or converted at all.
+    class frame_stream {
+    public:
+        // Identifies the format of the stream from its first bytes, and
+        // reads the header of the stream and of its first frame. This
+        // blocks until the headers have arrived. The descriptor is not
+        // closed by the stream.
+        //
+        // Throws std::runtime_error if the stream is empty, is not a PPM or
+        // Y4M stream, or uses an encoding which cannot be converted to
+        // 8-bit RGB.
+        explicit frame_stream(int fd);
+
+        frame_stream(const frame_stream&) = delete;
+        frame_stream& operator=(const frame_stream&) = delete;
+
+        stream_format format() const;
+
+        // The dimensions of the first frame. Every frame of a Y4M stream
+        // has these dimensions, but PPM frames may differ.
+        std::size_t width() const;
+        std::size_t height() const;
+
+        // Reads the next frame into img as 8-bit RGB, re-using its memory
+        // if it has the frame's dimensions. Returns false once the stream
+        // has ended. Throws std::runtime_error if the stream ends part way
+        // through a frame, or a frame's header is malformed, and
+        // std::system_error if the descriptor cannot be read.
+        bool read_frame(rgb_image_t& img);
+
+        // The number of frames read so far.
+        std::size_t frames_read() const;
+
+    private:
+        int fd;
+        stream_format stream_type;
+
+        // Bytes which have been read from the descriptor but not parsed.
+        std::vector<unsigned char> buffer;
+        std::size_t buffer_begin;
+        std::size_t buffer_end;
+
+        // The properties of the next frame, from its header.
+        bool has_next_header;
+        std::size_t frame_width;
+        std::size_t frame_height;
+        std::size_t first_width;
+        std::size_t first_height;
+        std::size_t frame_count;
+
+        // The maximum sample value of a PPM frame. Samples take two bytes
+        // if this is over 255.
+        std::size_t max_value;
+
+        // The chroma subsampling of a Y4M stream, as shifts applied to the
+        // luma coordinates, and whether it uses the full range of values.
+        // Monochrome streams have no chroma planes.
+        bool monochrome;
+        std::size_t chroma_shift_x;
+        std::size_t chroma_shift_y;
+        bool full_range;
+
+        // Samples which must be converted, re-used for every frame.
+        std::vector<uint8_t> planes;
+        std::vector<uint16_t> wide_samples;
+
+        // Reads more of the stream into the buffer. Returns false at the
+        // end of the stream.
+        bool fill_buffer();
+
+        // Returns the next byte without consuming it, or -1 at the end of
+        // the stream.
+        int peek_byte();
+        int get_byte();
+
+        // Reads exactly count bytes, throwing if the stream ends first.
+        // Large reads go straight from the descriptor to the destination.
+        void read_exact(unsigned char* destination, std::size_t count);
+
+        // Reads a line of at most a few kilobytes, without its newline.
+        std::string read_line();
+
+        // Parse the header of the next frame. Return false if the stream
+        // ended cleanly before it.
+        bool read_ppm_header();
+        bool read_y4m_frame_header();
+        void read_y4m_stream_header();
+
+        void read_ppm_pixels(rgb_image_t& img);
+        void read_y4m_pixels(rgb_image_t& img);
+    };
+}
+
+#endif
@@ -2,10 +2,16 @@
 #define IMAGE_IO_HPP
 
 #include "image_utils.hpp"
+#include "file_reader.hpp"
+#include "preprocess.hpp"
 #include <boost/gil.hpp> 
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
 
 // Defines functions for reading and writing still images from 
-// and to disk.
+// and to disk, and for decoding images held in memory.
 //
 // The main purpose of this simple library is to hide the use of 
 // the Boost::GIL IO extension from the rest of the build. This 
@@ -16,9 +22,62 @@
 // with C++20.
 namespace image {
 
+    // A read-only view of an encoded image in memory, such as the contents
+    // of a file or an image received over the network. A file_buffer 
+    // converts to a view implicitly. This stands in for std::span, which
+    // is not available in C++17. The viewed bytes must outlive the view.
+    class byte_view {
+    public:
+        byte_view() : bytes(nullptr), length(0) {}
+        byte_view(const unsigned char* data, std::size_t size) : bytes(data), length(size) {}
+        byte_view(const file_buffer& contents) : bytes(contents.data()), length(contents.size()) {}
+
+        const unsigned char* data() const { return bytes; }
+        std::size_t size() const { return length; }
+
+    private:
+        const unsigned char* bytes;
+        std::size_t length;
+    };
+
+    // The properties of an image which are stored in its header.
+    struct image_info {
+        file_type type;
+        std::size_t width;
+        std::size_t height;
+
+        // The number of bits in each channel of a pixel.
+        std::size_t bit_depth;
+
+        // The number of channels in each pixel, as stored in the file.
+        // An indexed PNG image has one channel.
+        std::size_t channels;
+    };
+
+    // Reads the dimensions and encoding of an image from the header of 
+    // a PNG or JPEG file without decoding any pixels. The file is first
+    // identified by its magic bytes, and then the PNG IHDR chunk or the
+    // JPEG SOF segment is parsed.
+    //
+    // Returns an empty optional if the file cannot be accessed, is not of 
+    // the given type, or has a malformed header.
+    std::optional<image_info> read_image_info(const std::string& filename, file_type type);
+
+    // Reads the header of an image in memory in the same way. The type is
+    // identified from the image's magic bytes. Returns an empty optional 
+    // if the contents are not a PNG or JPEG image or have a malformed 
+    // header.
+    std::optional<image_info> read_image_info(byte_view contents);
+
+    // Answers whether an image with the given properties can be read using
+    // a 24-bit color space (8 bits per channel) by read_image. PNG images 
+    // with any bit depth, gray or RGB, and with or without alpha can be 
+    // read, as can 8-bit grayscale and color JPEG images.
+    bool is_rgb8_compatible(const image_info& info);
+
     // Answers whether filename is a file of the given type.
     // Returns false if the file cannot be accessed or does 
-    // not exist. 
+    // not exist. Only the file's header is read.
     bool is_file_type(const std::string& filename, file_type type);
 
     // Reads a PNG or JPEG image at the specified location into
@@ -32,13 +91,98 @@ namespace image {
     //
     // Precondition: 
     //      The filename argument specifies a valid file of the 
-    //      appropriate type (PNG/JPEG) with an 8-bit RGB colour
-    //      encoding.
+    //      appropriate type (PNG/JPEG) with an encoding accepted
+    //      by is_rgb8_compatible.
     //
     // May throw an exception if the given file is not accessible.
     void read_png_image(const std::string& filename, rgb_image_t& img);
     void read_jpeg_image(const std::string& filename, rgb_image_t& img);
 
+    // Returns the length of an image dimension after it is reduced by the
+    // given scale, which must be greater than 0 and at most 1. The length
+    // is rounded up, as libjpeg does, and is at least 1.
+    std::size_t scaled_dimension(std::size_t dimension, double scale);
+
+    // Reads a JPEG image reduced by the given scale, which must be greater
+    // than 0 and at most 1. The image is reduced by the largest of 1/2, 1/4
+    // and 1/8 which does not go past the scale while it is decoded, using 
+    // libjpeg's scaled inverse DCT. Any remaining reduction is done by 
+    // averaging the pixels which cover each output pixel. The result has
+    // the dimensions given by scaled_dimension.
+    //
+    // Has the same preconditions as read_jpeg_image without a scale.
+    void read_jpeg_image(const std::string& filename, rgb_image_t& img, double scale);
+    void read_jpeg_image(byte_view contents, rgb_image_t& img, double scale);
+
+    // How images are converted to 8-bit RGB as they are read.
+    struct decode_options {
+        // The scale that the image is reduced by, which must be greater 
+        // than 0 and at most 1.
+        double scale = 1.0;
+
+        // The color which pixels with an alpha channel are blended against,
+        // as though they were drawn over it.
+        rgb_pixel_t background {0, 0, 0};
+    };
+
+    // Decodes a PNG or JPEG image from memory, such as the contents of a
+    // file which have already been read, reduced by the given scale. PNG images 
+    // are decoded in full and then reduced by averaging. Has the same 
+    // preconditions as reading the image from the file.
+    void read_image(byte_view contents, rgb_image_t& img, file_type type, double scale = 1.0);
+
+    // Decodes a PNG or JPEG image from memory as above. PNG images are 
+    // decoded in the layout that they are stored in and converted to 8-bit
+    // RGB row by row: 16-bit channels are narrowed with rounding, gray 
+    // pixels are expanded, and an alpha channel is blended against the 
+    // background. 
+    void read_image(byte_view contents, rgb_image_t& img, file_type type, 
+                    const decode_options& options);
+
+    // Decodes a PNG or JPEG image from memory as above, and fits it to the
+    // canvas if one is given. The image is decoded into a buffer which 
+    // each thread re-uses, so that fitting frames does not allocate once 
+    // the buffer has grown to the size of the largest frame.
+    void decode_to_canvas(byte_view contents, rgb_image_t& img, file_type type, 
+                          const decode_options& options,
+                          const std::optional<preprocess::fit_options>& canvas);
+
+    // Decodes a PNG or JPEG image from memory a band of rows at a time, so
+    // that only a few rows of the image are held at once. Rows are decoded
+    // and converted to 8-bit RGB as by read_image, at full scale. Reading
+    // bands in order from the top decodes the image once, and reading a 
+    // band above the last one restarts decoding from the top of the image.
+    //
+    // Interlaced PNG images are only complete after their last pass, so 
+    // they are decoded in full when the first band is read.
+    //
+    // The contents must outlive the reader.
+    class band_reader {
+    public:
+        // Reads the header of the image. Throws std::runtime_error if the
+        // image is invalid.
+        //
+        // Pre-condition: The contents hold an image of the given type with
+        //                an encoding accepted by is_rgb8_compatible.
+        band_reader(byte_view contents, file_type type, const decode_options& options = {});
+        ~band_reader();
+
+        band_reader(const band_reader&) = delete;
+        band_reader& operator=(const band_reader&) = delete;
+
+        std::size_t width() const;
+        std::size_t height() const;
+
+        // Decodes the rows of the image from first_row into the band, which
+        // must be as wide as the image and fit within it. Throws 
+        // std::runtime_error if the image is corrupt.
+        void read_rows(std::size_t first_row, const rgb_image_view_t& band);
+
+    private:
+        struct decoder;
+        std::unique_ptr<decoder> state;
+    };
+
     // Writes a PNG or JPEG image to a file at the provided path.
     // If no such file exists, a new one will be created. If the
     // file path identifies an existing file, it will be overwritten. 
@@ -0,0 +1,22 @@
+#ifndef OUTPUT_FILE_HPP
+#define OUTPUT_FILE_HPP
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+
+// Writes the GIFs which are produced from the input images.
+namespace image {
+
+    // Opens a file for binary output, which throws on any error.
+    std::ofstream open_output_file(const std::filesystem::path& output_path);
+
+    // Writes a file through a temporary file next to it, which replaces 
+    // the output once write returns. If write throws, the temporary file
+    // is removed and the output is left as it was, so that a failure never
+    // leaves a partial file behind.
+    void replace_file(const std::filesystem::path& output_path,
+                      const std::function<void(const std::filesystem::path&)>& write);
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef IMAGE_IO_PIXEL_CONVERT_HPP
+#define IMAGE_IO_PIXEL_CONVERT_HPP
+
+#include "image_utils.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Kernels which convert rows of pixels from the layouts that images are
+// stored in to the 8-bit RGB layout used by the rest of the program. Each
+// kernel is a simple loop over contiguous arrays of channels, which the
+// compiler vectorizes.
+namespace image {
+
+    // Narrows 16-bit channel values to 8 bits, rounding to the nearest
+    // value. The source holds count values in the machine's byte order.
+    void narrow_channels(const uint16_t* source, uint8_t* target, std::size_t count);
+
+    // Expands gray pixels to RGB pixels with three equal channels.
+    void expand_gray(const uint8_t* gray, uint8_t* rgb, std::size_t pixels);
+
+    // Blends gray or RGB pixels which are followed by an alpha channel with
+    // the background color, as though they were drawn over it. An alpha of
+    // 255 is opaque, and 0 gives the background color.
+    void flatten_gray_alpha(const uint8_t* gray_alpha, rgb_pixel_t background,
+                            uint8_t* rgb, std::size_t pixels);
+    void flatten_alpha(const uint8_t* rgba, rgb_pixel_t background,
+                       uint8_t* rgb, std::size_t pixels);
+
+    // Converts BT.601 YCbCr pixels to RGB. The chroma samples are shared by
+    // 2^chroma_shift horizontally adjacent pixels. Limited range samples 
+    // have luma values from 16 to 235, and full range samples use every 
+    // value, as in JPEG files.
+    void ycbcr_to_rgb(const uint8_t* luma, const uint8_t* cb, const uint8_t* cr,
+                      std::size_t chroma_shift, bool full_range,
+                      uint8_t* rgb, std::size_t pixels);
+}
+
+#endif
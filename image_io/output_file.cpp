@@ -0,0 +1,30 @@
+#include "output_file.hpp"
+#include <stdexcept>
+#include <system_error>
+
+namespace image {
+
+    std::ofstream open_output_file(const std::filesystem::path& output_path) {
+        std::ofstream output_file(output_path, std::ios::out | std::ios::binary);
+        if (!output_file) {
+            throw std::runtime_error("Unable to open " + output_path.string() + " for writing");
+        }
+        output_file.exceptions(std::ios::badbit | std::ios::failbit);
+        return output_file;
+    }
+
+    void replace_file(const std::filesystem::path& output_path,
+                      const std::function<void(const std::filesystem::path&)>& write) {
+        std::filesystem::path temp_path(output_path);
+        temp_path += ".tmp";
+        try {
+            write(temp_path);
+            std::filesystem::rename(temp_path, output_path);
+        }
+        catch (...) {
+            std::error_code ignored;
+            std::filesystem::remove(temp_path, ignored);
+            throw;
+        }
+    }
+}
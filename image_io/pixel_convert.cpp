@@ -0,0 +1,80 @@
+#include "pixel_convert.hpp"
+
+namespace image {
+
+    // v / 257, rounded to the nearest integer, without a division.
+    inline uint8_t narrow(uint32_t value) {
+        return static_cast<uint8_t>((value * 255 + 32895) >> 16);
+    }
+
+    // (color * alpha + background * (255 - alpha)) / 255, rounded to the
+    // nearest integer, without a division.
+    inline uint8_t blend(uint32_t color, uint32_t background, uint32_t alpha) {
+        uint32_t sum = color * alpha + background * (255 - alpha) + 128;
+        return static_cast<uint8_t>((sum + (sum >> 8)) >> 8);
+    }
+
+    void narrow_channels(const uint16_t* source, uint8_t* target, std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            target[i] = narrow(source[i]);
+        }
+    }
+
+    void expand_gray(const uint8_t* gray, uint8_t* rgb, std::size_t pixels) {
+        for (std::size_t i = 0; i < pixels; ++i) {
+            rgb[3 * i] = gray[i];
+            rgb[3 * i + 1] = gray[i];
+            rgb[3 * i + 2] = gray[i];
+        }
+    }
+
+    void flatten_gray_alpha(const uint8_t* gray_alpha, rgb_pixel_t background,
+                            uint8_t* rgb, std::size_t pixels) {
+        const uint32_t r = background[0], g = background[1], b = background[2];
+        for (std::size_t i = 0; i < pixels; ++i) {
+            uint32_t gray = gray_alpha[2 * i];
+            uint32_t alpha = gray_alpha[2 * i + 1];
+            rgb[3 * i] = blend(gray, r, alpha);
+            rgb[3 * i + 1] = blend(gray, g, alpha);
+            rgb[3 * i + 2] = blend(gray, b, alpha);
+        }
+    }
+
+    void flatten_alpha(const uint8_t* rgba, rgb_pixel_t background,
+                       uint8_t* rgb, std::size_t pixels) {
+        const uint32_t r = background[0], g = background[1], b = background[2];
+        for (std::size_t i = 0; i < pixels; ++i) {
+            uint32_t alpha = rgba[4 * i + 3];
+            rgb[3 * i] = blend(rgba[4 * i], r, alpha);
+            rgb[3 * i + 1] = blend(rgba[4 * i + 1], g, alpha);
+            rgb[3 * i + 2] = blend(rgba[4 * i + 2], b, alpha);
+        }
+    }
+
+    inline uint8_t clamp_channel(int32_t value) {
+        return static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+    }
+
+    // The conversion is done in 16-bit fixed point. Limited range luma is
+    // stretched by 255/219 and chroma by 255/224.
+    void ycbcr_to_rgb(const uint8_t* luma, const uint8_t* cb, const uint8_t* cr,
+                      std::size_t chroma_shift, bool full_range,
+                      uint8_t* rgb, std::size_t pixels) {
+        const int32_t luma_offset = full_range ? 0 : 16;
+        const int32_t luma_scale = full_range ? 65536 : 76309;
+        const int32_t red_cr = full_range ? 91881 : 104597;
+        const int32_t green_cb = full_range ? 22554 : 25675;
+        const int32_t green_cr = full_range ? 46802 : 53279;
+        const int32_t blue_cb = full_range ? 116130 : 132201;
+        constexpr int32_t ROUNDING = 1 << 15;
+
+        for (std::size_t i = 0; i < pixels; ++i) {
+            int32_t y = (luma[i] - luma_offset) * luma_scale + ROUNDING;
+            int32_t u = cb[i >> chroma_shift] - 128;
+            int32_t v = cr[i >> chroma_shift] - 128;
+            rgb[3 * i] = clamp_channel((y + red_cr * v) >> 16);
+            rgb[3 * i + 1] = clamp_channel((y - green_cb * u - green_cr * v) >> 16);
+            rgb[3 * i + 2] = clamp_channel((y + blue_cb * u) >> 16);
+        }
+    }
+}
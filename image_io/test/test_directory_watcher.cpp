@@ -0,0 +1,78 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include "directory_watcher.hpp"
+#include "test_support.hpp"
+
+using namespace image;
+using namespace test_support;
+
+void write_file(const std::string& filename, const std::string& contents) {
+    std::ofstream file(filename, std::ios::binary);
+    file << contents;
+}
+
+TEST_CASE("Test watching a directory for new files", "[directory_watcher]") {
+    temp_directory dir("test_directory_watcher");
+    write_file(dir.file("existing"), "old");
+
+    directory_watcher watcher(dir.path.string());
+    auto before = std::chrono::steady_clock::now();
+
+    SECTION("Files are reported in the order they are completed") {
+        write_file(dir.file("b"), "1");
+        write_file(dir.file("a"), "2");
+        auto first = watcher.next_file();
+        auto second = watcher.next_file();
+        REQUIRE(first.has_value());
+        REQUIRE(second.has_value());
+        REQUIRE(first->path == dir.file("b"));
+        REQUIRE(second->path == dir.file("a"));
+        REQUIRE(first->completed >= before);
+    }
+
+    SECTION("A file which is renamed into place is reported once") {
+        write_file(dir.file(".partial"), "frame");
+        std::filesystem::rename(dir.file(".partial"), dir.file("frame"));
+        std::filesystem::create_directory(dir.file("subdirectory"));
+        write_file(dir.file("frame"), "rewritten");
+        write_file(dir.file("next"), "frame");
+
+        auto first = watcher.next_file();
+        auto second = watcher.next_file();
+        REQUIRE(first.has_value());
+        REQUIRE(second.has_value());
+        REQUIRE(first->path == dir.file("frame"));
+        REQUIRE(second->path == dir.file("next"));
+    }
+
+    SECTION("Stopping wakes a waiting thread") {
+        std::thread stopper([&watcher]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            watcher.stop();
+        });
+        REQUIRE_FALSE(watcher.next_file().has_value());
+        stopper.join();
+
+        write_file(dir.file("late"), "frame");
+        REQUIRE_FALSE(watcher.next_file().has_value());
+    }
+
+    SECTION("Removing the directory ends the files") {
+        std::filesystem::remove_all(dir.path);
+        REQUIRE_FALSE(watcher.next_file().has_value());
+    }
+}
+
+TEST_CASE("Test watching a directory which does not exist", "[directory_watcher]") {
+    temp_directory dir("test_directory_watcher");
+    REQUIRE_THROWS_AS(directory_watcher(dir.file("missing")), std::system_error);
+    write_file(dir.file("file"), "");
+    REQUIRE_THROWS_AS(directory_watcher(dir.file("file")), std::system_error);
+}
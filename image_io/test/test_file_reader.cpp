@@ -0,0 +1,121 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "file_reader.hpp"
+
+using namespace image;
+
+// Returns the contents used for test file i, which vary in length.
+file_buffer file_contents(std::size_t i) {
+    file_buffer contents(i * 997 % 5000);
+    for (std::size_t j = 0; j < contents.size(); ++j) {
+        contents[j] = static_cast<unsigned char>(i * 31 + j * 7);
+    }
+    return contents;
+}
+
+// Writes file_count test files to the temporary directory and returns 
+// their names.
+std::vector<std::string> write_files(std::size_t file_count) {
+    std::vector<std::string> filenames;
+    for (std::size_t i = 0; i < file_count; ++i) {
+        auto filename = (std::filesystem::temp_directory_path() / ("test_file_reader_" + std::to_string(i))).string();
+        auto contents = file_contents(i);
+        std::ofstream file(filename, std::ios::out | std::ios::binary);
+        file.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+        filenames.push_back(filename);
+    }
+    return filenames;
+}
+
+void remove_files(const std::vector<std::string>& filenames) {
+    for (const auto& filename : filenames) {
+        std::filesystem::remove(filename);
+    }
+}
+
+TEST_CASE("Test reading batches of files", "[file_reader]") {
+    // More files than fit in one batch, and one which does not exist.
+    constexpr std::size_t FILE_COUNT = batch_file_reader::MAX_BATCH_FILES + 10;
+    auto filenames = write_files(FILE_COUNT);
+    remove_files({filenames[5]});
+
+    auto allow_io_uring = GENERATE(true, false);
+    batch_file_reader reader(allow_io_uring);
+    if (!allow_io_uring) {
+        REQUIRE(reader.active_backend() == batch_file_reader::backend::pread);
+    }
+
+    std::vector<file_read> reads(FILE_COUNT);
+    for (std::size_t i = 0; i < FILE_COUNT; ++i) {
+        reads[i].filename = filenames[i];
+        // Buffers which already hold data are overwritten.
+        reads[i].contents.assign(100, 0xFF);
+    }
+    reader.read_files(reads);
+
+    for (std::size_t i = 0; i < FILE_COUNT; ++i) {
+        if (i == 5) {
+            REQUIRE(reads[i].error);
+            REQUIRE(reads[i].contents.empty());
+        }
+        else {
+            REQUIRE_FALSE(reads[i].error);
+            REQUIRE(reads[i].contents == file_contents(i));
+        }
+    }
+
+    remove_files(filenames);
+}
+
+TEST_CASE("Test prefetching files", "[file_reader]") {
+    constexpr std::size_t FILE_COUNT = 150;
+    auto filenames = write_files(FILE_COUNT);
+
+    auto allow_io_uring = GENERATE(true, false);
+    auto max_files = GENERATE(std::size_t(1), std::size_t(8), file_prefetcher::DEFAULT_MAX_FILES_AHEAD);
+    auto max_bytes = GENERATE(std::size_t(0), file_prefetcher::DEFAULT_MAX_BYTES_AHEAD);
+    file_prefetcher files(filenames, max_files, max_bytes, allow_io_uring);
+    REQUIRE(files.file_count() == FILE_COUNT);
+
+    SECTION("In order") {
+        for (std::size_t i = 0; i < FILE_COUNT; ++i) {
+            auto contents = files.take(i);
+            REQUIRE(contents == file_contents(i));
+            files.recycle(std::move(contents));
+        }
+    }
+
+    SECTION("Out of order") {
+        // Later files are not held back by the limits while they are 
+        // waited for.
+        for (std::size_t i = 0; i < FILE_COUNT; i += 2) {
+            REQUIRE(files.take(FILE_COUNT - 1 - i) == file_contents(FILE_COUNT - 1 - i));
+        }
+        for (std::size_t i = 1; i < FILE_COUNT; i += 2) {
+            REQUIRE(files.take(FILE_COUNT - 1 - i) == file_contents(FILE_COUNT - 1 - i));
+        }
+    }
+
+    SECTION("Only some files") {
+        REQUIRE(files.take(3) == file_contents(3));
+    }
+
+    remove_files(filenames);
+}
+
+TEST_CASE("Test prefetching missing files", "[file_reader]") {
+    auto filenames = write_files(4);
+    remove_files({filenames[1]});
+
+    file_prefetcher files(filenames);
+    REQUIRE(files.take(0) == file_contents(0));
+    REQUIRE_THROWS_AS(files.take(1), std::system_error);
+    REQUIRE(files.take(2) == file_contents(2));
+
+    remove_files(filenames);
+}
@@ -0,0 +1,118 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <string>
+#include <vector>
+#include "frame_prefetcher.hpp"
+#include "image_io.hpp"
+
+using namespace image;
+
+constexpr std::size_t WIDTH = 40;
+constexpr std::size_t HEIGHT = 30;
+constexpr std::size_t FRAME_BYTES = WIDTH * HEIGHT * sizeof(rgb_pixel_t);
+
+// The color of every pixel in frame i.
+rgb_pixel_t frame_color(std::size_t i) {
+    return rgb_pixel_t(i, 255 - i, 2 * i);
+}
+
+// Writes frame_count PNG frames to the temporary directory and returns 
+// their names.
+std::vector<std::string> write_frames(std::size_t frame_count) {
+    std::vector<std::string> filenames;
+    rgb_image_t img(WIDTH, HEIGHT);
+    for (std::size_t i = 0; i < frame_count; ++i) {
+        auto filename = std::filesystem::temp_directory_path() / ("test_frame_prefetcher_" + std::to_string(i) + ".png");
+        boost::gil::fill_pixels(boost::gil::view(img), frame_color(i));
+        write_image(filename.string(), img, file_type::PNG);
+        filenames.push_back(filename.string());
+    }
+    return filenames;
+}
+
+void remove_frames(const std::vector<std::string>& filenames) {
+    for (const auto& filename : filenames) {
+        std::filesystem::remove(filename);
+    }
+}
+
+TEST_CASE("Test frames are returned in order", "[frame_prefetcher]") {
+    constexpr std::size_t FRAME_COUNT = 20;
+    auto filenames = write_frames(FRAME_COUNT);
+
+    auto workers = GENERATE(1, 3);
+    auto max_bytes = GENERATE(std::size_t(0), 4 * FRAME_BYTES, frame_prefetcher::DEFAULT_MAX_BUFFERED_BYTES);
+    runtime::task_pool pool(workers);
+    frame_prefetcher frames(filenames, file_type::PNG, {}, max_bytes, pool);
+
+    REQUIRE(frames.frame_count() == FRAME_COUNT);
+    REQUIRE(frames.buffer_count() >= 2);
+    REQUIRE(frames.buffer_count() <= std::max<std::size_t>(2, max_bytes / FRAME_BYTES));
+
+    for (std::size_t i = 0; i < FRAME_COUNT; ++i) {
+        REQUIRE(frames.has_next_frame());
+        auto& img = frames.next_frame();
+        REQUIRE(img.width() == WIDTH);
+        REQUIRE(img.height() == HEIGHT);
+        REQUIRE(boost::gil::const_view(img)(WIDTH - 1, HEIGHT - 1) == frame_color(i));
+    }
+    REQUIRE_FALSE(frames.has_next_frame());
+
+    remove_frames(filenames);
+}
+
+TEST_CASE("Test decoding errors are rethrown for their frame", "[frame_prefetcher]") {
+    auto filenames = write_frames(6);
+    remove_frames({filenames[2]});
+
+    runtime::task_pool pool(2);
+    frame_prefetcher frames(filenames, file_type::PNG, {}, 3 * FRAME_BYTES, pool);
+    for (std::size_t i = 0; i < filenames.size(); ++i) {
+        if (i == 2) {
+            REQUIRE_THROWS(frames.next_frame());
+        }
+        else {
+            REQUIRE(boost::gil::const_view(frames.next_frame())(0, 0) == frame_color(i));
+        }
+    }
+
+    remove_frames(filenames);
+}
+
+TEST_CASE("Test stopping before the last frame", "[frame_prefetcher]") {
+    auto filenames = write_frames(10);
+
+    runtime::task_pool pool(2);
+    {
+        frame_prefetcher frames(filenames, file_type::PNG, {}, frame_prefetcher::DEFAULT_MAX_BUFFERED_BYTES, pool);
+        REQUIRE(boost::gil::const_view(frames.next_frame())(0, 0) == frame_color(0));
+    }
+
+    remove_frames(filenames);
+}
+
+TEST_CASE("Test destroying a prefetcher on the only worker of its pool", "[frame_prefetcher]") {
+    auto filenames = write_frames(4);
+
+    // The decoding tasks are queued behind the task which destroys the
+    // prefetcher, so it must not wait for them.
+    runtime::task_pool pool(1);
+    std::promise<rgb_pixel_t> first_pixel;
+    pool.submit([&]() {
+        rgb_pixel_t pixel;
+        {
+            frame_prefetcher frames(filenames, file_type::PNG, {}, frame_prefetcher::DEFAULT_MAX_BUFFERED_BYTES, pool);
+            pixel = boost::gil::const_view(frames.next_frame())(0, 0);
+        }
+        first_pixel.set_value(pixel);
+    });
+    auto result = first_pixel.get_future();
+    REQUIRE(result.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    REQUIRE(result.get() == frame_color(0));
+
+    remove_frames(filenames);
+}
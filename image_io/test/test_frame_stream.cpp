@@ -0,0 +1,196 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <csignal>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "frame_stream.hpp"
+
+using namespace image;
+
+using byte_string = std::vector<unsigned char>;
+
+void append(byte_string& bytes, const std::string& text) {
+    bytes.insert(bytes.end(), text.begin(), text.end());
+}
+
+// A PPM frame whose pixels have the channels (x, y, index) scaled to the
+// maximum value.
+byte_string ppm_frame(std::size_t width, std::size_t height, std::size_t index, std::size_t max_value = 255) {
+    byte_string bytes;
+    append(bytes, "P6\n# A comment\n" + std::to_string(width) + " " + std::to_string(height) + 
+                  "\n" + std::to_string(max_value) + "\n");
+    for (std::size_t y = 0; y < height; ++y) {
+        for (std::size_t x = 0; x < width; ++x) {
+            for (auto value : {x, y, index}) {
+                auto sample = value % 256 * max_value / 255;
+                if (max_value > 255) {
+                    bytes.push_back(static_cast<unsigned char>(sample >> 8));
+                }
+                bytes.push_back(static_cast<unsigned char>(sample));
+            }
+        }
+    }
+    return bytes;
+}
+
+// Opens a descriptor from which the given bytes can be read. The bytes are 
+// written to a pipe in small chunks by a thread, which the caller joins.
+int open_stream(const byte_string& bytes, std::thread& writer, std::size_t chunk_size = 1000) {
+    // The writer stops if the reader closes the pipe first.
+    std::signal(SIGPIPE, SIG_IGN);
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    writer = std::thread([bytes, chunk_size, fd = fds[1]]() {
+        for (std::size_t i = 0; i < bytes.size(); i += chunk_size) {
+            auto count = std::min(chunk_size, bytes.size() - i);
+            if (write(fd, bytes.data() + i, count) != static_cast<ssize_t>(count)) {
+                break;
+            }
+        }
+        close(fd);
+    });
+    return fds[0];
+}
+
+// Reads the whole stream, closing the descriptor.
+std::vector<rgb_image_t> read_all_frames(const byte_string& bytes, std::size_t chunk_size = 1000) {
+    std::thread writer;
+    int fd = open_stream(bytes, writer, chunk_size);
+    std::vector<rgb_image_t> frames;
+    try {
+        frame_stream stream(fd);
+        frames.emplace_back();
+        while (stream.read_frame(frames.back())) {
+            frames.emplace_back();
+        }
+        frames.pop_back();
+    }
+    catch(...) {
+        close(fd);
+        writer.join();
+        throw;
+    }
+    close(fd);
+    writer.join();
+    return frames;
+}
+
+TEST_CASE("Test reading a PPM stream", "[frame_stream]") {
+    // The second frame is larger than the stream's buffer, so most of it
+    // is read straight into the image.
+    byte_string bytes = ppm_frame(5, 4, 0);
+    auto large = ppm_frame(200, 120, 1);
+    bytes.insert(bytes.end(), large.begin(), large.end());
+    append(bytes, "\n");
+    auto last = ppm_frame(5, 4, 2);
+    bytes.insert(bytes.end(), last.begin(), last.end());
+
+    auto chunk_size = GENERATE(std::size_t(7), std::size_t(100000));
+    auto frames = read_all_frames(bytes, chunk_size);
+    REQUIRE(frames.size() == 3);
+    REQUIRE(frames[1].width() == 200);
+    REQUIRE(frames[1].height() == 120);
+
+    bool all_match = true;
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        auto img_view = boost::gil::const_view(frames[i]);
+        for (std::ptrdiff_t y = 0; y < img_view.height(); ++y) {
+            for (std::ptrdiff_t x = 0; x < img_view.width(); ++x) {
+                all_match = all_match && img_view(x, y) == rgb_pixel_t(x % 256, y % 256, i);
+            }
+        }
+    }
+    REQUIRE(all_match);
+}
+
+TEST_CASE("Test reading PPM streams with other sample ranges", "[frame_stream]") {
+    // Samples are stretched to the 8-bit range.
+    auto max_value = GENERATE(std::size_t(65535), std::size_t(1023), std::size_t(15));
+    auto frames = read_all_frames(ppm_frame(3, 2, 255, max_value));
+    REQUIRE(frames.size() == 1);
+    auto img_view = boost::gil::const_view(frames[0]);
+    REQUIRE(img_view(0, 0)[0] == 0);
+    REQUIRE(img_view(0, 0)[2] == 255);
+}
+
+// A Y4M stream with the given header parameters and frames of planes.
+byte_string y4m_stream(const std::string& parameters, const std::vector<byte_string>& frames) {
+    byte_string bytes;
+    append(bytes, "YUV4MPEG2 " + parameters + "\n");
+    for (const auto& frame : frames) {
+        append(bytes, "FRAME\n");
+        bytes.insert(bytes.end(), frame.begin(), frame.end());
+    }
+    return bytes;
+}
+
+TEST_CASE("Test reading a Y4M stream", "[frame_stream]") {
+    SECTION("4:2:0 limited range") {
+        // Black on the left and white on the right, with neutral chroma.
+        byte_string frame = {16, 16, 235, 235,   16, 16, 235, 235,   128, 128,   128, 128};
+        auto frames = read_all_frames(y4m_stream("W4 H2 F25:1 Ip A1:1 C420jpeg", {frame, frame}));
+        REQUIRE(frames.size() == 2);
+        auto img_view = boost::gil::const_view(frames[1]);
+        REQUIRE(img_view(1, 1) == rgb_pixel_t(0, 0, 0));
+        REQUIRE(img_view(2, 0) == rgb_pixel_t(255, 255, 255));
+    }
+
+    SECTION("4:4:4 full range") {
+        // Pure red, green and blue in full range BT.601.
+        byte_string frame = {76, 150, 29,   85, 44, 255,   255, 21, 107};
+        auto frames = read_all_frames(y4m_stream("W3 H1 C444 XCOLORRANGE=FULL", {frame}));
+        auto img_view = boost::gil::const_view(frames[0]);
+        std::vector<rgb_pixel_t> expected = {rgb_pixel_t(255, 0, 0), rgb_pixel_t(0, 255, 0), rgb_pixel_t(0, 0, 255)};
+        for (std::size_t x = 0; x < 3; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                REQUIRE(std::abs(img_view(x, 0)[c] - expected[x][c]) <= 2);
+            }
+        }
+    }
+
+    SECTION("4:2:2 odd width") {
+        // Chroma samples cover two pixels, and the last covers one.
+        byte_string frame = {128, 128, 128,   128, 128,   128, 255};
+        auto frames = read_all_frames(y4m_stream("W3 H1 C422 XCOLORRANGE=FULL", {frame}));
+        auto img_view = boost::gil::const_view(frames[0]);
+        REQUIRE(img_view(0, 0) == rgb_pixel_t(128, 128, 128));
+        REQUIRE(img_view(1, 0) == rgb_pixel_t(128, 128, 128));
+        REQUIRE(img_view(2, 0)[0] == 255);
+    }
+
+    SECTION("Monochrome") {
+        byte_string frame = {0, 100, 255};
+        auto frames = read_all_frames(y4m_stream("W3 H1 Cmono XCOLORRANGE=FULL", {frame}));
+        REQUIRE(boost::gil::const_view(frames[0])(1, 0) == rgb_pixel_t(100, 100, 100));
+    }
+}
+
+TEST_CASE("Test reading invalid streams", "[frame_stream]") {
+    SECTION("Empty") {
+        REQUIRE_THROWS_AS(read_all_frames({}), std::runtime_error);
+    }
+    SECTION("Unknown format") {
+        byte_string bytes;
+        append(bytes, "GIF89a");
+        REQUIRE_THROWS_AS(read_all_frames(bytes), std::runtime_error);
+    }
+    SECTION("Truncated frame") {
+        auto bytes = ppm_frame(10, 10, 0);
+        auto more = ppm_frame(10, 10, 1);
+        bytes.insert(bytes.end(), more.begin(), more.end() - 1);
+        REQUIRE_THROWS_AS(read_all_frames(bytes), std::runtime_error);
+    }
+    SECTION("Malformed PPM header") {
+        byte_string bytes;
+        append(bytes, "P6 10 x 255\n");
+        REQUIRE_THROWS_AS(read_all_frames(bytes), std::runtime_error);
+    }
+    SECTION("Unsupported color space") {
+        REQUIRE_THROWS_AS(read_all_frames(y4m_stream("W2 H2 C420p10", {})), std::runtime_error);
+    }
+}
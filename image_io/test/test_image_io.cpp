@@ -0,0 +1,483 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <boost/gil/extension/io/jpeg.hpp>
+#include <png.h>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "image_io.hpp"
+
+using namespace image;
+
+// Returns a path for a file in the temporary directory.
+std::string temp_file(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / ("test_image_io_" + name)).string();
+}
+
+void write_bytes(const std::string& filename, const std::vector<unsigned char>& bytes) {
+    std::ofstream file(filename, std::ios::out | std::ios::binary);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+// The start of a PNG file, up to the end of the IHDR chunk's fields.
+std::vector<unsigned char> png_header(uint32_t width, uint32_t height, uint8_t bit_depth, uint8_t color_type) {
+    return {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n',
+        0, 0, 0, 13, 'I', 'H', 'D', 'R',
+        uint8_t(width >> 24), uint8_t(width >> 16), uint8_t(width >> 8), uint8_t(width),
+        uint8_t(height >> 24), uint8_t(height >> 16), uint8_t(height >> 8), uint8_t(height),
+        bit_depth, color_type, 0, 0, 0
+    };
+}
+
+// Writes a PNG file with libpng from rows of channels in the given layout.
+// 16-bit channels are given in big-endian order, as they are stored.
+void write_png(const std::string& filename, uint32_t width, uint32_t height, 
+               int bit_depth, int color_type, std::vector<std::vector<unsigned char>> rows,
+               bool interlaced = false, const std::vector<png_color>& palette = {}, 
+               const std::vector<png_byte>& palette_alpha = {}) {
+    auto file = std::fopen(filename.c_str(), "wb");
+    auto png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    auto info = png_create_info_struct(png);
+    png_init_io(png, file);
+    png_set_IHDR(png, info, width, height, bit_depth, color_type, 
+                 interlaced ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    if (!palette.empty()) {
+        png_set_PLTE(png, info, palette.data(), palette.size());
+    }
+    if (!palette_alpha.empty()) {
+        png_set_tRNS(png, info, palette_alpha.data(), palette_alpha.size(), nullptr);
+    }
+    std::vector<png_bytep> row_pointers;
+    for (auto& row : rows) {
+        row_pointers.push_back(row.data());
+    }
+    png_write_info(png, info);
+    png_write_image(png, row_pointers.data());
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    std::fclose(file);
+}
+
+file_buffer read_contents(const std::string& filename) {
+    std::vector<file_read> reads(1);
+    reads[0].filename = filename;
+    batch_file_reader(false).read_files(reads);
+    return reads[0].contents;
+}
+
+// The start of a JPEG file, with an APP0 segment, fill bytes, and then a 
+// progressive SOF segment.
+std::vector<unsigned char> jpeg_header(uint16_t width, uint16_t height, uint8_t components) {
+    return {
+        0xFF, 0xD8,
+        0xFF, 0xE0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0,
+        0xFF, 0xFF, 0xC2, 0, uint8_t(8 + 3 * components), 8,
+        uint8_t(height >> 8), uint8_t(height), uint8_t(width >> 8), uint8_t(width),
+        components
+    };
+}
+
+TEST_CASE("Test reading headers of written images", "[image_io]") {
+    rgb_image_t img(37, 21);
+    boost::gil::fill_pixels(boost::gil::view(img), rgb_pixel_t(10, 200, 30));
+
+    auto type = GENERATE(file_type::PNG, file_type::JPEG);
+    auto other_type = type == file_type::PNG ? file_type::JPEG : file_type::PNG;
+    auto filename = temp_file(type == file_type::PNG ? "written.png" : "written.jpg");
+    write_image(filename, img, type);
+
+    auto info = read_image_info(filename, type);
+    REQUIRE(info.has_value());
+    REQUIRE(info->type == type);
+    REQUIRE(info->width == 37);
+    REQUIRE(info->height == 21);
+    REQUIRE(info->bit_depth == 8);
+    REQUIRE(info->channels == 3);
+    REQUIRE(is_rgb8_compatible(*info));
+
+    // Decoding from memory gives the same image as decoding the file.
+    rgb_image_t from_file;
+    read_image(filename, from_file, type);
+    std::vector<file_read> reads(1);
+    reads[0].filename = filename;
+    batch_file_reader(false).read_files(reads);
+    rgb_image_t from_memory;
+    read_image(reads[0].contents, from_memory, type);
+    REQUIRE(from_memory == from_file);
+
+    REQUIRE(is_file_type(filename, type));
+    REQUIRE_FALSE(is_file_type(filename, other_type));
+    REQUIRE_FALSE(read_image_info(filename, other_type).has_value());
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Test reading PNG headers", "[image_io]") {
+    auto filename = temp_file("header.png");
+
+    SECTION("16-bit grayscale") {
+        write_bytes(filename, png_header(70000, 3, 16, 0));
+        auto info = read_image_info(filename, file_type::PNG);
+        REQUIRE(info.has_value());
+        REQUIRE(info->width == 70000);
+        REQUIRE(info->height == 3);
+        REQUIRE(info->bit_depth == 16);
+        REQUIRE(info->channels == 1);
+        REQUIRE(is_rgb8_compatible(*info));
+    }
+
+    SECTION("RGBA and indexed") {
+        write_bytes(filename, png_header(4, 5, 8, 6));
+        REQUIRE(read_image_info(filename, file_type::PNG)->channels == 4);
+        write_bytes(filename, png_header(4, 5, 8, 3));
+        REQUIRE(read_image_info(filename, file_type::PNG)->channels == 1);
+    }
+
+    SECTION("Malformed headers") {
+        auto header = png_header(4, 5, 8, 2);
+        write_bytes(filename, std::vector<unsigned char>(header.begin(), header.end() - 5));
+        REQUIRE_FALSE(read_image_info(filename, file_type::PNG).has_value());
+
+        write_bytes(filename, png_header(0, 5, 8, 2));
+        REQUIRE_FALSE(read_image_info(filename, file_type::PNG).has_value());
+
+        write_bytes(filename, png_header(4, 5, 8, 5));
+        REQUIRE_FALSE(read_image_info(filename, file_type::PNG).has_value());
+    }
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Test reading JPEG headers", "[image_io]") {
+    auto filename = temp_file("header.jpg");
+
+    SECTION("Grayscale") {
+        write_bytes(filename, jpeg_header(640, 480, 1));
+        auto info = read_image_info(filename, file_type::JPEG);
+        REQUIRE(info.has_value());
+        REQUIRE(info->width == 640);
+        REQUIRE(info->height == 480);
+        REQUIRE(info->bit_depth == 8);
+        REQUIRE(info->channels == 1);
+        REQUIRE(is_rgb8_compatible(*info));
+    }
+
+    SECTION("CMYK") {
+        write_bytes(filename, jpeg_header(640, 480, 4));
+        REQUIRE_FALSE(is_rgb8_compatible(*read_image_info(filename, file_type::JPEG)));
+    }
+
+    SECTION("Truncated before the frame header") {
+        auto header = jpeg_header(640, 480, 3);
+        write_bytes(filename, std::vector<unsigned char>(header.begin(), header.begin() + 20));
+        REQUIRE_FALSE(read_image_info(filename, file_type::JPEG).has_value());
+    }
+
+    SECTION("Image data before the frame header") {
+        write_bytes(filename, {0xFF, 0xD8, 0xFF, 0xDA, 0, 2});
+        REQUIRE_FALSE(read_image_info(filename, file_type::JPEG).has_value());
+    }
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Test reading headers of missing files", "[image_io]") {
+    REQUIRE_FALSE(read_image_info(temp_file("missing.png"), file_type::PNG).has_value());
+    REQUIRE_FALSE(is_file_type(temp_file("missing.jpg"), file_type::JPEG));
+}
+
+TEST_CASE("Test reading headers from memory", "[image_io]") {
+    auto png = png_header(4, 5, 16, 6);
+    auto info = read_image_info(png);
+    REQUIRE(info.has_value());
+    REQUIRE(info->type == file_type::PNG);
+    REQUIRE(info->width == 4);
+    REQUIRE(info->height == 5);
+    REQUIRE(info->bit_depth == 16);
+    REQUIRE(info->channels == 4);
+
+    auto jpeg = jpeg_header(640, 480, 3);
+    info = read_image_info(jpeg);
+    REQUIRE(info.has_value());
+    REQUIRE(info->type == file_type::JPEG);
+    REQUIRE(info->width == 640);
+    REQUIRE(info->height == 480);
+    REQUIRE(info->channels == 3);
+
+    // Only the given bytes are read.
+    REQUIRE_FALSE(read_image_info(byte_view(jpeg.data(), 20)).has_value());
+    REQUIRE_FALSE(read_image_info(byte_view(png.data(), 20)).has_value());
+    REQUIRE_FALSE(read_image_info(byte_view()).has_value());
+    REQUIRE_FALSE(read_image_info(file_buffer {'G', 'I', 'F', '8', '9', 'a'}).has_value());
+}
+
+TEST_CASE("Test scaled dimensions", "[image_io]") {
+    REQUIRE(scaled_dimension(100, 1) == 100);
+    REQUIRE(scaled_dimension(100, 0.3) == 30);
+    REQUIRE(scaled_dimension(1001, 0.5) == 501);
+    REQUIRE(scaled_dimension(1001, 0.125) == 126);
+    REQUIRE(scaled_dimension(3, 0.01) == 1);
+}
+
+TEST_CASE("Test reading scaled images", "[image_io]") {
+    // Blocks of 8x8 pixels of one color, so that the reduced images have 
+    // exactly known colors.
+    constexpr std::size_t WIDTH = 64;
+    constexpr std::size_t HEIGHT = 48;
+    rgb_image_t img(WIDTH, HEIGHT);
+    auto img_view = boost::gil::view(img);
+    for (std::size_t y = 0; y < HEIGHT; ++y) {
+        for (std::size_t x = 0; x < WIDTH; ++x) {
+            img_view(x, y) = rgb_pixel_t(x / 8 * 30, y / 8 * 40, 128);
+        }
+    }
+
+    auto type = GENERATE(file_type::PNG, file_type::JPEG);
+    auto filename = temp_file(type == file_type::PNG ? "scaled.png" : "scaled.jpg");
+    write_image(filename, img, type);
+    std::vector<file_read> reads(1);
+    reads[0].filename = filename;
+    batch_file_reader(false).read_files(reads);
+
+    // Powers of two are reduced by libjpeg alone, and other scales are
+    // resampled afterwards.
+    auto scale = GENERATE(1.0, 0.5, 0.25, 0.125, 0.3);
+    rgb_image_t scaled;
+    read_image(reads[0].contents, scaled, type, scale);
+    REQUIRE(std::size_t(scaled.width()) == scaled_dimension(WIDTH, scale));
+    REQUIRE(std::size_t(scaled.height()) == scaled_dimension(HEIGHT, scale));
+
+    // JPEG compression is lossy, so colors are compared at the center of
+    // each block with a tolerance.
+    auto scaled_view = boost::gil::const_view(scaled);
+    for (std::size_t block_y = 0; block_y < HEIGHT / 8; ++block_y) {
+        for (std::size_t block_x = 0; block_x < WIDTH / 8; ++block_x) {
+            auto x = static_cast<std::size_t>((block_x * 8 + 4) * scale);
+            auto y = static_cast<std::size_t>((block_y * 8 + 4) * scale);
+            auto pixel = scaled_view(x, y);
+            auto expected = rgb_pixel_t(block_x * 30, block_y * 40, 128);
+            for (int c = 0; c < 3; ++c) {
+                REQUIRE(std::abs(int(pixel[c]) - int(expected[c])) <= 12);
+            }
+        }
+    }
+
+    if (type == file_type::JPEG) {
+        rgb_image_t from_file;
+        read_jpeg_image(filename, from_file, scale);
+        REQUIRE(from_file == scaled);
+    }
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Test reading scaled invalid JPEG images", "[image_io]") {
+    file_buffer contents = {0xFF, 0xD8, 0xFF, 0xDB, 0, 3, 0};
+    rgb_image_t img;
+    REQUIRE_THROWS_AS(read_jpeg_image(contents, img, 0.5), std::runtime_error);
+}
+
+TEST_CASE("Test reading PNG images in other layouts", "[image_io]") {
+    auto filename = temp_file("layout.png");
+    rgb_image_t img;
+
+    SECTION("16-bit RGB") {
+        // Each 16-bit channel is rounded to the nearest 8-bit value, and 
+        // 8-bit values v are stored as v * 257.
+        write_png(filename, 2, 1, 16, PNG_COLOR_TYPE_RGB, {{
+            0x00, 0x80, 0xFF, 0xFF, 0x12, 0x34,   0x7F, 0xFF, 0x80, 0x00, 0x01, 0x00
+        }});
+        auto info = read_image_info(filename, file_type::PNG);
+        REQUIRE(is_rgb8_compatible(*info));
+        read_image(filename, img, file_type::PNG);
+        auto img_view = boost::gil::const_view(img);
+        REQUIRE(img_view(0, 0) == rgb_pixel_t(0, 255, 18));
+        REQUIRE(img_view(1, 0) == rgb_pixel_t(127, 128, 1));
+    }
+
+    SECTION("Grayscale") {
+        write_png(filename, 3, 1, 8, PNG_COLOR_TYPE_GRAY, {{0, 100, 255}});
+        read_image(filename, img, file_type::PNG);
+        auto img_view = boost::gil::const_view(img);
+        REQUIRE(img_view(0, 0) == rgb_pixel_t(0, 0, 0));
+        REQUIRE(img_view(1, 0) == rgb_pixel_t(100, 100, 100));
+        REQUIRE(img_view(2, 0) == rgb_pixel_t(255, 255, 255));
+
+        // Packed gray pixels are expanded to 8 bits.
+        write_png(filename, 4, 1, 2, PNG_COLOR_TYPE_GRAY, {{0b00011011}});
+        read_image(filename, img, file_type::PNG);
+        REQUIRE(boost::gil::const_view(img)(1, 0) == rgb_pixel_t(85, 85, 85));
+        REQUIRE(boost::gil::const_view(img)(3, 0) == rgb_pixel_t(255, 255, 255));
+    }
+
+    SECTION("RGBA and gray with alpha") {
+        // Pixels are opaque, transparent and half transparent.
+        auto rgba_row = std::vector<unsigned char>{200, 100, 0, 255,   200, 100, 0, 0,   200, 100, 0, 128};
+        auto rgba_16_row = std::vector<unsigned char>{
+            200, 200, 100, 100, 0, 0, 255, 255,   200, 200, 100, 100, 0, 0, 0, 0,   200, 200, 100, 100, 0, 0, 128, 128
+        };
+        auto gray_alpha_row = std::vector<unsigned char>{200, 255,   200, 0,   200, 128};
+        auto is_gray = GENERATE(false, true);
+        auto is_16_bit = GENERATE(false, true);
+        if (is_gray) {
+            write_png(filename, 3, 1, 8, PNG_COLOR_TYPE_GRAY_ALPHA, {gray_alpha_row});
+        }
+        else if (is_16_bit) {
+            write_png(filename, 3, 1, 16, PNG_COLOR_TYPE_RGBA, {rgba_16_row});
+        }
+        else {
+            write_png(filename, 3, 1, 8, PNG_COLOR_TYPE_RGBA, {rgba_row});
+        }
+
+        decode_options options;
+        options.background = rgb_pixel_t(0, 0, 255);
+        read_image(read_contents(filename), img, file_type::PNG, options);
+
+        auto img_view = boost::gil::const_view(img);
+        auto color = is_gray ? rgb_pixel_t(200, 200, 200) : rgb_pixel_t(200, 100, 0);
+        REQUIRE(img_view(0, 0) == color);
+        REQUIRE(img_view(1, 0) == options.background);
+        for (int c = 0; c < 3; ++c) {
+            auto expected = std::lround((color[c] * 128 + options.background[c] * 127) / 255.0);
+            REQUIRE(std::abs(img_view(2, 0)[c] - expected) <= 1);
+        }
+    }
+
+    SECTION("Indexed with transparency") {
+        write_png(filename, 2, 1, 8, PNG_COLOR_TYPE_PALETTE, {{0, 1}}, false, 
+                  {{10, 20, 30}, {40, 50, 60}}, {255, 0});
+        decode_options options;
+        options.background = rgb_pixel_t(255, 255, 255);
+        read_image(read_contents(filename), img, file_type::PNG, options);
+        REQUIRE(boost::gil::const_view(img)(0, 0) == rgb_pixel_t(10, 20, 30));
+        REQUIRE(boost::gil::const_view(img)(1, 0) == rgb_pixel_t(255, 255, 255));
+    }
+
+    SECTION("Interlaced") {
+        // An interlaced image decodes to the same pixels as a plain one.
+        constexpr uint32_t SIZE = 11;
+        auto is_16_bit = GENERATE(false, true);
+        std::vector<std::vector<unsigned char>> rows;
+        for (uint32_t y = 0; y < SIZE; ++y) {
+            rows.emplace_back();
+            for (uint32_t x = 0; x < SIZE; ++x) {
+                if (is_16_bit) {
+                    rows.back().insert(rows.back().end(), {uint8_t(x * 20), uint8_t(x * 20), uint8_t(y * 20), uint8_t(y * 20), 7, 7});
+                }
+                else {
+                    rows.back().insert(rows.back().end(), {uint8_t(x * 20), uint8_t(y * 20), 7, 255});
+                }
+            }
+        }
+        auto bit_depth = is_16_bit ? 16 : 8;
+        auto color_type = is_16_bit ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGBA;
+        write_png(filename, SIZE, SIZE, bit_depth, color_type, rows);
+        rgb_image_t plain;
+        read_image(filename, plain, file_type::PNG);
+        write_png(filename, SIZE, SIZE, bit_depth, color_type, rows, true);
+        read_image(filename, img, file_type::PNG);
+        REQUIRE(img == plain);
+        REQUIRE(boost::gil::const_view(img)(SIZE - 1, 1) == rgb_pixel_t(200, 20, 7));
+    }
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Test reading invalid PNG images", "[image_io]") {
+    auto header = png_header(4, 5, 8, 2);
+    file_buffer contents(header.begin(), header.end());
+    rgb_image_t img;
+    REQUIRE_THROWS_AS(read_image(contents, img, file_type::PNG), std::runtime_error);
+}
+
+TEST_CASE("Test reading grayscale JPEG images", "[image_io]") {
+    auto filename = temp_file("gray.jpg");
+    boost::gil::gray8_image_t gray(16, 8);
+    boost::gil::fill_pixels(boost::gil::view(gray), boost::gil::gray8_pixel_t(90));
+    boost::gil::write_view(filename, boost::gil::const_view(gray), boost::gil::jpeg_tag{});
+    REQUIRE(is_rgb8_compatible(*read_image_info(filename, file_type::JPEG)));
+
+    rgb_image_t img;
+    read_image(filename, img, file_type::JPEG);
+    REQUIRE(img.width() == 16);
+    REQUIRE(boost::gil::const_view(img)(3, 3) == rgb_pixel_t(90, 90, 90));
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Test reading images in bands", "[image_io][band_reader]") {
+    constexpr std::size_t WIDTH = 40;
+    constexpr std::size_t HEIGHT = 30;
+    auto layout = GENERATE(0, 1, 2, 3);
+    auto type = layout == 1 ? file_type::JPEG : file_type::PNG;
+    auto filename = temp_file(layout == 1 ? "bands.jpg" : "bands.png");
+
+    // Plain RGB images of both types, a 16-bit RGBA image which must be 
+    // converted, and an interlaced image which is decoded in full.
+    if (layout < 2) {
+        rgb_image_t img(WIDTH, HEIGHT);
+        auto img_view = boost::gil::view(img);
+        for (std::size_t y = 0; y < HEIGHT; ++y) {
+            for (std::size_t x = 0; x < WIDTH; ++x) {
+                img_view(x, y) = rgb_pixel_t(x * 6, y * 8, (x + y) * 3);
+            }
+        }
+        write_image(filename, img, type);
+    }
+    else {
+        std::vector<std::vector<unsigned char>> rows;
+        for (std::size_t y = 0; y < HEIGHT; ++y) {
+            rows.emplace_back();
+            for (std::size_t x = 0; x < WIDTH; ++x) {
+                if (layout == 2) {
+                    rows.back().insert(rows.back().end(), {uint8_t(x * 6), 0, uint8_t(y * 8), 0, 40, 40, uint8_t(x * y), 0});
+                }
+                else {
+                    rows.back().insert(rows.back().end(), {uint8_t(x * 6), uint8_t(y * 8), 9});
+                }
+            }
+        }
+        write_png(filename, WIDTH, HEIGHT, layout == 2 ? 16 : 8, 
+                  layout == 2 ? PNG_COLOR_TYPE_RGBA : PNG_COLOR_TYPE_RGB, rows, layout == 3);
+    }
+
+    auto contents = read_contents(filename);
+    decode_options options;
+    options.background = rgb_pixel_t(0, 255, 0);
+    rgb_image_t expected;
+    read_image(contents, expected, type, options);
+
+    band_reader reader(contents, type, options);
+    REQUIRE(reader.width() == WIDTH);
+    REQUIRE(reader.height() == HEIGHT);
+
+    // Bands are read from the top, with the last band cut short, and then
+    // an earlier band is read again.
+    constexpr std::size_t BAND_ROWS = 7;
+    rgb_image_t band(WIDTH, BAND_ROWS);
+    auto expected_view = boost::gil::const_view(expected);
+    auto check_band = [&](std::size_t first_row) {
+        auto rows = std::min(BAND_ROWS, HEIGHT - first_row);
+        auto band_view = boost::gil::subimage_view(boost::gil::view(band), 0, 0, WIDTH, rows);
+        reader.read_rows(first_row, band_view);
+        REQUIRE(boost::gil::equal_pixels(
+            boost::gil::subimage_view(expected_view, 0, first_row, WIDTH, rows), band_view));
+    };
+    for (std::size_t first_row = 0; first_row < HEIGHT; first_row += BAND_ROWS) {
+        check_band(first_row);
+    }
+    check_band(BAND_ROWS);
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Test reading invalid images in bands", "[image_io][band_reader]") {
+    auto header = png_header(4, 5, 8, 2);
+    file_buffer contents(header.begin(), header.end());
+    REQUIRE_THROWS_AS(band_reader(contents, file_type::PNG), std::runtime_error);
+}
@@ -0,0 +1,73 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <vector>
+#include "pixel_convert.hpp"
+
+using namespace image;
+
+TEST_CASE("Test narrowing 16-bit channels", "[pixel_convert]") {
+    std::vector<uint16_t> wide(0x10000);
+    for (std::size_t i = 0; i < wide.size(); ++i) {
+        wide[i] = static_cast<uint16_t>(i);
+    }
+    std::vector<uint8_t> narrow(wide.size());
+    narrow_channels(wide.data(), narrow.data(), wide.size());
+
+    // Every value is rounded to the nearest 8-bit value.
+    for (std::size_t i = 0; i < wide.size(); ++i) {
+        REQUIRE(narrow[i] == std::lround(i / 257.0));
+    }
+}
+
+TEST_CASE("Test expanding gray pixels", "[pixel_convert]") {
+    std::vector<uint8_t> gray = {0, 17, 255};
+    std::vector<uint8_t> rgb(9);
+    expand_gray(gray.data(), rgb.data(), gray.size());
+    REQUIRE(rgb == std::vector<uint8_t>{0, 0, 0, 17, 17, 17, 255, 255, 255});
+}
+
+TEST_CASE("Test flattening alpha", "[pixel_convert]") {
+    auto background = GENERATE(rgb_pixel_t(0, 0, 0), rgb_pixel_t(255, 255, 255), rgb_pixel_t(12, 130, 201));
+
+    // Every color and alpha value in the first channel, with fixed colors
+    // in the others.
+    std::vector<uint8_t> rgba;
+    for (int color = 0; color < 256; ++color) {
+        for (int alpha = 0; alpha < 256; ++alpha) {
+            rgba.insert(rgba.end(), {uint8_t(color), 0, 255, uint8_t(alpha)});
+        }
+    }
+    std::size_t pixels = rgba.size() / 4;
+    std::vector<uint8_t> rgb(3 * pixels);
+    flatten_alpha(rgba.data(), background, rgb.data(), pixels);
+
+    auto expected = [](int color, int background, int alpha) {
+        return std::lround((color * alpha + background * (255 - alpha)) / 255.0);
+    };
+    bool all_match = true;
+    for (std::size_t i = 0; i < pixels; ++i) {
+        int alpha = rgba[4 * i + 3];
+        all_match = all_match 
+            && rgb[3 * i] == expected(rgba[4 * i], background[0], alpha)
+            && rgb[3 * i + 1] == expected(0, background[1], alpha)
+            && rgb[3 * i + 2] == expected(255, background[2], alpha);
+    }
+    REQUIRE(all_match);
+
+    // Opaque pixels keep their color, and fully transparent pixels take
+    // the background color.
+    REQUIRE(rgb[3 * 255] == 0);
+    REQUIRE(rgb[3 * 256] == background[0]);
+
+    // Gray pixels with alpha are blended in the same way.
+    std::vector<uint8_t> gray_alpha = {200, 255, 200, 0, 200, 128};
+    std::vector<uint8_t> gray_rgb(9);
+    flatten_gray_alpha(gray_alpha.data(), background, gray_rgb.data(), 3);
+    for (int c = 0; c < 3; ++c) {
+        REQUIRE(gray_rgb[c] == 200);
+        REQUIRE(gray_rgb[3 + c] == background[c]);
+        REQUIRE(gray_rgb[6 + c] == expected(200, background[c], 128));
+    }
+}
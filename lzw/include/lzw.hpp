@@ -1,9 +1,9 @@
 #ifndef LZW_HPP
 #define LZW_HPP
 
+#include <array>
 #include <cassert>
 #include <cstdint>
-#include <map>
 #include <vector>
 
 namespace lzw {
@@ -194,6 +194,8 @@ namespace lzw {
         lzw_encoder(size_type starting_bits, OutputStream& out) : 
                     starting_code_size(starting_bits), 
                     current_code_size(starting_bits + 1),
+                    prefix(0),
+                    has_prefix(false),
                     flushed(false),
                     byte_buf(out) {
             assert (starting_bits >= 3);
@@ -220,34 +222,39 @@ namespace lzw {
         // a clear code will be emitted and the dictionary will be 
         // rebuilt.
         void encode(input_symbol_type i) {
-            // Add the provided symbol to the current matched sequence
-            symbol_string_type augmented = symbol_buf;
-            augmented.push_back(i);
-
-            if (dict.contains(augmented)) {
-                // Augmented string has been seen before. Use swap() to
-                // add symbol i to the end of the working buffer without 
-                // risking a duplicate re-allocation of memory from 
-                // push_back calls to both augmented (above) and 
-                // symbol_buf
-                std::swap(symbol_buf, augmented);
+            assert (i < clear_code());
+
+            // Every single symbol is a literal in the dictionary, so a
+            // symbol only needs to be looked up if it extends a prefix.
+            if (!has_prefix) {
+                prefix = i;
+                has_prefix = true;
+                return;
+            }
+
+            auto slot = find_slot(prefix, i);
+            if (dict_keys[slot] != EMPTY_KEY) {
+                // The augmented string has been seen before, so it becomes
+                // the current matched sequence.
+                prefix = dict_codes[slot];
+            }
+            else if (next_code > MAX_CODE_VALUE) {
+                // The dictionary is full. The new symbol is written as a
+                // literal before the dictionary is cleared, after which 
+                // nothing is matched.
+                encode_buffered_symbols();
+                prefix = i;
+                has_prefix = true;
+                clear();
             }
             else {
-                // Write the code for the currently matched string
-                // and make the new working string the most recently
-                // matched character.
+                // Write the code for the currently matched string and add
+                // the augmented string to the dictionary. The new working
+                // string is the most recently matched character.
                 encode_buffered_symbols();
-                symbol_buf.push_back(i);
-                assert (symbol_buf.size() == 1);
-
-                // If the dictionary is full, clear it. Otherwise, we add 
-                // the augmented string to the dictionary. 
-                if (next_code > MAX_CODE_VALUE) {                  
-                    clear();
-                }
-                else {
-                    add_code_for_string(augmented);
-                }
+                add_code_for_string(slot, prefix, i);
+                prefix = i;
+                has_prefix = true;
             }
         }
 
@@ -303,12 +310,18 @@ namespace lzw {
         }
 
     private:
-        using symbol_string_type = std::string;
-        using dict_type = std::map<symbol_string_type, code_type>;
-
         const static size_type MAX_CODE_SIZE = 12;
         const static size_type MAX_CODE_VALUE = 4095;
 
+        // The dictionary maps a string to its code. Each string other than
+        // a literal is a shorter string in the dictionary followed by one 
+        // symbol, so it is keyed by that string's code and the symbol. The
+        // keys are held in an open-addressed hash table with at most half
+        // of its slots in use, which is stored inline so that the encoder
+        // never allocates memory.
+        const static size_type DICT_SLOTS = 8192;
+        const static uint32_t EMPTY_KEY = 0xFFFFFFFF;
+
         // Bit sizes
         size_type starting_code_size;
         size_type current_code_size;
@@ -318,11 +331,14 @@ namespace lzw {
         // the dictionary gets full.
         uint32_t next_code;
 
-        // Current sequence of matched symbols
-        symbol_string_type symbol_buf;
+        // The code of the current sequence of matched symbols, if any
+        // symbols have been matched.
+        code_type prefix;
+        bool has_prefix;
         bool flushed;
 
-        dict_type dict;
+        std::array<uint32_t, DICT_SLOTS> dict_keys;
+        std::array<code_type, DICT_SLOTS> dict_codes;
 
         // Holds partial bytes from previously encoded sequences
         // and writes data downstream.
@@ -338,11 +354,21 @@ namespace lzw {
         // downstream. Clears the symbol buffer. Does not change the state
         // of the dictionary.
         void encode_buffered_symbols() {
-            if (!symbol_buf.empty()) {
-                auto code_entry = dict.find(symbol_buf);
-                write_code(code_entry->second);
-                symbol_buf.clear();
+            if (has_prefix) {
+                write_code(prefix);
+                has_prefix = false;
+            }
+        }
+
+        // Returns the slot which holds the string made of the given prefix
+        // and symbol, or the empty slot where it should be added.
+        size_type find_slot(code_type prefix_code, input_symbol_type symbol) const {
+            uint32_t key = (uint32_t(prefix_code) << 8) | symbol;
+            size_type slot = (key * 2654435761u) >> (32 - 13);
+            while (dict_keys[slot] != EMPTY_KEY && dict_keys[slot] != key) {
+                slot = (slot + 1) & (DICT_SLOTS - 1);
             }
+            return slot;
         }
 
         // Inserts the clear code into the output stream
@@ -353,26 +379,9 @@ namespace lzw {
             encode_buffered_symbols();
             write_code(clear_code());
 
-            dict.clear();
-
-            // Initialize the dictionary to hold mappings for all 
-            // the literal values [0, 2^starting_bits).
-            uint16_t max_literal(clear_code() - 1);
-            for (uint16_t i = 0; i <= max_literal; ++i)  {
-                input_symbol_type literal(i);
-                symbol_string_type key {static_cast<char>(literal)};
-                code_type value(i);
-
-                // This assertion structure is a little ugly, but lets us
-                // avoid unused variable errors/warnings when asserts are
-                // disabled.
-#ifdef NDEBUG
-                dict.insert(std::make_pair(key, value));
-#else
-                auto result = dict.insert(std::make_pair(key, value));
-                assert (result.second);
-#endif
-            }
+            // The literal values [0, 2^starting_bits) are their own codes,
+            // so they are not stored in the table.
+            dict_keys.fill(uint32_t(EMPTY_KEY));
 
             // Reset our starting point in the code list to the 
             // first empty slot following the EOI code. 
@@ -380,14 +389,15 @@ namespace lzw {
             current_code_size = starting_code_size + 1;
         }
 
-        // Add the given string of symbols to the dictionary
-        // and update next_code and possibly the current code size.
-        void add_code_for_string(const symbol_string_type& s) {
-            assert (!dict.contains(s));
+        // Add the given string of symbols to the dictionary in the empty 
+        // slot found for it, and update next_code and possibly the current
+        // code size.
+        void add_code_for_string(size_type slot, code_type prefix_code, input_symbol_type symbol) {
+            assert (dict_keys[slot] == EMPTY_KEY);
             assert (next_code <= MAX_CODE_VALUE);
 
-            auto mapping = std::make_pair(s, next_code);
-            dict.insert(mapping);
+            dict_keys[slot] = (uint32_t(prefix_code) << 8) | symbol;
+            dict_codes[slot] = static_cast<code_type>(next_code);
             ++next_code;
 
             // If we've hit the maximum code we can represent with the
@@ -402,4 +412,4 @@ namespace lzw {
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,4 +1,5 @@
 #include "color_table.hpp"
+#include <stdexcept>
 
 namespace palettize {
     
@@ -26,7 +27,7 @@ namespace palettize {
         uint32_t min_distance = MAX_EUCLIDEAN_DISTANCE + 1;
         index_type index = 0;
         for (std::size_t i = 0; i < size(); ++i) {
-            uint32_t new_distance = euclidean_distance(p, table.at(i));
+            uint32_t new_distance = euclidean_distance(p, table[i]);
             if (new_distance < min_distance) {
                 min_distance = new_distance;
                 index = static_cast<index_type>(i);
@@ -43,12 +44,12 @@ namespace palettize {
 
     void color_table::add_color(const image::rgb_pixel_t& p) {
         assert (size() < max_size());
-        table.push_back(p);
+        table[table_size++] = p;
     }
 
     bool color_table::contains_color(const image::rgb_pixel_t& p) {  
-        for (const auto& entry : table) {
-            if (entry == p) {
+        for (std::size_t i = 0; i < size(); ++i) {
+            if (table[i] == p) {
                 return true;
             }
         }
@@ -56,7 +57,10 @@ namespace palettize {
     }
 
     const image::rgb_pixel_t& color_table::at(uint32_t i) const {
-        return table.at(i);
+        if (i >= size()) {
+            throw std::out_of_range("color table index out of range");
+        }
+        return table[i];
     }
 
     uint8_t color_table::min_bit_depth() const {
@@ -81,10 +85,10 @@ namespace palettize {
 
     // Returns the number of entries in the color table.
     std::size_t color_table::size() const {
-        return table.size();
+        return table_size;
     } 
 
     std::size_t color_table::max_size() {
-        return 256;
+        return MAX_SIZE;
     }
 }
@@ -3,6 +3,7 @@
 
 #include "image_utils.hpp"
 #include <boost/gil.hpp>
+#include <array>
 #include <cstdint>
 #include <cassert>
 #include <unordered_map>
@@ -14,7 +15,8 @@ namespace palettize {
     // of colors with which to quantize and encode one or more
     // frames of image data.
     //
-    // A color table may support up to 256 distinct colors.
+    // A color table may support up to 256 distinct colors. The colors are
+    // stored inline, so tables never allocate memory.
     class color_table {
     public:
 
@@ -61,7 +63,10 @@ namespace palettize {
         //    = 195075
         static const uint32_t MAX_EUCLIDEAN_DISTANCE = 195075;
 
-        std::vector<image::rgb_pixel_t> table;
+        static constexpr std::size_t MAX_SIZE = 256;
+
+        std::array<image::rgb_pixel_t, MAX_SIZE> table {};
+        std::size_t table_size = 0;
     };
 
 }
@@ -3,6 +3,8 @@
 
 #include "image_utils.hpp"
 #include "color_table.hpp"
+#include <memory_resource>
+#include <vector>
 
 namespace palettize {
 
@@ -24,8 +26,29 @@ namespace palettize {
         };
 
         // A histogram showing the number of occurrences of each color
-        // present in an image.
-        using color_histogram = std::vector<histogram_node>;
+        // present in an image. Nodes are kept sorted in RGB order.
+        //
+        // Histograms, and the temporary data used to compute them, are 
+        // allocated from a memory resource so that a frame's arena can 
+        // supply them. The default resource uses the global allocator.
+        using color_histogram = std::pmr::vector<histogram_node>;
+
+        // Generates a histogram of the colors used in the image. Only every
+        // sample_step'th pixel, in row-major order, is counted.
+        color_histogram compute_color_histogram(const image::rgb_image_view_t& image_view,
+                                                std::size_t sample_step = 1,
+                                                std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+        // Generates a histogram of the colors used by the pixels of the image
+        // which are not flagged in the excluded mask.
+        color_histogram compute_color_histogram(const image::rgb_image_view_t& image_view,
+                                                const image::pixel_mask& excluded,
+                                                std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+        // Adds the counts from one histogram into another. Both histograms 
+        // must be sorted in RGB order, and the result will be too. The 
+        // result is allocated from the memory resource of into.
+        void merge_histograms(color_histogram& into, const color_histogram& from);
 
         // Represents a non-empty 3-dimensional region in the 0-255 RGB cube 
         // and the set of colors in that region that are used in an image.
@@ -117,6 +140,29 @@ namespace palettize {
     // and uses less space.
     color_table median_cut(const image::rgb_image_view_t& image_view);
 
+    // A task-parallel variant of median_cut which produces exactly the 
+    // same palette. Once a region is split, its two halves own disjoint 
+    // sections of the shared histogram, so all the regions at the lowest
+    // split level can be sorted and partitioned concurrently. Regions are
+    // split one level at a time (a level-synchronous wave), and new regions
+    // are recorded in the same order that the serial algorithm would use.
+    //
+    // Each wave is split into at most max_threads tasks on the shared task
+    // pool. Small waves are split on the calling thread since they are not
+    // worth the cost of queuing tasks.
+    color_table parallel_median_cut(const image::rgb_image_view_t& image_view, 
+                                    std::size_t max_threads,
+                                    std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+    // Runs the parallel median cut algorithm over a pre-computed histogram. 
+    // This allows one palette to be computed for the colors of many images,
+    // or for a subset of an image's pixels. At most max_colors colors are 
+    // placed in the palette. Temporary data is allocated from the memory
+    // resource of the histogram.
+    color_table parallel_median_cut(internal::color_histogram histogram, 
+                                    std::size_t max_threads,
+                                    std::size_t max_colors = color_table::max_size());
+
 }
 
 #endif
\ No newline at end of file
@@ -1,8 +1,11 @@
 #ifndef PALETTIZE_HPP
 #define PALETTIZE_HPP
 
+#include <array>
+#include <memory_resource>
 #include <vector>
 #include "color_table.hpp"
+#include "median_cut.hpp"
 
 // Provides utilities to convert a full-color (8-bit) image
 // into a corresponding image representation that uses at most
@@ -18,8 +21,19 @@ namespace palettize {
     // Creates and returns a color table of up to 256 RGB pixel 
     // colors to represent the given image as closely as possible.
     // The median cut algorithm is used to do this, with no up-front
-    // scalar quantization. 
-    color_table create_color_table(const image::rgb_image_view_t& image_view);
+    // scalar quantization. Regions are split in parallel on the
+    // shared task pool. The histogram and other temporary data are 
+    // allocated from the memory resource.
+    color_table create_color_table(const image::rgb_image_view_t& image_view,
+                                   std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+    // Creates and returns a color table of up to max_colors colors to 
+    // represent the pixels of the image which are not flagged in the 
+    // excluded mask. The table is empty if every pixel is excluded.
+    color_table create_color_table(const image::rgb_image_view_t& image_view,
+                                   const image::pixel_mask& excluded,
+                                   std::size_t max_colors,
+                                   std::pmr::memory_resource* memory = std::pmr::get_default_resource());
 
     // Quantizes image using the provided color table to produce 
     // a list of index values. Each pixel in the image is mapped
@@ -28,6 +42,83 @@ namespace palettize {
     // are listed in row-major order.
     std::vector<uint8_t> palettize_image(const image::rgb_image_view_t& image_view, 
                                          const color_table& palette);
+
+    // As above, except that pixels flagged in the excluded mask are not
+    // quantized and are given excluded_index instead. Typically this is
+    // an index beyond the end of the palette, such as a transparent color.
+    std::vector<uint8_t> palettize_image(const image::rgb_image_view_t& image_view, 
+                                         const color_table& palette,
+                                         const image::pixel_mask& excluded,
+                                         color_table::index_type excluded_index);
+
+    // Maps the rows of the image from first_row up to end_row to indices as
+    // palettize_image does, and writes them to indices in row-major order.
+    // This lets callers consume the indices of a frame a few rows at a time
+    // from a small buffer. If excluded is given, the pixels it flags are 
+    // given excluded_index instead.
+    void palettize_rows(const image::rgb_image_view_t& image_view, 
+                        const color_table& palette,
+                        std::size_t first_row, std::size_t end_row,
+                        uint8_t* indices,
+                        const image::pixel_mask* excluded = nullptr,
+                        color_table::index_type excluded_index = 0);
+
+    // A coarse histogram of the colors in an image which keeps only the 
+    // 4 most significant bits of each channel, for 4096 bins in total. It
+    // is far cheaper to build and compare than a full color histogram, 
+    // which makes it suitable for detecting scene changes between frames.
+    struct coarse_histogram {
+        static constexpr std::size_t BITS_PER_CHANNEL = 4;
+        static constexpr std::size_t BIN_COUNT = 1 << (3 * BITS_PER_CHANNEL);
+
+        std::array<std::size_t, BIN_COUNT> bins;
+        std::size_t pixel_count;
+    };
+
+    // Counts the pixels of the image into a coarse histogram.
+    coarse_histogram compute_coarse_histogram(const image::rgb_image_view_t& image_view);
+
+    // Measures how different the color distributions described by two
+    // coarse histograms are. The result is the total variation distance 
+    // between the normalized histograms: 0 for identical distributions and
+    // 1 for distributions which share no bins. 
+    //
+    // Pre-condition: Neither histogram may be empty.
+    double histogram_distance(const coarse_histogram& h1, const coarse_histogram& h2);
+
+    // Measures how well the palette represents the image as the root-mean-
+    // square Euclidean distance between each pixel and its nearest palette 
+    // color. Only every sample_step'th pixel, in row-major order, is used.
+    double quantization_error(const image::rgb_image_view_t& image_view,
+                              const color_table& palette,
+                              std::size_t sample_step = 1);
+
+    // Accumulates a joint color histogram over many frames so that a 
+    // single color table can be created to represent all of them. Frames
+    // may be added to separate histograms in parallel and merged afterwards.
+    class multi_frame_histogram {
+    public:
+
+        // Adds the colors of the frame to the histogram. Only every
+        // sample_step'th pixel, in row-major order, is counted.
+        void add_frame(const image::rgb_image_view_t& image_view, 
+                       std::size_t sample_step = 1);
+
+        // Adds the counts from another histogram to this one.
+        void merge(const multi_frame_histogram& other);
+
+        // Returns the number of distinct colors that have been counted.
+        std::size_t colors() const;
+
+        // Creates a color table of up to max_colors colors to represent 
+        // the colors that have been counted, using median cut.
+        //
+        // Pre-condition: At least one frame has been added.
+        color_table create_color_table(std::size_t max_colors = color_table::max_size()) const;
+
+    private:
+        internal::color_histogram histogram;
+    };
 }
 
 #endif
\ No newline at end of file
@@ -3,7 +3,7 @@
 #include <optional>
 #include <algorithm>
 #include <ranges>
-#include <iostream>
+#include "task_pool.hpp"
 
 namespace palettize {
 
@@ -28,18 +28,9 @@ namespace palettize {
         return pack_pixel(p1) < pack_pixel(p2);
     }
 
-    // Generates a histogram of all the colors used in the image
-    color_histogram 
-    compute_color_histogram(const image::rgb_image_view_t& image_view) { 
-        color_histogram histogram;
-
-        // Copy the data from the image into a flat vector so we can sort 
-        // it to efficiently generate the histogram counts.
-        std::vector<image::rgb_pixel_t> pixels(image_view.begin(), image_view.end());
-        std::sort(pixels.begin(), pixels.end(), rgb_pixel_comparator);
-
-        // Generate the histogram data by counting runs in the sorted 
-        // list of pixels.
+    // Counts the runs in a sorted list of pixels to produce a histogram.
+    color_histogram count_sorted_pixels(const std::pmr::vector<image::rgb_pixel_t>& pixels) {
+        color_histogram histogram(pixels.get_allocator());
         for (const image::rgb_pixel_t& pixel : pixels) {
             if (histogram.size() > 0 && histogram.back().color == pixel) {
                 // Existing run is continuing.
@@ -50,10 +41,136 @@ namespace palettize {
                 histogram.emplace_back(pixel, 1);
             }
         }
-
         return histogram;
     }
 
+    // Builds a histogram of an image from the histograms of bands of rows, 
+    // which are computed in parallel and then merged pairwise. The merged
+    // histogram is sorted, so it does not depend on how the image was cut 
+    // into bands. collect(first_row, end_row, pixels) must add the pixels 
+    // of the band which should be counted. Every vector is allocated from
+    // the memory resource, which must be thread-safe if there are several
+    // bands.
+    template <typename collect_function>
+    color_histogram compute_banded_histogram(const image::rgb_image_view_t& image_view, 
+                                             std::pmr::memory_resource* memory,
+                                             collect_function collect) {
+        // Bands are large enough that sorting them outweighs the cost of a 
+        // task, with a few bands per worker to balance the load.
+        constexpr std::size_t MIN_BAND_PIXELS = 1 << 16;
+        auto& pool = runtime::task_pool::shared();
+        std::size_t height = image_view.height();
+        std::size_t width = std::max<std::size_t>(1, image_view.width());
+        std::size_t band_rows = std::max({
+            std::size_t(1), 
+            MIN_BAND_PIXELS / width, 
+            height / (2 * pool.worker_count())
+        });
+        std::size_t band_count = std::max<std::size_t>(1, (height + band_rows - 1) / band_rows);
+
+        std::pmr::vector<color_histogram> histograms(band_count, memory);
+        runtime::parallel_for(0, height, band_rows, [&](std::size_t first_row, std::size_t end_row) {
+            std::pmr::vector<image::rgb_pixel_t> pixels(memory);
+            collect(first_row, end_row, pixels);
+            std::sort(pixels.begin(), pixels.end(), rgb_pixel_comparator);
+            histograms[first_row / band_rows] = count_sorted_pixels(pixels);
+        }, pool);
+
+        // Merge neighbouring pairs of histograms until one remains.
+        for (std::size_t step = 1; step < band_count; step *= 2) {
+            std::size_t pair_count = (band_count + 2 * step - 1) / (2 * step);
+            runtime::parallel_for(0, pair_count, 1, [&](std::size_t first_pair, std::size_t end_pair) {
+                for (std::size_t pair = first_pair; pair < end_pair; ++pair) {
+                    auto into = 2 * step * pair;
+                    if (into + step < band_count) {
+                        merge_histograms(histograms[into], histograms[into + step]);
+                        histograms[into + step].clear();
+                        histograms[into + step].shrink_to_fit();
+                    }
+                }
+            }, pool);
+        }
+
+        return std::move(histograms.front());
+    }
+
+    color_histogram 
+    internal::compute_color_histogram(const image::rgb_image_view_t& image_view, 
+                                      std::size_t sample_step,
+                                      std::pmr::memory_resource* memory) { 
+        assert (sample_step > 0);
+
+        // Copy the data from each band into a flat vector so we can sort 
+        // it to efficiently generate the histogram counts. The sampled 
+        // pixels are those whose row-major position is a multiple of 
+        // sample_step.
+        std::size_t width = image_view.width();
+        return compute_banded_histogram(image_view, memory, [&](std::size_t first_row, 
+                                                                std::size_t end_row, 
+                                                                std::pmr::vector<image::rgb_pixel_t>& pixels) {
+            std::size_t first = first_row * width;
+            std::size_t end = end_row * width;
+            first += (sample_step - first % sample_step) % sample_step;
+            if (first >= end) {
+                return;
+            }
+
+            pixels.reserve((end - first - 1) / sample_step + 1);
+            for (std::size_t i = first; i < end; i += sample_step) {
+                pixels.push_back(image_view(i % width, i / width));
+            }
+        });
+    }
+
+    color_histogram 
+    internal::compute_color_histogram(const image::rgb_image_view_t& image_view, 
+                                      const image::pixel_mask& excluded,
+                                      std::pmr::memory_resource* memory) {
+        assert (excluded.size() == image_view.size());
+
+        std::size_t width = image_view.width();
+        return compute_banded_histogram(image_view, memory, [&](std::size_t first_row, 
+                                                                std::size_t end_row, 
+                                                                std::pmr::vector<image::rgb_pixel_t>& pixels) {
+            pixels.reserve((end_row - first_row) * width);
+            for (std::size_t y = first_row; y < end_row; ++y) {
+                auto excluded_it = excluded.begin() + y * width;
+                for (auto it = image_view.row_begin(y); it != image_view.row_end(y); ++it) {
+                    if (!*excluded_it++) {
+                        pixels.push_back(*it);
+                    }
+                }
+            }
+        });
+    }
+
+    void internal::merge_histograms(color_histogram& into, const color_histogram& from) {
+        color_histogram merged(into.get_allocator());
+        merged.reserve(into.size() + from.size());
+
+        // A standard merge of two sorted lists, except that equal colors
+        // are combined into one node.
+        auto it_1 = into.begin();
+        auto it_2 = from.begin();
+        while (it_1 != into.end() && it_2 != from.end()) {
+            if (it_1->color == it_2->color) {
+                merged.emplace_back(it_1->color, it_1->count + it_2->count);
+                ++it_1;
+                ++it_2;
+            }
+            else if (rgb_pixel_comparator(it_1->color, it_2->color)) {
+                merged.push_back(*it_1++);
+            }
+            else {
+                merged.push_back(*it_2++);
+            }
+        }
+        merged.insert(merged.end(), it_1, into.end());
+        merged.insert(merged.end(), it_2, from.end());
+
+        into = std::move(merged);
+    }
+
     // Returns a functor which compares two histogram_node's based
     // on their color values in the given color dimension. The resulting
     // comparator can be used to order regions in the histogram in the 
@@ -216,7 +333,7 @@ namespace palettize {
     // and replaces it with two new regions that partition it.
     // Returns true if the subdivision was successful, or false if no
     // available region could be subdivided.
-    bool subdivide_region(std::vector<color_region>& regions) {
+    bool subdivide_region(std::pmr::vector<color_region>& regions) {
         assert (!regions.empty());
 
         // Select a split-able region with the minimal level.
@@ -246,6 +363,78 @@ namespace palettize {
         return true;
     }
 
+    // Splits every splittable region with the minimal split level, visiting 
+    // them in list order, until the list holds max_regions regions. This is 
+    // equivalent to calling subdivide_region repeatedly: splitting a region 
+    // only creates regions on the next level, so the serial algorithm would 
+    // pick exactly these regions, in this order, before any others.
+    //
+    // Each split only touches the split region and its section of the shared 
+    // histogram, so the splits themselves are run as up to max_threads tasks
+    // on the shared task pool. The new regions are appended in order once all splits finish.
+    //
+    // Returns true if the subdivision was successful, or false if no 
+    // available region could be subdivided.
+    bool subdivide_lowest_level(std::pmr::vector<color_region>& regions,
+                                std::size_t max_regions,
+                                std::size_t max_threads) {
+        assert (!regions.empty());
+        assert (regions.size() < max_regions);
+        assert (max_threads > 0);
+
+        // Find the minimal level among the regions that can be split.
+        std::optional<uint> min_level;
+        for (const auto& region : regions) {
+            if (region.can_split() && (!min_level || region.split_level() < *min_level)) {
+                min_level = region.split_level();
+            }
+        }
+        if (!min_level) {
+            // None of the regions in the list can be split.
+            return false;
+        }
+
+        // Gather the regions in the wave without exceeding max_regions.
+        auto memory = regions.get_allocator().resource();
+        std::pmr::vector<std::size_t> wave(memory);
+        std::size_t wave_colors = 0;
+        for (std::size_t i = 0; i < regions.size() && regions.size() + wave.size() < max_regions; ++i) {
+            if (regions[i].can_split() && regions[i].split_level() == *min_level) {
+                wave.push_back(i);
+                wave_colors += regions[i].colors();
+            }
+        }
+        assert (!wave.empty());
+
+        // Split the regions in the wave, with the wave cut into at most 
+        // max_threads chunks of consecutive regions.
+        std::pmr::vector<std::optional<color_region>> new_regions(wave.size(), memory);
+        auto split_regions = [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                new_regions[i].emplace(regions[wave[i]].split_region());
+            }
+        };
+
+        // Queuing tasks costs more than sorting a few thousand colors.
+        constexpr std::size_t MIN_PARALLEL_WAVE_COLORS = 1 << 15;
+        if (wave_colors < MIN_PARALLEL_WAVE_COLORS || max_threads == 1) {
+            split_regions(0, wave.size());
+        }
+        else {
+            auto grain = (wave.size() + max_threads - 1) / max_threads;
+            runtime::parallel_for(0, wave.size(), grain, split_regions);
+        }
+
+        // Record the second part of each partition in wave order, just as 
+        // subdivide_region would have.
+        for (auto& region : new_regions) {
+            assert (region.has_value());
+            regions.push_back(*region);
+        }
+
+        return true;
+    }
+
     // The median cut algorithm repeatedly partitions the RGB color 
     // cube into smaller and smaller regions until a threshold is 
     // reached. Then, each region's color content is averaged to 
@@ -259,12 +448,18 @@ namespace palettize {
     // section of this list. The region owns that section of the list, 
     // and can sort it in-place to allow the subdivision process to use
     // O(1) extra space. 
-    color_table median_cut(const image::rgb_image_view_t& image_view) {
-        auto histogram = compute_color_histogram(image_view);
-
-        std::cout << "\tCreating color palette. Found " << histogram.size() << " unique colors" << std::endl;
-
-        if (histogram.size() <= color_table::max_size()) {
+    //
+    // The Subdivide functor is used to grow the list of regions. It must
+    // return false once no more subdivisions are possible.
+    //
+    // At most max_colors colors are placed in the palette.
+    template <class Subdivide>
+    color_table run_median_cut(color_histogram histogram, Subdivide subdivide, 
+                               std::size_t max_colors = color_table::max_size()) {
+        assert (max_colors > 0);
+        assert (max_colors <= color_table::max_size());
+
+        if (histogram.size() <= max_colors) {
             // There are few enough colors in the image already 
             // that we can fit them all in the palette.
             color_table palette;
@@ -277,13 +472,14 @@ namespace palettize {
         // To start, create a one-item list of regions containing a single region
         // representing the entire color space.
         color_region initial_region(histogram, 0, histogram.size(), 0);
-        std::vector<color_region> regions { initial_region };
+        std::pmr::vector<color_region> regions(histogram.get_allocator());
         regions.reserve(color_table::max_size());
+        regions.push_back(initial_region);
 
         // Repeatedly choose and subdivide a region with minimal level until we
         // reach the maximum allowed number of regions.
-        while(regions.size() < color_table::max_size()) {
-            auto success = subdivide_region(regions);
+        while(regions.size() < max_colors) {
+            auto success = subdivide(regions);
             if (!success) {
                 // No more subdivisions are possible. The image is fully palettized.
                 break;
@@ -300,5 +496,24 @@ namespace palettize {
         return palette;
     }
 
-}
+    color_table median_cut(const image::rgb_image_view_t& image_view) {
+        return run_median_cut(compute_color_histogram(image_view), subdivide_region);
+    }
+
+    color_table parallel_median_cut(const image::rgb_image_view_t& image_view, 
+                                    std::size_t max_threads,
+                                    std::pmr::memory_resource* memory) {
+        return parallel_median_cut(compute_color_histogram(image_view, 1, memory), max_threads);
+    }
 
+    color_table parallel_median_cut(color_histogram histogram, 
+                                    std::size_t max_threads, 
+                                    std::size_t max_colors) {
+        assert (max_threads > 0);
+        auto subdivide = [max_threads, max_colors](std::pmr::vector<color_region>& regions) {
+            return subdivide_lowest_level(regions, max_colors, max_threads);
+        };
+        return run_median_cut(std::move(histogram), subdivide, max_colors);
+    }
+
+}
@@ -1,26 +1,180 @@
 #include "palettize.hpp"
 #include "median_cut.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "task_pool.hpp"
 
 namespace palettize {
 
-    color_table create_color_table(const image::rgb_image_view_t& image_view) {
-        return median_cut(image_view);
+    // Returns the number of threads to use for median cut. 
+    std::size_t median_cut_threads() {
+        return runtime::task_pool::shared().worker_count();
     }
 
-    std::vector<uint8_t> palettize_image(const image::rgb_image_view_t& image_view, const color_table& palette) {
-        auto w = image_view.width();
-        auto h = image_view.height();
+    // The number of rows to map to indices in one task. Rows are grouped 
+    // so that each task has enough pixels to outweigh its cost.
+    std::size_t palettize_grain(const image::rgb_image_view_t& image_view) {
+        constexpr std::size_t MIN_TASK_PIXELS = 1 << 14;
+        return std::max<std::size_t>(1, MIN_TASK_PIXELS / std::max<std::ptrdiff_t>(1, image_view.width()));
+    }
+
+    color_table create_color_table(const image::rgb_image_view_t& image_view,
+                                   std::pmr::memory_resource* memory) {
+        return parallel_median_cut(image_view, median_cut_threads(), memory);
+    }
+
+    color_table create_color_table(const image::rgb_image_view_t& image_view,
+                                   const image::pixel_mask& excluded,
+                                   std::size_t max_colors,
+                                   std::pmr::memory_resource* memory) {
+        auto histogram = internal::compute_color_histogram(image_view, excluded, memory);
+        if (histogram.empty()) {
+            return color_table();
+        }
+        return parallel_median_cut(std::move(histogram), median_cut_threads(), max_colors);
+    }
+
+    void palettize_rows(const image::rgb_image_view_t& image_view, 
+                        const color_table& palette,
+                        std::size_t first_row, std::size_t end_row,
+                        uint8_t* indices,
+                        const image::pixel_mask* excluded,
+                        color_table::index_type excluded_index) {
+        assert (first_row <= end_row && end_row <= std::size_t(image_view.height()));
+        assert (!excluded || excluded->size() == image_view.size());
+
+        std::size_t w = image_view.width();
+        if (!excluded) {
+            for (std::size_t y = first_row; y < end_row; ++y) {
+                for (auto it = image_view.row_begin(y); it != image_view.row_end(y); ++it) {
+                    *indices++ = palette.get_nearest_color_index(*it);
+                }
+            }
+            return;
+        }
 
-        std::vector<uint8_t> indices;
-        indices.reserve(w * h);
-        
-        for (auto& pixel : image_view) {
-            auto index = palette.get_nearest_color_index(pixel);
-            indices.push_back(index);
+        auto excluded_it = excluded->begin() + first_row * w;
+        for (std::size_t y = first_row; y < end_row; ++y) {
+            for (auto it = image_view.row_begin(y); it != image_view.row_end(y); ++it) {
+                *indices++ = *excluded_it++ 
+                           ? excluded_index 
+                           : palette.get_nearest_color_index(*it);
+            }
         }
+    }
+
+    // Rows are mapped in parallel, each into its own section of the output.
+    std::vector<uint8_t> palettize_image(const image::rgb_image_view_t& image_view, const color_table& palette) {
+        std::size_t w = image_view.width();
+        std::size_t h = image_view.height();
+
+        std::vector<uint8_t> indices(w * h);
+        runtime::parallel_for(0, h, palettize_grain(image_view), [&](std::size_t first_row, std::size_t end_row) {
+            palettize_rows(image_view, palette, first_row, end_row, indices.data() + first_row * w);
+        });
 
         return indices;
     }
 
-}
+    std::vector<uint8_t> palettize_image(const image::rgb_image_view_t& image_view, 
+                                         const color_table& palette,
+                                         const image::pixel_mask& excluded,
+                                         color_table::index_type excluded_index) {
+        assert (excluded.size() == image_view.size());
+
+        std::size_t w = image_view.width();
+        std::size_t h = image_view.height();
+
+        std::vector<uint8_t> indices(w * h);
+        runtime::parallel_for(0, h, palettize_grain(image_view), [&](std::size_t first_row, std::size_t end_row) {
+            palettize_rows(image_view, palette, first_row, end_row, indices.data() + first_row * w, 
+                           &excluded, excluded_index);
+        });
+
+        return indices;
+    }
+
+    coarse_histogram compute_coarse_histogram(const image::rgb_image_view_t& image_view) {
+        constexpr auto shift = 8 - coarse_histogram::BITS_PER_CHANNEL;
+
+        coarse_histogram histogram;
+        histogram.bins.fill(0);
+        histogram.pixel_count = image_view.width() * image_view.height();
+
+        for (const auto& pixel : image_view) {
+            std::size_t bin = ((pixel[0] >> shift) << (2 * coarse_histogram::BITS_PER_CHANNEL))
+                            | ((pixel[1] >> shift) << coarse_histogram::BITS_PER_CHANNEL)
+                            |  (pixel[2] >> shift);
+            ++histogram.bins[bin];
+        }
 
+        return histogram;
+    }
+
+    double histogram_distance(const coarse_histogram& h1, const coarse_histogram& h2) {
+        assert (h1.pixel_count > 0);
+        assert (h2.pixel_count > 0);
+
+        // The histograms may describe images of different sizes, so each
+        // is scaled to sum to one before comparing.
+        double scale_1 = 1.0 / h1.pixel_count;
+        double scale_2 = 1.0 / h2.pixel_count;
+
+        double total_difference = 0;
+        for (std::size_t i = 0; i < coarse_histogram::BIN_COUNT; ++i) {
+            total_difference += std::abs(h1.bins[i] * scale_1 - h2.bins[i] * scale_2);
+        }
+
+        return total_difference / 2;
+    }
+
+    double quantization_error(const image::rgb_image_view_t& image_view,
+                              const color_table& palette,
+                              std::size_t sample_step) {
+        assert (sample_step > 0);
+        assert (palette.size() > 0);
+
+        double total_squared_error = 0;
+        std::size_t samples = 0;
+        std::size_t skip = 0;
+        for (const auto& pixel : image_view) {
+            if (skip == 0) {
+                const auto& nearest = palette.at(palette.get_nearest_color_index(pixel));
+                for (int c = 0; c < 3; ++c) {
+                    double difference = double(pixel[c]) - double(nearest[c]);
+                    total_squared_error += difference * difference;
+                }
+                ++samples;
+                skip = sample_step;
+            }
+            --skip;
+        }
+
+        return samples == 0 ? 0 : std::sqrt(total_squared_error / samples);
+    }
+
+    void multi_frame_histogram::add_frame(const image::rgb_image_view_t& image_view, 
+                                          std::size_t sample_step) {
+        auto frame_histogram = internal::compute_color_histogram(image_view, sample_step);
+        if (histogram.empty()) {
+            histogram = std::move(frame_histogram);
+        }
+        else {
+            internal::merge_histograms(histogram, frame_histogram);
+        }
+    }
+
+    void multi_frame_histogram::merge(const multi_frame_histogram& other) {
+        internal::merge_histograms(histogram, other.histogram);
+    }
+
+    std::size_t multi_frame_histogram::colors() const {
+        return histogram.size();
+    }
+
+    color_table multi_frame_histogram::create_color_table(std::size_t max_colors) const {
+        assert (!histogram.empty());
+        return parallel_median_cut(histogram, median_cut_threads(), max_colors);
+    }
+}
@@ -230,3 +230,36 @@ TEST_CASE("Smoke test median cut on image with more than 256 colors", "[median_c
     REQUIRE(missing_count > 0);
     REQUIRE(missing_count <= 2);
 }
+
+TEST_CASE("Test parallel median cut matches serial median cut", "[median_cut][parallel]") {
+    // Use enough distinct colors that several waves are large enough to 
+    // be split across threads.
+    std::size_t w = 400, h = 300;
+    image::rgb_image_t img(w, h);
+    image::rgb_image_view_t img_view = view(img);
+
+    srand(42);
+    for (auto& pixel : img_view) {
+        pixel = image::rgb_pixel_t(rand() % 256, rand() % 256, rand() % 256);
+    }
+
+    auto serial_palette = median_cut(img_view);
+
+    std::size_t threads;
+    SECTION("One thread") {
+        threads = 1;
+    }
+    SECTION("Two threads") {
+        threads = 2;
+    }
+    SECTION("Many threads") {
+        threads = 16;
+    }
+
+    auto parallel_palette = parallel_median_cut(img_view, threads);
+    REQUIRE(parallel_palette.size() == serial_palette.size());
+    REQUIRE(parallel_palette.size() == color_table::max_size());
+    for (std::size_t i = 0; i < serial_palette.size(); ++i) {
+        REQUIRE(parallel_palette.at(i) == serial_palette.at(i));
+    }
+}
@@ -0,0 +1,221 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include "image_utils.hpp"
+#include "palettize.hpp"
+
+using namespace palettize;
+
+// Fills the image with a horizontal gradient in the red channel. For
+// widths which divide 256, every red value is used equally often.
+void fill_gradient(image::rgb_image_view_t& img_view, uint8_t green, uint8_t blue) {
+    for (int y = 0; y < img_view.height(); ++y) {
+        for (int x = 0; x < img_view.width(); ++x) {
+            uint8_t red = (x * 256) / img_view.width();
+            img_view(x, y) = image::rgb_pixel_t(red, green, blue);
+        }
+    }
+}
+
+TEST_CASE("Test coarse histogram counts every pixel", "[palettize][histogram]") {
+    image::rgb_image_t img(64, 32);
+    image::rgb_image_view_t img_view = view(img);
+    fill_gradient(img_view, 0x10, 0x20);
+
+    auto histogram = compute_coarse_histogram(img_view);
+    REQUIRE(histogram.pixel_count == 64 * 32);
+
+    std::size_t total = 0;
+    for (auto count : histogram.bins) {
+        total += count;
+    }
+    REQUIRE(total == histogram.pixel_count);
+
+    // The red gradient covers all 16 red bins, while green and blue
+    // are constant.
+    std::size_t nonzero_bins = std::count_if(
+        histogram.bins.begin(), histogram.bins.end(), [](auto c) { return c > 0; }
+    );
+    REQUIRE(nonzero_bins == 16);
+}
+
+TEST_CASE("Test histogram distance of similar images", "[palettize][histogram]") {
+    image::rgb_image_t img_1(64, 32);
+    image::rgb_image_view_t view_1 = view(img_1);
+    fill_gradient(view_1, 0x10, 0x20);
+
+    SECTION("Identical images") {
+        auto histogram = compute_coarse_histogram(view_1);
+        REQUIRE(histogram_distance(histogram, histogram) == 0);
+    }
+    SECTION("Small change") {
+        image::rgb_image_t img_2(img_1);
+        image::rgb_image_view_t view_2 = view(img_2);
+        view_2(0, 0) = image::rgb_pixel_t(0xFF, 0xFF, 0xFF);
+
+        auto distance = histogram_distance(
+            compute_coarse_histogram(view_1), compute_coarse_histogram(view_2)
+        );
+        REQUIRE(distance == Approx(1.0 / (64 * 32)));
+    }
+    SECTION("Differently sized images") {
+        image::rgb_image_t img_2(128, 8);
+        image::rgb_image_view_t view_2 = view(img_2);
+        fill_gradient(view_2, 0x10, 0x20);
+
+        auto distance = histogram_distance(
+            compute_coarse_histogram(view_1), compute_coarse_histogram(view_2)
+        );
+        REQUIRE(distance == Approx(0).margin(1e-9));
+    }
+}
+
+TEST_CASE("Test histogram distance of unrelated images", "[palettize][histogram]") {
+    image::rgb_image_t img_1(64, 32);
+    image::rgb_image_view_t view_1 = view(img_1);
+    fill_gradient(view_1, 0x00, 0x00);
+
+    image::rgb_image_t img_2(64, 32);
+    image::rgb_image_view_t view_2 = view(img_2);
+    fill_gradient(view_2, 0xFF, 0xFF);
+
+    auto distance = histogram_distance(
+        compute_coarse_histogram(view_1), compute_coarse_histogram(view_2)
+    );
+    REQUIRE(distance == Approx(1.0));
+}
+
+TEST_CASE("Test quantization error", "[palettize][error]") {
+    image::rgb_image_t img(16, 16);
+    image::rgb_image_view_t img_view = view(img);
+    for (auto& pixel : img_view) {
+        pixel = image::rgb_pixel_t(10, 20, 30);
+    }
+
+    color_table palette;
+    SECTION("Exact match") {
+        palette.add_color(image::rgb_pixel_t(10, 20, 30));
+        REQUIRE(quantization_error(img_view, palette) == 0);
+    }
+    SECTION("Distant match") {
+        palette.add_color(image::rgb_pixel_t(13, 24, 30));
+        REQUIRE(quantization_error(img_view, palette) == Approx(5));
+        REQUIRE(quantization_error(img_view, palette, 7) == Approx(5));
+    }
+}
+
+TEST_CASE("Test multi-frame histogram combines frames", "[palettize][multi_frame]") {
+    // Two frames with disjoint sets of colors, which fit in one palette together.
+    image::rgb_image_t img_1(100, 1);
+    image::rgb_image_view_t view_1 = view(img_1);
+    image::rgb_image_t img_2(100, 1);
+    image::rgb_image_view_t view_2 = view(img_2);
+    for (int x = 0; x < 100; ++x) {
+        view_1(x, 0) = image::rgb_pixel_t(x, 0, 0);
+        view_2(x, 0) = image::rgb_pixel_t(0, x + 1, 0);
+    }
+
+    multi_frame_histogram combined;
+    SECTION("Added to one histogram") {
+        combined.add_frame(view_1);
+        combined.add_frame(view_2);
+        combined.add_frame(view_2);
+    }
+    SECTION("Merged from separate histograms") {
+        multi_frame_histogram other;
+        other.add_frame(view_2);
+        other.add_frame(view_2);
+        combined.add_frame(view_1);
+        combined.merge(other);
+    }
+
+    REQUIRE(combined.colors() == 200);
+    auto palette = combined.create_color_table();
+    REQUIRE(palette.size() == 200);
+    for (int x = 0; x < 100; ++x) {
+        REQUIRE(palette.contains_color(view_1(x, 0)));
+        REQUIRE(palette.contains_color(view_2(x, 0)));
+    }
+}
+
+TEST_CASE("Test multi-frame histogram sampling", "[palettize][multi_frame]") {
+    image::rgb_image_t img(10, 10);
+    image::rgb_image_view_t img_view = view(img);
+    for (int y = 0; y < 10; ++y) {
+        for (int x = 0; x < 10; ++x) {
+            img_view(x, y) = image::rgb_pixel_t(x, y, 0);
+        }
+    }
+
+    multi_frame_histogram histogram;
+    histogram.add_frame(img_view, 10);
+
+    // Only the first column is sampled.
+    REQUIRE(histogram.colors() == 10);
+}
+
+TEST_CASE("Test palettize with excluded pixels", "[palettize][mask]") {
+    image::rgb_image_t img(4, 1);
+    image::rgb_image_view_t img_view = view(img);
+    img_view(0, 0) = image::rgb_pixel_t(0xFF, 0, 0);
+    img_view(1, 0) = image::rgb_pixel_t(0, 0xFF, 0);
+    img_view(2, 0) = image::rgb_pixel_t(0, 0, 0xFF);
+    img_view(3, 0) = image::rgb_pixel_t(0, 0xFF, 0);
+
+    image::pixel_mask excluded { 0, 1, 0, 1 };
+    auto palette = create_color_table(img_view, excluded, color_table::max_size());
+
+    // Only the colors of the included pixels are in the palette.
+    REQUIRE(palette.size() == 2);
+    REQUIRE(palette.contains_color(img_view(0, 0)));
+    REQUIRE(palette.contains_color(img_view(2, 0)));
+
+    auto indices = palettize_image(img_view, palette, excluded, 2);
+    REQUIRE(indices.size() == 4);
+    REQUIRE(palette.at(indices[0]) == img_view(0, 0));
+    REQUIRE(indices[1] == 2);
+    REQUIRE(palette.at(indices[2]) == img_view(2, 0));
+    REQUIRE(indices[3] == 2);
+}
+
+TEST_CASE("Test color table limited in size", "[palettize][mask]") {
+    image::rgb_image_t img(300, 1);
+    image::rgb_image_view_t img_view = view(img);
+    for (int x = 0; x < 300; ++x) {
+        img_view(x, 0) = image::rgb_pixel_t(x % 256, x / 256, 0);
+    }
+
+    image::pixel_mask none_excluded(300, 0);
+    REQUIRE(create_color_table(img_view, none_excluded, 255).size() == 255);
+    REQUIRE(create_color_table(img_view, none_excluded, 16).size() == 16);
+
+    image::pixel_mask all_excluded(300, 1);
+    REQUIRE(create_color_table(img_view, all_excluded, 255).size() == 0);
+}
+
+TEST_CASE("Test palettize rows matches whole image", "[palettize][rows]") {
+    image::rgb_image_t img(64, 9);
+    image::rgb_image_view_t img_view = view(img);
+    fill_gradient(img_view, 40, 200);
+    auto palette = create_color_table(img_view, image::pixel_mask(img_view.size(), 0), 16);
+
+    image::pixel_mask excluded(img_view.size(), 0);
+    for (std::size_t i = 0; i < excluded.size(); i += 5) {
+        excluded[i] = 1;
+    }
+    auto with_mask = GENERATE(false, true);
+    auto expected = with_mask 
+        ? palettize_image(img_view, palette, excluded, 16)
+        : palettize_image(img_view, palette);
+
+    // Rows are mapped in uneven chunks into a buffer which is re-used.
+    std::vector<uint8_t> indices;
+    std::vector<uint8_t> chunk(4 * 64);
+    for (std::size_t first_row = 0; first_row < 9; first_row += 4) {
+        auto end_row = std::min<std::size_t>(9, first_row + 4);
+        palettize_rows(img_view, palette, first_row, end_row, chunk.data(), 
+                       with_mask ? &excluded : nullptr, 16);
+        indices.insert(indices.end(), chunk.begin(), chunk.begin() + (end_row - first_row) * 64);
+    }
+    REQUIRE(indices == expected);
+}
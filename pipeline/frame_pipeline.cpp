@@ -0,0 +1,338 @@
+#include "frame_pipeline.hpp"
+#include "frame_arena.hpp"
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace pipeline {
+
+    // A frame buffer which is cycled through the pipeline. Frame i uses 
+    // slot i % slot_count. The frame's temporary data is allocated from the
+    // slot's arena, which is reset once the frame is written, so that a 
+    // pipeline which has warmed up does not call the global allocator for
+    // it. The frame is constructed in place so that its data keeps the 
+    // arena as its allocator.
+    struct frame_slot {
+        image::rgb_image_t image;
+        runtime::frame_arena arena;
+        std::optional<gif::frame_job> frame;
+    };
+
+    // Runs a step for each frame in frame order, as frames become ready in
+    // any order. At most window frames may be waiting at once.
+    class ordered_stage {
+    public:
+        ordered_stage(std::size_t window, std::function<void(std::size_t)> step);
+
+        // Marks the frame as ready. If it is next in line, the step is run
+        // for it and for every ready frame after it, on the calling thread.
+        // Runs of the step never overlap. The step must not throw.
+        void frame_ready(std::size_t frame);
+
+    private:
+        std::mutex mutex;
+        std::vector<bool> ready;
+        std::size_t next_frame;
+        bool running;
+        std::function<void(std::size_t)> step;
+    };
+
+    ordered_stage::ordered_stage(std::size_t window, std::function<void(std::size_t)> s) :
+            mutex(),
+            ready(window, false),
+            next_frame(0),
+            running(false),
+            step(std::move(s)) {
+    }
+
+    void ordered_stage::frame_ready(std::size_t frame) {
+        std::unique_lock<std::mutex> lock(mutex);
+        assert (frame >= next_frame && frame < next_frame + ready.size());
+        ready[frame % ready.size()] = true;
+        if (running) {
+            return;
+        }
+
+        running = true;
+        while (ready[next_frame % ready.size()]) {
+            ready[next_frame % ready.size()] = false;
+            auto current_frame = next_frame++;
+
+            lock.unlock();
+            step(current_frame);
+            lock.lock();
+        }
+        running = false;
+    }
+
+    // The state shared by the tasks of one call to add_frames.
+    class frame_pipeline {
+    public:
+        frame_pipeline(gif::gif_builder& builder, 
+                       std::size_t frame_count,
+                       const frame_decoder& decode,
+                       const frame_callback& on_frame_added,
+                       runtime::task_pool& pool);
+
+        void run();
+
+        // Reads frames on the calling thread until the stream ends, and
+        // returns the number of frames read. Used with a frame_count of 0.
+        std::size_t run_stream(const frame_reader& read);
+
+    private:
+        gif::gif_builder& builder;
+        const std::size_t frame_count;
+        const frame_decoder& decode;
+        const frame_callback& on_frame_added;
+        runtime::task_pool& pool;
+
+        const std::size_t slot_count;
+        std::unique_ptr<frame_slot[]> slots;
+        ordered_stage prepare_stage;
+        ordered_stage write_stage;
+
+        // The number of queued or running tasks. Every task queues its 
+        // successor before it finishes, so this only reaches zero once 
+        // every frame is written or the pipeline has failed. The counter 
+        // is shared with the tasks, which use it after the last frame is 
+        // written.
+        std::shared_ptr<std::atomic<std::size_t>> outstanding_tasks;
+
+        std::atomic<bool> failed;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+
+        // The number of frames written, which frees their slots. Streamed
+        // frames wait for their slot to be freed before they are read.
+        std::mutex slot_mutex;
+        std::condition_variable slot_freed;
+        std::size_t frames_written;
+
+        frame_slot& slot_for(std::size_t frame);
+
+        // Records the first error. No new frames are started after this.
+        void fail(std::exception_ptr);
+
+        // Waits for every queued task to finish, and rethrows the first 
+        // error, if any.
+        void finish();
+
+        // Queues a task for the given frame.
+        void submit(std::size_t frame, runtime::task t);
+
+        // The work of each stage.
+        void decode_frame(std::size_t frame);
+        void prepare_frame(std::size_t frame);
+        void encode_frame(std::size_t frame);
+        void write_frame(std::size_t frame);
+    };
+
+    frame_pipeline::frame_pipeline(gif::gif_builder& b, 
+                                   std::size_t count,
+                                   const frame_decoder& d,
+                                   const frame_callback& callback,
+                                   runtime::task_pool& p) :
+            builder(b),
+            frame_count(count),
+            decode(d),
+            on_frame_added(callback),
+            pool(p),
+            // Enough frames to keep every worker busy while the frames 
+            // ahead of them are finished.
+            slot_count(2 * p.worker_count() + 2),
+            slots(std::make_unique<frame_slot[]>(slot_count)),
+            prepare_stage(slot_count, [this](std::size_t frame) { prepare_frame(frame); }),
+            write_stage(slot_count, [this](std::size_t frame) { write_frame(frame); }),
+            outstanding_tasks(std::make_shared<std::atomic<std::size_t>>(0)),
+            failed(false),
+            error_mutex(),
+            error(),
+            slot_mutex(),
+            slot_freed(),
+            frames_written(0) {
+    }
+
+    frame_slot& frame_pipeline::slot_for(std::size_t frame) {
+        return slots[frame % slot_count];
+    }
+
+    void frame_pipeline::fail(std::exception_ptr e) {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = e;
+            }
+            failed.store(true);
+        }
+
+        // Stop a streaming reader from waiting for a slot.
+        std::lock_guard<std::mutex> lock(slot_mutex);
+        slot_freed.notify_all();
+    }
+
+    void frame_pipeline::submit(std::size_t frame, runtime::task t) {
+        outstanding_tasks->fetch_add(1);
+        pool.submit([outstanding = outstanding_tasks, t = std::move(t)]() {
+            t();
+            if (outstanding->fetch_sub(1) == 1) {
+                outstanding->notify_all();
+            }
+        }, frame);
+    }
+
+    void frame_pipeline::decode_frame(std::size_t frame) {
+        if (failed.load()) {
+            return;
+        }
+
+        try {
+            decode(frame, slot_for(frame).image);
+        }
+        catch(...) {
+            fail(std::current_exception());
+            return;
+        }
+        prepare_stage.frame_ready(frame);
+    }
+
+    void frame_pipeline::prepare_frame(std::size_t frame) {
+        if (failed.load()) {
+            return;
+        }
+
+        try {
+            auto& slot = slot_for(frame);
+            slot.frame.emplace(builder.prepare_frame(boost::gil::view(slot.image), &slot.arena));
+            submit(frame, [this, frame]() { encode_frame(frame); });
+        }
+        catch(...) {
+            fail(std::current_exception());
+        }
+    }
+
+    // Frames which re-use a palette wait for the frame that creates it. 
+    // That frame was queued earlier with a lower priority, so it has 
+    // always been started by another worker. For the same reason, frames
+    // must still be mapped after a failure.
+    void frame_pipeline::encode_frame(std::size_t frame) {
+        auto& slot = slot_for(frame);
+        try {
+            builder.map_frame(*slot.frame);
+            if (failed.load()) {
+                return;
+            }
+            builder.compress_frame(*slot.frame);
+        }
+        catch(...) {
+            fail(std::current_exception());
+            return;
+        }
+        write_stage.frame_ready(frame);
+    }
+
+    // Writing a frame frees its slot for a later frame.
+    void frame_pipeline::write_frame(std::size_t frame) {
+        if (failed.load()) {
+            return;
+        }
+
+        try {
+            auto& slot = slot_for(frame);
+            builder.write_frame(*slot.frame);
+            slot.frame.reset();
+            slot.arena.reset();
+            if (on_frame_added) {
+                on_frame_added(frame);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(slot_mutex);
+                ++frames_written;
+            }
+            slot_freed.notify_all();
+
+            auto next_frame = frame + slot_count;
+            if (next_frame < frame_count) {
+                submit(next_frame, [this, next_frame]() { decode_frame(next_frame); });
+            }
+        }
+        catch(...) {
+            fail(std::current_exception());
+        }
+    }
+
+    void frame_pipeline::run() {
+        try {
+            for (std::size_t i = 0; i < std::min(slot_count, frame_count); ++i) {
+                submit(i, [this, i]() { decode_frame(i); });
+            }
+        }
+        catch(...) {
+            fail(std::current_exception());
+        }
+        finish();
+    }
+
+    // The reader is the only caller of prepare_stage, so each frame it 
+    // reads is prepared immediately on the calling thread.
+    std::size_t frame_pipeline::run_stream(const frame_reader& read) {
+        std::size_t frames_read = 0;
+        try {
+            while (!failed.load()) {
+                {
+                    std::unique_lock<std::mutex> lock(slot_mutex);
+                    slot_freed.wait(lock, [this, frames_read]() {
+                        return frames_read < frames_written + slot_count || failed.load();
+                    });
+                }
+                if (failed.load() || !read(slot_for(frames_read).image)) {
+                    break;
+                }
+                prepare_stage.frame_ready(frames_read++);
+            }
+        }
+        catch(...) {
+            fail(std::current_exception());
+        }
+        finish();
+        return frames_read;
+    }
+
+    void frame_pipeline::finish() {
+        while (true) {
+            auto outstanding = outstanding_tasks->load();
+            if (outstanding == 0) {
+                break;
+            }
+            outstanding_tasks->wait(outstanding);
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void add_frames(gif::gif_builder& builder, 
+                    std::size_t frame_count,
+                    const frame_decoder& decode,
+                    const frame_callback& on_frame_added,
+                    runtime::task_pool& pool) {
+        frame_pipeline pipeline(builder, frame_count, decode, on_frame_added, pool);
+        pipeline.run();
+    }
+
+    std::size_t add_streamed_frames(gif::gif_builder& builder,
+                                    const frame_reader& read,
+                                    const frame_callback& on_frame_added,
+                                    runtime::task_pool& pool) {
+        frame_decoder no_decoder;
+        frame_pipeline pipeline(builder, 0, no_decoder, on_frame_added, pool);
+        return pipeline.run_stream(read);
+    }
+}
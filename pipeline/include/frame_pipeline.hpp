@@ -0,0 +1,61 @@
+#ifndef FRAME_PIPELINE_HPP
+#define FRAME_PIPELINE_HPP
+
+#include <cstddef>
+#include <functional>
+#include "gif_builder.hpp"
+#include "image_utils.hpp"
+#include "task_pool.hpp"
+
+// Encodes many frames at once by running the steps of gif_builder as tasks
+// on a task pool.
+namespace pipeline {
+
+    // Reads frame number index into img. Called concurrently for different
+    // frames. img may hold an earlier frame, so that its memory is re-used.
+    using frame_decoder = std::function<void(std::size_t index, image::rgb_image_t& img)>;
+
+    // Reads the next frame of a stream into img, and returns false once the
+    // stream has ended. Called for one frame at a time, in frame order.
+    using frame_reader = std::function<bool(image::rgb_image_t& img)>;
+
+    // Called in frame order after each frame has been given to the builder.
+    using frame_callback = std::function<void(std::size_t index)>;
+
+    // Adds frame_count frames to the builder. Each frame passes through the
+    // following stages:
+    //  1. Decoding.
+    //  2. Preparation, in frame order.
+    //  3. Palette creation, mapping to indices and LZW compression.
+    //  4. Writing, in frame order.
+    // Stages 1 and 3 run as top-level tasks on the pool, with the frame 
+    // number as their priority so that earlier frames are finished first.
+    // The in-order stages are run by whichever task completes the frame 
+    // which is next in line. A fixed number of frame buffers is cycled 
+    // through the stages, each with an arena for its frame's temporary 
+    // data, so that memory use does not grow with the number of frames and
+    // frames stop allocating once the arenas have warmed up. The output is
+    // identical to adding the frames one by one with gif_builder::add_frame.
+    //
+    // The calling thread waits for the frames to be written. If any stage
+    // throws, no more frames are started and the first exception is 
+    // rethrown. The builder must not be used after that.
+    void add_frames(gif::gif_builder& builder, 
+                    std::size_t frame_count,
+                    const frame_decoder& decode,
+                    const frame_callback& on_frame_added = {},
+                    runtime::task_pool& pool = runtime::task_pool::shared());
+
+    // Adds frames from a stream to the builder until the stream ends, and
+    // returns the number of frames added. Frames pass through the same 
+    // stages as above, except that they are read on the calling thread,
+    // which waits for a free frame buffer before reading each frame. Frames
+    // are encoded as soon as they are read, so a slow producer overlaps 
+    // with the encoding of earlier frames.
+    std::size_t add_streamed_frames(gif::gif_builder& builder,
+                                    const frame_reader& read,
+                                    const frame_callback& on_frame_added = {},
+                                    runtime::task_pool& pool = runtime::task_pool::shared());
+}
+
+#endif
@@ -0,0 +1,196 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <sstream>
+#include <stdexcept>
+#include "frame_pipeline.hpp"
+
+using namespace pipeline;
+
+constexpr std::size_t WIDTH = 64;
+constexpr std::size_t HEIGHT = 48;
+constexpr std::size_t FRAME_COUNT = 24;
+
+// Draws a frame of an animation with a moving square over a background 
+// which changes every few frames. Every fourth frame repeats the one 
+// before it.
+void draw_frame(std::size_t index, image::rgb_image_t& img) {
+    img.recreate(WIDTH, HEIGHT);
+    auto img_view = boost::gil::view(img);
+
+    auto frame = index % 4 == 3 ? index - 1 : index;
+    auto scene = frame / 8;
+    for (std::size_t y = 0; y < HEIGHT; ++y) {
+        for (std::size_t x = 0; x < WIDTH; ++x) {
+            img_view(x, y) = image::rgb_pixel_t(4 * x + scene * 50, 5 * y, (x * y + scene) % 256);
+        }
+    }
+
+    auto left = (2 * frame) % (WIDTH - 8);
+    for (std::size_t y = 10; y < 18; ++y) {
+        for (std::size_t x = left; x < left + 8; ++x) {
+            img_view(x, y) = image::rgb_pixel_t(255, 255 - frame, 0);
+        }
+    }
+}
+
+// Encodes every frame with gif_builder::add_frame.
+std::string encode_serially(const gif::builder_options& options) {
+    std::ostringstream out;
+    gif::gif_builder builder(out, WIDTH, HEIGHT, 10, options);
+    image::rgb_image_t img;
+    for (std::size_t i = 0; i < FRAME_COUNT; ++i) {
+        draw_frame(i, img);
+        builder.add_frame(boost::gil::view(img));
+    }
+    builder.complete_stream();
+    return out.str();
+}
+
+std::string encode_with_pipeline(const gif::builder_options& options, std::size_t workers) {
+    runtime::task_pool pool(workers);
+    std::ostringstream out;
+    gif::gif_builder builder(out, WIDTH, HEIGHT, 10, options);
+    add_frames(builder, FRAME_COUNT, draw_frame, {}, pool);
+    builder.complete_stream();
+    return out.str();
+}
+
+TEST_CASE("Test pipeline output matches serial output", "[frame_pipeline]") {
+    gif::builder_options options;
+    SECTION("Default options") {}
+    SECTION("Re-used palettes") {
+        options.reuse_palettes = true;
+    }
+    SECTION("Delta frames with transparency") {
+        options.delta_frames = true;
+        options.transparency_tolerance = 2;
+    }
+    SECTION("Coalesced duplicates") {
+        options.coalesce_duplicates = true;
+        options.reuse_palettes = true;
+    }
+
+    auto expected = encode_serially(options);
+    for (std::size_t workers : {1, 2, 5, 8}) {
+        REQUIRE(encode_with_pipeline(options, workers) == expected);
+    }
+}
+
+TEST_CASE("Test pipeline reports frames in order", "[frame_pipeline]") {
+    std::ostringstream out;
+    gif::gif_builder builder(out, WIDTH, HEIGHT);
+
+    runtime::task_pool pool(4);
+    std::vector<std::size_t> added;
+    add_frames(builder, FRAME_COUNT, draw_frame, [&added](std::size_t i) {
+        added.push_back(i);
+    }, pool);
+
+    REQUIRE(added.size() == FRAME_COUNT);
+    for (std::size_t i = 0; i < FRAME_COUNT; ++i) {
+        REQUIRE(added[i] == i);
+    }
+}
+
+TEST_CASE("Test pipeline errors are rethrown", "[frame_pipeline]") {
+    std::ostringstream out;
+    gif::gif_builder builder(out, WIDTH, HEIGHT);
+
+    auto failing_decoder = [](std::size_t i, image::rgb_image_t& img) {
+        if (i == FRAME_COUNT / 2) {
+            throw std::runtime_error("Unreadable frame");
+        }
+        draw_frame(i, img);
+    };
+
+    runtime::task_pool pool(2);
+    REQUIRE_THROWS_AS(add_frames(builder, FRAME_COUNT, failing_decoder, {}, pool), std::runtime_error);
+}
+
+std::string encode_streamed(const gif::builder_options& options, std::size_t workers) {
+    runtime::task_pool pool(workers);
+    std::ostringstream out;
+    gif::gif_builder builder(out, WIDTH, HEIGHT, 10, options);
+    std::size_t next_frame = 0;
+    auto read_frame = [&next_frame](image::rgb_image_t& img) {
+        if (next_frame == FRAME_COUNT) {
+            return false;
+        }
+        draw_frame(next_frame++, img);
+        return true;
+    };
+    REQUIRE(add_streamed_frames(builder, read_frame, {}, pool) == FRAME_COUNT);
+    builder.complete_stream();
+    return out.str();
+}
+
+TEST_CASE("Test streamed output matches serial output", "[frame_pipeline]") {
+    gif::builder_options options;
+    SECTION("Default options") {}
+    SECTION("Delta frames with coalesced duplicates") {
+        options.delta_frames = true;
+        options.coalesce_duplicates = true;
+        options.reuse_palettes = true;
+    }
+
+    auto expected = encode_serially(options);
+    for (std::size_t workers : {1, 2, 5}) {
+        REQUIRE(encode_streamed(options, workers) == expected);
+    }
+}
+
+TEST_CASE("Test streamed errors are rethrown", "[frame_pipeline]") {
+    std::ostringstream out;
+    gif::gif_builder builder(out, WIDTH, HEIGHT);
+
+    std::size_t next_frame = 0;
+    auto failing_reader = [&next_frame](image::rgb_image_t& img) {
+        if (next_frame == FRAME_COUNT / 2) {
+            throw std::runtime_error("Truncated stream");
+        }
+        draw_frame(next_frame++, img);
+        return true;
+    };
+
+    runtime::task_pool pool(2);
+    REQUIRE_THROWS_AS(add_streamed_frames(builder, failing_reader, {}, pool), std::runtime_error);
+}
+
+// Encodes every frame with gif_builder::add_banded_frame.
+std::string encode_banded(const gif::builder_options& options, std::size_t band_rows) {
+    std::ostringstream out;
+    gif::gif_builder builder(out, WIDTH, HEIGHT, 10, options);
+    image::rgb_image_t img;
+    for (std::size_t i = 0; i < FRAME_COUNT; ++i) {
+        draw_frame(i, img);
+        auto img_view = boost::gil::const_view(img);
+        builder.add_banded_frame([&img_view](std::size_t first_row, const image::rgb_image_view_t& band) {
+            auto rows = boost::gil::subimage_view(img_view, 0, first_row, WIDTH, band.height());
+            boost::gil::copy_pixels(rows, band);
+        }, band_rows);
+    }
+    builder.complete_stream();
+    return out.str();
+}
+
+TEST_CASE("Test banded frames match whole frames", "[frame_pipeline][banded]") {
+    gif::builder_options options;
+    SECTION("Local palettes") {}
+    SECTION("Global palette") {
+        image::rgb_image_t img;
+        draw_frame(0, img);
+        options.global_palette = palettize::create_color_table(boost::gil::view(img));
+    }
+    SECTION("Global palette with a local palette threshold") {
+        image::rgb_image_t img;
+        draw_frame(0, img);
+        options.global_palette = palettize::create_color_table(boost::gil::view(img));
+        options.local_palette_threshold = 8;
+    }
+
+    auto expected = encode_serially(options);
+    for (std::size_t band_rows : {std::size_t(1), std::size_t(7), std::size_t(16), HEIGHT, std::size_t(1000)}) {
+        REQUIRE(encode_banded(options, band_rows) == expected);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef PREPROCESS_HPP
+#define PREPROCESS_HPP
+
+#include "image_utils.hpp"
+#include <cstddef>
+
+// Resizes, crops and pads decoded frames to fit the GIF's canvas before
+// they are palettized. Shrinking frames first reduces the work of every
+// later stage.
+//
+// Each pass of a resize works on bands of rows in parallel on the shared
+// task pool. The inner loops run over contiguous arrays of floats so that
+// the compiler can vectorize them. The results do not depend on the 
+// number of threads.
+namespace preprocess {
+
+    enum class resize_filter {
+        // Each output pixel is the average of the source area it covers.
+        // This is the best filter for reducing images.
+        area,
+
+        // A Lanczos filter with a radius of three source pixels, which 
+        // keeps more detail, particularly when enlarging images.
+        lanczos
+    };
+
+    // How frames are fitted to a canvas with a different aspect ratio.
+    enum class fit_mode {
+        // Resize the frame to the canvas, changing its aspect ratio.
+        stretch,
+
+        // Resize the frame to cover the canvas, and cut off the edges 
+        // which overflow it equally on both sides.
+        crop,
+
+        // Resize the frame to fit inside the canvas, and fill the space 
+        // left equally on both sides with the pad color.
+        pad
+    };
+
+    struct fit_options {
+        std::size_t width = 0;
+        std::size_t height = 0;
+        fit_mode fit = fit_mode::pad;
+        resize_filter filter = resize_filter::area;
+        image::rgb_pixel_t pad_color = image::rgb_pixel_t(0, 0, 0);
+    };
+
+    // Resizes the source into the target view using the given filter. The 
+    // views must not overlap.
+    void resize(const image::rgb_image_view_t& source, 
+                const image::rgb_image_view_t& target, 
+                resize_filter filter);
+
+    // Fits the source frame to the canvas described by the options, and 
+    // stores the result in target. The target's memory is re-used if it 
+    // already has the canvas dimensions.
+    void fit_frame(const image::rgb_image_view_t& source, 
+                   image::rgb_image_t& target, 
+                   const fit_options& options);
+}
+
+#endif
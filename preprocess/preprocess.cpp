@@ -0,0 +1,218 @@
+#include "preprocess.hpp"
+#include "task_pool.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+namespace preprocess {
+
+    constexpr std::size_t CHANNELS = boost::gil::num_channels<image::rgb_pixel_t>::value;
+
+    // The source pixels which contribute to one output pixel along one 
+    // dimension, and the weight of each. The weights sum to 1.
+    struct pixel_weights {
+        std::size_t first;
+        std::vector<float> weights;
+    };
+
+    float lanczos(double x) {
+        constexpr double RADIUS = 3;
+        if (x == 0) {
+            return 1;
+        }
+        if (std::abs(x) >= RADIUS) {
+            return 0;
+        }
+        double pi_x = std::numbers::pi * x;
+        return static_cast<float>(RADIUS * std::sin(pi_x) * std::sin(pi_x / RADIUS) / (pi_x * pi_x));
+    }
+
+    // Each output pixel covers the interval [i * ratio, (i + 1) * ratio) of
+    // the source, and is weighted by how much of each source pixel it 
+    // covers. When enlarging, this picks the nearest source pixel.
+    std::vector<pixel_weights> compute_area_weights(std::size_t source_length, std::size_t target_length) {
+        double ratio = double(source_length) / target_length;
+
+        std::vector<pixel_weights> all_weights(target_length);
+        for (std::size_t i = 0; i < target_length; ++i) {
+            double begin = i * ratio;
+            double end = std::min<double>(source_length, (i + 1) * ratio);
+            auto& weights = all_weights[i];
+            weights.first = std::min(source_length - 1, static_cast<std::size_t>(begin));
+            for (auto j = weights.first; j < end; ++j) {
+                double covered = std::min<double>(end, j + 1) - std::max<double>(begin, j);
+                weights.weights.push_back(static_cast<float>(covered / ratio));
+            }
+        }
+        return all_weights;
+    }
+
+    // The Lanczos kernel is stretched by the reduction ratio when reducing,
+    // so that it averages over every source pixel. Source pixels beyond 
+    // the edges are replaced by the nearest edge pixel.
+    std::vector<pixel_weights> compute_lanczos_weights(std::size_t source_length, std::size_t target_length) {
+        constexpr double RADIUS = 3;
+        double ratio = double(source_length) / target_length;
+        double kernel_scale = std::max(1.0, ratio);
+        double support = RADIUS * kernel_scale;
+
+        std::vector<pixel_weights> all_weights(target_length);
+        for (std::size_t i = 0; i < target_length; ++i) {
+            double center = (i + 0.5) * ratio;
+            auto begin = static_cast<long>(std::floor(center - support));
+            auto end = static_cast<long>(std::ceil(center + support));
+            begin = std::max<long>(begin, 0);
+            end = std::min<long>(end, source_length);
+
+            auto& weights = all_weights[i];
+            weights.first = begin;
+            double total = 0;
+            for (auto j = begin; j < end; ++j) {
+                auto weight = lanczos((j + 0.5 - center) / kernel_scale);
+                weights.weights.push_back(weight);
+                total += weight;
+            }
+            for (auto& weight : weights.weights) {
+                weight = static_cast<float>(weight / total);
+            }
+        }
+        return all_weights;
+    }
+
+    std::vector<pixel_weights> compute_weights(std::size_t source_length, std::size_t target_length, resize_filter filter) {
+        assert (source_length > 0 && target_length > 0);
+        return filter == resize_filter::area
+            ? compute_area_weights(source_length, target_length)
+            : compute_lanczos_weights(source_length, target_length);
+    }
+
+    // The number of rows in each band, so that each task has enough 
+    // pixels to outweigh its cost.
+    std::size_t band_rows(std::size_t width) {
+        constexpr std::size_t MIN_BAND_PIXELS = 1 << 14;
+        return std::max<std::size_t>(1, MIN_BAND_PIXELS / std::max<std::size_t>(1, width));
+    }
+
+    void resize(const image::rgb_image_view_t& source, 
+                const image::rgb_image_view_t& target, 
+                resize_filter filter) {
+        std::size_t source_width = source.width();
+        std::size_t source_height = source.height();
+        std::size_t width = target.width();
+        std::size_t height = target.height();
+        if (width == 0 || height == 0) {
+            return;
+        }
+        assert (source_width > 0 && source_height > 0);
+
+        auto horizontal_weights = compute_weights(source_width, width, filter);
+        auto vertical_weights = compute_weights(source_height, height, filter);
+
+        // The horizontal pass resizes each source row into a row of floats.
+        // The buffer is kept by each thread for its next resize.
+        thread_local std::vector<float> rows;
+        rows.assign(source_height * width * CHANNELS, 0.0f);
+        std::vector<float>& row_buffer = rows;
+        runtime::parallel_for(0, source_height, band_rows(width), [&](std::size_t first_row, std::size_t end_row) {
+            for (std::size_t y = first_row; y < end_row; ++y) {
+                auto source_row = source.row_begin(y);
+                float* row = &row_buffer[y * width * CHANNELS];
+                for (std::size_t x = 0; x < width; ++x) {
+                    const auto& weights = horizontal_weights[x];
+                    float sums[CHANNELS] = {};
+                    for (std::size_t j = 0; j < weights.weights.size(); ++j) {
+                        const auto& pixel = source_row[weights.first + j];
+                        for (std::size_t c = 0; c < CHANNELS; ++c) {
+                            sums[c] += weights.weights[j] * pixel[c];
+                        }
+                    }
+                    std::copy(sums, sums + CHANNELS, row + x * CHANNELS);
+                }
+            }
+        });
+
+        // The vertical pass sums whole rows of floats at once, which 
+        // vectorizes well.
+        runtime::parallel_for(0, height, band_rows(width), [&](std::size_t first_row, std::size_t end_row) {
+            std::vector<float> sums(width * CHANNELS);
+            for (std::size_t y = first_row; y < end_row; ++y) {
+                std::fill(sums.begin(), sums.end(), 0.0f);
+                const auto& weights = vertical_weights[y];
+                for (std::size_t j = 0; j < weights.weights.size(); ++j) {
+                    const float* row = &row_buffer[(weights.first + j) * width * CHANNELS];
+                    float weight = weights.weights[j];
+                    for (std::size_t i = 0; i < sums.size(); ++i) {
+                        sums[i] += weight * row[i];
+                    }
+                }
+
+                auto target_row = target.row_begin(y);
+                for (std::size_t x = 0; x < width; ++x) {
+                    for (std::size_t c = 0; c < CHANNELS; ++c) {
+                        auto value = std::lround(sums[x * CHANNELS + c]);
+                        target_row[x][c] = static_cast<uint8_t>(std::clamp<long>(value, 0, UINT8_MAX));
+                    }
+                }
+            }
+        });
+    }
+
+    // Scales a length by a ratio, rounding to the nearest pixel but keeping
+    // at least one pixel, and at most the limit.
+    std::size_t scale_length(std::size_t length, double ratio, std::size_t limit) {
+        auto scaled = static_cast<std::size_t>(std::lround(length * ratio));
+        return std::clamp<std::size_t>(scaled, 1, limit);
+    }
+
+    void fit_frame(const image::rgb_image_view_t& source, 
+                   image::rgb_image_t& target, 
+                   const fit_options& options) {
+        assert (options.width > 0 && options.height > 0);
+        if (static_cast<std::size_t>(target.width()) != options.width || 
+                static_cast<std::size_t>(target.height()) != options.height) {
+            target.recreate(options.width, options.height);
+        }
+        auto target_view = boost::gil::view(target);
+
+        std::size_t source_width = source.width();
+        std::size_t source_height = source.height();
+        double width_ratio = double(options.width) / source_width;
+        double height_ratio = double(options.height) / source_height;
+
+        switch (options.fit) {
+            case fit_mode::stretch:
+                resize(source, target_view, options.filter);
+                break;
+
+            case fit_mode::crop: {
+                // Cut the source to the canvas's aspect ratio, then resize.
+                double ratio = std::max(width_ratio, height_ratio);
+                auto crop_width = scale_length(options.width, 1 / ratio, source_width);
+                auto crop_height = scale_length(options.height, 1 / ratio, source_height);
+                auto cropped = boost::gil::subimage_view(source, 
+                                                         (source_width - crop_width) / 2, 
+                                                         (source_height - crop_height) / 2, 
+                                                         crop_width, 
+                                                         crop_height);
+                resize(cropped, target_view, options.filter);
+                break;
+            }
+
+            case fit_mode::pad: {
+                // Resize the source into the middle of the canvas.
+                double ratio = std::min(width_ratio, height_ratio);
+                auto inner_width = scale_length(source_width, ratio, options.width);
+                auto inner_height = scale_length(source_height, ratio, options.height);
+                auto left = (options.width - inner_width) / 2;
+                auto top = (options.height - inner_height) / 2;
+                if (inner_width < options.width || inner_height < options.height) {
+                    boost::gil::fill_pixels(target_view, options.pad_color);
+                }
+                resize(source, boost::gil::subimage_view(target_view, left, top, inner_width, inner_height), options.filter);
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <cstdlib>
+#include "preprocess.hpp"
+
+using namespace preprocess;
+
+// Creates an image made of square blocks of colors, where every block 
+// has a different color.
+image::rgb_image_t make_blocks(std::size_t width, std::size_t height, std::size_t block_size) {
+    image::rgb_image_t img(width, height);
+    auto img_view = boost::gil::view(img);
+    for (std::size_t y = 0; y < height; ++y) {
+        for (std::size_t x = 0; x < width; ++x) {
+            img_view(x, y) = image::rgb_pixel_t(x / block_size * 20, y / block_size * 30, 77);
+        }
+    }
+    return img;
+}
+
+bool is_uniform(const image::rgb_image_view_t& view, const image::rgb_pixel_t& color) {
+    for (const auto& pixel : view) {
+        if (pixel != color) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("Test area resize averages blocks", "[preprocess]") {
+    auto source = make_blocks(64, 48, 8);
+
+    // Reducing by exactly the block size gives one pixel per block.
+    image::rgb_image_t target(8, 6);
+    resize(boost::gil::view(source), boost::gil::view(target), resize_filter::area);
+    auto target_view = boost::gil::view(target);
+    for (std::size_t y = 0; y < 6; ++y) {
+        for (std::size_t x = 0; x < 8; ++x) {
+            REQUIRE(target_view(x, y) == image::rgb_pixel_t(x * 20, y * 30, 77));
+        }
+    }
+
+    // Reducing by half of a block averages neighbouring blocks evenly.
+    image::rgb_image_t uneven(4, 3);
+    resize(boost::gil::view(source), boost::gil::view(uneven), resize_filter::area);
+    REQUIRE(boost::gil::view(uneven)(0, 0) == image::rgb_pixel_t(10, 15, 77));
+}
+
+TEST_CASE("Test resizing keeps uniform colors", "[preprocess]") {
+    image::rgb_image_t source(37, 23);
+    auto color = image::rgb_pixel_t(200, 3, 99);
+    boost::gil::fill_pixels(boost::gil::view(source), color);
+
+    auto filter = GENERATE(resize_filter::area, resize_filter::lanczos);
+    auto width = GENERATE(1, 10, 37, 100);
+    auto height = GENERATE(1, 9, 60);
+    image::rgb_image_t target(width, height);
+    resize(boost::gil::view(source), boost::gil::view(target), filter);
+    REQUIRE(is_uniform(boost::gil::view(target), color));
+}
+
+TEST_CASE("Test Lanczos resize keeps smooth gradients", "[preprocess]") {
+    image::rgb_image_t source(200, 4);
+    auto source_view = boost::gil::view(source);
+    for (std::size_t y = 0; y < 4; ++y) {
+        for (std::size_t x = 0; x < 200; ++x) {
+            source_view(x, y) = image::rgb_pixel_t(x, x, x);
+        }
+    }
+
+    image::rgb_image_t target(100, 4);
+    resize(source_view, boost::gil::view(target), resize_filter::lanczos);
+    auto target_view = boost::gil::view(target);
+
+    // Away from the edges, each output pixel is the midpoint of the two 
+    // source pixels it covers.
+    for (std::size_t x = 5; x < 95; ++x) {
+        REQUIRE(std::abs(int(target_view(x, 2)[0]) - int(2 * x)) <= 1);
+    }
+}
+
+TEST_CASE("Test fitting frames to a canvas", "[preprocess]") {
+    // A wide frame with a red left half and blue right half.
+    image::rgb_image_t source(80, 20);
+    auto source_view = boost::gil::view(source);
+    auto red = image::rgb_pixel_t(255, 0, 0);
+    auto blue = image::rgb_pixel_t(0, 0, 255);
+    boost::gil::fill_pixels(boost::gil::subimage_view(source_view, 0, 0, 40, 20), red);
+    boost::gil::fill_pixels(boost::gil::subimage_view(source_view, 40, 0, 40, 20), blue);
+
+    fit_options options;
+    options.width = 40;
+    options.height = 40;
+    options.pad_color = image::rgb_pixel_t(1, 2, 3);
+    image::rgb_image_t target;
+
+    SECTION("Pad") {
+        options.fit = fit_mode::pad;
+        fit_frame(source_view, target, options);
+        auto target_view = boost::gil::view(target);
+        REQUIRE(target_view.width() == 40);
+        REQUIRE(target_view.height() == 40);
+
+        // The frame is reduced to 40x10 in the middle of the canvas.
+        REQUIRE(is_uniform(boost::gil::subimage_view(target_view, 0, 0, 40, 15), options.pad_color));
+        REQUIRE(is_uniform(boost::gil::subimage_view(target_view, 0, 15, 20, 10), red));
+        REQUIRE(is_uniform(boost::gil::subimage_view(target_view, 20, 15, 20, 10), blue));
+        REQUIRE(is_uniform(boost::gil::subimage_view(target_view, 0, 25, 40, 15), options.pad_color));
+    }
+
+    SECTION("Crop") {
+        options.fit = fit_mode::crop;
+        fit_frame(source_view, target, options);
+        auto target_view = boost::gil::view(target);
+
+        // The middle 20x20 of the frame is enlarged to fill the canvas.
+        REQUIRE(is_uniform(boost::gil::subimage_view(target_view, 0, 0, 20, 40), red));
+        REQUIRE(is_uniform(boost::gil::subimage_view(target_view, 20, 0, 20, 40), blue));
+    }
+
+    SECTION("Stretch") {
+        options.fit = fit_mode::stretch;
+        fit_frame(source_view, target, options);
+        auto target_view = boost::gil::view(target);
+        REQUIRE(is_uniform(boost::gil::subimage_view(target_view, 0, 0, 20, 40), red));
+        REQUIRE(is_uniform(boost::gil::subimage_view(target_view, 20, 0, 20, 40), blue));
+    }
+
+    SECTION("Target memory is re-used") {
+        target.recreate(40, 40);
+        auto pixels = &boost::gil::view(target)(0, 0);
+        fit_frame(source_view, target, options);
+        REQUIRE(&boost::gil::view(target)(0, 0) == pixels);
+    }
+}
@@ -0,0 +1,85 @@
+#include "frame_arena.hpp"
+#include <cstdint>
+#include <new>
+
+namespace runtime {
+
+    frame_arena::frame_arena(std::size_t initial_capacity) :
+            block(initial_capacity > 0 ? new std::byte[initial_capacity] : nullptr),
+            block_size(initial_capacity),
+            offset(0),
+            overflow_bytes(0) {
+    }
+
+    frame_arena::~frame_arena() {
+        free_overflow();
+    }
+
+    // A block which overflowed grows by half again on top of what it was
+    // short of, so that slowly growing frames do not replace it every time.
+    void frame_arena::reset() {
+        if (!overflow.empty()) {
+            auto needed = block_size + overflow_bytes;
+            free_overflow();
+            block_size = needed + needed / 2;
+            block.reset();
+            block.reset(new std::byte[block_size]);
+        }
+        offset.store(0);
+    }
+
+    std::size_t frame_arena::capacity() const {
+        return block_size;
+    }
+
+    std::size_t frame_arena::used() const {
+        return offset.load();
+    }
+
+    // The offset is claimed with a compare-and-swap so that threads never
+    // receive overlapping memory.
+    void* frame_arena::do_allocate(std::size_t bytes, std::size_t alignment) {
+        auto base = reinterpret_cast<std::uintptr_t>(block.get());
+        auto current = offset.load();
+        while (block) {
+            auto aligned = ((base + current + alignment - 1) & ~(std::uintptr_t(alignment) - 1)) - base;
+            auto end = aligned + bytes;
+            if (end > block_size) {
+                break;
+            }
+            if (offset.compare_exchange_weak(current, end)) {
+                return block.get() + aligned;
+            }
+        }
+        return allocate_overflow(bytes, alignment);
+    }
+
+    void frame_arena::do_deallocate(void*, std::size_t, std::size_t) {
+    }
+
+    bool frame_arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+        return this == &other;
+    }
+
+    void* frame_arena::allocate_overflow(std::size_t bytes, std::size_t alignment) {
+        auto memory = ::operator new(bytes, std::align_val_t(alignment));
+        std::lock_guard<std::mutex> lock(overflow_mutex);
+        try {
+            overflow.push_back({memory, alignment});
+        }
+        catch(...) {
+            ::operator delete(memory, std::align_val_t(alignment));
+            throw;
+        }
+        overflow_bytes += bytes + alignment;
+        return memory;
+    }
+
+    void frame_arena::free_overflow() {
+        for (const auto& allocation : overflow) {
+            ::operator delete(allocation.memory, std::align_val_t(allocation.alignment));
+        }
+        overflow.clear();
+        overflow_bytes = 0;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef FRAME_ARENA_HPP
+#define FRAME_ARENA_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+// A memory resource for the temporary data of one frame, such as its color
+// histogram and its compressed image data.
+namespace runtime {
+
+    // Hands out memory from one large block by bumping an offset, and frees
+    // all of it at once when the frame is finished. Deallocation does
+    // nothing. Allocations which do not fit in the block are taken from the
+    // global allocator, and the block is replaced by one large enough for
+    // all of them on the next reset. Once the arena has seen the largest
+    // frame, later frames make no calls to the global allocator.
+    //
+    // Memory may be allocated from several threads at once, so that the
+    // parallel stages of a frame can share its arena. reset must not
+    // overlap with allocation.
+    class frame_arena : public std::pmr::memory_resource {
+    public:
+        explicit frame_arena(std::size_t initial_capacity = 0);
+        ~frame_arena();
+
+        frame_arena(const frame_arena&) = delete;
+        frame_arena& operator=(const frame_arena&) = delete;
+
+        // Frees everything that was allocated since the last reset. Memory
+        // allocated from the arena must not be used afterwards.
+        void reset();
+
+        // The size of the block, and how much of it is in use.
+        std::size_t capacity() const;
+        std::size_t used() const;
+
+    protected:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    private:
+        struct overflow_allocation {
+            void* memory;
+            std::size_t alignment;
+        };
+
+        std::unique_ptr<std::byte[]> block;
+        std::size_t block_size;
+        std::atomic<std::size_t> offset;
+
+        // Allocations which did not fit in the block, and their total size.
+        std::mutex overflow_mutex;
+        std::vector<overflow_allocation> overflow;
+        std::size_t overflow_bytes;
+
+        void* allocate_overflow(std::size_t bytes, std::size_t alignment);
+        void free_overflow();
+    };
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef TASK_POOL_HPP
+#define TASK_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing task scheduler which is shared by every module, so
+// that parallel work from different modules, or nested inside other 
+// parallel work, never runs on more threads than the machine has cores.
+//
+// There are two kinds of tasks. Top-level tasks, such as the encoding of a
+// whole frame, wait in a shared queue ordered by priority. Nested tasks, 
+// such as the pieces of a parallel loop, are pushed onto the deque of the 
+// worker which created them. Each worker runs its own newest nested task
+// first, and idle workers steal the oldest nested tasks of other workers.
+// Threads which wait for nested tasks help to run them rather than block.
+namespace runtime {
+
+    using task = std::function<void()>;
+
+    class task_pool {
+    public:
+
+        // Starts a pool with the given number of worker threads, which must
+        // be at least 1.
+        explicit task_pool(std::size_t worker_count);
+
+        // Waits for every queued task to run, then stops the workers.
+        ~task_pool();
+
+        // Pools are neither copyable nor moveable.
+        task_pool(const task_pool&) = delete;
+        task_pool& operator=(const task_pool&) = delete;
+        task_pool(task_pool&&) = delete;
+        task_pool& operator=(task_pool&&) = delete;
+
+        std::size_t worker_count() const;
+
+        // Queues a top-level task. Top-level tasks are started by idle 
+        // workers in order of priority, lowest value first, and then in the
+        // order they were submitted. Unlike nested tasks, top-level tasks 
+        // may block. Tasks must not throw; see task_group.
+        void submit(task t, std::size_t priority = 0);
+
+        // Queues a nested task. Called from a worker of this pool, the task
+        // is pushed onto that worker's deque. Called from any other thread,
+        // it is queued as a top-level task with priority 0. Nested tasks 
+        // must neither block nor throw.
+        void spawn(task t);
+
+        // Runs one queued nested task on the calling thread, if there is 
+        // one. Returns false if there was no task to run. 
+        bool run_nested_task();
+
+        // The pool shared by the whole program. It is created on first use
+        // with one worker per core, unless set_shared_worker_count was 
+        // called earlier. Setting the count once the pool exists would have
+        // no effect, so it throws std::logic_error instead.
+        static task_pool& shared();
+        static void set_shared_worker_count(std::size_t worker_count);
+
+    private:
+        // A worker's nested tasks, kept in a ring buffer. Unlike std::deque,
+        // the buffer keeps its memory as tasks come and go, so that a steady
+        // flow of tasks does not allocate.
+        struct worker_deque {
+            std::mutex mutex;
+            std::vector<task> tasks;
+            std::size_t first = 0;
+            std::size_t count = 0;
+
+            void push_back(task t);
+            bool pop_back(task& t);
+            bool pop_front(task& t);
+        };
+
+        struct queued_task {
+            std::size_t priority;
+            std::size_t sequence;
+            task t;
+        };
+
+        std::vector<std::unique_ptr<worker_deque>> deques;
+
+        // The top-level tasks, kept as a heap with the most urgent task on
+        // top.
+        std::mutex shared_mutex;
+        std::vector<queued_task> shared_tasks;
+        std::size_t next_sequence;
+
+        // Incremented whenever a task is queued, so that idle workers can 
+        // wait for it to change.
+        std::atomic<uint32_t> work_epoch;
+        std::atomic<bool> stopping;
+        std::vector<std::thread> workers;
+
+        // Returns the index of the calling thread's worker in this pool, or
+        // worker_count() if the caller is not one of its workers.
+        std::size_t current_worker() const;
+
+        bool pop_local(std::size_t worker, task& t);
+        bool steal(std::size_t thief, task& t);
+        bool pop_shared(task& t);
+        void notify_work();
+        void run_worker(std::size_t worker);
+    };
+
+    // The state which a task group shares with its queued tasks.
+    struct group_state;
+
+    // Runs a set of nested tasks and waits for all of them to finish.
+    class task_group {
+    public:
+        explicit task_group(task_pool& pool = task_pool::shared());
+
+        // Waits for the group's tasks. Exceptions which have not been 
+        // rethrown by wait are discarded.
+        ~task_group();
+
+        task_group(const task_group&) = delete;
+        task_group& operator=(const task_group&) = delete;
+
+        // Queues a task as part of the group. The task may throw.
+        void run(task t);
+
+        // Waits for every task in the group to finish, running other nested
+        // tasks in the meantime. Rethrows the first exception thrown by any
+        // of the group's tasks.
+        void wait();
+
+    private:
+        task_pool& pool;
+
+        // Shared with the queued tasks, which may finish after wait returns.
+        // The state is recycled when the group is destroyed, so that groups
+        // do not allocate memory once warmed up.
+        group_state* state;
+    };
+
+    // Calls body(chunk_begin, chunk_end) for consecutive chunks of the range
+    // [begin, end). Every chunk holds grain elements, except possibly the 
+    // last. The chunks only depend on the arguments, not on the number of 
+    // threads, so results which are computed per chunk are deterministic.
+    //
+    // The calling thread works on chunks too, and helps with other nested
+    // tasks while it waits for the rest. Rethrows the first exception 
+    // thrown by body, once every chunk has finished.
+    void run_parallel_for(std::size_t begin, std::size_t end, std::size_t grain,
+                          const std::function<void(std::size_t, std::size_t)>& body,
+                          task_pool& pool);
+
+    // As run_parallel_for. A range which fits in one chunk is run on the 
+    // calling thread directly, without wrapping the body in a std::function,
+    // which may allocate memory.
+    template <class Body>
+    void parallel_for(std::size_t begin, std::size_t end, std::size_t grain,
+                      Body&& body, task_pool& pool = task_pool::shared()) {
+        if (begin < end && end - begin <= grain) {
+            body(begin, end);
+            return;
+        }
+        run_parallel_for(begin, end, grain, std::function<void(std::size_t, std::size_t)>(std::ref(body)), pool);
+    }
+}
+
+#endif
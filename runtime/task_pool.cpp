@@ -0,0 +1,457 @@
+#include "task_pool.hpp"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace runtime {
+
+    // Identifies the pool and worker which the current thread belongs to.
+    thread_local const task_pool* current_pool = nullptr;
+    thread_local std::size_t current_worker_index = 0;
+
+    // The most urgent task, with the lowest priority and then the lowest
+    // sequence number, must end up on top of the heap.
+    bool runs_later(const auto& t1, const auto& t2) {
+        return t1.priority != t2.priority 
+            ? t1.priority > t2.priority 
+            : t1.sequence > t2.sequence;
+    }
+
+    // The number of tasks which each queue has room for up front, which 
+    // covers the usual parallel steps without growing the queues.
+    constexpr std::size_t INITIAL_QUEUE_CAPACITY = 64;
+
+    void task_pool::worker_deque::push_back(task t) {
+        if (count == tasks.size()) {
+            // Unwrap the tasks into a larger buffer.
+            std::vector<task> grown(std::max(INITIAL_QUEUE_CAPACITY, 2 * tasks.size()));
+            for (std::size_t i = 0; i < count; ++i) {
+                grown[i] = std::move(tasks[(first + i) % tasks.size()]);
+            }
+            tasks.swap(grown);
+            first = 0;
+        }
+        tasks[(first + count) % tasks.size()] = std::move(t);
+        ++count;
+    }
+
+    bool task_pool::worker_deque::pop_back(task& t) {
+        if (count == 0) {
+            return false;
+        }
+        --count;
+        t = std::move(tasks[(first + count) % tasks.size()]);
+        return true;
+    }
+
+    bool task_pool::worker_deque::pop_front(task& t) {
+        if (count == 0) {
+            return false;
+        }
+        t = std::move(tasks[first]);
+        first = (first + 1) % tasks.size();
+        --count;
+        return true;
+    }
+
+    task_pool::task_pool(std::size_t worker_count) :
+            deques(),
+            shared_mutex(),
+            shared_tasks(),
+            next_sequence(0),
+            work_epoch(0),
+            stopping(false),
+            workers() {
+        assert (worker_count > 0);
+
+        for (std::size_t i = 0; i < worker_count; ++i) {
+            deques.push_back(std::make_unique<worker_deque>());
+            deques.back()->tasks.resize(INITIAL_QUEUE_CAPACITY);
+        }
+        shared_tasks.reserve(INITIAL_QUEUE_CAPACITY);
+        for (std::size_t i = 0; i < worker_count; ++i) {
+            workers.emplace_back(&task_pool::run_worker, this, i);
+        }
+    }
+
+    task_pool::~task_pool() {
+        stopping.store(true);
+        work_epoch.fetch_add(1, std::memory_order_release);
+        work_epoch.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    std::size_t task_pool::worker_count() const {
+        return deques.size();
+    }
+
+    std::size_t task_pool::current_worker() const {
+        return current_pool == this ? current_worker_index : worker_count();
+    }
+
+    void task_pool::notify_work() {
+        work_epoch.fetch_add(1, std::memory_order_release);
+        work_epoch.notify_one();
+    }
+
+    void task_pool::submit(task t, std::size_t priority) {
+        {
+            std::lock_guard<std::mutex> lock(shared_mutex);
+            shared_tasks.push_back(queued_task { priority, next_sequence++, std::move(t) });
+            std::push_heap(shared_tasks.begin(), shared_tasks.end(), runs_later<queued_task, queued_task>);
+        }
+        notify_work();
+    }
+
+    void task_pool::spawn(task t) {
+        auto worker = current_worker();
+        if (worker == worker_count()) {
+            submit(std::move(t));
+            return;
+        }
+
+        {
+            auto& deque = *deques[worker];
+            std::lock_guard<std::mutex> lock(deque.mutex);
+            deque.push_back(std::move(t));
+        }
+        notify_work();
+    }
+
+    // A worker takes its own newest task, which is the most likely to 
+    // still be in its cache.
+    bool task_pool::pop_local(std::size_t worker, task& t) {
+        auto& deque = *deques[worker];
+        std::lock_guard<std::mutex> lock(deque.mutex);
+        return deque.pop_back(t);
+    }
+
+    // Thieves take the oldest task of another worker, which is usually the
+    // largest piece of work left. The search starts after the thief so that
+    // thieves spread over the victims.
+    bool task_pool::steal(std::size_t thief, task& t) {
+        for (std::size_t i = 1; i <= worker_count(); ++i) {
+            auto& deque = *deques[(thief + i) % worker_count()];
+            std::lock_guard<std::mutex> lock(deque.mutex);
+            if (deque.pop_front(t)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool task_pool::pop_shared(task& t) {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        if (shared_tasks.empty()) {
+            return false;
+        }
+
+        std::pop_heap(shared_tasks.begin(), shared_tasks.end(), runs_later<queued_task, queued_task>);
+        t = std::move(shared_tasks.back().t);
+        shared_tasks.pop_back();
+        return true;
+    }
+
+    // Waiting threads only run nested tasks. A top-level task may block, 
+    // and it could be waiting for the very task which the helping thread 
+    // has left unfinished further up its stack.
+    bool task_pool::run_nested_task() {
+        auto worker = current_worker();
+        task t;
+        if ((worker < worker_count() && pop_local(worker, t)) || steal(worker, t)) {
+            t();
+            return true;
+        }
+        return false;
+    }
+
+    // Nested work is finished before new top-level work is started, so 
+    // that earlier frames are completed first.
+    void task_pool::run_worker(std::size_t worker) {
+        current_pool = this;
+        current_worker_index = worker;
+
+        task t;
+        while (true) {
+            // Loading the epoch before looking for work ensures that a task
+            // queued in between is not missed by the wait.
+            auto epoch = work_epoch.load(std::memory_order_acquire);
+            if (pop_local(worker, t) || pop_shared(t) || steal(worker, t)) {
+                t();
+                t = nullptr;
+            }
+            else if (stopping.load()) {
+                return;
+            }
+            else {
+                work_epoch.wait(epoch, std::memory_order_acquire);
+            }
+        }
+    }
+
+    std::atomic<std::size_t> shared_worker_count(0);
+    std::atomic<bool> shared_pool_created(false);
+
+    task_pool& task_pool::shared() {
+        static task_pool pool([] {
+            shared_pool_created.store(true);
+            return shared_worker_count.load() > 0 
+                ? shared_worker_count.load() 
+                : std::max(1u, std::thread::hardware_concurrency());
+        }());
+        return pool;
+    }
+
+    void task_pool::set_shared_worker_count(std::size_t worker_count) {
+        assert (worker_count > 0);
+        if (shared_pool_created.load()) {
+            throw std::logic_error("The shared task pool was created before its worker count was set");
+        }
+        shared_worker_count.store(worker_count);
+    }
+
+    // Keeps objects which are no longer used, so that they are reused 
+    // rather than allocated again. The state of task groups and parallel 
+    // loops is kept like this, so that a steady flow of parallel work 
+    // stops allocating once it has warmed up.
+    //
+    // Objects are only freed when the program exits, so a task which still
+    // touches an object just after it was released, such as to wake a
+    // waiting thread, never touches freed memory.
+    template <class T>
+    class recycler {
+    public:
+        T* acquire() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (unused.empty()) {
+                // Make room for the new object to be kept once released, so
+                // that releasing never allocates.
+                unused.reserve(created.size() + 1);
+                created.push_back(std::make_unique<T>());
+                return created.back().get();
+            }
+            auto object = unused.back();
+            unused.pop_back();
+            return object;
+        }
+
+        void release(T* object) {
+            std::lock_guard<std::mutex> lock(mutex);
+            unused.push_back(object);
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<std::unique_ptr<T>> created;
+        std::vector<T*> unused;
+    };
+
+    struct group_state {
+        std::atomic<std::size_t> pending {0};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    // A task queued by a task group. Only a pointer to it is captured by 
+    // the task which is spawned, so that the pool can store that task 
+    // without allocating memory.
+    struct group_task {
+        group_state* group;
+        task t;
+    };
+
+    // These are constant-initialized, so they outlive every pool.
+    constinit recycler<group_state> group_states;
+    constinit recycler<group_task> group_tasks;
+
+    task_group::task_group(task_pool& p) : 
+            pool(p), 
+            state(group_states.acquire()) {
+    }
+
+    task_group::~task_group() {
+        try {
+            wait();
+        }
+        catch(...) {
+        }
+        group_states.release(state);
+    }
+
+    void task_group::run(task t) {
+        auto queued = group_tasks.acquire();
+        queued->group = state;
+        queued->t = std::move(t);
+        state->pending.fetch_add(1);
+        pool.spawn([queued]() {
+            auto s = queued->group;
+            try {
+                queued->t();
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(s->error_mutex);
+                if (!s->error) {
+                    s->error = std::current_exception();
+                }
+            }
+            queued->t = nullptr;
+            group_tasks.release(queued);
+
+            if (s->pending.fetch_sub(1) == 1) {
+                s->pending.notify_all();
+            }
+        });
+    }
+
+    void task_group::wait() {
+        while (true) {
+            auto pending = state->pending.load();
+            if (pending == 0) {
+                break;
+            }
+            else if (!pool.run_nested_task()) {
+                state->pending.wait(pending);
+            }
+        }
+
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(state->error_mutex);
+            std::swap(error, state->error);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // The state of a parallel_for call. Chunks are claimed from a counter,
+    // so the number of helper tasks only affects how many threads take 
+    // part. 
+    //
+    // Helpers may still be queued when the loop has finished and its state
+    // has been reused by another loop. Each helper is given the generation
+    // of its loop, and a helper which finds that the generation has moved
+    // on returns without touching the rest of the state.
+    struct loop_state {
+        std::size_t begin;
+        std::size_t end;
+        std::size_t grain;
+        std::size_t chunk_count;
+        const std::function<void(std::size_t, std::size_t)>* body;
+
+        std::atomic<std::size_t> generation {0};
+        std::atomic<std::size_t> active_helpers {0};
+        std::atomic<std::size_t> next_chunk {0};
+        std::atomic<std::size_t> completed_chunks {0};
+        std::atomic<bool> failed {false};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    constinit recycler<loop_state> loop_states;
+
+    void run_chunks(loop_state& loop) {
+        while (true) {
+            auto chunk = loop.next_chunk.fetch_add(1);
+            if (chunk >= loop.chunk_count) {
+                return;
+            }
+
+            // Once a chunk fails, the others are skipped.
+            if (!loop.failed.load()) {
+                auto chunk_begin = loop.begin + chunk * loop.grain;
+                auto chunk_end = std::min(chunk_begin + loop.grain, loop.end);
+                try {
+                    (*loop.body)(chunk_begin, chunk_end);
+                }
+                catch(...) {
+                    std::lock_guard<std::mutex> lock(loop.error_mutex);
+                    if (!loop.error) {
+                        loop.error = std::current_exception();
+                    }
+                    loop.failed.store(true);
+                }
+            }
+
+            if (loop.completed_chunks.fetch_add(1) + 1 == loop.chunk_count) {
+                loop.completed_chunks.notify_all();
+            }
+        }
+    }
+
+    void run_helper(loop_state& loop, std::size_t generation) {
+        // Registering before checking the generation ensures that the 
+        // caller either sees this helper or has already moved the 
+        // generation on.
+        loop.active_helpers.fetch_add(1);
+        if (loop.generation.load() == generation) {
+            run_chunks(loop);
+        }
+        if (loop.active_helpers.fetch_sub(1) == 1) {
+            loop.active_helpers.notify_all();
+        }
+    }
+
+    void run_parallel_for(std::size_t begin, std::size_t end, std::size_t grain,
+                          const std::function<void(std::size_t, std::size_t)>& body,
+                          task_pool& pool) {
+        assert (grain > 0);
+        if (begin >= end) {
+            return;
+        }
+
+        auto chunk_count = (end - begin + grain - 1) / grain;
+        if (chunk_count == 1) {
+            body(begin, end);
+            return;
+        }
+
+        auto loop = loop_states.acquire();
+        loop->begin = begin;
+        loop->end = end;
+        loop->grain = grain;
+        loop->chunk_count = chunk_count;
+        loop->body = &body;
+        loop->next_chunk.store(0);
+        loop->completed_chunks.store(0);
+        loop->failed.store(false);
+
+        auto generation = loop->generation.load();
+        auto helper_count = std::min(chunk_count - 1, pool.worker_count());
+        for (std::size_t i = 0; i < helper_count; ++i) {
+            pool.spawn([loop, generation]() { run_helper(*loop, generation); });
+        }
+        run_chunks(*loop);
+
+        while (true) {
+            auto completed = loop->completed_chunks.load();
+            if (completed == chunk_count) {
+                break;
+            }
+            else if (!pool.run_nested_task()) {
+                loop->completed_chunks.wait(completed);
+            }
+        }
+
+        // Every chunk has finished, so the helpers which are still running
+        // have nothing left to do. Once they return, and the generation has
+        // moved on, the state can be reused.
+        loop->generation.fetch_add(1);
+        while (true) {
+            auto active = loop->active_helpers.load();
+            if (active == 0) {
+                break;
+            }
+            loop->active_helpers.wait(active);
+        }
+
+        std::exception_ptr error;
+        std::swap(error, loop->error);
+        loop_states.release(loop);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "frame_arena.hpp"
+
+using namespace runtime;
+
+TEST_CASE("Test arena allocations are aligned and do not overlap", "[frame_arena]") {
+    frame_arena arena(4096);
+    REQUIRE(arena.capacity() == 4096);
+    REQUIRE(arena.used() == 0);
+
+    auto first = static_cast<char*>(arena.allocate(3, 1));
+    auto second = static_cast<char*>(arena.allocate(64, 64));
+    auto third = static_cast<char*>(arena.allocate(8, 8));
+
+    REQUIRE(reinterpret_cast<std::uintptr_t>(second) % 64 == 0);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(third) % 8 == 0);
+    REQUIRE(second >= first + 3);
+    REQUIRE(third >= second + 64);
+    REQUIRE(arena.used() >= 3 + 64 + 8);
+
+    arena.reset();
+    REQUIRE(arena.used() == 0);
+    REQUIRE(arena.capacity() == 4096);
+    REQUIRE(arena.allocate(3, 1) == first);
+}
+
+TEST_CASE("Test arena grows to fit allocations on reset", "[frame_arena]") {
+    frame_arena arena;
+    REQUIRE(arena.capacity() == 0);
+
+    {
+        std::pmr::vector<int> values(&arena);
+        for (int i = 0; i < 1000; ++i) {
+            values.push_back(i);
+        }
+        REQUIRE(values[999] == 999);
+    }
+    arena.reset();
+    auto capacity = arena.capacity();
+    REQUIRE(capacity >= 1000 * sizeof(int));
+
+    // The same allocations now fit in the block.
+    {
+        std::pmr::vector<int> values(&arena);
+        for (int i = 0; i < 1000; ++i) {
+            values.push_back(i);
+        }
+    }
+    arena.reset();
+    REQUIRE(arena.capacity() == capacity);
+}
+
+TEST_CASE("Test arena allocations from several threads", "[frame_arena]") {
+    constexpr std::size_t THREADS = 4, ALLOCATIONS = 1000;
+    frame_arena arena(THREADS * ALLOCATIONS * 16);
+
+    std::vector<std::vector<char*>> results(THREADS);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&arena, &results, t]() {
+            for (std::size_t i = 0; i < ALLOCATIONS; ++i) {
+                auto memory = static_cast<char*>(arena.allocate(16, 16));
+                std::fill(memory, memory + 16, static_cast<char>(t));
+                results[t].push_back(memory);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<char*> all;
+    for (std::size_t t = 0; t < THREADS; ++t) {
+        for (auto memory : results[t]) {
+            REQUIRE(std::all_of(memory, memory + 16, [t](char c) { return c == static_cast<char>(t); }));
+            all.push_back(memory);
+        }
+    }
+    std::sort(all.begin(), all.end());
+    REQUIRE(std::adjacent_find(all.begin(), all.end()) == all.end());
+}
@@ -0,0 +1,161 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <future>
+#include <numeric>
+#include <stdexcept>
+#include "task_pool.hpp"
+
+using namespace runtime;
+
+TEST_CASE("Test submitted tasks run", "[task_pool]") {
+    std::atomic<int> count(0);
+    {
+        task_pool pool(3);
+        REQUIRE(pool.worker_count() == 3);
+        for (int i = 0; i < 100; ++i) {
+            pool.submit([&count]() { ++count; });
+        }
+    }
+
+    // The pool runs every queued task before it is destroyed.
+    REQUIRE(count == 100);
+}
+
+TEST_CASE("Test top-level tasks run in priority order", "[task_pool]") {
+    task_pool pool(1);
+
+    // Keep the only worker busy until every task has been queued.
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    pool.submit([released]() { released.wait(); });
+
+    std::vector<int> order;
+    std::mutex order_mutex;
+    for (int priority : {5, 1, 3, 1, 0}) {
+        pool.submit([&order, &order_mutex, priority]() {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(priority);
+        }, priority);
+    }
+    release.set_value();
+
+    std::promise<void> done;
+    pool.submit([&done]() { done.set_value(); }, 10);
+    done.get_future().wait();
+
+    REQUIRE(order == std::vector<int>{0, 1, 1, 3, 5});
+}
+
+TEST_CASE("Test task groups", "[task_pool][task_group]") {
+    task_pool pool(4);
+
+    SECTION("Every task runs before wait returns") {
+        std::vector<int> results(50, 0);
+        task_group group(pool);
+        for (int i = 0; i < 50; ++i) {
+            group.run([&results, i]() { results[i] = i * i; });
+        }
+        group.wait();
+
+        for (int i = 0; i < 50; ++i) {
+            REQUIRE(results[i] == i * i);
+        }
+    }
+
+    SECTION("Exceptions are rethrown by wait") {
+        task_group group(pool);
+        for (int i = 0; i < 10; ++i) {
+            group.run([i]() {
+                if (i == 7) {
+                    throw std::runtime_error("Task failed");
+                }
+            });
+        }
+        REQUIRE_THROWS_AS(group.wait(), std::runtime_error);
+    }
+
+    SECTION("Groups may be nested") {
+        std::atomic<int> count(0);
+        task_group outer(pool);
+        for (int i = 0; i < 8; ++i) {
+            outer.run([&pool, &count]() {
+                task_group inner(pool);
+                for (int j = 0; j < 8; ++j) {
+                    inner.run([&count]() { ++count; });
+                }
+                inner.wait();
+            });
+        }
+        outer.wait();
+        REQUIRE(count == 64);
+    }
+}
+
+TEST_CASE("Test parallel for", "[task_pool][parallel_for]") {
+    task_pool pool(4);
+
+    SECTION("Chunks cover the range exactly once") {
+        // Catch assertions are not thread-safe, so results are checked 
+        // once the loop has finished.
+        std::vector<std::atomic<int>> visits(1000);
+        std::atomic<int> oversized_chunks(0);
+        parallel_for(10, 1000, 7, [&visits, &oversized_chunks](std::size_t begin, std::size_t end) {
+            oversized_chunks += end - begin > 7;
+            for (auto i = begin; i < end; ++i) {
+                ++visits[i];
+            }
+        }, pool);
+
+        REQUIRE(oversized_chunks == 0);
+        for (std::size_t i = 0; i < visits.size(); ++i) {
+            REQUIRE(visits[i] == (i < 10 ? 0 : 1));
+        }
+    }
+
+    SECTION("Chunk boundaries do not depend on the pool") {
+        task_pool single_pool(1);
+        auto record_chunks = [](task_pool& p) {
+            std::vector<std::size_t> chunk_ends(100, 0);
+            parallel_for(0, 100, 9, [&chunk_ends](std::size_t begin, std::size_t end) {
+                chunk_ends[begin] = end;
+            }, p);
+            return chunk_ends;
+        };
+        REQUIRE(record_chunks(pool) == record_chunks(single_pool));
+    }
+
+    SECTION("Loops may be nested without deadlock") {
+        std::vector<std::size_t> sums(64, 0);
+        parallel_for(0, 64, 1, [&sums, &pool](std::size_t i, std::size_t) {
+            std::vector<std::size_t> values(100, 0);
+            parallel_for(0, 100, 10, [&values, i](std::size_t begin, std::size_t end) {
+                for (auto j = begin; j < end; ++j) {
+                    values[j] = i + j;
+                }
+            }, pool);
+            sums[i] = std::accumulate(values.begin(), values.end(), std::size_t(0));
+        }, pool);
+
+        for (std::size_t i = 0; i < sums.size(); ++i) {
+            REQUIRE(sums[i] == 100 * i + 4950);
+        }
+    }
+
+    SECTION("Exceptions are rethrown") {
+        auto failing_loop = [&pool]() {
+            parallel_for(0, 100, 1, [](std::size_t i, std::size_t) {
+                if (i == 42) {
+                    throw std::runtime_error("Chunk failed");
+                }
+            }, pool);
+        };
+        REQUIRE_THROWS_AS(failing_loop(), std::runtime_error);
+    }
+}
+
+TEST_CASE("Test the shared pool's worker count is set before it is created", "[task_pool]") {
+    auto& pool = task_pool::shared();
+    REQUIRE(pool.worker_count() > 0);
+    REQUIRE_THROWS_AS(task_pool::set_shared_worker_count(2), std::logic_error);
+}
@@ -0,0 +1,47 @@
+#include "encode_client.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace server {
+
+    encode_client::encode_client(const std::string& socket_path) : fd(-1) {
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("The socket path must have between 1 and " + 
+                                        std::to_string(sizeof(address.sun_path) - 1) + " characters");
+        }
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Unable to create socket");
+        }
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            auto error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "Unable to connect to " + socket_path);
+        }
+    }
+
+    encode_client::~encode_client() {
+        close(fd);
+    }
+
+    void encode_client::encode(uint32_t request_id, const std::string& request_json) {
+        write_message(fd, message_type::encode, request_id, request_json);
+    }
+
+    void encode_client::cancel(uint32_t request_id) {
+        write_message(fd, message_type::cancel, request_id, {});
+    }
+
+    bool encode_client::receive(message& m) {
+        return read_message(fd, m);
+    }
+}
@@ -0,0 +1,448 @@
+#include "encode_server.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "gif_sink.hpp"
+#include "memory_encoder.hpp"
+
+namespace server {
+
+    client_connection::client_connection(int socket_fd) : fd(socket_fd), send_mutex(), open(true) {
+    }
+
+    client_connection::~client_connection() {
+        close(fd);
+    }
+
+    int client_connection::socket() const {
+        return fd;
+    }
+
+    bool client_connection::send(message_type type, uint32_t request_id, std::span<const char> payload) {
+        std::lock_guard<std::mutex> lock(send_mutex);
+        if (!open) {
+            return false;
+        }
+        try {
+            write_message(fd, type, request_id, payload);
+        }
+        catch (const std::system_error&) {
+            // The message may have been sent in part, so nothing more can be
+            // sent. Shutting down also stops the thread reading from the 
+            // client, which cancels its requests.
+            open = false;
+            shutdown(fd, SHUT_RDWR);
+        }
+        return open;
+    }
+
+    void client_connection::shut_down() {
+        shutdown(fd, SHUT_RDWR);
+    }
+
+    request_queue::request_queue() : mutex(), pushed(), requests(), next_sequence(0), closed(false) {
+    }
+
+    void request_queue::push(std::shared_ptr<encode_request> request) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            request->sequence = next_sequence++;
+            requests.push_back(std::move(request));
+        }
+        pushed.notify_one();
+    }
+
+    std::shared_ptr<encode_request> request_queue::pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        pushed.wait(lock, [this]() { return closed || !requests.empty(); });
+        if (closed) {
+            return nullptr;
+        }
+
+        // The queue is short, as each request waits for a runner, so a 
+        // scan is cheaper than keeping it ordered.
+        auto most_urgent = std::min_element(requests.begin(), requests.end(), [](const auto& a, const auto& b) {
+            return std::make_pair(a->job.priority, a->sequence) < std::make_pair(b->job.priority, b->sequence);
+        });
+        auto request = std::move(*most_urgent);
+        requests.erase(most_urgent);
+        return request;
+    }
+
+    std::shared_ptr<encode_request> request_queue::remove(const client_connection* client, uint32_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = std::find_if(requests.begin(), requests.end(), [&](const auto& request) {
+            return request->client.get() == client && request->id == id;
+        });
+        if (found == requests.end()) {
+            return nullptr;
+        }
+        auto request = std::move(*found);
+        requests.erase(found);
+        return request;
+    }
+
+    std::vector<std::shared_ptr<encode_request>> request_queue::remove_all(const client_connection* client) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto first_removed = std::stable_partition(requests.begin(), requests.end(), [&](const auto& request) {
+            return request->client.get() != client;
+        });
+        std::vector<std::shared_ptr<encode_request>> removed(std::make_move_iterator(first_removed), 
+                                                             std::make_move_iterator(requests.end()));
+        requests.erase(first_removed, requests.end());
+        return removed;
+    }
+
+    void request_queue::close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        pushed.notify_all();
+    }
+
+    std::size_t request_queue::size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return requests.size();
+    }
+
+    // Thrown from a request's sink to stop encoding it.
+    struct request_cancelled : std::runtime_error {
+        request_cancelled() : std::runtime_error("The request was cancelled") {}
+    };
+
+    // Sends the GIF of a request to its client as it is encoded.
+    class client_sink : public gif::gif_sink {
+    public:
+        explicit client_sink(encode_request& r) : request(r), bytes_sent(0) {}
+
+        void on_bytes(std::span<const char> bytes) override {
+            check_cancelled();
+            while (!bytes.empty()) {
+                auto part = bytes.first(std::min(bytes.size(), MAX_PAYLOAD_BYTES));
+                if (!request.client->send(message_type::data, request.id, part)) {
+                    throw request_cancelled();
+                }
+                bytes_sent += part.size();
+                bytes = bytes.subspan(part.size());
+            }
+        }
+
+        void on_frame_begin(std::size_t) override {
+            check_cancelled();
+        }
+
+        std::size_t sent() const {
+            return bytes_sent;
+        }
+
+    private:
+        encode_request& request;
+        std::size_t bytes_sent;
+
+        void check_cancelled() {
+            if (request.cancelled.load()) {
+                throw request_cancelled();
+            }
+        }
+    };
+
+    // Writes the result of a request as a JSON object.
+    std::string format_result(uint32_t id, const std::string& status, const batch::job_result& result) {
+        std::ostringstream json;
+        json << "{\"id\": " << id << ", \"status\": \"" << status << "\"";
+        if (!result.error.empty()) {
+            json << ", \"error\": ";
+            batch::write_json_string(json, result.error);
+        }
+        json << ", \"frames\": " << result.frames
+             << ", \"bytes\": " << result.output_bytes
+             << std::fixed << std::setprecision(3)
+             << ", \"queued_ms\": " << 1000 * result.queued_time.count()
+             << ", \"run_ms\": " << 1000 * result.run_time.count()
+             << "}";
+        return json.str();
+    }
+
+    encode_server::encode_server(const std::string& path, const server_options& server_opts, runtime::task_pool& task_pool) :
+            socket_path(path),
+            options(server_opts),
+            pool(task_pool),
+            listen_fd(-1),
+            wake_fds{-1, -1},
+            queue(),
+            budget(server_opts.memory_limit),
+            active_mutex(),
+            active(),
+            clients() {
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("The socket path must have between 1 and " + 
+                                        std::to_string(sizeof(address.sun_path) - 1) + " characters");
+        }
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+        auto address_ptr = reinterpret_cast<const sockaddr*>(&address);
+
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Unable to create socket");
+        }
+
+        auto fail = [this](int error, const std::string& what) {
+            close(listen_fd);
+            throw std::system_error(error, std::generic_category(), what);
+        };
+
+        // A socket left by a server which has stopped is replaced, but not 
+        // the socket of one which is still running.
+        std::error_code ignored;
+        if (std::filesystem::exists(socket_path, ignored)) {
+            if (!std::filesystem::is_socket(socket_path, ignored)) {
+                close(listen_fd);
+                throw std::invalid_argument(socket_path + " exists and is not a socket");
+            }
+            int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool in_use = probe >= 0 && connect(probe, address_ptr, sizeof(address)) == 0;
+            if (probe >= 0) {
+                close(probe);
+            }
+            if (in_use) {
+                fail(EADDRINUSE, "Another server is listening on " + socket_path);
+            }
+            std::filesystem::remove(socket_path, ignored);
+        }
+
+        if (bind(listen_fd, address_ptr, sizeof(address)) < 0) {
+            fail(errno, "Unable to bind socket to " + socket_path);
+        }
+        if (listen(listen_fd, SOMAXCONN) < 0) {
+            fail(errno, "Unable to listen on " + socket_path);
+        }
+        if (pipe2(wake_fds, O_CLOEXEC) < 0) {
+            fail(errno, "Unable to create pipe");
+        }
+    }
+
+    encode_server::~encode_server() {
+        close(listen_fd);
+        close(wake_fds[0]);
+        close(wake_fds[1]);
+        std::error_code ignored;
+        std::filesystem::remove(socket_path, ignored);
+    }
+
+    void encode_server::stop() {
+        char wake = 0;
+        while (write(wake_fds[1], &wake, 1) < 0 && errno == EINTR) {
+        }
+    }
+
+    void encode_server::run() {
+        auto runner_count = options.max_jobs > 0 ? options.max_jobs : 2 * pool.worker_count();
+        std::vector<std::thread> runners;
+        for (std::size_t i = 0; i < runner_count; ++i) {
+            runners.emplace_back([this]() { run_requests(); });
+        }
+
+        while (true) {
+            pollfd fds[2] = {{listen_fd, POLLIN, 0}, {wake_fds[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            if (fds[1].revents != 0) {
+                break;
+            }
+            if ((fds[0].revents & POLLIN) == 0) {
+                continue;
+            }
+
+            int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client_fd < 0) {
+                continue;
+            }
+            timeval send_timeout {};
+            send_timeout.tv_sec = options.send_timeout.count() / 1000;
+            send_timeout.tv_usec = options.send_timeout.count() % 1000 * 1000;
+            setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+            for (auto entry = clients.begin(); entry != clients.end();) {
+                if (entry->finished.load()) {
+                    entry->reader.join();
+                    entry = clients.erase(entry);
+                }
+                else {
+                    ++entry;
+                }
+            }
+            auto& entry = clients.emplace_back();
+            entry.client = std::make_shared<client_connection>(client_fd);
+            entry.reader = std::thread([this, &entry]() { serve_client(entry); });
+        }
+
+        // Every client is disconnected, which cancels its requests, and the
+        // runners stop once their current requests end.
+        queue.close();
+        for (auto& entry : clients) {
+            entry.client->shut_down();
+        }
+        for (auto& entry : clients) {
+            entry.reader.join();
+        }
+        clients.clear();
+        {
+            std::lock_guard<std::mutex> lock(active_mutex);
+            for (auto& [key, request] : active) {
+                request->cancelled.store(true);
+            }
+        }
+        for (auto& runner : runners) {
+            runner.join();
+        }
+    }
+
+    void encode_server::serve_client(client_thread& entry) {
+        const auto& client = entry.client;
+        message m;
+        try {
+            while (read_message(client->socket(), m)) {
+                if (m.type == message_type::encode) {
+                    auto request = std::make_shared<encode_request>();
+                    request->client = client;
+                    request->id = m.request_id;
+                    request->received = std::chrono::steady_clock::now();
+                    try {
+                        request->job = batch::parse_job(m.payload, m.request_id, batch::job_format::request);
+                    }
+                    catch (const std::invalid_argument& e) {
+                        batch::job_result result;
+                        result.error = e.what();
+                        client->send(message_type::result, m.request_id, format_result(m.request_id, "failed", result));
+                        continue;
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock(active_mutex);
+                        active.emplace(std::make_pair(client.get(), request->id), request);
+                    }
+                    queue.push(std::move(request));
+                }
+                else if (m.type == message_type::cancel) {
+                    cancel(client.get(), m.request_id);
+                }
+                else {
+                    throw std::runtime_error("Clients may only send encode and cancel messages");
+                }
+            }
+        }
+        catch (const std::exception&) {
+            // The client broke the protocol or its socket failed, so it is
+            // disconnected.
+        }
+
+        cancel_all(client.get());
+        client->shut_down();
+        entry.finished.store(true);
+    }
+
+    void encode_server::cancel(const client_connection* client, uint32_t id) {
+        {
+            std::lock_guard<std::mutex> lock(active_mutex);
+            auto [first, last] = active.equal_range(std::make_pair(client, id));
+            for (auto entry = first; entry != last; ++entry) {
+                entry->second->cancelled.store(true);
+            }
+        }
+
+        // A request which has not started is finished here. One which has 
+        // is stopped by its runner.
+        if (auto waiting = queue.remove(client, id)) {
+            finish(waiting, "cancelled", {});
+        }
+    }
+
+    void encode_server::cancel_all(const client_connection* client) {
+        {
+            std::lock_guard<std::mutex> lock(active_mutex);
+            for (auto& [key, request] : active) {
+                if (key.first == client) {
+                    request->cancelled.store(true);
+                }
+            }
+        }
+        for (const auto& waiting : queue.remove_all(client)) {
+            finish(waiting, "cancelled", {});
+        }
+    }
+
+    void encode_server::finish(const std::shared_ptr<encode_request>& request, const std::string& status, 
+                               const batch::job_result& result) {
+        {
+            std::lock_guard<std::mutex> lock(active_mutex);
+            auto [first, last] = active.equal_range(std::make_pair(request->client.get(), request->id));
+            auto entry = std::find_if(first, last, [&](const auto& e) { return e.second == request; });
+            if (entry != last) {
+                active.erase(entry);
+            }
+        }
+        request->client->send(message_type::result, request->id, format_result(request->id, status, result));
+    }
+
+    void encode_server::run_requests() {
+        // The inputs' buffers stay allocated from request to request.
+        batch::job_inputs inputs;
+        while (auto request = queue.pop()) {
+            if (request->cancelled.load()) {
+                finish(request, "cancelled", {});
+                continue;
+            }
+            auto reserved = budget.acquire(batch::estimate_job_memory(request->job, pool));
+            encode(request, inputs);
+            budget.release(reserved);
+        }
+    }
+
+    void encode_server::encode(const std::shared_ptr<encode_request>& request, batch::job_inputs& inputs) {
+        batch::job_result result;
+        auto started = std::chrono::steady_clock::now();
+        result.queued_time = started - request->received;
+
+        std::string status = "ok";
+        client_sink sink(*request);
+        try {
+            const auto& images = inputs.read(request->job.input_files);
+            result.frames = encoder::encode_images(images, sink, request->job.options, pool).frames;
+        }
+        catch (const request_cancelled&) {
+            status = "cancelled";
+        }
+        catch (const std::exception& e) {
+            if (request->cancelled.load()) {
+                status = "cancelled";
+            }
+            else {
+                status = "failed";
+                result.error = e.what();
+            }
+        }
+
+        result.output_bytes = sink.sent();
+        result.run_time = std::chrono::steady_clock::now() - started;
+        inputs.trim();
+        finish(request, status, result);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef ENCODE_CLIENT_HPP
+#define ENCODE_CLIENT_HPP
+
+#include <cstdint>
+#include <string>
+#include "protocol.hpp"
+
+namespace server {
+
+    // A connection to an encode server. Requests may be sent while the
+    // messages about earlier requests are received.
+    class encode_client {
+    public:
+        // Connects to the server listening on the socket path. Throws 
+        // std::system_error if it cannot connect.
+        explicit encode_client(const std::string& socket_path);
+        ~encode_client();
+
+        encode_client(const encode_client&) = delete;
+        encode_client& operator=(const encode_client&) = delete;
+
+        // Sends a request, given as a JSON object, to encode a GIF. The id
+        // identifies the messages about the request.
+        void encode(uint32_t request_id, const std::string& request_json);
+
+        void cancel(uint32_t request_id);
+
+        // Reads the next message from the server. Returns false once the
+        // server has closed the connection.
+        bool receive(message& m);
+
+    private:
+        int fd;
+    };
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef ENCODE_SERVER_HPP
+#define ENCODE_SERVER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include "batch_runner.hpp"
+#include "manifest.hpp"
+#include "protocol.hpp"
+#include "task_pool.hpp"
+
+// A daemon which encodes GIFs for local clients, so that the task pool and
+// the buffers of its runners stay warm between requests rather than being
+// set up by a new process for each GIF.
+namespace server {
+
+    // A client of the server. Messages are sent to the client by several
+    // threads, one at a time.
+    class client_connection {
+    public:
+        // Takes ownership of the socket.
+        explicit client_connection(int fd);
+        ~client_connection();
+
+        client_connection(const client_connection&) = delete;
+        client_connection& operator=(const client_connection&) = delete;
+
+        int socket() const;
+
+        // Sends a message, and returns false if the client has gone or has
+        // stopped reading. Once a send fails, the connection is shut down
+        // and later messages are dropped.
+        bool send(message_type type, uint32_t request_id, std::span<const char> payload);
+
+        // Ends the connection, which makes a thread reading from it stop.
+        void shut_down();
+
+    private:
+        const int fd;
+        std::mutex send_mutex;
+        bool open;
+    };
+
+    // A request which has been received and has not yet finished.
+    struct encode_request {
+        std::shared_ptr<client_connection> client;
+        uint32_t id = 0;
+        batch::batch_job job;
+        std::chrono::steady_clock::time_point received;
+
+        // Set when the client cancels the request or goes. A running 
+        // request stops at the next frame it emits.
+        std::atomic<bool> cancelled {false};
+
+        // The order that requests were queued in, which breaks ties 
+        // between requests with the same priority.
+        std::size_t sequence = 0;
+    };
+
+    // Holds the requests which wait for a runner, so that the most urgent
+    // can be taken next: the one with the lowest priority value, and then
+    // the one received first.
+    class request_queue {
+    public:
+        request_queue();
+
+        void push(std::shared_ptr<encode_request> request);
+
+        // Waits for a request and removes the most urgent. Returns null 
+        // once the queue is closed.
+        std::shared_ptr<encode_request> pop();
+
+        // Removes the client's request with the id, if it is waiting, and
+        // returns it.
+        std::shared_ptr<encode_request> remove(const client_connection* client, uint32_t id);
+
+        // Removes and returns every waiting request of the client.
+        std::vector<std::shared_ptr<encode_request>> remove_all(const client_connection* client);
+
+        // Wakes every thread waiting in pop. Requests which are still 
+        // waiting are left in the queue.
+        void close();
+
+        std::size_t size();
+
+    private:
+        std::mutex mutex;
+        std::condition_variable pushed;
+        std::vector<std::shared_ptr<encode_request>> requests;
+        std::size_t next_sequence;
+        bool closed;
+    };
+
+    struct server_options {
+        // The largest number of requests which are encoded at once, or 0 
+        // for twice the number of workers in the pool.
+        std::size_t max_jobs = 0;
+
+        // The bytes that the running requests are expected to use at once.
+        std::size_t memory_limit = std::size_t(1) << 30;
+
+        // How long a send to a client may block before the client is 
+        // disconnected, which cancels its requests, or 0 to wait for as 
+        // long as it takes. GIF data is sent from the workers of the pool,
+        // so a client which stops reading must not block them for long.
+        std::chrono::milliseconds send_timeout = std::chrono::seconds(10);
+    };
+
+    // Serves encode requests on a Unix domain socket. Each request is 
+    // read from input files, as a job of a batch is, and its GIF is sent
+    // back to the client in data messages as each frame is encoded, 
+    // followed by a result message. Requests are started in order of 
+    // priority by a fixed set of runner threads, as memory allows, and 
+    // the frames of every running request share the task pool. A client 
+    // may cancel its requests, and the requests of a client which 
+    // disconnects are cancelled.
+    class encode_server {
+    public:
+        // Listens on the socket path. A socket which was left at the path
+        // by an earlier server is replaced. Throws std::system_error if 
+        // the socket cannot be created, and std::invalid_argument if the
+        // path is too long for a socket address or is a file other than a
+        // socket.
+        encode_server(const std::string& socket_path, 
+                      const server_options& options = {},
+                      runtime::task_pool& pool = runtime::task_pool::shared());
+
+        // Removes the socket file.
+        ~encode_server();
+
+        encode_server(const encode_server&) = delete;
+        encode_server& operator=(const encode_server&) = delete;
+
+        // Accepts clients and serves their requests until stop is called.
+        // Running requests are cancelled before this returns.
+        void run();
+
+        // Makes run return. This may be called from any thread, before or
+        // during run.
+        void stop();
+
+    private:
+        const std::string socket_path;
+        const server_options options;
+        runtime::task_pool& pool;
+        int listen_fd;
+
+        // Written to by stop to wake run.
+        int wake_fds[2];
+
+        request_queue queue;
+        batch::memory_budget budget;
+
+        // The requests which are waiting or being encoded, so that they 
+        // can be cancelled. A request is added before it is queued, and 
+        // removed once its result is sent.
+        std::mutex active_mutex;
+        std::multimap<std::pair<const client_connection*, uint32_t>, std::shared_ptr<encode_request>> active;
+
+        // The clients, and the threads which read their messages. Threads
+        // of clients which have gone are joined as new clients connect.
+        struct client_thread {
+            std::shared_ptr<client_connection> client;
+            std::thread reader;
+            std::atomic<bool> finished {false};
+        };
+        std::list<client_thread> clients;
+
+        void serve_client(client_thread& entry);
+        void cancel(const client_connection* client, uint32_t id);
+        void cancel_all(const client_connection* client);
+        void finish(const std::shared_ptr<encode_request>& request, const std::string& status, 
+                    const batch::job_result& result);
+        void run_requests();
+        void encode(const std::shared_ptr<encode_request>& request, batch::job_inputs& inputs);
+    };
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// The messages exchanged by the encode server and its clients over a Unix
+// domain socket. Each message is a header followed by its payload. The
+// header holds the payload's length as a 32-bit little-endian value, the
+// message's type as one byte, and the id of the request that the message
+// is about as a 32-bit little-endian value. Ids are chosen by the client,
+// and only need to be unique among its own requests.
+namespace server {
+
+    enum class message_type : uint8_t {
+        // From the client: a request to encode a GIF. The payload is a JSON
+        // object as described by batch::parse_job for requests.
+        encode = 1,
+
+        // From the client: cancels the request. The payload is empty.
+        cancel = 2,
+
+        // From the server: the next bytes of the request's GIF.
+        data = 3,
+
+        // From the server: the outcome of the request, as a JSON object
+        // with a status of ok, failed or cancelled. This is the last 
+        // message about the request.
+        result = 4
+    };
+
+    constexpr std::size_t MESSAGE_HEADER_BYTES = 9;
+
+    // Longer messages are rejected, so that a corrupt header cannot make
+    // the reader allocate an unbounded buffer.
+    constexpr std::size_t MAX_PAYLOAD_BYTES = std::size_t(64) << 20;
+
+    struct message {
+        message_type type;
+        uint32_t request_id;
+        std::string payload;
+    };
+
+    // Writes a message to the socket. Throws std::system_error if the
+    // socket fails, such as when the other end has closed it.
+    void write_message(int fd, message_type type, uint32_t request_id, std::span<const char> payload);
+
+    // Reads the next message from the socket into m, whose payload's
+    // memory is re-used. Returns false if the other end closed the socket
+    // before the message began. Throws std::system_error if the socket 
+    // fails, and std::runtime_error if the message is malformed or ends 
+    // early.
+    bool read_message(int fd, message& m);
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include "protocol.hpp"
+#include <array>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace server {
+
+    void write_all(int fd, const char* data, std::size_t size) {
+        while (size > 0) {
+            // A client which has gone must not raise SIGPIPE in the server.
+            auto written = send(fd, data, size, MSG_NOSIGNAL);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Unable to write to socket");
+            }
+            data += written;
+            size -= written;
+        }
+    }
+
+    // Reads exactly size bytes, and returns the number read before the
+    // socket was closed.
+    std::size_t read_all(int fd, char* data, std::size_t size) {
+        std::size_t total = 0;
+        while (total < size) {
+            auto count = recv(fd, data + total, size - total, 0);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Unable to read from socket");
+            }
+            if (count == 0) {
+                break;
+            }
+            total += count;
+        }
+        return total;
+    }
+
+    void put_uint32(char* out, uint32_t value) {
+        for (std::size_t i = 0; i < 4; ++i) {
+            out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    uint32_t get_uint32(const char* in) {
+        uint32_t value = 0;
+        for (std::size_t i = 0; i < 4; ++i) {
+            value |= uint32_t(static_cast<uint8_t>(in[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    void write_message(int fd, message_type type, uint32_t request_id, std::span<const char> payload) {
+        if (payload.size() > MAX_PAYLOAD_BYTES) {
+            throw std::invalid_argument("A message payload may be at most " + std::to_string(MAX_PAYLOAD_BYTES) + " bytes");
+        }
+
+        std::array<char, MESSAGE_HEADER_BYTES> header;
+        put_uint32(header.data(), static_cast<uint32_t>(payload.size()));
+        header[4] = static_cast<char>(type);
+        put_uint32(header.data() + 5, request_id);
+        write_all(fd, header.data(), header.size());
+        write_all(fd, payload.data(), payload.size());
+    }
+
+    bool read_message(int fd, message& m) {
+        std::array<char, MESSAGE_HEADER_BYTES> header;
+        auto header_bytes = read_all(fd, header.data(), header.size());
+        if (header_bytes == 0) {
+            return false;
+        }
+        if (header_bytes < header.size()) {
+            throw std::runtime_error("The socket was closed part way through a message");
+        }
+
+        auto size = get_uint32(header.data());
+        auto type = static_cast<uint8_t>(header[4]);
+        if (type < uint8_t(message_type::encode) || type > uint8_t(message_type::result)) {
+            throw std::runtime_error("Unknown message type " + std::to_string(type));
+        }
+        if (size > MAX_PAYLOAD_BYTES) {
+            throw std::runtime_error("A message of " + std::to_string(size) + " bytes is too long");
+        }
+
+        m.type = static_cast<message_type>(type);
+        m.request_id = get_uint32(header.data() + 5);
+        m.payload.resize(size);
+        if (read_all(fd, m.payload.data(), size) < size) {
+            throw std::runtime_error("The socket was closed part way through a message");
+        }
+        return true;
+    }
+}
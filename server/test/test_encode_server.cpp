@@ -0,0 +1,298 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include "encode_client.hpp"
+#include "encode_server.hpp"
+#include "test_support.hpp"
+
+using namespace server;
+using namespace test_support;
+
+// The messages received about one request.
+struct request_outcome {
+    std::string data;
+    std::string status;
+    std::string error;
+    std::size_t frames = 0;
+    std::size_t bytes = 0;
+};
+
+// Receives messages until every request has a result, and returns the ids
+// in the order their results arrived.
+std::vector<uint32_t> receive_results(encode_client& client, std::size_t request_count, 
+                                      std::map<uint32_t, request_outcome>& outcomes) {
+    std::vector<uint32_t> finished;
+    message m;
+    while (finished.size() < request_count && client.receive(m)) {
+        auto& outcome = outcomes[m.request_id];
+        if (m.type == message_type::data) {
+            outcome.data += m.payload;
+        }
+        else if (m.type == message_type::result) {
+            boost::property_tree::ptree result;
+            std::istringstream in(m.payload);
+            boost::property_tree::read_json(in, result);
+            outcome.status = result.get<std::string>("status");
+            outcome.error = result.get<std::string>("error", "");
+            outcome.frames = result.get<std::size_t>("frames");
+            outcome.bytes = result.get<std::size_t>("bytes");
+            finished.push_back(m.request_id);
+        }
+    }
+    return finished;
+}
+
+// Runs a server on a socket in the temporary directory.
+struct running_server {
+    std::string socket_path;
+    encode_server server;
+    std::thread thread;
+
+    running_server(const temp_directory& dir, const server_options& options) : 
+            socket_path(dir.file("server.sock")),
+            server(socket_path, options),
+            thread([this]() { server.run(); }) {
+    }
+
+    ~running_server() {
+        server.stop();
+        thread.join();
+    }
+};
+
+TEST_CASE("Test the order of a request queue", "[encode_server]") {
+    request_queue queue;
+    auto client = std::make_shared<client_connection>(-1);
+    auto other_client = std::make_shared<client_connection>(-1);
+    auto make_request = [&](uint32_t id, int priority, const std::shared_ptr<client_connection>& owner) {
+        auto request = std::make_shared<encode_request>();
+        request->client = owner;
+        request->id = id;
+        request->job.priority = priority;
+        return request;
+    };
+
+    queue.push(make_request(1, 0, client));
+    queue.push(make_request(2, 5, client));
+    queue.push(make_request(3, -1, other_client));
+    queue.push(make_request(4, 0, client));
+    queue.push(make_request(5, 0, other_client));
+    REQUIRE(queue.size() == 5);
+
+    REQUIRE(queue.remove(client.get(), 3) == nullptr);
+    REQUIRE(queue.remove(client.get(), 4)->id == 4);
+    REQUIRE(queue.pop()->id == 3);
+    REQUIRE(queue.pop()->id == 1);
+
+    auto removed = queue.remove_all(other_client.get());
+    REQUIRE(removed.size() == 1);
+    REQUIRE(removed[0]->id == 5);
+    REQUIRE(queue.pop()->id == 2);
+
+    // Closing the queue wakes a waiting runner.
+    std::thread closer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        queue.close();
+    });
+    REQUIRE(queue.pop() == nullptr);
+    closer.join();
+}
+
+TEST_CASE("Test serving requests", "[encode_server]") {
+    temp_directory dir("test_encode_server");
+    std::vector<std::string> frames;
+    for (std::size_t i = 0; i < 5; ++i) {
+        frames.push_back(write_frame(dir, i, 40, 30));
+    }
+    server_options options;
+    options.max_jobs = 2;
+    running_server running(dir, options);
+
+    encode_client client(running.socket_path);
+    client.encode(1, "{\"inputs\": " + json_list(frames) + "}");
+    client.encode(2, "{\"inputs\": " + json_list({frames[0], frames[2]}) + ", \"delay\": 50, \"options\": {\"delta\": true}}");
+    client.encode(3, "{\"inputs\": " + json_list(frames) + ", \"output\": \"out.gif\"}");
+    client.encode(4, "{\"inputs\": [\"" + dir.file("missing.png") + "\"]}");
+
+    // A second client is served at the same time.
+    encode_client other_client(running.socket_path);
+    other_client.encode(1, "{\"inputs\": " + json_list({frames[4]}) + "}");
+
+    std::map<uint32_t, request_outcome> outcomes;
+    REQUIRE(receive_results(client, 4, outcomes).size() == 4);
+
+    REQUIRE(outcomes[1].status == "ok");
+    REQUIRE(outcomes[1].frames == 5);
+    REQUIRE(outcomes[1].bytes == outcomes[1].data.size());
+    auto expected = encode_files(frames, {});
+    REQUIRE(outcomes[1].data == std::string(expected.begin(), expected.end()));
+
+    encoder::encode_options delta_options;
+    delta_options.delay = 5;
+    delta_options.builder.delta_frames = true;
+    REQUIRE(outcomes[2].status == "ok");
+    expected = encode_files({frames[0], frames[2]}, delta_options);
+    REQUIRE(outcomes[2].data == std::string(expected.begin(), expected.end()));
+
+    // Requests have no output file, and inputs which cannot be read fail 
+    // the request.
+    REQUIRE(outcomes[3].status == "failed");
+    REQUIRE(outcomes[3].error.find("output") != std::string::npos);
+    REQUIRE(outcomes[4].status == "failed");
+    REQUIRE(outcomes[4].error.find("missing.png") != std::string::npos);
+
+    std::map<uint32_t, request_outcome> other_outcomes;
+    REQUIRE(receive_results(other_client, 1, other_outcomes).size() == 1);
+    REQUIRE(other_outcomes[1].status == "ok");
+    expected = encode_files({frames[4]}, {});
+    REQUIRE(other_outcomes[1].data == std::string(expected.begin(), expected.end()));
+}
+
+// A request for many frames, which keeps a runner busy for a while.
+std::string long_request(const temp_directory& dir, int priority) {
+    std::vector<std::string> frames;
+    auto first = write_frame(dir, 0, 40, 30);
+    auto second = write_frame(dir, 1, 40, 30);
+    for (std::size_t i = 0; i < 30; ++i) {
+        frames.push_back(i % 2 == 0 ? first : second);
+    }
+    return "{\"inputs\": " + json_list(frames) + ", \"priority\": " + std::to_string(priority) + "}";
+}
+
+TEST_CASE("Test request priorities", "[encode_server]") {
+    temp_directory dir("test_encode_server");
+    auto frame = write_frame(dir, 0, 40, 30);
+    server_options options;
+    options.max_jobs = 1;
+    running_server running(dir, options);
+
+    // While the only runner is busy, the more urgent request is queued 
+    // last but started first.
+    encode_client client(running.socket_path);
+    client.encode(1, long_request(dir, 0));
+    client.encode(2, "{\"inputs\": [\"" + frame + "\"], \"priority\": 5}");
+    client.encode(3, "{\"inputs\": [\"" + frame + "\"], \"priority\": -1}");
+
+    std::map<uint32_t, request_outcome> outcomes;
+    auto order = receive_results(client, 3, outcomes);
+    REQUIRE(order.size() == 3);
+    auto position = [&](uint32_t id) { return std::find(order.begin(), order.end(), id) - order.begin(); };
+    REQUIRE(position(3) < position(2));
+    for (const auto& [id, outcome] : outcomes) {
+        REQUIRE(outcome.status == "ok");
+    }
+}
+
+TEST_CASE("Test cancelling requests", "[encode_server]") {
+    temp_directory dir("test_encode_server");
+    auto frame = write_frame(dir, 0, 40, 30);
+    server_options options;
+    options.max_jobs = 1;
+    running_server running(dir, options);
+
+    // The first request is cancelled while it runs, and the second while
+    // it waits for the runner. Unknown ids are ignored.
+    encode_client client(running.socket_path);
+    client.encode(1, long_request(dir, 0));
+    client.encode(2, "{\"inputs\": [\"" + frame + "\"]}");
+    client.cancel(2);
+    client.cancel(1);
+    client.cancel(99);
+    client.encode(3, "{\"inputs\": [\"" + frame + "\"]}");
+
+    std::map<uint32_t, request_outcome> outcomes;
+    REQUIRE(receive_results(client, 3, outcomes).size() == 3);
+    REQUIRE(outcomes[1].status == "cancelled");
+    REQUIRE(outcomes[1].frames == 0);
+    REQUIRE(outcomes[2].status == "cancelled");
+    REQUIRE(outcomes[2].data.empty());
+    REQUIRE(outcomes[3].status == "ok");
+
+    // A client which disconnects part way through a request does not 
+    // disturb the others.
+    {
+        encode_client leaving_client(running.socket_path);
+        leaving_client.encode(1, long_request(dir, 0));
+        message m;
+        REQUIRE(leaving_client.receive(m));
+    }
+    encode_client next_client(running.socket_path);
+    next_client.encode(1, "{\"inputs\": [\"" + frame + "\"]}");
+    outcomes.clear();
+    REQUIRE(receive_results(next_client, 1, outcomes).size() == 1);
+    REQUIRE(outcomes[1].status == "ok");
+    REQUIRE(outcomes[1].frames == 1);
+}
+
+TEST_CASE("Test a client which stops reading is disconnected", "[encode_server]") {
+    temp_directory dir("test_encode_server");
+
+    // Noise compresses badly, so the GIF is larger than the socket can 
+    // buffer.
+    image::rgb_image_t noise(160, 120);
+    uint32_t state = 1;
+    for (auto& pixel : boost::gil::view(noise)) {
+        state = state * 1664525 + 1013904223;
+        pixel = image::rgb_pixel_t(state >> 24, state >> 16, state >> 8);
+    }
+    auto noise_frame = dir.file("noise.png");
+    image::write_image(noise_frame, noise, image::file_type::PNG);
+    auto frame = write_frame(dir, 0, 40, 30);
+
+    server_options options;
+    options.max_jobs = 1;
+    options.send_timeout = std::chrono::milliseconds(100);
+    running_server running(dir, options);
+
+    // Once the stalled client's request has started, the client stops 
+    // reading. The only runner is held by the request until a send times
+    // out and the request is cancelled, and then the other client is 
+    // served.
+    encode_client stalled_client(running.socket_path);
+    stalled_client.encode(1, "{\"inputs\": " + json_list(std::vector<std::string>(30, noise_frame)) + "}");
+    message m;
+    REQUIRE(stalled_client.receive(m));
+
+    encode_client next_client(running.socket_path);
+    next_client.encode(1, "{\"inputs\": [\"" + frame + "\"]}");
+
+    std::map<uint32_t, request_outcome> outcomes;
+    REQUIRE(receive_results(next_client, 1, outcomes).size() == 1);
+    REQUIRE(outcomes[1].status == "ok");
+
+    // The stalled client was disconnected, perhaps part way through a 
+    // message, without the rest of its GIF or a result.
+    try {
+        while (stalled_client.receive(m)) {
+            REQUIRE(m.type == message_type::data);
+        }
+    }
+    catch (const std::runtime_error&) {
+    }
+}
+
+TEST_CASE("Test the server's socket", "[encode_server]") {
+    temp_directory dir("test_encode_server");
+    auto socket_path = dir.file("server.sock");
+    {
+        encode_server first(socket_path);
+
+        // The socket of a server which is listening is not replaced.
+        REQUIRE_THROWS_AS(encode_server(socket_path), std::system_error);
+    }
+    REQUIRE_FALSE(std::filesystem::exists(socket_path));
+
+    REQUIRE_THROWS_AS(encode_server(dir.file(std::string(200, 's'))), std::invalid_argument);
+    REQUIRE_THROWS_AS(encode_client(socket_path), std::system_error);
+
+    // A server which is stopped before it runs returns straight away.
+    encode_server server(socket_path);
+    server.stop();
+    server.run();
+}
@@ -0,0 +1,106 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "protocol.hpp"
+
+using namespace server;
+
+// A connected pair of sockets, which are closed at the end of a test.
+struct socket_pair {
+    int fds[2];
+
+    socket_pair() {
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    }
+
+    ~socket_pair() {
+        close_end(0);
+        close_end(1);
+    }
+
+    void close_end(int end) {
+        if (fds[end] >= 0) {
+            close(fds[end]);
+            fds[end] = -1;
+        }
+    }
+};
+
+TEST_CASE("Test writing and reading messages", "[protocol]") {
+    socket_pair sockets;
+    std::string json = R"({"inputs": ["a.png"]})";
+    std::string data(100000, 'x');
+    write_message(sockets.fds[0], message_type::encode, 7, json);
+    write_message(sockets.fds[0], message_type::cancel, 0xFFFFFFFF, {});
+
+    // The payload is larger than the socket's buffer, so it is read while
+    // it is written.
+    std::thread writer([&]() {
+        write_message(sockets.fds[0], message_type::data, 3, data);
+        close(sockets.fds[0]);
+    });
+
+    message m;
+    REQUIRE(read_message(sockets.fds[1], m));
+    REQUIRE(m.type == message_type::encode);
+    REQUIRE(m.request_id == 7);
+    REQUIRE(m.payload == json);
+
+    REQUIRE(read_message(sockets.fds[1], m));
+    REQUIRE(m.type == message_type::cancel);
+    REQUIRE(m.request_id == 0xFFFFFFFF);
+    REQUIRE(m.payload.empty());
+
+    REQUIRE(read_message(sockets.fds[1], m));
+    writer.join();
+    sockets.fds[0] = -1;
+    REQUIRE(m.type == message_type::data);
+    REQUIRE(m.request_id == 3);
+    REQUIRE(m.payload == data);
+
+    // The other end closed the socket between messages.
+    REQUIRE_FALSE(read_message(sockets.fds[1], m));
+}
+
+TEST_CASE("Test reading malformed messages", "[protocol]") {
+    socket_pair sockets;
+    message m;
+
+    SECTION("Unknown type") {
+        std::array<char, MESSAGE_HEADER_BYTES> header {0, 0, 0, 0, 9, 1, 0, 0, 0};
+        REQUIRE(write(sockets.fds[0], header.data(), header.size()) == MESSAGE_HEADER_BYTES);
+        REQUIRE_THROWS_AS(read_message(sockets.fds[1], m), std::runtime_error);
+    }
+
+    SECTION("Too long") {
+        std::array<char, MESSAGE_HEADER_BYTES> header {0, 0, 0, char(0x80), 3, 1, 0, 0, 0};
+        REQUIRE(write(sockets.fds[0], header.data(), header.size()) == MESSAGE_HEADER_BYTES);
+        REQUIRE_THROWS_AS(read_message(sockets.fds[1], m), std::runtime_error);
+    }
+
+    SECTION("Closed part way through the header") {
+        std::array<char, 4> header {5, 0, 0, 0};
+        REQUIRE(write(sockets.fds[0], header.data(), header.size()) == 4);
+        sockets.close_end(0);
+        REQUIRE_THROWS_AS(read_message(sockets.fds[1], m), std::runtime_error);
+    }
+
+    SECTION("Closed part way through the payload") {
+        std::array<char, MESSAGE_HEADER_BYTES + 2> partial {5, 0, 0, 0, 3, 1, 0, 0, 0, 'a', 'b'};
+        REQUIRE(write(sockets.fds[0], partial.data(), partial.size()) == MESSAGE_HEADER_BYTES + 2);
+        sockets.close_end(0);
+        REQUIRE_THROWS_AS(read_message(sockets.fds[1], m), std::runtime_error);
+    }
+
+    SECTION("Writing to a closed socket") {
+        sockets.close_end(1);
+        REQUIRE_THROWS_AS(write_message(sockets.fds[0], message_type::data, 1, std::string(10, 'x')), std::system_error);
+    }
+}
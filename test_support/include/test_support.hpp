@@ -0,0 +1,55 @@
+#ifndef TEST_SUPPORT_HPP
+#define TEST_SUPPORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "image_utils.hpp"
+
+namespace encoder {
+    struct encode_options;
+}
+
+// Helpers shared by the tests of several modules. The image IO tests are 
+// built as C++17, so this header must not depend on C++20.
+namespace test_support {
+
+    // A directory which is removed with its contents at the end of a test.
+    // Each test program names its own directory, so that test programs may
+    // run at the same time.
+    struct temp_directory {
+        std::filesystem::path path;
+
+        explicit temp_directory(const std::string& name);
+        ~temp_directory();
+
+        temp_directory(const temp_directory&) = delete;
+        temp_directory& operator=(const temp_directory&) = delete;
+
+        std::string file(const std::string& name) const;
+    };
+
+    // Draws the frame which the encoding tests share: a gradient whose 
+    // blue changes with the index, and an 8x8 red square which moves to 
+    // the right with the index.
+    void draw_frame(std::size_t index, const image::rgb_image_view_t& img_view);
+
+    // Draws a frame of the given size and writes it to the directory. 
+    // Returns the filename.
+    std::string write_frame(const temp_directory& dir, std::size_t index, std::size_t width, std::size_t height,
+                            image::file_type type = image::file_type::PNG);
+
+    std::vector<uint8_t> read_file(const std::string& filename);
+
+    // Formats the strings as a JSON array. The strings are not escaped.
+    std::string json_list(const std::vector<std::string>& values);
+
+    // Reads the files and encodes them directly with the memory encoder, 
+    // to give the GIF that other ways of encoding them should match.
+    std::vector<uint8_t> encode_files(const std::vector<std::string>& filenames, 
+                                      const encoder::encode_options& options);
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include "test_support.hpp"
+#include <fstream>
+#include <iterator>
+#include "file_reader.hpp"
+#include "image_io.hpp"
+#include "memory_encoder.hpp"
+
+namespace test_support {
+
+    temp_directory::temp_directory(const std::string& name) : 
+            path(std::filesystem::temp_directory_path() / name) {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+
+    temp_directory::~temp_directory() {
+        std::error_code ignored;
+        std::filesystem::remove_all(path, ignored);
+    }
+
+    std::string temp_directory::file(const std::string& name) const {
+        return (path / name).string();
+    }
+
+    void draw_frame(std::size_t index, const image::rgb_image_view_t& img_view) {
+        for (std::size_t y = 0; y < static_cast<std::size_t>(img_view.height()); ++y) {
+            for (std::size_t x = 0; x < static_cast<std::size_t>(img_view.width()); ++x) {
+                bool in_square = x >= 3 * index && x < 3 * index + 8 && y >= 10 && y < 18;
+                img_view(x, y) = in_square 
+                    ? image::rgb_pixel_t(255, 0, 0) 
+                    : image::rgb_pixel_t(6 * x, 8 * y, 40 * index);
+            }
+        }
+    }
+
+    std::string write_frame(const temp_directory& dir, std::size_t index, std::size_t width, std::size_t height,
+                            image::file_type type) {
+        image::rgb_image_t img(width, height);
+        draw_frame(index, boost::gil::view(img));
+        auto filename = dir.file("frame" + std::to_string(width) + "x" + std::to_string(height) + "_" + 
+                                 std::to_string(index) + (type == image::file_type::PNG ? ".png" : ".jpg"));
+        image::write_image(filename, img, type);
+        return filename;
+    }
+
+    std::vector<uint8_t> read_file(const std::string& filename) {
+        std::ifstream in(filename, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    std::string json_list(const std::vector<std::string>& values) {
+        std::string list = "[";
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            list += (i > 0 ? ", \"" : "\"") + values[i] + "\"";
+        }
+        return list + "]";
+    }
+
+    std::vector<uint8_t> encode_files(const std::vector<std::string>& filenames, 
+                                      const encoder::encode_options& options) {
+        std::vector<image::file_read> reads(filenames.size());
+        for (std::size_t i = 0; i < filenames.size(); ++i) {
+            reads[i].filename = filenames[i];
+        }
+        image::batch_file_reader(false).read_files(reads);
+        std::vector<image::byte_view> images;
+        for (const auto& read : reads) {
+            images.emplace_back(read.contents);
+        }
+        std::vector<uint8_t> output;
+        encoder::encode_images(images, output, options);
+        return output;
+    }
+}